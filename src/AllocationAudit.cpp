@@ -0,0 +1,191 @@
+#include "AllocationAudit.h"
+#include "DerivedFields.h"
+#include "FieldView.h"
+#include "FluidSolver.h"
+#include "LatticeBoltzmannSolver.h"
+#include "ParticleTracer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> AllocationCount{ 0 };
+
+// Steps before counting starts: first-use buffers, solver setup and the scalar tiles settle within these
+constexpr int WarmUpSteps = 20;
+constexpr float AuditTimeStep = 0.01f;
+
+// Enough tracers for every advance chunk of the pool to take part
+constexpr int AuditParticles = 20000;
+
+}
+
+#if defined(CFD_ALLOCATION_AUDIT)
+
+namespace {
+
+void* CountedAllocate(std::size_t size)
+{
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    while (true) {
+        if (void* pointer = std::malloc(size)) return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) return nullptr;
+        handler();
+    }
+}
+
+void* CountedAllocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = std::max(sizeof(void*), (std::size_t)alignment);
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align; // aligned_alloc wants a multiple
+    while (true) {
+        if (void* pointer = std::aligned_alloc(align, size)) return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) return nullptr;
+        handler();
+    }
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* pointer = CountedAllocate(size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (void* pointer = CountedAllocate(size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return CountedAllocate(size); } catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return CountedAllocate(size); } catch (...) { return nullptr; }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* pointer = CountedAllocateAligned(size, alignment)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    if (void* pointer = CountedAllocateAligned(size, alignment)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+bool AllocationAudit::IsEnabled()
+{
+    return true;
+}
+
+#else
+
+bool AllocationAudit::IsEnabled()
+{
+    return false;
+}
+
+#endif
+
+uint64_t AllocationAudit::GetCount()
+{
+    return AllocationCount.load(std::memory_order_relaxed);
+}
+
+int RunAllocationAudit(int steps)
+{
+    if (!AllocationAudit::IsEnabled()) {
+        std::cerr << "ERROR::AUDIT:: Allocation audit needs a build with CFD_ALLOCATION_AUDIT" << std::endl;
+        return 1;
+    }
+
+    struct Configuration {
+        const char* Name;
+        FluidSolver::Relaxation Relaxation;
+        FluidSolver::TurbulenceModel Turbulence;
+        bool SubCell;
+        bool Lattice;
+    };
+    const Configuration configurations[] = {
+        { "Gauss-Seidel",       FluidSolver::Relaxation::GaussSeidel,       FluidSolver::TurbulenceModel::None,        false, false },
+        { "Jacobi",             FluidSolver::Relaxation::Jacobi,            FluidSolver::TurbulenceModel::None,        false, false },
+        { "Conjugate Gradient", FluidSolver::Relaxation::ConjugateGradient, FluidSolver::TurbulenceModel::None,        false, false },
+        { "Spectral",           FluidSolver::Relaxation::Spectral,          FluidSolver::TurbulenceModel::None,        false, false },
+        { "WALE, sub-cell",     FluidSolver::Relaxation::GaussSeidel,       FluidSolver::TurbulenceModel::WALE,        true,  false },
+        { "Lattice Boltzmann",  FluidSolver::Relaxation::GaussSeidel,       FluidSolver::TurbulenceModel::None,        false, true  }
+    };
+
+    std::cout << "Counting steps, frame publishing, particles and derived fields; GL uploads need the UI's per-frame count"
+              << std::endl;
+
+    int failures = 0;
+    for (const Configuration& configuration : configurations) {
+        FluidSolver solver(256, 128);
+        solver.m_Relaxation = configuration.Relaxation;
+        solver.m_TurbulenceModel = configuration.Turbulence;
+        solver.m_SubCellBoundaries = configuration.SubCell;
+
+        std::unique_ptr<LatticeBoltzmannSolver> lattice;
+        if (configuration.Lattice) {
+            lattice = std::make_unique<LatticeBoltzmannSolver>(solver.GetWidth(), solver.GetHeight());
+            lattice->SetObstacleMask(solver.GetSolidMask());
+        }
+        FlowSolver& engine = lattice ? (FlowSolver&)*lattice : (FlowSolver&)solver;
+
+        FieldSlice frame;
+        ParticleTracer particles(AuditParticles);
+        DerivedFields derived;
+        uint64_t allocations = 0;
+        int allocatingSteps = 0;
+        for (int step = 0; step < WarmUpSteps + steps; step++) {
+            uint64_t before = AllocationAudit::GetCount();
+            engine.Step(AuditTimeStep);
+            frame.Assign(engine.GetFieldView());
+
+            FieldView view = frame.GetView();
+            particles.Advance(view, AuditTimeStep);
+            for (int field = 0; field < (int)DerivedField::Count; field++) derived.Get((DerivedField)field, view);
+            uint64_t made = AllocationAudit::GetCount() - before;
+
+            if (step < WarmUpSteps || made == 0) continue;
+            allocations += made;
+            allocatingSteps++;
+        }
+
+        if (allocatingSteps > 0) {
+            std::cerr << "ERROR::AUDIT:: " << configuration.Name << ": " << allocatingSteps << " of " << steps
+                      << " steady frames allocated (" << allocations << " allocations)" << std::endl;
+            failures++;
+        } else {
+            std::cout << configuration.Name << ": no allocations in " << steps << " steady frames" << std::endl;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counting, for checking that steady-state steps and frames stay off the heap. Builds with
+// CFD_ALLOCATION_AUDIT (the CMake option of the same name) replace the global operator new and delete to count
+// every allocation made through them, on any thread. malloc calls of C libraries (GLFW, the GL driver, ImGui's
+// default allocator) are not seen.
+class AllocationAudit {
+public:
+    // False in regular builds, where the count stays 0
+    static bool IsEnabled();
+
+    // Allocations so far, across all threads
+    static uint64_t GetCount();
+};
+
+// Headless check of steady-state frames: runs each 2D engine and solver configuration with an obstacle and, per
+// step, does the CPU work of a displayed frame as well: publishing the fields as the simulation thread does, then
+// advancing particles and computing every derived field from them as the UI thread does before drawing. After a
+// warm-up counts the allocations of 'steps' more. Returns 0 when none of them allocated; needs an audit build.
+//
+// The GL side of a frame (texture and particle uploads, uniform lookups) needs a context and is not covered here;
+// the UI of an audit build shows the allocations of each whole frame for that.
+int RunAllocationAudit(int steps);
@@ -1,8 +1,14 @@
 #include "Application.h"
-#include "FluidSolver.h"
+#include "AllocationAudit.h"
+#include "SimulationThread.h"
 #include "Renderer.h"
+#include "ParticleTracer.h"
+#include "DerivedFields.h"
+#include "KernelProfiler.h"
+#include "SnapshotExporter.h"
 #include "Geometry/Slicer.h"
-#include "Geometry/SceneImporter.h"
+#include "Geometry/MeshImportJob.h"
+#include "Geometry/Voxelizer.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <glad/glad.h>
@@ -12,16 +18,55 @@
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+namespace {
+
+// Upper bound on particle sub-steps per displayed frame when the simulation runs far ahead of the display
+constexpr int MaxParticleSubsteps = 8;
+
+// A slice scan steps by the slice thickness, but takes no more bands than this
+constexpr int MaxScanBands = 256;
+
+// 2D grid sizes offered in the UI; the tunnel keeps its 2:1 shape
+constexpr int GridPresetCount = 6;
+constexpr int GridPresetHeights[GridPresetCount] = { 64, 128, 192, 256, 384, 512 };
+
+}
+
 Application::Application(const std::string& title, int width, int height)
     : m_Title(title), m_WindowWidth(width), m_WindowHeight(height)
 {
     Init();
 
-    m_Solver = std::make_unique<FluidSolver>(256, 128);
+    // Once, while nothing else competes for the pool and the memory bus; enabling the profiler later reuses it
+    KernelProfiler::Get().MeasurePeakBandwidth();
+
+    auto solver = std::make_unique<FluidSolver>(m_GridWidth, m_GridHeight);
+    m_Settings.Viscosity = solver->m_Viscosity;
+    m_Settings.InflowVelocity = solver->m_InflowVelocity;
+    m_Settings.Iterations = solver->m_Iterations;
+    m_Settings.Relaxation = (int)solver->m_Relaxation;
+    m_Settings.PressureTolerance = solver->m_PressureTolerance;
+    m_Settings.FrontalSource = solver->m_FrontalSource;
+    m_Settings.SubCellBoundaries = solver->m_SubCellBoundaries;
+    m_Settings.TurbulenceModel = (int)solver->m_TurbulenceModel;
+    m_Settings.SmagorinskyConstant = solver->m_SmagorinskyConstant;
+    m_Settings.WaleConstant = solver->m_WaleConstant;
+    m_Settings.Boundaries = solver->GetBoundarySettings();
+    m_Settings.Species = solver->GetSpecies();
+    m_Settings.DisplayedSpecies = solver->m_DisplayedSpecies;
+    m_Airfoil = ObstacleLibrary::GetDefaultAirfoil(m_GridWidth, m_GridHeight);
+
+    m_Simulation = std::make_unique<SimulationThread>(std::move(solver));
+    m_Simulation->SetTimeStep(m_SimulationTimeStep);
+
     m_Renderer = std::make_unique<Renderer>();
-    m_Slicer = std::make_unique<Slicer>(256, 128);
+    m_DerivedFields = std::make_unique<DerivedFields>();
+    m_Renderer->SetDerivedFields(m_DerivedFields.get());
+    m_Slicer = std::make_unique<Slicer>(m_GridWidth, m_GridHeight);
 }
 
 Application::~Application()
@@ -71,10 +116,11 @@ void Application::Init()
 
 void Application::Shutdown()
 {
+    m_MeshImport.reset();
+    m_Simulation.reset();
     m_Mesh.reset();
     m_Slicer.reset();
     m_Renderer.reset();
-    m_Solver.reset();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -90,18 +136,15 @@ void Application::Shutdown()
 void Application::Run()
 {
     while (!glfwWindowShouldClose(m_Window)) {
-        float currentFrame = (float)glfwGetTime();
-        float deltaTime = currentFrame - m_LastFrameTime;
-        m_LastFrameTime = currentFrame;
+        uint64_t allocations = AllocationAudit::GetCount();
 
         ProcessInput();
-
-        if (!m_Paused) {
-            Update(m_SimulationTimeStep);
-        }
-
+        Update();
         Render();
         glfwPollEvents();
+
+        // Includes the simulation thread's steps during the frame; edits allocate for their commands
+        m_FrameAllocations = AllocationAudit::GetCount() - allocations;
     }
 }
 
@@ -111,13 +154,259 @@ void Application::ProcessInput()
         glfwSetWindowShouldClose(m_Window, true);
 }
 
-void Application::Update(float deltaTime)
+void Application::Update()
+{
+    // The simulation thread steps on its own; pick up whatever it finished since the last frame
+    if (!m_Simulation || !m_Simulation->AcquireFrame()) return;
+
+    const SimulationFrame& frame = m_Simulation->GetFrame();
+    float elapsed = (float)(frame.Time - m_ParticleTime);
+    m_ParticleTime = frame.Time;
+
+    // Particles follow the latest field over the simulated time that passed, in steps no longer than the solver's
+    if (m_ShowParticles && m_Particles && !frame.Volume && elapsed > 0.0f) {
+        int substeps = std::min(MaxParticleSubsteps, std::max(1, (int)std::ceil(elapsed / m_SimulationTimeStep)));
+        for (int i = 0; i < substeps; i++) {
+            m_Particles->Advance(frame.Fields.GetView(), elapsed / substeps);
+        }
+    }
+}
+
+void Application::SubmitSettings()
+{
+    SolverSettings settings = m_Settings;
+    m_Simulation->Submit([settings](SimulationState& state) {
+        FluidSolver& solver = *state.Solver;
+        solver.m_Viscosity = settings.Viscosity;
+        solver.m_InflowVelocity = settings.InflowVelocity;
+        solver.m_Iterations = settings.Iterations;
+        solver.m_Relaxation = (FluidSolver::Relaxation)settings.Relaxation;
+        solver.m_PressureTolerance = settings.PressureTolerance;
+        solver.m_FrontalSource = settings.FrontalSource;
+        solver.m_SubCellBoundaries = settings.SubCellBoundaries;
+        solver.m_TurbulenceModel = (FluidSolver::TurbulenceModel)settings.TurbulenceModel;
+        solver.m_SmagorinskyConstant = settings.SmagorinskyConstant;
+        solver.m_WaleConstant = settings.WaleConstant;
+        solver.SetBoundarySettings(settings.Boundaries);
+        solver.SetSpecies(settings.Species);
+        solver.m_DisplayedSpecies = settings.DisplayedSpecies;
+
+        // The volume solver shares the 2D solver's physical parameters
+        if (state.Solver3D) {
+            state.Solver3D->m_Viscosity = settings.Viscosity;
+            state.Solver3D->m_Diffusion = settings.Species.empty() ? 0.0f : settings.Species[0].Diffusion;
+            state.Solver3D->m_InflowVelocity = settings.InflowVelocity;
+            state.Solver3D->m_Iterations = settings.VolumeIterations;
+        }
+
+        // So does the lattice Boltzmann engine
+        if (state.Lattice) {
+            LatticeBoltzmannSolver& lattice = *state.Lattice;
+            lattice.m_Viscosity = settings.Viscosity;
+            lattice.m_InflowVelocity = settings.InflowVelocity;
+            lattice.m_Collision = (LatticeBoltzmannSolver::Collision)settings.Collision;
+            lattice.m_LatticeVelocity = settings.LatticeVelocity;
+            lattice.SetBoundarySettings(settings.Boundaries);
+            lattice.SetSpecies(settings.Species);
+            lattice.m_DisplayedSpecies = settings.DisplayedSpecies;
+        }
+    });
+}
+
+void Application::SubmitVolumeView()
+{
+    // Slice plane follows the mesh slice offset, converted to volume cells
+    float cellScale = (float)m_VolumeSize.x / m_GridWidth;
+    int depthIndex = (int)(m_SliceZ * cellScale + m_VolumeSize.z * 0.5f);
+
+    bool volumeMode = m_VolumeMode;
+    glm::ivec3 size = m_VolumeSize;
+    FluidSolver3D::SliceSummary summary = (FluidSolver3D::SliceSummary)m_VolumeSummary;
+    m_Simulation->Submit([volumeMode, size, summary, depthIndex](SimulationState& state) {
+        if (volumeMode && !state.Solver3D) {
+            state.Solver3D = std::make_unique<FluidSolver3D>(size.x, size.y, size.z);
+        }
+        state.VolumeMode = volumeMode;
+        state.VolumeSummary = summary;
+        state.VolumeDepthIndex = depthIndex;
+    });
+}
+
+void Application::SubmitEngine()
+{
+    bool latticeMode = m_LatticeMode;
+    m_Simulation->Submit([latticeMode](SimulationState& state) {
+        if (latticeMode && !state.Lattice) {
+            // Later obstacle edits reach it through the simulation thread
+            state.Lattice = std::make_unique<LatticeBoltzmannSolver>(state.Solver->GetWidth(), state.Solver->GetHeight());
+            state.Lattice->SetObstacleMask(state.Solver->GetSolidMask());
+        }
+        state.LatticeMode = latticeMode;
+    });
+}
+
+void Application::SubmitObstacleMask(std::vector<float> mask)
+{
+    m_Simulation->Submit([mask = std::move(mask)](SimulationState& state) {
+        state.Solver->SetObstacleMask(mask);
+    });
+}
+
+void Application::SubmitObstacleDistance(std::vector<float> distance)
+{
+    m_Simulation->Submit([distance = std::move(distance)](SimulationState& state) {
+        state.Solver->SetObstacleDistance(distance);
+    });
+}
+
+void Application::SubmitAirfoil()
 {
-    if (m_Solver) {
-        m_Solver->Step(deltaTime);
+    m_ObstacleSource = ObstacleSource::Airfoil;
+    m_Simulation->Submit([airfoil = m_Airfoil](SimulationState& state) {
+        state.Solver->SetAirfoil(airfoil);
+    });
+}
+
+void Application::SliceMesh()
+{
+    if (!m_Slicer || !m_Mesh || !m_Simulation) return;
+
+    m_ObstacleSource = ObstacleSource::Mesh;
+    CaptureMeshSlice(m_SliceBuffer);
+    if (m_Settings.SubCellBoundaries) {
+        SubmitObstacleDistance(m_SliceBuffer);
+    } else {
+        SubmitObstacleMask(m_SliceBuffer);
     }
 }
 
+void Application::CaptureMeshSlice(std::vector<float>& slice)
+{
+    glm::mat4 model = GetMeshModelMatrix();
+    if (m_Settings.SubCellBoundaries) {
+        // The sub-cell boundary needs the surface position inside cells, so slice finer and keep the distance
+        m_Slicer->CaptureDistance(*m_Mesh, model, m_SliceZ, m_SliceThickness, slice);
+    } else {
+        m_Slicer->Capture(*m_Mesh, model, m_SliceZ, m_SliceThickness, slice);
+    }
+}
+
+void Application::ScanSlices()
+{
+    if (!m_Slicer || !m_Mesh) return;
+
+    // Depth range of the placed mesh, from the corners of its bounding box
+    glm::mat4 model = GetMeshModelMatrix();
+    const glm::vec3& low = m_Mesh->GetBoundsMin();
+    const glm::vec3& high = m_Mesh->GetBoundsMax();
+    float minZ = 0.0f, maxZ = 0.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 position((corner & 1) ? high.x : low.x, (corner & 2) ? high.y : low.y, (corner & 4) ? high.z : low.z);
+        float z = (model * glm::vec4(position, 1.0f)).z;
+        minZ = corner == 0 ? z : std::min(minZ, z);
+        maxZ = corner == 0 ? z : std::max(maxZ, z);
+    }
+
+    int count = std::max(1, std::min((int)std::ceil((maxZ - minZ) / m_SliceThickness), MaxScanBands));
+    float spacing = (maxZ - minZ) / count;
+    m_ScanBands.resize(count);
+    for (int band = 0; band < count; band++) {
+        m_ScanBands[band].SliceZ = minZ + (band + 0.5f) * spacing;
+        m_ScanBands[band].Thickness = m_SliceThickness;
+    }
+
+    m_Slicer->CaptureStack(*m_Mesh, model, m_ScanBands, m_ScanMasks, m_ScanStatistics);
+    m_ScanBlockage.resize(count);
+    for (int band = 0; band < count; band++) m_ScanBlockage[band] = (float)m_ScanStatistics[band].BlockedRows / m_GridHeight;
+    m_ScanBest = Slicer::FindLargestBlockage(m_ScanStatistics);
+}
+
+void Application::ResizeGrid(int width, int height)
+{
+    if (!m_Simulation || (width == m_GridWidth && height == m_GridHeight)) return;
+
+    // World space is measured in grid cells, so whatever is placed in it grows with the grid
+    float scaleX = (float)width / m_GridWidth;
+    float scaleY = (float)height / m_GridHeight;
+    m_MeshPosition = glm::vec3(m_MeshPosition.x * scaleX, m_MeshPosition.y * scaleY, m_MeshPosition.z * scaleX);
+    m_MeshScale *= scaleX;
+    m_SliceZ *= scaleX;
+    m_SliceThickness *= scaleX;
+    m_Airfoil.Chord *= scaleX;
+    m_Airfoil.LeadingEdgeX *= scaleX;
+    m_Airfoil.LeadingEdgeY *= scaleY;
+    m_GridWidth = width;
+    m_GridHeight = height;
+
+    // The obstacle is rebuilt from its source within the resize, before the resampled flow is projected, so the
+    // flow is divergence-free against it; a loaded mask has no source and keeps its resampled form
+    m_Slicer = std::make_unique<Slicer>(width, height);
+    std::vector<float> slice;
+    if (m_ObstacleSource == ObstacleSource::Mesh && m_Mesh) CaptureMeshSlice(slice);
+
+    // The lattice engine and a journal are tied to one grid size: the lattice is rebuilt from the resampled solver
+    // below and the journal ends here
+    m_Simulation->Submit([width, height, source = m_ObstacleSource, airfoil = m_Airfoil, slice = std::move(slice),
+                          sliceDistance = m_Settings.SubCellBoundaries](SimulationState& state) {
+        if (state.Journal) state.Journal->Close(*state.Solver);
+        state.Journal.reset();
+        state.Lattice.reset();
+        state.Solver->Resize(width, height, [&](FluidSolver& solver) {
+            if (source == ObstacleSource::Default) {
+                solver.InitObstacle();
+            } else if (source == ObstacleSource::Airfoil) {
+                solver.SetAirfoil(airfoil);
+            } else if (!slice.empty()) {
+                if (sliceDistance) solver.SetObstacleDistance(slice);
+                else solver.SetObstacleMask(slice);
+            }
+        });
+    });
+    SubmitEngine();
+    SubmitSettings();
+
+    // Particles are placed in cells and the scan was made on the old grid
+    if (m_Particles) m_Particles->Resize(m_ParticleCount);
+    m_ScanBands.clear();
+    m_ScanStatistics.clear();
+    m_ScanMasks.clear();
+    m_ScanBlockage.clear();
+    m_ScanBest = -1;
+}
+
+glm::mat4 Application::GetMeshModelMatrix() const
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, m_MeshPosition);
+    model = glm::scale(model, glm::vec3(m_MeshScale));
+    model = glm::rotate(model, glm::radians(m_MeshRotation.x), glm::vec3(1, 0, 0));
+    model = glm::rotate(model, glm::radians(m_MeshRotation.y), glm::vec3(0, 1, 0));
+    model = glm::rotate(model, glm::radians(m_MeshRotation.z), glm::vec3(0, 0, 1));
+    return model;
+}
+
+FieldView Application::GetDisplayedFields() const
+{
+    if (m_Simulation) return m_Simulation->GetFrame().Fields.GetView();
+    return FieldView();
+}
+
+void Application::VoxelizeMesh()
+{
+    if (!m_VolumeMode || !m_Mesh || !m_Simulation) return;
+
+    // World space is measured in 2D grid cells; the volume is coarser and centred on z = 0
+    float cellScale = (float)m_VolumeSize.x / m_GridWidth;
+    glm::mat4 gridFromWorld = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, m_VolumeSize.z * 0.5f));
+    gridFromWorld = glm::scale(gridFromWorld, glm::vec3(cellScale));
+
+    std::vector<float> mask;
+    Voxelizer::Voxelize(*m_Mesh, gridFromWorld * GetMeshModelMatrix(), m_VolumeSize.x, m_VolumeSize.y, m_VolumeSize.z, mask);
+    m_Simulation->Submit([mask = std::move(mask)](SimulationState& state) {
+        if (state.Solver3D) state.Solver3D->SetObstacleMask(mask);
+    });
+}
+
 void Application::Render()
 {
     int display_w, display_h;
@@ -128,32 +417,35 @@ void Application::Render()
     glEnable(GL_DEPTH_TEST);
 
     // ViewProjection (2D Orthographic)
-    glm::mat4 viewProjection;
-    if (m_Solver)
-        viewProjection = glm::ortho(0.0f, (float)m_Solver->GetWidth(), 0.0f, (float)m_Solver->GetHeight(), -1000.0f, 1000.0f);
-    else
-        viewProjection = glm::mat4(1.0f);
-
-    // Render Simulation (Background)
-    if (m_Renderer && m_Solver) {
+    glm::mat4 viewProjection = glm::ortho(0.0f, (float)m_GridWidth, 0.0f, (float)m_GridHeight, -1000.0f, 1000.0f);
+
+    // Render Simulation (Background) from the newest frame the simulation thread published
+    const SimulationFrame* frame = m_Simulation ? &m_Simulation->GetFrame() : nullptr;
+    if (m_Renderer && frame && frame->Fields.Width > 0) {
         glDepthMask(GL_FALSE); // Draw background without writing depth
-        m_Renderer->Draw(*m_Solver, display_w, display_h, viewProjection);
+        if (frame->Volume) {
+            // Stretch the coarser volume over the same world area as the 2D grid
+            float cellScale = (float)frame->Fields.Width / m_GridWidth;
+            glm::mat4 volumeViewProjection = glm::scale(viewProjection, glm::vec3(1.0f / cellScale, 1.0f / cellScale, 1.0f));
+            m_Renderer->Draw(frame->Fields.GetView(), volumeViewProjection);
+        } else {
+            m_Renderer->Draw(frame->Fields.GetView(), viewProjection);
+
+            if (m_ShowParticles && m_Particles) {
+                m_Renderer->DrawParticles(*m_Particles, viewProjection, m_ParticleSize);
+            }
+        }
         glDepthMask(GL_TRUE);
     }
 
     // Render Mesh Preview
-    if (m_Mesh && m_Renderer && m_Solver) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, m_MeshPosition);
-        model = glm::scale(model, glm::vec3(m_MeshScale));
-        model = glm::rotate(model, glm::radians(m_MeshRotation.x), glm::vec3(1, 0, 0));
-        model = glm::rotate(model, glm::radians(m_MeshRotation.y), glm::vec3(0, 1, 0));
-        model = glm::rotate(model, glm::radians(m_MeshRotation.z), glm::vec3(0, 0, 1));
+    if (m_Mesh && m_Renderer) {
+        glm::mat4 model = GetMeshModelMatrix();
 
         if (m_ShowMeshPreview) {
             m_Renderer->DrawMeshPreview(*m_Mesh, model, viewProjection, m_SliceZ, m_SliceThickness, m_MeshWireframe);
         }
-        m_Renderer->DrawMeshViews(*m_Mesh, model, m_SliceZ, m_SliceThickness);
+        m_Renderer->DrawMeshViews(*m_Mesh, model, m_SliceZ, m_SliceThickness, m_GridWidth, m_GridHeight);
     }
 
     RenderUI();
@@ -177,57 +469,390 @@ void Application::RenderUI()
 
         ImGui::Separator();
 
-        ImGui::Checkbox("Pause", &m_Paused);
-        ImGui::SliderFloat("Time Step", &m_SimulationTimeStep, 0.001f, 0.1f);
+        if (m_Simulation) {
+            const SimulationFrame& frame = m_Simulation->GetFrame();
+            float stepsPerSecond = frame.StepMilliseconds > 0.0f ? 1000.0f / frame.StepMilliseconds : 0.0f;
+            ImGui::Text("Simulation %.2f ms/step (%.0f steps/s), t = %.2f", frame.StepMilliseconds, stepsPerSecond, frame.Time);
+        }
+        if (AllocationAudit::IsEnabled()) {
+            ImGui::Text("Heap allocations: %llu last frame", (unsigned long long)m_FrameAllocations);
+        }
+
+        if (ImGui::Checkbox("Pause", &m_Paused) && m_Simulation) {
+            m_Simulation->SetPaused(m_Paused);
+        }
+        if (ImGui::SliderFloat("Time Step", &m_SimulationTimeStep, 0.001f, 0.1f) && m_Simulation) {
+            m_Simulation->SetTimeStep(m_SimulationTimeStep);
+        }
 
         if (ImGui::CollapsingHeader("Solver Settings", ImGuiTreeNodeFlags_DefaultOpen)) {
-            if (m_Solver) {
-                ImGui::SliderFloat("Viscosity", &m_Solver->m_Viscosity, 0.0f, 0.001f, "%.6f");
-                ImGui::SliderFloat("Diffusion", &m_Solver->m_Diffusion, 0.0f, 0.001f, "%.6f");
-                ImGui::SliderFloat("Inflow Velocity", &m_Solver->m_InflowVelocity, 0.0f, 5.0f);
-                ImGui::SliderInt("Jacobi Iterations", &m_Solver->m_Iterations, 1, 100);
+            if (m_Simulation) {
+                bool settingsChanged = false;
+                settingsChanged |= ImGui::SliderFloat("Viscosity", &m_Settings.Viscosity, 0.0f, 0.001f, "%.6f");
+                settingsChanged |= ImGui::SliderFloat("Inflow Velocity", &m_Settings.InflowVelocity, 0.0f, 5.0f);
+                settingsChanged |= ImGui::SliderInt("Jacobi Iterations", &m_Settings.Iterations, 1, 100);
+
+                const char* relaxations[] = { "Gauss-Seidel", "Jacobi (decomposition independent)", "Conjugate Gradient", "Spectral (direct)" };
+                settingsChanged |= ImGui::Combo("Relaxation", &m_Settings.Relaxation, relaxations, 4);
+                settingsChanged |= ImGui::SliderFloat("Pressure Tolerance", &m_Settings.PressureTolerance, 0.0f, 0.0001f, "%.7f");
+                ImGui::Text("Pressure sweeps: %d", m_Simulation->GetFrame().PressureIterations);
+                ImGui::Text("Diffusion iterations: %d", m_Simulation->GetFrame().DiffusionIterations);
+
+                const char* turbulenceModels[] = { "None", "Smagorinsky", "WALE" };
+                settingsChanged |= ImGui::Combo("Turbulence Model", &m_Settings.TurbulenceModel, turbulenceModels, 3);
+                if (m_Settings.TurbulenceModel == (int)FluidSolver::TurbulenceModel::Smagorinsky) {
+                    settingsChanged |= ImGui::SliderFloat("Smagorinsky Constant", &m_Settings.SmagorinskyConstant, 0.05f, 0.3f);
+                } else if (m_Settings.TurbulenceModel == (int)FluidSolver::TurbulenceModel::WALE) {
+                    settingsChanged |= ImGui::SliderFloat("WALE Constant", &m_Settings.WaleConstant, 0.1f, 1.0f);
+                }
+
+                if (ImGui::Checkbox("Sub-cell Obstacle Boundaries", &m_Settings.SubCellBoundaries)) {
+                    settingsChanged = true;
+                    SliceMesh(); // The mesh slice differs between the two modes (mask vs. supersampled distance)
+                }
+
+                if (ImGui::TreeNode("Domain Boundaries")) {
+                    BoundarySettings& boundaries = m_Settings.Boundaries;
+                    const char* sides[] = { "Left", "Right", "Bottom", "Top" };
+                    const char* types[] = { "Inflow", "Outflow", "Convective Outflow", "Free-slip Wall", "No-slip Wall", "Periodic" };
+                    const char* profiles[] = { "Uniform", "Log-law", "Synthetic Eddies" };
+                    bool logLaw = false, eddies = false;
+                    for (int side = 0; side < 4; side++) {
+                        ImGui::PushID(side);
+                        int type = (int)boundaries.Types[side];
+                        if (ImGui::Combo(sides[side], &type, types, (int)BoundaryType::Count)) {
+                            boundaries.SetType((BoundarySide)side, (BoundaryType)type);
+                            settingsChanged = true;
+                        }
+                        if (boundaries.Types[side] == BoundaryType::Inflow) {
+                            int profile = (int)boundaries.Profiles[side];
+                            if (ImGui::Combo("Profile", &profile, profiles, (int)InflowProfile::Count)) {
+                                boundaries.Profiles[side] = (InflowProfile)profile;
+                                settingsChanged = true;
+                            }
+                            logLaw |= boundaries.Profiles[side] == InflowProfile::LogLaw;
+                            eddies |= boundaries.Profiles[side] == InflowProfile::SyntheticEddies;
+                        }
+                        ImGui::PopID();
+                    }
+                    if (logLaw) {
+                        settingsChanged |= ImGui::SliderFloat("Roughness Length", &boundaries.RoughnessLength, 0.0001f, 0.1f, "%.4f");
+                        settingsChanged |= ImGui::SliderFloat("Reference Height", &boundaries.ReferenceHeight, 0.05f, 1.0f);
+                    }
+                    if (eddies) {
+                        settingsChanged |= ImGui::SliderFloat("Turbulence Intensity", &boundaries.TurbulenceIntensity, 0.0f, 0.5f);
+                        settingsChanged |= ImGui::SliderFloat("Eddy Size", &boundaries.EddySize, 0.01f, 0.25f);
+                        settingsChanged |= ImGui::SliderInt("Eddy Count", &boundaries.EddyCount, 8, 512);
+                    }
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Scalar Species")) {
+                    std::vector<ScalarSpecies>& species = m_Settings.Species;
+                    const char* shapes[] = { "Inflow Band", "Obstacle Surface", "Disc" };
+                    const char* sides[] = { "Left", "Right", "Bottom", "Top" };
+                    int removeSpecies = -1;
+                    for (int s = 0; s < (int)species.size(); s++) {
+                        ImGui::PushID(s);
+                        ImGui::Text(s == 0 ? "Species 0 (dye)" : "Species %d", s);
+                        settingsChanged |= ImGui::SliderFloat("Diffusion", &species[s].Diffusion, 0.0f, 0.001f, "%.6f");
+                        settingsChanged |= ImGui::SliderFloat("Decay", &species[s].Decay, 0.0f, 1.0f);
+
+                        std::vector<ScalarEmitter>& emitters = species[s].Emitters;
+                        int removeEmitter = -1;
+                        for (int e = 0; e < (int)emitters.size(); e++) {
+                            ScalarEmitter& emitter = emitters[e];
+                            ImGui::PushID(e);
+                            int shape = (int)emitter.Type;
+                            if (ImGui::Combo("Emitter", &shape, shapes, (int)ScalarEmitter::Shape::Count)) {
+                                emitter.Type = (ScalarEmitter::Shape)shape;
+                                settingsChanged = true;
+                            }
+                            if (emitter.Type == ScalarEmitter::Shape::InflowBand) {
+                                int side = (int)emitter.Side;
+                                if (ImGui::Combo("Side", &side, sides, 4)) {
+                                    emitter.Side = (BoundarySide)side;
+                                    settingsChanged = true;
+                                }
+                                settingsChanged |= ImGui::SliderFloat("Band Begin", &emitter.Begin, 0.0f, 1.0f);
+                                settingsChanged |= ImGui::SliderFloat("Band End", &emitter.End, 0.0f, 1.0f);
+                            } else if (emitter.Type == ScalarEmitter::Shape::Disc) {
+                                settingsChanged |= ImGui::SliderFloat("Centre X", &emitter.X, 0.0f, 1.0f);
+                                settingsChanged |= ImGui::SliderFloat("Centre Y", &emitter.Y, 0.0f, 1.0f);
+                                settingsChanged |= ImGui::SliderFloat("Radius", &emitter.Radius, 0.005f, 0.2f);
+                            }
+                            settingsChanged |= ImGui::SliderFloat("Value", &emitter.Value, 0.0f, 1.0f);
+                            if (ImGui::Button("Remove Emitter")) removeEmitter = e;
+                            ImGui::PopID();
+                        }
+                        if (removeEmitter >= 0) {
+                            emitters.erase(emitters.begin() + removeEmitter);
+                            settingsChanged = true;
+                        }
+                        if (ImGui::Button("Add Emitter")) {
+                            emitters.push_back(ScalarEmitter());
+                            settingsChanged = true;
+                        }
+                        if (s > 0) {
+                            ImGui::SameLine();
+                            if (ImGui::Button("Remove Species")) removeSpecies = s;
+                        }
+                        ImGui::Separator();
+                        ImGui::PopID();
+                    }
+                    if (removeSpecies >= 0) {
+                        species.erase(species.begin() + removeSpecies);
+                        settingsChanged = true;
+                    }
+                    if (ImGui::Button("Add Species")) {
+                        species.push_back(ScalarSpecies());
+                        species.back().Emitters.push_back(ScalarEmitter());
+                        settingsChanged = true;
+                    }
+
+                    // Shown in the dye display mode
+                    settingsChanged |= ImGui::SliderInt("Displayed Species", &m_Settings.DisplayedSpecies, 0, (int)species.size() - 1);
+                    m_Settings.DisplayedSpecies = std::min(m_Settings.DisplayedSpecies, (int)species.size() - 1);
+                    ImGui::TreePop();
+                }
+
+                // Presets run from 128x64 to 1024x512; a finer grid resolves more but steps more slowly
+                int preset = 0;
+                while (preset < GridPresetCount - 1 && GridPresetHeights[preset] < m_GridHeight) preset++;
+                const char* gridSizes[GridPresetCount] = { "128 x 64", "256 x 128", "384 x 192", "512 x 256", "768 x 384", "1024 x 512" };
+                if (ImGui::Combo("Grid", &preset, gridSizes, GridPresetCount)) {
+                    ResizeGrid(2 * GridPresetHeights[preset], GridPresetHeights[preset]);
+                }
 
                 if (ImGui::Button("Reset Obstacle")) {
-                    m_Solver->InitObstacle();
+                    m_ObstacleSource = ObstacleSource::Default;
+                    m_Simulation->Submit([](SimulationState& state) {
+                        state.Solver->InitObstacle();
+                        if (state.Solver3D) state.Solver3D->InitObstacle();
+                    });
+                }
+
+                if (ImGui::TreeNode("Airfoil")) {
+                    static char naca[8] = "0015";
+                    bool airfoilChanged = ImGui::InputText("NACA", naca, 8, ImGuiInputTextFlags_CharsDecimal);
+                    airfoilChanged |= ImGui::SliderFloat("Chord", &m_Airfoil.Chord, 8.0f, (float)m_GridWidth);
+                    airfoilChanged |= ImGui::SliderFloat("Angle of Attack", &m_Airfoil.AngleOfAttack, -30.0f, 30.0f, "%.1f deg");
+                    airfoilChanged |= ImGui::SliderFloat("Leading Edge X", &m_Airfoil.LeadingEdgeX, 0.0f, (float)m_GridWidth);
+                    airfoilChanged |= ImGui::SliderFloat("Leading Edge Y", &m_Airfoil.LeadingEdgeY, 0.0f, (float)m_GridHeight);
+
+                    // Shapes are cached, so dragging back over earlier settings is free; half-typed codes are ignored
+                    if (airfoilChanged && ObstacleLibrary::IsValidNaca(naca)) {
+                        m_Airfoil.Naca = naca;
+                        SubmitAirfoil();
+                    }
+
+                    static char maskPath[128] = "obstacle.mask";
+                    ImGui::InputText("Mask File", maskPath, 128);
+                    if (ImGui::Button("Save Mask")) {
+                        m_Simulation->Submit([path = std::string(maskPath)](SimulationState& state) {
+                            const FluidSolver& solver = *state.Solver;
+                            ObstacleLibrary::SaveMask(path, solver.GetSolidMask(), solver.GetWidth(), solver.GetHeight());
+                        });
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Load Mask")) {
+                        std::vector<float> mask;
+                        int width = 0, height = 0;
+                        if (ObstacleLibrary::LoadMask(maskPath, mask, width, height)) {
+                            if (width == m_GridWidth && height == m_GridHeight) {
+                                m_ObstacleSource = ObstacleSource::Mask;
+                                SubmitObstacleMask(std::move(mask));
+                            } else {
+                                std::cerr << "Mask " << maskPath << " is " << width << "x" << height << ", the grid is "
+                                          << m_GridWidth << "x" << m_GridHeight << std::endl;
+                            }
+                        }
+                    }
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Session Journal")) {
+                    static char journalPath[128] = "session.journal";
+                    const SimulationFrame& frame = m_Simulation->GetFrame();
+                    if (frame.Recording) {
+                        ImGui::Text("Recording: %llu steps", (unsigned long long)frame.RecordedSteps);
+                        if (ImGui::Button("Stop Recording")) {
+                            m_Simulation->Submit([](SimulationState& state) {
+                                if (state.Journal) state.Journal->Close(*state.Solver);
+                                state.Journal.reset();
+                            });
+                        }
+                    } else {
+                        ImGui::InputText("Journal File", journalPath, 128);
+
+                        // A replay starts from rest, so the recording does too
+                        if (ImGui::Button("Restart and Record")) {
+                            m_Simulation->Submit([path = std::string(journalPath)](SimulationState& state) {
+                                state.Solver->Reset();
+                                auto journal = std::make_unique<SessionJournal>();
+                                if (journal->Open(path, *state.Solver)) state.Journal = std::move(journal);
+                            });
+                        }
+                        ImGui::TextDisabled("Replay with --replay <file>");
+                    }
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Performance Counters")) {
+                    // Switched between steps, so no phase is half counted
+                    if (ImGui::Checkbox("Enable", &m_ProfilerEnabled)) {
+                        m_Simulation->Submit([enabled = m_ProfilerEnabled](SimulationState&) {
+                            KernelProfiler::Get().SetEnabled(enabled);
+                        });
+                    }
+
+                    KernelProfiler& profiler = KernelProfiler::Get();
+                    if (profiler.IsEnabled()) {
+                        ImGui::SameLine();
+                        if (ImGui::Button("Reset")) profiler.ResetTotals();
+                        ImGui::Text("Peak bandwidth: %.1f GB/s (STREAM triad)", profiler.GetPeakBandwidth() * 1e-9);
+                        std::string status = profiler.GetStatus();
+                        if (!status.empty()) ImGui::TextWrapped("Missing counts: %s", status.c_str());
+
+                        if (ImGui::BeginTable("Phases", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                            for (const char* column : { "Phase", "ms", "IPC", "B/cell", "Peak", "Bound" }) ImGui::TableSetupColumn(column);
+                            ImGui::TableHeadersRow();
+                            for (const PhaseReport& phase : profiler.GetReport()) {
+                                if (phase.Calls == 0) continue;
+                                ImGui::TableNextRow();
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%s", phase.Name);
+                                if (ImGui::IsItemHovered()) {
+                                    if (phase.Counted) {
+                                        ImGui::SetTooltip("%llu calls, %.1f GB/s\nLLC miss traffic %.1f B/cell\nBranch misses %.3f/cell\nVector ops %s",
+                                                          (unsigned long long)phase.Calls, phase.Bandwidth * 1e-9, phase.MissBytesPerCell,
+                                                          phase.BranchMissesPerCell,
+                                                          phase.HasVectorOps ? std::to_string(phase.VectorOpsPerCell).c_str() : "n/a");
+                                    } else {
+                                        ImGui::SetTooltip("%llu calls, %.1f GB/s (nominal traffic)", (unsigned long long)phase.Calls, phase.Bandwidth * 1e-9);
+                                    }
+                                }
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.3f", phase.Milliseconds);
+                                ImGui::TableNextColumn();
+                                if (phase.Counted) ImGui::Text("%.2f", phase.Ipc);
+                                else ImGui::TextDisabled("n/a");
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.0f", phase.BytesPerCell);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.0f%%", 100.0 * phase.PeakFraction);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%s", KernelProfiler::GetBoundName(phase.Bound));
+                            }
+                            ImGui::EndTable();
+                        }
+                    }
+                    ImGui::TreePop();
+                }
+
+                ImGui::Separator();
+                if (ImGui::Checkbox("Volume Solver (3D)", &m_VolumeMode)) {
+                    SubmitVolumeView();
+                    if (m_VolumeMode) {
+                        // The volume solver is created by the command above and picks up the current parameters
+                        settingsChanged = true;
+                        VoxelizeMesh();
+                    }
+                }
+                if (ImGui::Checkbox("Lattice Boltzmann (D2Q9)", &m_LatticeMode)) {
+                    SubmitEngine();
+                    // Created by the command above, the lattice picks up the current parameters
+                    if (m_LatticeMode) settingsChanged = true;
+                }
+                if (m_LatticeMode) {
+                    const char* collisions[] = { "BGK", "MRT" };
+                    settingsChanged |= ImGui::Combo("Collision", &m_Settings.Collision, collisions, 2);
+                    settingsChanged |= ImGui::SliderFloat("Lattice Velocity", &m_Settings.LatticeVelocity, 0.02f, 0.2f);
+                    const SimulationFrame& frame = m_Simulation->GetFrame();
+                    ImGui::Text("Lattice steps: %d (tau %.3f)", frame.LatticeSteps, frame.RelaxationTime);
                 }
+                if (m_VolumeMode) {
+                    const char* summaries[] = { "Slice Plane", "Depth Average" };
+                    if (ImGui::Combo("Volume View", &m_VolumeSummary, summaries, 2)) SubmitVolumeView();
+                    settingsChanged |= ImGui::SliderInt("Volume Iterations", &m_Settings.VolumeIterations, 1, 100);
+                }
+
+                if (settingsChanged) SubmitSettings();
             }
         }
 
         if (ImGui::CollapsingHeader("Visualization", ImGuiTreeNodeFlags_DefaultOpen)) {
             if (m_Renderer) {
 
-                const char* modes[] = { "Dye", "Velocity", "Pressure" };
+                const char* modes[] = { "Dye", "Velocity", "Pressure", "Vorticity", "Q-Criterion", "Streamfunction" };
                 int currentMode = (int)m_Renderer->m_CurrentMode;
-                if (ImGui::Combo("Display Mode", &currentMode, modes, 3)) {
+                if (ImGui::Combo("Display Mode", &currentMode, modes, 6)) {
                     m_Renderer->m_CurrentMode = (Renderer::DisplayMode)currentMode;
                 }
+                if (m_Renderer->m_CurrentMode == Renderer::DisplayMode::StreamFunction && m_DerivedFields) {
+                    ImGui::SliderInt("Streamfunction Sweeps", &m_DerivedFields->m_StreamFunctionIterations, 1, 200);
+                }
+
+                ImGui::Separator();
+                static char snapshotPath[128] = "snapshot.vtk";
+                ImGui::InputText("Snapshot File", snapshotPath, 128);
+                for (int i = 0; i < (int)DerivedField::Count; i++) {
+                    if (i % 2) ImGui::SameLine();
+                    ImGui::Checkbox(DerivedFields::GetName((DerivedField)i), &m_ExportDerived[i]);
+                }
+                if (ImGui::Button("Export Snapshot") && m_DerivedFields) {
+                    std::vector<DerivedField> derived;
+                    for (int i = 0; i < (int)DerivedField::Count; i++) {
+                        if (m_ExportDerived[i]) derived.push_back((DerivedField)i);
+                    }
+                    if (!SnapshotExporter::WriteVTK(snapshotPath, GetDisplayedFields(), *m_DerivedFields, derived)) {
+                        std::cerr << "Failed to export snapshot: " << snapshotPath << std::endl;
+                    }
+                }
+
+                ImGui::Separator();
+                if (ImGui::Checkbox("Particles", &m_ShowParticles) && m_ShowParticles && !m_Particles) {
+                    m_Particles = std::make_unique<ParticleTracer>(m_ParticleCount);
+                }
+                if (m_ShowParticles && m_Particles) {
+                    ImGui::SliderInt("Particle Count", &m_ParticleCount, 1000, 2000000);
+                    // Reallocating while dragging would restart the stream every frame
+                    if (ImGui::IsItemDeactivatedAfterEdit()) {
+                        m_Particles->Resize(m_ParticleCount);
+                    }
+                    ImGui::SliderFloat("Particle Lifetime", &m_Particles->m_MaxAge, 0.1f, 10.0f);
+                    ImGui::SliderFloat("Particle Size", &m_ParticleSize, 1.0f, 8.0f);
+                }
             }
         }
 
         if (ImGui::CollapsingHeader("Geometry Slicer", ImGuiTreeNodeFlags_DefaultOpen)) {
             static char filepath[128] = "assets/car.gltf";
             ImGui::InputText("File", filepath, 128);
-            auto PerformSlice = [&]() {
-                glm::mat4 model = glm::mat4(1.0f);
-                model = glm::translate(model, m_MeshPosition);
-                model = glm::scale(model, glm::vec3(m_MeshScale));
-                model = glm::rotate(model, glm::radians(m_MeshRotation.x), glm::vec3(1, 0, 0));
-                model = glm::rotate(model, glm::radians(m_MeshRotation.y), glm::vec3(0, 1, 0));
-                model = glm::rotate(model, glm::radians(m_MeshRotation.z), glm::vec3(0, 0, 1));
-
-                if (m_Slicer && m_Mesh) {
-                    std::vector<float> mask = m_Slicer->Capture(*m_Mesh, model, m_SliceZ, m_SliceThickness);
-                    if (m_Solver) m_Solver->SetObstacleMask(mask);
+            if (m_MeshImport) {
+                // The import runs in the background; only the upload happens here once it is done
+                if (m_MeshImport->IsFinished()) {
+                    bool cancelled = m_MeshImport->IsCancelled();
+                    auto mesh = m_MeshImport->TakeMesh();
+                    if (!mesh) {
+                        if (!cancelled) std::cerr << "Failed to load mesh: " << m_MeshImport->GetPath() << std::endl;
+                    } else {
+                        m_Mesh = std::move(mesh);
+                        SliceMesh();
+                        if (m_VolumeMode) VoxelizeMesh();
+                    }
+                    m_MeshImport.reset();
+                } else {
+                    ImGui::ProgressBar(m_MeshImport->GetProgress(), ImVec2(-80.0f, 0.0f));
+                    ImGui::SameLine();
+                    if (ImGui::Button("Cancel")) m_MeshImport->Cancel();
                 }
-            };
-
-            if (ImGui::Button("Load Mesh")) {
-                m_Mesh = SceneImporter::LoadGLTF(filepath);
-                if (!m_Mesh) std::cerr << "Failed to load mesh: " << filepath << std::endl;
-                else PerformSlice();
+            } else if (ImGui::Button("Load Mesh")) {
+                m_MeshImport = std::make_unique<MeshImportJob>(filepath);
             }
 
             if (m_Mesh) {
+                ImGui::Text("%zu vertices, %.1f MB on the GPU", m_Mesh->GetVertexCount(), m_Mesh->GetGpuBytes() / (1024.0 * 1024.0));
                 ImGui::Checkbox("Show Preview Overlay", &m_ShowMeshPreview);
                 if (m_ShowMeshPreview) {
                     ImGui::SameLine();
@@ -240,11 +865,32 @@ void Application::RenderUI()
                 changed |= ImGui::SliderFloat("Slice Offset", &m_SliceZ, -100.0f, 100.0f);
                 changed |= ImGui::SliderFloat("Thickness", &m_SliceThickness, 0.01f, 50.0f);
 
+                if (ImGui::Button("Scan Slices")) ScanSlices();
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Captures every band of this thickness across the mesh in one pass");
+                if (!m_ScanBlockage.empty()) {
+                    ImGui::PlotLines("Blockage", m_ScanBlockage.data(), (int)m_ScanBlockage.size(), 0, nullptr, 0.0f, 1.0f, ImVec2(0.0f, 40.0f));
+                    if (m_ScanBest >= 0) {
+                        const SliceStatistics& best = m_ScanStatistics[m_ScanBest];
+                        ImGui::Text("Largest at z = %.2f: %.0f%% of the height, %d cells", m_ScanBands[m_ScanBest].SliceZ,
+                                    100.0f * m_ScanBlockage[m_ScanBest], best.SolidCells);
+                        ImGui::SameLine();
+                        if (ImGui::Button("Use")) {
+                            m_SliceZ = m_ScanBands[m_ScanBest].SliceZ;
+                            changed = true;
+                        }
+                    } else {
+                        ImGui::Text("No band meets the mesh");
+                    }
+                }
+
                 ImGui::Separator();
                 ImGui::Text("Transform");
+                // The volume only needs re-voxelising when the mesh itself moves, not the slice band
+                bool sliceChanged = changed;
+                changed = false;
                 changed |= ImGui::DragFloat3("Position", &m_MeshPosition.x, 1.0f);
                 if (ImGui::Button("Center on Grid")) {
-                    m_MeshPosition = glm::vec3(128.0f, 64.0f, 0.0f);
+                    m_MeshPosition = glm::vec3(0.5f * m_GridWidth, 0.5f * m_GridHeight, 0.0f);
                     changed = true;
                 }
 
@@ -254,22 +900,25 @@ void Application::RenderUI()
                 ImGui::Text("Orientation Presets:");
                 if (ImGui::Button("Front")) {
                     m_MeshRotation = glm::vec3(0.0f, 0.0f, 0.0f);
-                    if (m_Solver) m_Solver->m_FrontalSource = false;
+                    m_Settings.FrontalSource = false;
                     changed = true;
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Top")) {
                     m_MeshRotation = glm::vec3(90.0f, 0.0f, 0.0f);
-                    if (m_Solver) m_Solver->m_FrontalSource = false;
+                    m_Settings.FrontalSource = false;
                     changed = true;
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Side")) {
                     m_MeshRotation = glm::vec3(0.0f, 90.0f, 0.0f);
-                    if (m_Solver) m_Solver->m_FrontalSource = true;
+                    m_Settings.FrontalSource = true;
                     changed = true;
                 }
 
+                bool transformChanged = changed;
+                changed |= sliceChanged;
+
                 if (m_Renderer) {
                     ImGui::Text("Front View / Side View");
                     // Flip UVs to correct OpenGL texture orientation
@@ -279,7 +928,10 @@ void Application::RenderUI()
                 }
 
                 if (changed) {
-                    PerformSlice();
+                    SliceMesh();
+                    if (transformChanged && m_VolumeMode) VoxelizeMesh();
+                    if (sliceChanged && m_VolumeMode) SubmitVolumeView();
+                    if (transformChanged && m_Simulation) SubmitSettings();
                 }
             }
         }
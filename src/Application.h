@@ -1,15 +1,26 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 #include <glm/glm.hpp>
+#include "DomainBoundaries.h"
+#include "ObstacleLibrary.h"
+#include "ScalarTransport.h"
 
 struct GLFWwindow;
 
-class FluidSolver;
+class SimulationThread;
 class Renderer;
 class Mesh;
+class MeshImportJob;
 class Slicer;
+struct SliceBand;
+struct SliceStatistics;
+class ParticleTracer;
+class DerivedFields;
+struct FieldView;
 
 class Application {
 public:
@@ -23,20 +34,47 @@ private:
     void Shutdown();
     
     void ProcessInput();
-    void Update(float dt);
+    void Update();
     void Render();
     void RenderUI();
 
+    glm::mat4 GetMeshModelMatrix() const;
+    FieldView GetDisplayedFields() const;
+    void VoxelizeMesh();
+
+    // UI edits reach the solvers as commands run on the simulation thread
+    void SubmitSettings();
+    void SubmitVolumeView();
+    void SubmitEngine();
+    void SubmitObstacleMask(std::vector<float> mask);
+    void SubmitObstacleDistance(std::vector<float> distance);
+    void SubmitAirfoil();
+
+    // Slices the mesh into the 2D solver's obstacle
+    void SliceMesh();
+    void CaptureMeshSlice(std::vector<float>& slice);
+
+    // Captures bands of the current thickness across the placed mesh's depth and finds the one blocking the most
+    // of the channel height
+    void ScanSlices();
+
+    // Moves the 2D run onto a width x height grid over the same tunnel: the flow is resampled, the obstacle rebuilt
+    // from its source and everything placed in grid units scaled along
+    void ResizeGrid(int width, int height);
+
 private:
     GLFWwindow* m_Window = nullptr;
     int m_WindowWidth;
     int m_WindowHeight;
     std::string m_Title;
 
-    std::unique_ptr<FluidSolver> m_Solver;
+    std::unique_ptr<SimulationThread> m_Simulation;
     std::unique_ptr<Renderer> m_Renderer;
     std::unique_ptr<Mesh> m_Mesh;
+    std::unique_ptr<MeshImportJob> m_MeshImport; // Load in flight, if any
     std::unique_ptr<Slicer> m_Slicer;
+    std::unique_ptr<ParticleTracer> m_Particles;
+    std::unique_ptr<DerivedFields> m_DerivedFields;
 
     // Slicing settings
     float m_SliceZ = 0.0f;
@@ -46,6 +84,64 @@ private:
     glm::vec3 m_MeshPosition = glm::vec3(100.0f, 62.0f, 0.0f);
     bool m_ShowMeshPreview = true;
     bool m_MeshWireframe = true;
+    std::vector<float> m_SliceBuffer; // Capture target, kept so re-slicing does not allocate
+
+    // Last slice scan
+    std::vector<SliceBand> m_ScanBands;
+    std::vector<SliceStatistics> m_ScanStatistics;
+    std::vector<float> m_ScanMasks;
+    std::vector<float> m_ScanBlockage; // Blocked fraction of the height per band
+    int m_ScanBest = -1;
+
+    // Where the 2D obstacle last came from, so a grid resize can rebuild it at the new resolution
+    enum class ObstacleSource { Default, Airfoil, Mesh, Mask };
+    ObstacleSource m_ObstacleSource = ObstacleSource::Default;
+
+    // Grid sizes; the solvers themselves live on the simulation thread
+    int m_GridWidth = 256;
+    int m_GridHeight = 128;
+    glm::ivec3 m_VolumeSize = glm::ivec3(128, 64, 64);
+
+    // UI copy of the solver parameters, pushed to both solvers whenever one changes
+    struct SolverSettings {
+        float Viscosity = 0.0f;
+        float InflowVelocity = 0.0f;
+        int Iterations = 0;
+        int Relaxation = 0; // FluidSolver::Relaxation
+        float PressureTolerance = 0.0f;
+        bool FrontalSource = false;
+        bool SubCellBoundaries = false;
+        int TurbulenceModel = 0; // FluidSolver::TurbulenceModel
+        float SmagorinskyConstant = 0.0f;
+        float WaleConstant = 0.0f;
+        BoundarySettings Boundaries;
+        std::vector<ScalarSpecies> Species;
+        int DisplayedSpecies = 0;
+        int VolumeIterations = 20;
+        int Collision = 1; // LatticeBoltzmannSolver::Collision
+        float LatticeVelocity = 0.1f;
+    };
+    SolverSettings m_Settings;
+
+    // Parametric obstacle edited in the UI
+    ObstacleLibrary::Airfoil m_Airfoil;
+
+    // Volume solver settings
+    bool m_VolumeMode = false;
+    int m_VolumeSummary = 0; // FluidSolver3D::SliceSummary
+
+    // 2D engine: Stable Fluids, or lattice Boltzmann while set
+    bool m_LatticeMode = false;
+    bool m_ProfilerEnabled = false;
+
+    // Snapshot export: which derived fields to include, indexed by DerivedField
+    bool m_ExportDerived[4] = { true, true, true, true };
+
+    // Particle settings
+    bool m_ShowParticles = false;
+    double m_ParticleTime = 0.0; // Simulated time the particles have been advanced to
+    int m_ParticleCount = 200000;
+    float m_ParticleSize = 2.0f;
 
     // Camera settings
     bool m_3DMode = false;
@@ -61,8 +157,6 @@ private:
 
     // Simulation settings
     bool m_Paused = false;
+    uint64_t m_FrameAllocations = 0; // Heap allocations of the last frame on every thread, in audit builds
     float m_SimulationTimeStep = 0.01f; // Simulation time step
-    
-    // For calculating delta time
-    float m_LastFrameTime = 0.0f;
 };
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "DerivedFields.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Rows per task for the per-cell kernels
+constexpr int RowGrain = 8;
+
+// Over-relaxation factor for the streamfunction sweeps
+constexpr float StreamFunctionOmega = 1.7f;
+
+}
+
+const char* DerivedFields::GetName(DerivedField field)
+{
+    switch (field) {
+        case DerivedField::Vorticity: return "Vorticity";
+        case DerivedField::Speed: return "Speed";
+        case DerivedField::QCriterion: return "QCriterion";
+        case DerivedField::StreamFunction: return "StreamFunction";
+        default: return "Unknown";
+    }
+}
+
+const std::vector<float>& DerivedFields::Get(DerivedField field, const FieldView& fields)
+{
+    CachedField& cache = m_Cache[(int)field];
+    size_t size = (size_t)fields.Width * fields.Height;
+
+    bool upToDate = fields.Version != 0 && cache.Version == fields.Version && cache.Source == fields.VelocityX && cache.Data.size() == size;
+    if (upToDate) return cache.Data;
+
+    // Keep the old data when the size matches: the streamfunction solve warm-starts from the previous result
+    if (cache.Data.size() != size) {
+        cache.Data.assign(size, 0.0f);
+    }
+
+    switch (field) {
+        case DerivedField::Vorticity: ComputeVorticity(fields, cache.Data); break;
+        case DerivedField::Speed: ComputeSpeed(fields, cache.Data); break;
+        case DerivedField::QCriterion: ComputeQCriterion(fields, cache.Data); break;
+        case DerivedField::StreamFunction: ComputeStreamFunction(fields, cache.Data); break;
+        default: break;
+    }
+
+    cache.Source = fields.VelocityX;
+    cache.Version = fields.Version;
+    cache.Range = ComputeRange(cache.Data);
+    return cache.Data;
+}
+
+void DerivedFields::ComputeVorticity(const FieldView& fields, std::vector<float>& result)
+{
+    int width = fields.Width;
+    int height = fields.Height;
+    const float* u = fields.VelocityX;
+    const float* v = fields.VelocityY;
+
+    // Central differences; the domain spans one unit over the (width - 2) x (height - 2) interior cells
+    float halfInvDx = 0.5f * (width - 2);
+    float halfInvDy = 0.5f * (height - 2);
+
+    ThreadPool::Get().ParallelFor(0, height, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            float* row = result.data() + j * width;
+            if (j == 0 || j == height - 1) {
+                std::fill(row, row + width, 0.0f);
+                continue;
+            }
+
+            row[0] = 0.0f;
+            row[width - 1] = 0.0f;
+            for (int i = 1; i < width - 1; i++) {
+                int index = i + j * width;
+                float dvdx = (v[index + 1] - v[index - 1]) * halfInvDx;
+                float dudy = (u[index + width] - u[index - width]) * halfInvDy;
+                row[i] = dvdx - dudy;
+            }
+        }
+    });
+}
+
+void DerivedFields::ComputeSpeed(const FieldView& fields, std::vector<float>& result)
+{
+    int width = fields.Width;
+    const float* u = fields.VelocityX;
+    const float* v = fields.VelocityY;
+
+    ThreadPool::Get().ParallelFor(0, fields.Height, RowGrain, [&](int begin, int end) {
+        for (int index = begin * width; index < end * width; index++) {
+            result[index] = std::sqrt(u[index] * u[index] + v[index] * v[index]);
+        }
+    });
+}
+
+void DerivedFields::ComputeQCriterion(const FieldView& fields, std::vector<float>& result)
+{
+    int width = fields.Width;
+    int height = fields.Height;
+    const float* u = fields.VelocityX;
+    const float* v = fields.VelocityY;
+
+    float halfInvDx = 0.5f * (width - 2);
+    float halfInvDy = 0.5f * (height - 2);
+
+    // Q = 0.5 * (|rotation|^2 - |strain|^2), which in 2D reduces to -0.5 * (ux^2 + vy^2) - uy * vx
+    ThreadPool::Get().ParallelFor(0, height, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            float* row = result.data() + j * width;
+            if (j == 0 || j == height - 1) {
+                std::fill(row, row + width, 0.0f);
+                continue;
+            }
+
+            row[0] = 0.0f;
+            row[width - 1] = 0.0f;
+            for (int i = 1; i < width - 1; i++) {
+                int index = i + j * width;
+                float dudx = (u[index + 1] - u[index - 1]) * halfInvDx;
+                float dudy = (u[index + width] - u[index - width]) * halfInvDy;
+                float dvdx = (v[index + 1] - v[index - 1]) * halfInvDx;
+                float dvdy = (v[index + width] - v[index - width]) * halfInvDy;
+                row[i] = -0.5f * (dudx * dudx + dvdy * dvdy) - dudy * dvdx;
+            }
+        }
+    });
+}
+
+void DerivedFields::ComputeStreamFunction(const FieldView& fields, std::vector<float>& result)
+{
+    int width = fields.Width;
+    int height = fields.Height;
+    const float* u = fields.VelocityX;
+    const float* v = fields.VelocityY;
+
+    // Solves laplacian(psi) = -vorticity, reusing the cached vorticity when it is current
+    const std::vector<float>& vorticity = Get(DerivedField::Vorticity, fields);
+
+    float dx = 1.0f / (width - 2);
+    float dy = 1.0f / (height - 2);
+
+    // Dirichlet values from integrating u = dpsi/dy and v = -dpsi/dx around the boundary, starting at psi(0, 0) = 0
+    result[0] = 0.0f;
+    for (int j = 1; j < height; j++) {
+        int index = j * width;
+        result[index] = result[index - width] + 0.5f * (u[index] + u[index - width]) * dy;
+    }
+    for (int i = 1; i < width; i++) {
+        result[i] = result[i - 1] - 0.5f * (v[i] + v[i - 1]) * dx;
+
+        int top = i + (height - 1) * width;
+        result[top] = result[top - 1] - 0.5f * (v[top] + v[top - 1]) * dx;
+    }
+    for (int j = 1; j < height - 1; j++) {
+        int index = (width - 1) + j * width;
+        result[index] = result[index - width] + 0.5f * (u[index] + u[index - width]) * dy;
+    }
+
+    float weightX = 1.0f / (dx * dx);
+    float weightY = 1.0f / (dy * dy);
+    float inverseDiagonal = 1.0f / (2.0f * weightX + 2.0f * weightY);
+
+    // Red-black SOR so both colours can be swept in parallel
+    for (int k = 0; k < m_StreamFunctionIterations; k++) {
+        for (int parity = 0; parity < 2; parity++) {
+            ThreadPool::Get().ParallelFor(1, height - 1, RowGrain, [&](int begin, int end) {
+                for (int j = begin; j < end; j++) {
+                    for (int i = 1 + ((j + parity) & 1); i < width - 1; i += 2) {
+                        int index = i + j * width;
+                        float target = (weightX * (result[index - 1] + result[index + 1]) +
+                                        weightY * (result[index - width] + result[index + width]) +
+                                        vorticity[index]) * inverseDiagonal;
+                        result[index] += StreamFunctionOmega * (target - result[index]);
+                    }
+                }
+            });
+        }
+    }
+}
+
+float DerivedFields::ComputeRange(const std::vector<float>& values) const
+{
+    float range = 0.0f;
+    for (float value : values) {
+        range = std::max(range, std::abs(value));
+    }
+    return range;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "FieldView.h"
+
+enum class DerivedField {
+    Vorticity = 0,
+    Speed = 1,
+    QCriterion = 2,
+    StreamFunction = 3,
+    Count = 4
+};
+
+// Quantities computed from the velocity field on request. Each result is cached with the version of the
+// fields it came from and is only recomputed when asked for after the fields changed, so nothing is spent
+// on fields no consumer (renderer, exporter) is looking at.
+class DerivedFields {
+public:
+    const std::vector<float>& Get(DerivedField field, const FieldView& fields);
+
+    // Largest absolute value of the last computed result, for colour mapping
+    float GetRange(DerivedField field) const { return m_Cache[(int)field].Range; }
+
+    static const char* GetName(DerivedField field);
+
+    // Red-black sweeps per streamfunction update (warm-started from the previous result)
+    int m_StreamFunctionIterations = 60;
+
+private:
+    void ComputeVorticity(const FieldView& fields, std::vector<float>& result);
+    void ComputeSpeed(const FieldView& fields, std::vector<float>& result);
+    void ComputeQCriterion(const FieldView& fields, std::vector<float>& result);
+    void ComputeStreamFunction(const FieldView& fields, std::vector<float>& result);
+
+    float ComputeRange(const std::vector<float>& values) const;
+
+private:
+    struct CachedField {
+        std::vector<float> Data;
+        const float* Source = nullptr; // Fields the data was computed from
+        uint64_t Version = 0;
+        float Range = 0.0f;
+    };
+
+    CachedField m_Cache[(int)DerivedField::Count];
+};
@@ -0,0 +1,134 @@
+#include "DistributedCheck.h"
+#include "DistributedFluidSolver.h"
+#include "SharedMemoryTransport.h"
+#include "MpiTransport.h"
+#include "../FluidSolver.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(CFD_HAS_SHARED_MEMORY_TRANSPORT)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int CheckWidth = 256;
+constexpr int CheckHeight = 128;
+constexpr float CheckTimeStep = 0.01f;
+
+bool SameBits(const char* name, const std::vector<float>& expected, const std::vector<float>& actual)
+{
+    if (expected.size() == actual.size() && std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0) {
+        return true;
+    }
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < expected.size() && i < actual.size(); i++) {
+        if (std::memcmp(&expected[i], &actual[i], sizeof(float)) != 0) mismatches++;
+    }
+    std::cerr << "Distributed check: " << name << " differs in " << mismatches << " cells" << std::endl;
+    return false;
+}
+
+// Runs the slab on this rank and, on rank 0, compares against the single-process reference
+int RunRank(HaloTransport& transport, int steps)
+{
+    DistributedFluidSolver solver(CheckWidth, CheckHeight, transport);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++) {
+        solver.Step(CheckTimeStep);
+    }
+    transport.Barrier();
+    double distributedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<float> velocityX, velocityY, pressure, dye;
+    solver.GatherGlobal(solver.GetVelocityX(), velocityX);
+    solver.GatherGlobal(solver.GetVelocityY(), velocityY);
+    solver.GatherGlobal(solver.GetPressure(), pressure);
+    solver.GatherGlobal(solver.GetDyeDensity(), dye);
+
+    if (transport.GetRank() != 0) return 0;
+
+    FluidSolver reference(CheckWidth, CheckHeight);
+    reference.m_Relaxation = FluidSolver::Relaxation::Jacobi;
+
+    start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++) {
+        reference.Step(CheckTimeStep);
+    }
+    double referenceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    bool identical = SameBits("VelocityX", reference.GetVelocityX(), velocityX);
+    identical &= SameBits("VelocityY", reference.GetVelocityY(), velocityY);
+    identical &= SameBits("Pressure", reference.GetPressure(), pressure);
+    identical &= SameBits("DyeDensity", reference.GetDyeDensity(), dye);
+
+    std::cout << "Distributed check: " << transport.GetRankCount() << " ranks, " << steps << " steps, "
+              << distributedMs / steps << " ms/step (single process " << referenceMs / steps << " ms/step) - "
+              << (identical ? "bit-identical" : "MISMATCH") << std::endl;
+
+    return identical ? 0 : 1;
+}
+
+}
+
+int RunSharedMemoryCheck(int rankCount, int steps)
+{
+#if defined(CFD_HAS_SHARED_MEMORY_TRANSPORT)
+    std::string name = "/opengl-cfd-" + std::to_string(getpid());
+
+    int maxSlab = (CheckWidth + rankCount - 1) / rankCount;
+    if (!SharedMemoryTransport::CreateSegment(name, rankCount, 8 * CheckHeight, maxSlab * CheckHeight)) {
+        return 1;
+    }
+
+    std::vector<pid_t> children;
+    for (int rank = 0; rank < rankCount; rank++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            SharedMemoryTransport transport(name, rank);
+            _exit(transport.IsValid() ? RunRank(transport, steps) : 1);
+        }
+        children.push_back(pid);
+    }
+
+    int result = 0;
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) result = 1;
+    }
+
+    SharedMemoryTransport::RemoveSegment(name);
+    return result;
+#else
+    (void)rankCount;
+    (void)steps;
+    std::cerr << "Shared memory transport is only available on Linux" << std::endl;
+    return 1;
+#endif
+}
+
+int RunMpiCheck(int steps)
+{
+#if defined(CFD_WITH_MPI)
+    MPI_Init(nullptr, nullptr);
+    int result = 0;
+    {
+        MpiTransport transport;
+        result = RunRank(transport, steps);
+    }
+    MPI_Finalize();
+    return result;
+#else
+    (void)steps;
+    std::cerr << "Built without MPI support (configure with -DCFD_ENABLE_MPI=ON)" << std::endl;
+    return 1;
+#endif
+}
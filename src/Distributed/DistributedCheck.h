@@ -0,0 +1,11 @@
+#pragma once
+
+// Headless consistency runs for the distributed solver. Both run the default tunnel for 'steps' steps,
+// gather the fields on rank 0 and compare them bit for bit with a single FluidSolver using Jacobi
+// relaxation. They return 0 when every field matches.
+
+// Forks 'rankCount' local processes connected through SharedMemoryTransport (Linux only)
+int RunSharedMemoryCheck(int rankCount, int steps);
+
+// Uses the ranks of MPI_COMM_WORLD (requires a build with CFD_ENABLE_MPI, launched through mpirun)
+int RunMpiCheck(int steps);
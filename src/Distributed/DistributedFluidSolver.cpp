@@ -0,0 +1,175 @@
+#include "DistributedFluidSolver.h"
+#include "../SignedDistance.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+DistributedFluidSolver::DistributedFluidSolver(int width, int height, HaloTransport& transport, int haloWidth)
+    : m_Transport(transport), m_Width(width), m_Height(height), m_Halo(haloWidth)
+{
+    int rankCount = m_Transport.GetRankCount();
+    GetSlabRange(m_Transport.GetRank(), rankCount, m_Width, m_X0, m_X1);
+
+    // Halo columns are sent straight out of the owned ones, so no slab may be narrower than the halo
+    int narrowest = m_Width / rankCount;
+    if (narrowest < m_Halo) {
+        std::cerr << "WARNING::DISTRIBUTED_SOLVER:: Slab of " << narrowest << " columns is narrower than the halo ("
+                  << m_Halo << "), the halo shrinks to match; use fewer ranks" << std::endl;
+        m_Halo = std::max(1, narrowest);
+    }
+
+    // The slab plus up to a halo on either side, so a slab at a domain side holds its wall as the single grid does
+    m_ColumnOffset = std::max(0, m_X0 - m_Halo);
+    m_LocalWidth = std::min(m_Width, m_X1 + m_Halo) - m_ColumnOffset;
+
+    m_Solver = std::make_unique<FluidSolver>(m_LocalWidth, m_Height);
+    m_Solver->m_Relaxation = FluidSolver::Relaxation::Jacobi;
+
+    // A single rank holds the whole domain and runs as a plain FluidSolver
+    if (rankCount > 1) {
+        int columnBegin = std::max(1, m_X0) - m_ColumnOffset;
+        int columnEnd = std::min(m_Width - 1, m_X1) - m_ColumnOffset;
+        m_Solver->SetSlab(m_Width, m_ColumnOffset, columnBegin, columnEnd, *this);
+    }
+
+    m_SendLeft.resize(m_Halo * m_Height);
+    m_SendRight.resize(m_Halo * m_Height);
+    m_ReceiveLeft.resize(m_Halo * m_Height);
+    m_ReceiveRight.resize(m_Halo * m_Height);
+
+    InitObstacle();
+}
+
+DistributedFluidSolver::~DistributedFluidSolver()
+{
+
+}
+
+void DistributedFluidSolver::GetSlabRange(int rank, int rankCount, int width, int& x0, int& x1)
+{
+    int base = width / rankCount;
+    int remainder = width % rankCount;
+    x0 = rank * base + std::min(rank, remainder);
+    x1 = x0 + base + (rank < remainder ? 1 : 0);
+}
+
+void DistributedFluidSolver::Step(float dt)
+{
+    // Semi-Lagrangian backtraces must stay inside the halo for the result to match the single-process solver
+    if (!m_CflWarningShown && m_Transport.GetRankCount() > 1) {
+        const std::vector<float>& velocityX = m_Solver->GetVelocityX();
+        int columnBegin = std::max(1, m_X0) - m_ColumnOffset;
+        int columnEnd = std::min(m_Width - 1, m_X1) - m_ColumnOffset;
+        float maxVelocity = 0.0f;
+        for (int j = 1; j < m_Height - 1; j++) {
+            for (int index = columnBegin + j * m_LocalWidth; index < columnEnd + j * m_LocalWidth; index++) {
+                maxVelocity = std::max(maxVelocity, std::abs(velocityX[index]));
+            }
+        }
+        float maxDisplacement = m_Transport.AllReduceMax(maxVelocity) * dt * (m_Width - 2);
+        if (maxDisplacement > m_Halo - 1) {
+            if (m_Transport.GetRank() == 0) {
+                std::cerr << "WARNING::DISTRIBUTED_SOLVER:: Backtrace of " << maxDisplacement << " cells exceeds the halo of "
+                          << m_Halo << ", results will differ from the single-process solver" << std::endl;
+            }
+            m_CflWarningShown = true;
+        }
+    }
+
+    m_Solver->Step(dt);
+}
+
+void DistributedFluidSolver::ExchangeHalos(float* field)
+{
+    bool hasLeft = m_Transport.GetRank() > 0;
+    bool hasRight = m_Transport.GetRank() < m_Transport.GetRankCount() - 1;
+    int first = m_X0 - m_ColumnOffset; // First owned local column
+    int end = m_X1 - m_ColumnOffset;
+
+    // Pack the owned edge columns, row by row
+    for (int j = 0; j < m_Height; j++) {
+        const float* row = field + j * m_LocalWidth;
+        if (hasLeft) std::copy(row + first, row + first + m_Halo, m_SendLeft.begin() + j * m_Halo);
+        if (hasRight) std::copy(row + end - m_Halo, row + end, m_SendRight.begin() + j * m_Halo);
+    }
+
+    m_Transport.ExchangeHalos(hasLeft ? m_SendLeft.data() : nullptr, hasLeft ? m_ReceiveLeft.data() : nullptr,
+                              hasRight ? m_SendRight.data() : nullptr, hasRight ? m_ReceiveRight.data() : nullptr,
+                              m_Halo * m_Height);
+
+    for (int j = 0; j < m_Height; j++) {
+        float* row = field + j * m_LocalWidth;
+        if (hasLeft) std::copy(m_ReceiveLeft.begin() + j * m_Halo, m_ReceiveLeft.begin() + (j + 1) * m_Halo, row + first - m_Halo);
+        if (hasRight) std::copy(m_ReceiveRight.begin() + j * m_Halo, m_ReceiveRight.begin() + (j + 1) * m_Halo, row + end);
+    }
+}
+
+float DistributedFluidSolver::AllReduceMax(float value)
+{
+    return m_Transport.AllReduceMax(value);
+}
+
+void DistributedFluidSolver::InitObstacle()
+{
+    SetAirfoil(ObstacleLibrary::GetDefaultAirfoil(m_Width, m_Height));
+}
+
+bool DistributedFluidSolver::SetAirfoil(const ObstacleLibrary::Airfoil& airfoil)
+{
+    std::shared_ptr<const ObstacleLibrary::Shape> shape = ObstacleLibrary::Get().GetAirfoil(airfoil, m_Width, m_Height);
+    if (!shape) return false;
+
+    SetSlabObstacle(shape->Mask, shape->Distance);
+    return true;
+}
+
+void DistributedFluidSolver::SetObstacleMask(Span<const float> mask)
+{
+    if (mask.size() != (size_t)m_Width * m_Height) return;
+
+    // The distance reaches across slab borders, so it comes from the whole mask
+    std::vector<float> distance;
+    SignedDistance::FromMask(mask.data(), m_Width, m_Height, distance);
+    SetSlabObstacle(mask, distance);
+}
+
+void DistributedFluidSolver::SetSlabObstacle(Span<const float> mask, Span<const float> distance)
+{
+    std::vector<float> localMask((size_t)m_LocalWidth * m_Height);
+    std::vector<float> localDistance((size_t)m_LocalWidth * m_Height);
+    for (int j = 0; j < m_Height; j++) {
+        size_t row = (size_t)m_ColumnOffset + (size_t)j * m_Width;
+        std::copy(mask.begin() + row, mask.begin() + row + m_LocalWidth, localMask.begin() + (size_t)j * m_LocalWidth);
+        std::copy(distance.begin() + row, distance.begin() + row + m_LocalWidth, localDistance.begin() + (size_t)j * m_LocalWidth);
+    }
+    m_Solver->SetObstacle(localMask, localDistance);
+}
+
+void DistributedFluidSolver::GatherGlobal(const std::vector<float>& localField, std::vector<float>& globalField) const
+{
+    std::vector<float> block;
+    block.reserve((size_t)(m_X1 - m_X0) * m_Height);
+    for (int j = 0; j < m_Height; j++) {
+        const float* row = localField.data() + j * m_LocalWidth;
+        block.insert(block.end(), row + (m_X0 - m_ColumnOffset), row + (m_X1 - m_ColumnOffset));
+    }
+
+    std::vector<float> blocks;
+    m_Transport.Gather(block.data(), (int)block.size(), blocks);
+
+    globalField.clear();
+    if (m_Transport.GetRank() != 0) return;
+
+    // Blocks arrive in rank order, each row-major over its own slab
+    globalField.assign((size_t)m_Width * m_Height, 0.0f);
+    size_t offset = 0;
+    for (int rank = 0; rank < m_Transport.GetRankCount(); rank++) {
+        int x0, x1;
+        GetSlabRange(rank, m_Transport.GetRankCount(), m_Width, x0, x1);
+        for (int j = 0; j < m_Height; j++) {
+            for (int i = x0; i < x1; i++) {
+                globalField[i + j * m_Width] = blocks[offset++];
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "HaloTransport.h"
+#include "../FluidSolver.h"
+#include "../Span.h"
+
+// FluidSolver split into vertical slabs of columns, one slab per rank. Each rank runs a FluidSolver over its own
+// columns plus 'haloWidth' columns on either side (see FluidSolver::SetSlab), which are refreshed from the
+// neighbours after every relaxation sweep, advection and boundary update.
+//
+// The solves use Relaxation::Jacobi, whose sweeps read only the previous iterate, so for any rank count the
+// gathered fields are bit-identical to a single FluidSolver running Jacobi relaxation.
+class DistributedFluidSolver : private SlabLink {
+public:
+    DistributedFluidSolver(int width, int height, HaloTransport& transport, int haloWidth = 8);
+    ~DistributedFluidSolver();
+
+    void Step(float deltaTime);
+
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
+    int GetSlabBegin() const { return m_X0; }
+    int GetSlabEnd() const { return m_X1; }
+
+    // This rank's solver, for its parameters, which every rank sets alike; SetSlab lists what a slab supports.
+    // Obstacles are set through the methods below instead, so every slab is cut from the same shape.
+    FluidSolver& GetSolver() { return *m_Solver; }
+    const FluidSolver& GetSolver() const { return *m_Solver; }
+
+    // Local fields, domain columns [GetColumnOffset(), GetColumnOffset() + the solver's width)
+    int GetColumnOffset() const { return m_ColumnOffset; }
+    const std::vector<float>& GetVelocityX() const { return m_Solver->GetVelocityX(); }
+    const std::vector<float>& GetVelocityY() const { return m_Solver->GetVelocityY(); }
+    const std::vector<float>& GetPressure() const { return m_Solver->GetPressure(); }
+    const std::vector<float>& GetDyeDensity() const { return m_Solver->GetDyeDensity(); }
+
+    // Collects the owned columns of a local field into a full width * height field on rank 0
+    void GatherGlobal(const std::vector<float>& localField, std::vector<float>& globalField) const;
+
+    void InitObstacle();
+    bool SetAirfoil(const ObstacleLibrary::Airfoil& airfoil);
+    // Full width * height mask, identical on every rank
+    void SetObstacleMask(Span<const float> mask);
+
+    // Columns [x0, x1) owned by 'rank' when 'width' columns are split across 'rankCount' ranks
+    static void GetSlabRange(int rank, int rankCount, int width, int& x0, int& x1);
+
+private:
+    void ExchangeHalos(float* values) override;
+    float AllReduceMax(float value) override;
+
+    // Hands the solver its columns of a full width * height obstacle
+    void SetSlabObstacle(Span<const float> mask, Span<const float> distance);
+
+private:
+    HaloTransport& m_Transport;
+
+    int m_Width;
+    int m_Height;
+    int m_Halo;
+    int m_X0; // First owned global column
+    int m_X1; // One past the last owned global column
+    int m_ColumnOffset; // Global column of the solver's first column
+    int m_LocalWidth;
+
+    bool m_CflWarningShown = false;
+
+    std::unique_ptr<FluidSolver> m_Solver;
+
+    // Packed halo columns: send/receive buffers for each side
+    std::vector<float> m_SendLeft, m_SendRight, m_ReceiveLeft, m_ReceiveRight;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+// Communication backend used by DistributedFluidSolver. Ranks are arranged in a line (one slab each),
+// so every rank only ever talks to rank - 1 and rank + 1, plus the collective operations below.
+class HaloTransport {
+public:
+    virtual ~HaloTransport() = default;
+
+    virtual int GetRank() const = 0;
+    virtual int GetRankCount() const = 0;
+
+    // Sends 'count' floats to each neighbour and receives 'count' floats back from it.
+    // Pointers for a missing neighbour (first/last rank) are null. Every rank must call this together.
+    virtual void ExchangeHalos(const float* sendLeft, float* receiveLeft, const float* sendRight, float* receiveRight, int count) = 0;
+
+    // Maximum of 'value' over all ranks, returned on every rank
+    virtual float AllReduceMax(float value) = 0;
+
+    // Concatenates each rank's block in rank order into 'receive' on rank 0 (other ranks get it cleared)
+    virtual void Gather(const float* send, int count, std::vector<float>& receive) = 0;
+
+    virtual void Barrier() = 0;
+};
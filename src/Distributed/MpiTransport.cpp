@@ -0,0 +1,58 @@
+#include "MpiTransport.h"
+
+#if defined(CFD_WITH_MPI)
+
+MpiTransport::MpiTransport(MPI_Comm communicator)
+    : m_Communicator(communicator)
+{
+    MPI_Comm_rank(m_Communicator, &m_Rank);
+    MPI_Comm_size(m_Communicator, &m_RankCount);
+}
+
+void MpiTransport::ExchangeHalos(const float* sendLeft, float* receiveLeft, const float* sendRight, float* receiveRight, int count)
+{
+    int left = m_Rank > 0 ? m_Rank - 1 : MPI_PROC_NULL;
+    int right = m_Rank < m_RankCount - 1 ? m_Rank + 1 : MPI_PROC_NULL;
+
+    MPI_Request requests[4];
+    int requestCount = 0;
+
+    if (receiveLeft) MPI_Irecv(receiveLeft, count, MPI_FLOAT, left, 1, m_Communicator, &requests[requestCount++]);
+    if (receiveRight) MPI_Irecv(receiveRight, count, MPI_FLOAT, right, 0, m_Communicator, &requests[requestCount++]);
+
+    // Tag 0 travels leftwards, tag 1 rightwards
+    if (sendLeft) MPI_Isend(sendLeft, count, MPI_FLOAT, left, 0, m_Communicator, &requests[requestCount++]);
+    if (sendRight) MPI_Isend(sendRight, count, MPI_FLOAT, right, 1, m_Communicator, &requests[requestCount++]);
+
+    MPI_Waitall(requestCount, requests, MPI_STATUSES_IGNORE);
+}
+
+float MpiTransport::AllReduceMax(float value)
+{
+    float result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_FLOAT, MPI_MAX, m_Communicator);
+    return result;
+}
+
+void MpiTransport::Gather(const float* send, int count, std::vector<float>& receive)
+{
+    std::vector<int> counts(m_Rank == 0 ? m_RankCount : 0);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, m_Communicator);
+
+    std::vector<int> offsets(counts.size(), 0);
+    int total = 0;
+    for (size_t rank = 0; rank < counts.size(); rank++) {
+        offsets[rank] = total;
+        total += counts[rank];
+    }
+
+    receive.assign(total, 0.0f);
+    MPI_Gatherv(send, count, MPI_FLOAT, receive.data(), counts.data(), offsets.data(), MPI_FLOAT, 0, m_Communicator);
+}
+
+void MpiTransport::Barrier()
+{
+    MPI_Barrier(m_Communicator);
+}
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#if defined(CFD_WITH_MPI)
+
+#include <mpi.h>
+#include "HaloTransport.h"
+
+// Multi-node transport over MPI. The caller owns MPI_Init / MPI_Finalize.
+class MpiTransport : public HaloTransport {
+public:
+    explicit MpiTransport(MPI_Comm communicator = MPI_COMM_WORLD);
+
+    int GetRank() const override { return m_Rank; }
+    int GetRankCount() const override { return m_RankCount; }
+
+    void ExchangeHalos(const float* sendLeft, float* receiveLeft, const float* sendRight, float* receiveRight, int count) override;
+    float AllReduceMax(float value) override;
+    void Gather(const float* send, int count, std::vector<float>& receive) override;
+    void Barrier() override;
+
+private:
+    MPI_Comm m_Communicator;
+    int m_Rank = 0;
+    int m_RankCount = 1;
+};
+
+#endif
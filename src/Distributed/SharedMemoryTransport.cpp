@@ -0,0 +1,211 @@
+#include "SharedMemoryTransport.h"
+
+#if defined(CFD_HAS_SHARED_MEMORY_TRANSPORT)
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int ReductionStride = 16; // Floats per reduction slot, keeps ranks on separate cache lines
+
+struct SegmentHeader {
+    int RankCount;
+    int MaxExchange;
+    int MaxGather;
+    pthread_barrier_t Barrier;
+};
+
+size_t AlignUp(size_t value)
+{
+    return (value + 63) & ~(size_t)63;
+}
+
+size_t GetSegmentSize(int rankCount, int maxExchange, int maxGather)
+{
+    size_t size = AlignUp(sizeof(SegmentHeader));
+    size += AlignUp(sizeof(float) * rankCount * 2 * maxExchange);
+    size += AlignUp(sizeof(float) * rankCount * ReductionStride);
+    size += AlignUp(sizeof(int) * rankCount);
+    size += AlignUp(sizeof(float) * rankCount * maxGather);
+    return size;
+}
+
+}
+
+bool SharedMemoryTransport::CreateSegment(const std::string& name, int rankCount, int maxExchange, int maxGather)
+{
+    // Calls go over in rounds of one mailbox / slot, which therefore cannot be empty
+    if (rankCount < 1 || maxExchange < 1 || maxGather < 1) {
+        std::cerr << "ERROR::SHM_TRANSPORT:: Segment " << name << " needs at least one rank and one float per mailbox and slot" << std::endl;
+        return false;
+    }
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "ERROR::SHM_TRANSPORT:: Cannot create segment " << name << std::endl;
+        return false;
+    }
+
+    size_t size = GetSegmentSize(rankCount, maxExchange, maxGather);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    SegmentHeader* header = static_cast<SegmentHeader*>(base);
+    header->RankCount = rankCount;
+    header->MaxExchange = maxExchange;
+    header->MaxGather = maxGather;
+
+    pthread_barrierattr_t attributes;
+    pthread_barrierattr_init(&attributes);
+    pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&header->Barrier, &attributes, (unsigned int)rankCount);
+    pthread_barrierattr_destroy(&attributes);
+
+    munmap(base, size);
+    return true;
+}
+
+void SharedMemoryTransport::RemoveSegment(const std::string& name)
+{
+    shm_unlink(name.c_str());
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const std::string& name, int rank)
+    : m_Rank(rank)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "ERROR::SHM_TRANSPORT:: Cannot open segment " << name << std::endl;
+        return;
+    }
+
+    struct stat info;
+    fstat(fd, &info);
+    m_MappedSize = (size_t)info.st_size;
+
+    void* base = mmap(nullptr, m_MappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+    m_Base = base;
+
+    const SegmentHeader* header = static_cast<const SegmentHeader*>(m_Base);
+    m_RankCount = header->RankCount;
+    m_MaxExchange = header->MaxExchange;
+    m_MaxGather = header->MaxGather;
+
+    char* cursor = static_cast<char*>(m_Base) + AlignUp(sizeof(SegmentHeader));
+    m_Mailboxes = reinterpret_cast<float*>(cursor);
+    cursor += AlignUp(sizeof(float) * m_RankCount * 2 * m_MaxExchange);
+    m_Reductions = reinterpret_cast<float*>(cursor);
+    cursor += AlignUp(sizeof(float) * m_RankCount * ReductionStride);
+    m_GatherCounts = reinterpret_cast<int*>(cursor);
+    cursor += AlignUp(sizeof(int) * m_RankCount);
+    m_GatherData = reinterpret_cast<float*>(cursor);
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+    if (m_Base) munmap(m_Base, m_MappedSize);
+}
+
+float* SharedMemoryTransport::GetMailbox(int rank, int direction) const
+{
+    return m_Mailboxes + ((size_t)rank * 2 + direction) * m_MaxExchange;
+}
+
+void SharedMemoryTransport::Barrier()
+{
+    pthread_barrier_wait(&static_cast<SegmentHeader*>(m_Base)->Barrier);
+}
+
+void SharedMemoryTransport::ExchangeHalos(const float* sendLeft, float* receiveLeft, const float* sendRight, float* receiveRight, int count)
+{
+    // Neighbours exchange equal counts, so every rank takes the same number of mailbox-sized rounds
+    for (int begin = 0; begin < count; begin += m_MaxExchange) {
+        size_t bytes = sizeof(float) * std::min(count - begin, m_MaxExchange);
+        if (sendLeft) std::memcpy(GetMailbox(m_Rank, 0), sendLeft + begin, bytes);
+        if (sendRight) std::memcpy(GetMailbox(m_Rank, 1), sendRight + begin, bytes);
+
+        Barrier();
+
+        // The left neighbour posted towards its right, the right neighbour towards its left
+        if (receiveLeft) std::memcpy(receiveLeft + begin, GetMailbox(m_Rank - 1, 1), bytes);
+        if (receiveRight) std::memcpy(receiveRight + begin, GetMailbox(m_Rank + 1, 0), bytes);
+
+        // Mailboxes may only be overwritten once every rank has read them
+        Barrier();
+    }
+}
+
+float SharedMemoryTransport::AllReduceMax(float value)
+{
+    m_Reductions[m_Rank * ReductionStride] = value;
+    Barrier();
+
+    float result = m_Reductions[0];
+    for (int rank = 1; rank < m_RankCount; rank++) {
+        result = std::max(result, m_Reductions[rank * ReductionStride]);
+    }
+
+    Barrier();
+    return result;
+}
+
+void SharedMemoryTransport::Gather(const float* send, int count, std::vector<float>& receive)
+{
+    // Blocks can differ in size, so the counts go first: they fix the number of slot-sized rounds and where each
+    // block lands in 'receive'
+    m_GatherCounts[m_Rank] = count;
+    Barrier();
+
+    int rounds = 0;
+    size_t total = 0;
+    for (int rank = 0; rank < m_RankCount; rank++) {
+        rounds = std::max(rounds, (m_GatherCounts[rank] + m_MaxGather - 1) / m_MaxGather);
+        total += (size_t)m_GatherCounts[rank];
+    }
+
+    receive.clear();
+    if (m_Rank == 0) receive.resize(total);
+
+    for (int round = 0; round < rounds; round++) {
+        int begin = round * m_MaxGather;
+        int part = std::max(0, std::min(count - begin, m_MaxGather));
+        std::memcpy(m_GatherData + (size_t)m_Rank * m_MaxGather, send + begin, sizeof(float) * part);
+
+        Barrier();
+
+        if (m_Rank == 0) {
+            size_t offset = 0;
+            for (int rank = 0; rank < m_RankCount; rank++) {
+                int blockPart = std::max(0, std::min(m_GatherCounts[rank] - begin, m_MaxGather));
+                const float* slot = m_GatherData + (size_t)rank * m_MaxGather;
+                std::copy(slot, slot + blockPart, receive.begin() + offset + begin);
+                offset += (size_t)m_GatherCounts[rank];
+            }
+        }
+
+        // Slots and counts may only be overwritten once rank 0 has read them
+        Barrier();
+    }
+    if (rounds == 0) Barrier();
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#if defined(__linux__)
+#define CFD_HAS_SHARED_MEMORY_TRANSPORT 1
+
+#include <string>
+#include "HaloTransport.h"
+
+// Single-node transport: all ranks map one POSIX shared memory segment holding per-rank mailboxes,
+// reduction slots and a process-shared barrier. The segment is created once (before the ranks start)
+// and every rank then attaches to it by name.
+class SharedMemoryTransport : public HaloTransport {
+public:
+    // maxExchange / maxGather are the float counts one mailbox / gather slot holds. Sizing them for the largest
+    // ExchangeHalos / Gather call keeps each call to one round; larger calls are split into several.
+    static bool CreateSegment(const std::string& name, int rankCount, int maxExchange, int maxGather);
+    static void RemoveSegment(const std::string& name);
+
+    SharedMemoryTransport(const std::string& name, int rank);
+    ~SharedMemoryTransport() override;
+
+    bool IsValid() const { return m_Base != nullptr; }
+
+    int GetRank() const override { return m_Rank; }
+    int GetRankCount() const override { return m_RankCount; }
+
+    void ExchangeHalos(const float* sendLeft, float* receiveLeft, const float* sendRight, float* receiveRight, int count) override;
+    float AllReduceMax(float value) override;
+    void Gather(const float* send, int count, std::vector<float>& receive) override;
+    void Barrier() override;
+
+private:
+    float* GetMailbox(int rank, int direction) const;
+
+private:
+    void* m_Base = nullptr;
+    size_t m_MappedSize = 0;
+
+    int m_Rank = 0;
+    int m_RankCount = 0;
+    int m_MaxExchange = 0;
+    int m_MaxGather = 0;
+
+    float* m_Mailboxes = nullptr;  // [rank][direction][MaxExchange], direction 0 = towards rank - 1
+    float* m_Reductions = nullptr; // One cache line per rank
+    int* m_GatherCounts = nullptr;
+    float* m_GatherData = nullptr; // [rank][MaxGather]
+};
+
+#endif
@@ -0,0 +1,321 @@
+#include "DomainBoundaries.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Fixed seeds keep turbulent inflow reproducible between runs
+constexpr unsigned int EddySeed = 0x5E3D1u;
+
+bool IsHorizontalNormal(int side)
+{
+    return side == (int)BoundarySide::Left || side == (int)BoundarySide::Right;
+}
+
+// Jarrin's tent shape function, normalised so that its square integrates to one over [-1, 1]
+float EddyShape(float r)
+{
+    float a = std::abs(r);
+    return a < 1.0f ? 1.2247449f * (1.0f - a) : 0.0f;
+}
+
+}
+
+void BoundarySettings::SetType(BoundarySide side, BoundaryType type)
+{
+    // Left / Right and Bottom / Top differ only in the lowest bit
+    int index = (int)side;
+    int opposite = index ^ 1;
+
+    if (type == BoundaryType::Periodic) {
+        Types[opposite] = BoundaryType::Periodic;
+    } else if (Types[index] == BoundaryType::Periodic) {
+        Types[opposite] = type == BoundaryType::Inflow ? BoundaryType::Outflow : type;
+    }
+    Types[index] = type;
+}
+
+bool BoundarySettings::operator==(const BoundarySettings& other) const
+{
+    return std::equal(Types, Types + 4, other.Types) && std::equal(Profiles, Profiles + 4, other.Profiles) &&
+           RoughnessLength == other.RoughnessLength && ReferenceHeight == other.ReferenceHeight &&
+           TurbulenceIntensity == other.TurbulenceIntensity && EddySize == other.EddySize && EddyCount == other.EddyCount;
+}
+
+void SyntheticEddies::Reset(int count, float size, unsigned int seed)
+{
+    m_Size = std::max(size, 1e-3f);
+    m_Random.seed(seed);
+    m_Eddies.resize(std::max(count, 1));
+    for (Eddy& eddy : m_Eddies) Respawn(eddy, true);
+
+    // The box spans 2 * size across the plane and 1 + 2 * size along it; scale the sum to unit variance
+    float variance = m_Eddies.size() * 0.5f * m_Size / (1.0f + 2.0f * m_Size);
+    m_Scale = 1.0f / std::sqrt(variance);
+}
+
+void SyntheticEddies::Advance(float distance)
+{
+    for (Eddy& eddy : m_Eddies) {
+        eddy.X += distance;
+        if (eddy.X > m_Size) Respawn(eddy, false);
+    }
+}
+
+void SyntheticEddies::Sample(float t, float& normal, float& tangent) const
+{
+    normal = 0.0f;
+    tangent = 0.0f;
+    float inverseSize = 1.0f / m_Size;
+    for (const Eddy& eddy : m_Eddies) {
+        float weight = EddyShape(eddy.X * inverseSize) * EddyShape((t - eddy.Y) * inverseSize);
+        normal += eddy.SignNormal * weight;
+        tangent += eddy.SignTangent * weight;
+    }
+    normal *= m_Scale;
+    tangent *= m_Scale;
+}
+
+void SyntheticEddies::Respawn(Eddy& eddy, bool anywhere)
+{
+    std::uniform_real_distribution<float> across(-m_Size, m_Size);
+    std::uniform_real_distribution<float> along(-m_Size, 1.0f + m_Size);
+    std::bernoulli_distribution sign(0.5);
+
+    // New eddies enter at the upstream face of the box
+    eddy.X = anywhere ? across(m_Random) : -m_Size;
+    eddy.Y = along(m_Random);
+    eddy.SignNormal = sign(m_Random) ? 1.0f : -1.0f;
+    eddy.SignTangent = sign(m_Random) ? 1.0f : -1.0f;
+}
+
+void DomainBoundaries::Configure(const BoundarySettings& settings, int width, int height, int domainWidth, int columnOffset)
+{
+    if (domainWidth <= 0) domainWidth = width;
+    if (settings == m_Settings && width == m_Width && height == m_Height && domainWidth == m_DomainWidth &&
+        columnOffset == m_ColumnOffset) {
+        return;
+    }
+    m_Settings = settings;
+    m_Width = width;
+    m_Height = height;
+    m_DomainWidth = domainWidth;
+    m_ColumnOffset = columnOffset;
+    m_HoldsSide[(int)BoundarySide::Left] = columnOffset == 0;
+    m_HoldsSide[(int)BoundarySide::Right] = columnOffset + width == domainWidth;
+
+    m_Lines[(int)BoundarySide::Left]   = { width, width, 1, width - 2, height - 2 };
+    m_Lines[(int)BoundarySide::Right]  = { 2 * width - 1, width, -1, -(width - 2), height - 2 };
+    m_Lines[(int)BoundarySide::Bottom] = { 1, 1, width, (height - 2) * width, width - 2 };
+    m_Lines[(int)BoundarySide::Top]    = { 1 + (height - 1) * width, 1, -width, -(height - 2) * width, width - 2 };
+
+    for (int side = 0; side < 4; side++) {
+        for (int field = 0; field < (int)BoundaryField::Count; field++) {
+            m_Rules[field][side] = GetRule(settings.Types[side], (BoundarySide)side, (BoundaryField)field);
+        }
+
+        int count = m_Lines[side].Count;
+        m_OutflowX[side].assign(count, 0.0f);
+        m_OutflowY[side].assign(count, 0.0f);
+        m_ProfileShape[side].assign(count, 1.0f);
+        m_Eddies[side].Reset(settings.EddyCount, settings.EddySize, EddySeed + side);
+
+        if (settings.Types[side] != BoundaryType::Inflow || settings.Profiles[side] != InflowProfile::LogLaw) continue;
+
+        // Distance from the adjacent no-slip wall: the nearer one if both sides are walls, the lower side if neither is
+        bool horizontal = IsHorizontalNormal(side);
+        bool wallLow = settings.Types[horizontal ? (int)BoundarySide::Bottom : (int)BoundarySide::Left] == BoundaryType::NoSlip;
+        bool wallHigh = settings.Types[horizontal ? (int)BoundarySide::Top : (int)BoundarySide::Right] == BoundaryType::NoSlip;
+        int length = horizontal ? height : domainWidth;
+        int first = horizontal ? 0 : columnOffset; // Of the side's first ghost cell, counted along the whole side
+
+        float roughness = std::max(settings.RoughnessLength, 1e-5f);
+        float reference = std::log((std::max(settings.ReferenceHeight, 1e-4f) + roughness) / roughness);
+        for (int n = 0; n < count; n++) {
+            float fromLow = (first + n + 0.5f) / (length - 2);
+            float fromHigh = (length - 2.5f - (first + n)) / (length - 2);
+            float distance = fromLow;
+            if (wallHigh) distance = wallLow ? std::min(fromLow, fromHigh) : fromHigh;
+            m_ProfileShape[side][n] = std::log((std::max(distance, 0.0f) + roughness) / roughness) / reference;
+        }
+    }
+    m_OutflowPrimed = false;
+}
+
+void DomainBoundaries::Reset()
+{
+    for (int side = 0; side < 4; side++) {
+        std::fill(m_OutflowX[side].begin(), m_OutflowX[side].end(), 0.0f);
+        std::fill(m_OutflowY[side].begin(), m_OutflowY[side].end(), 0.0f);
+        m_Eddies[side].Reset(m_Settings.EddyCount, m_Settings.EddySize, EddySeed + side);
+    }
+    m_OutflowPrimed = false;
+}
+
+DomainBoundaries::GhostRule DomainBoundaries::GetRule(BoundaryType type, BoundarySide side, BoundaryField field)
+{
+    BoundaryField normal = IsHorizontalNormal((int)side) ? BoundaryField::VelocityX : BoundaryField::VelocityY;
+    bool velocity = field == BoundaryField::VelocityX || field == BoundaryField::VelocityY;
+
+    switch (type) {
+    case BoundaryType::Inflow:
+        return GhostRule::Copy; // Velocity and scalars are overwritten by the inflow and emitters after each step
+    case BoundaryType::Outflow:
+        return field == BoundaryField::Pressure ? GhostRule::Zero : GhostRule::Copy;
+    case BoundaryType::ConvectiveOutflow:
+        if (field == BoundaryField::Pressure) return GhostRule::Zero;
+        return velocity ? GhostRule::Fixed : GhostRule::Copy;
+    case BoundaryType::FreeSlip:
+        return field == normal ? GhostRule::Negate : GhostRule::Copy;
+    case BoundaryType::NoSlip:
+        return velocity ? GhostRule::Negate : GhostRule::Copy;
+    case BoundaryType::Periodic:
+        return GhostRule::Wrap;
+    default:
+        return GhostRule::Copy;
+    }
+}
+
+void DomainBoundaries::Apply(BoundaryField field, float* values, bool homogeneous) const
+{
+    for (int side = 0; side < 4; side++) {
+        if (!m_HoldsSide[side]) continue;
+
+        const SideLine& line = m_Lines[side];
+        float* ghost = values + line.Start;
+        int stride = line.Stride;
+
+        GhostRule rule = m_Rules[(int)field][side];
+        if (homogeneous && rule == GhostRule::Fixed) rule = GhostRule::Zero;
+
+        switch (rule) {
+        case GhostRule::Copy:
+            for (int n = 0; n < line.Count; n++) ghost[n * stride] = ghost[n * stride + line.Inward];
+            break;
+        case GhostRule::Negate:
+            for (int n = 0; n < line.Count; n++) ghost[n * stride] = -ghost[n * stride + line.Inward];
+            break;
+        case GhostRule::Zero:
+            for (int n = 0; n < line.Count; n++) ghost[n * stride] = 0.0f;
+            break;
+        case GhostRule::Wrap:
+            for (int n = 0; n < line.Count; n++) ghost[n * stride] = ghost[n * stride + line.Wrap];
+            break;
+        case GhostRule::Fixed: {
+            const float* fixed = field == BoundaryField::VelocityX ? m_OutflowX[side].data() : m_OutflowY[side].data();
+            for (int n = 0; n < line.Count; n++) ghost[n * stride] = fixed[n];
+            break;
+        }
+        }
+    }
+
+    // Corners (average of neighbors)
+    int w = m_Width, h = m_Height;
+    if (m_HoldsSide[(int)BoundarySide::Left]) {
+        values[0]                 = 0.5f * (values[1] + values[w]);
+        values[(h - 1) * w]       = 0.5f * (values[1 + (h - 1) * w] + values[(h - 2) * w]);
+    }
+    if (m_HoldsSide[(int)BoundarySide::Right]) {
+        values[w - 1]               = 0.5f * (values[w - 2] + values[w - 1 + w]);
+        values[w - 1 + (h - 1) * w] = 0.5f * (values[w - 2 + (h - 1) * w] + values[w - 1 + (h - 2) * w]);
+    }
+}
+
+void DomainBoundaries::Advance(const float* velocityX, const float* velocityY, float inflowVelocity, float deltaTime)
+{
+    for (int side = 0; side < 4; side++) {
+        const SideLine& line = m_Lines[side];
+        bool horizontal = IsHorizontalNormal(side);
+        int across = horizontal ? m_DomainWidth : m_Height;
+        int along = horizontal ? m_Height : m_DomainWidth;
+
+        if (m_Settings.Types[side] == BoundaryType::ConvectiveOutflow && m_HoldsSide[side]) {
+            // Mean outward speed through the side, in the solver's advection units
+            const float* normal = horizontal ? velocityX : velocityY;
+            float outward = (side == (int)BoundarySide::Right || side == (int)BoundarySide::Top) ? 1.0f : -1.0f;
+            float speed = 0.0f;
+            for (int n = 0; n < line.Count; n++) speed += normal[line.Start + n * line.Stride + line.Inward];
+            speed = std::max(0.0f, outward * speed / line.Count);
+            float courant = std::min(1.0f, speed * deltaTime * (across - 2));
+
+            // Upwind step of dphi/dt + U dphi/dn = 0 with the adjacent interior cell upstream
+            float* ghostX = m_OutflowX[side].data();
+            float* ghostY = m_OutflowY[side].data();
+            for (int n = 0; n < line.Count; n++) {
+                int interior = line.Start + n * line.Stride + line.Inward;
+                float weight = m_OutflowPrimed ? courant : 1.0f;
+                ghostX[n] += weight * (velocityX[interior] - ghostX[n]);
+                ghostY[n] += weight * (velocityY[interior] - ghostY[n]);
+            }
+        }
+
+        if (m_Settings.Types[side] == BoundaryType::Inflow && m_Settings.Profiles[side] == InflowProfile::SyntheticEddies) {
+            m_Eddies[side].Advance(inflowVelocity * deltaTime * (across - 2) / (along - 2));
+        }
+    }
+    m_OutflowPrimed = true;
+}
+
+void DomainBoundaries::ApplyInflow(float* velocityX, float* velocityY, float inflowVelocity) const
+{
+    for (int side = 0; side < 4; side++) {
+        if (m_Settings.Types[side] != BoundaryType::Inflow || !m_HoldsSide[side]) continue;
+
+        const SideLine& line = m_Lines[side];
+        bool horizontal = IsHorizontalNormal(side);
+        int first = horizontal ? 0 : m_ColumnOffset;
+        int length = horizontal ? m_Height : m_DomainWidth;
+        float* normalField = horizontal ? velocityX : velocityY;
+        float* tangentField = horizontal ? velocityY : velocityX;
+        float inward = (side == (int)BoundarySide::Left || side == (int)BoundarySide::Bottom) ? 1.0f : -1.0f;
+        bool eddies = m_Settings.Profiles[side] == InflowProfile::SyntheticEddies;
+        float fluctuation = m_Settings.TurbulenceIntensity * inflowVelocity;
+
+        for (int n = 0; n < line.Count; n++) {
+            float normal = inflowVelocity * m_ProfileShape[side][n];
+            float tangent = 0.0f;
+            if (eddies) {
+                float normalEddy, tangentEddy;
+                m_Eddies[side].Sample((first + n + 0.5f) / (length - 2), normalEddy, tangentEddy);
+                normal += fluctuation * normalEddy;
+                tangent = fluctuation * tangentEddy;
+            }
+
+            int ghost = line.Start + n * line.Stride;
+            int interior = ghost + line.Inward;
+            normalField[ghost] = normalField[interior] = inward * normal;
+            tangentField[ghost] = tangentField[interior] = tangent;
+        }
+    }
+}
+
+void DomainBoundaries::ClearInflow(float* values) const
+{
+    for (int side = 0; side < 4; side++) {
+        if (m_Settings.Types[side] != BoundaryType::Inflow || !m_HoldsSide[side]) continue;
+
+        const SideLine& line = m_Lines[side];
+        for (int n = 0; n < line.Count; n++) values[line.Start + n * line.Stride] = 0.0f;
+    }
+}
+
+void DomainBoundaries::FillSideBand(BoundarySide side, float begin, float end, float value, float* values) const
+{
+    if (!m_HoldsSide[(int)side]) return;
+
+    const SideLine& line = m_Lines[(int)side];
+    bool horizontal = IsHorizontalNormal((int)side);
+    int length = horizontal ? m_Height : m_DomainWidth;
+    int first = horizontal ? 0 : m_ColumnOffset;
+    float bandBegin = length * begin;
+    float bandEnd = length * end;
+
+    for (int n = 0; n < line.Count; n++) {
+        // Cell coordinate along the whole side, counting the corner ghost
+        int coordinate = first + n + 1;
+        if (coordinate > bandBegin && coordinate < bandEnd) {
+            int ghost = line.Start + n * line.Stride;
+            values[ghost] = values[ghost + line.Inward] = value;
+        }
+    }
+}
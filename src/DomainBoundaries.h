@@ -0,0 +1,149 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+enum class BoundarySide { Left = 0, Right = 1, Bottom = 2, Top = 3, Count = 4 };
+
+enum class BoundaryType {
+    Inflow = 0,            // Prescribed profile, zero-gradient pressure
+    Outflow = 1,           // Zero-gradient velocity, p = 0
+    ConvectiveOutflow = 2, // Velocity carried out by the mean outflow speed (dphi/dt + U dphi/dn = 0), p = 0
+    FreeSlip = 3,
+    NoSlip = 4,
+    Periodic = 5,          // Always paired with the opposite side
+    Count = 6
+};
+
+enum class InflowProfile {
+    Uniform = 0,
+    LogLaw = 1,          // Grows logarithmically away from the nearest adjacent no-slip wall
+    SyntheticEddies = 2, // Uniform mean plus synthetic eddy fluctuations (Jarrin et al.)
+    Count = 3
+};
+
+// Which ghost-cell rule applies: matches the solver's boundaryType argument
+enum class BoundaryField { Scalar = 0, VelocityX = 1, VelocityY = 2, Pressure = 3, Count = 4 };
+
+struct BoundarySettings {
+    BoundaryType Types[4] = { BoundaryType::Inflow, BoundaryType::Outflow, BoundaryType::FreeSlip, BoundaryType::FreeSlip };
+    InflowProfile Profiles[4] = {};
+
+    // Log-law: roughness length and the height at which the inflow velocity is reached, as fractions of the side
+    float RoughnessLength = 0.01f;
+    float ReferenceHeight = 0.5f;
+
+    // Synthetic eddies: RMS fluctuation relative to the inflow velocity, eddy radius as a fraction of the side
+    float TurbulenceIntensity = 0.1f;
+    float EddySize = 0.05f;
+    int EddyCount = 64;
+
+    // Sets one side, keeping periodic sides paired: the opposite side follows into and out of Periodic
+    void SetType(BoundarySide side, BoundaryType type);
+
+    bool operator==(const BoundarySettings& other) const;
+    bool operator!=(const BoundarySettings& other) const { return !(*this == other); }
+};
+
+// Synthetic eddy method: eddies of random sign drift through a thin virtual box around the inflow plane and
+// their summed shape functions give a fluctuating but spatially correlated profile with unit variance
+class SyntheticEddies {
+public:
+    void Reset(int count, float size, unsigned int seed);
+
+    // 'distance' is how far the mean flow moved, in units of the side length
+    void Advance(float distance);
+
+    // Fluctuations at 't' (0..1 along the side), normal and tangential to it
+    void Sample(float t, float& normal, float& tangent) const;
+
+private:
+    struct Eddy {
+        float X, Y;
+        float SignNormal, SignTangent;
+    };
+
+    void Respawn(Eddy& eddy, bool anywhere);
+
+private:
+    std::vector<Eddy> m_Eddies;
+    float m_Size = 0.05f;
+    float m_Scale = 1.0f;
+    std::mt19937 m_Random;
+};
+
+// Ghost-cell layer of the 2D solver for any mix of side conditions. The rule for each side and field is
+// resolved when the settings change, so filling the ghost layer is a straight loop per side.
+class DomainBoundaries {
+public:
+    // Cheap when nothing changed; otherwise resets eddies and convective outflow state. A grid can be columns
+    // columnOffset .. columnOffset + width - 1 of a domain 'domainWidth' wide (see FluidSolver::SetSlab): then only the
+    // sides it reaches are filled, and profiles and bands along the bottom and top are placed in the whole domain.
+    // 0 stands for the grid's own width.
+    void Configure(const BoundarySettings& settings, int width, int height, int domainWidth = 0, int columnOffset = 0);
+    const BoundarySettings& GetSettings() const { return m_Settings; }
+
+    int GetDomainWidth() const { return m_DomainWidth; }
+    int GetColumnOffset() const { return m_ColumnOffset; }
+    bool HoldsSide(BoundarySide side) const { return m_HoldsSide[(int)side]; }
+
+    // Back to the state right after Configure: eddies restart from their seed, convective outflow from rest
+    void Reset();
+
+    bool IsPeriodicX() const { return m_Settings.Types[(int)BoundarySide::Left] == BoundaryType::Periodic; }
+    bool IsPeriodicY() const { return m_Settings.Types[(int)BoundarySide::Bottom] == BoundaryType::Periodic; }
+
+    // Whether the pressure ghost cells of a side are held at zero (Dirichlet) rather than mirrored or wrapped
+    bool HasFixedPressure(BoundarySide side) const { return m_Rules[(int)BoundaryField::Pressure][(int)side] == GhostRule::Zero; }
+
+    // Fills the ghost layer of a width * height field. 'homogeneous' zeroes prescribed values (convective outflow),
+    // leaving the linear part of each condition, as needed for corrections in an iterative solve.
+    void Apply(BoundaryField field, float* values, bool homogeneous = false) const;
+
+    // Once per step, before it: moves the convective outflow values and the inflow eddies forward
+    void Advance(const float* velocityX, const float* velocityY, float inflowVelocity, float deltaTime);
+
+    // Writes the inflow profile into the ghost and first interior layer of every inflow side
+    void ApplyInflow(float* velocityX, float* velocityY, float inflowVelocity) const;
+
+    // Scalars enter clean: zeroes the ghost cells of every inflow side
+    void ClearInflow(float* values) const;
+
+    // Holds 'value' in the ghost and first interior cells along part of one side ('begin' to 'end' as fractions
+    // of its length)
+    void FillSideBand(BoundarySide side, float begin, float end, float value, float* values) const;
+
+private:
+    enum class GhostRule { Copy, Negate, Zero, Wrap, Fixed };
+
+    // Ghost cells of one side, corners excluded
+    struct SideLine {
+        int Start;  // First ghost cell
+        int Stride; // Along the side
+        int Inward; // Ghost to adjacent interior cell
+        int Wrap;   // Ghost to the interior cell it mirrors across a periodic domain
+        int Count;
+    };
+
+    static GhostRule GetRule(BoundaryType type, BoundarySide side, BoundaryField field);
+
+private:
+    BoundarySettings m_Settings;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_DomainWidth = 0;
+    int m_ColumnOffset = 0;
+    bool m_HoldsSide[4] = { true, true, true, true };
+
+    GhostRule m_Rules[(int)BoundaryField::Count][4] = {};
+    SideLine m_Lines[4] = {};
+
+    // Inflow velocity profile per side relative to the inflow speed, and eddies for turbulent inflow
+    std::vector<float> m_ProfileShape[4];
+    SyntheticEddies m_Eddies[4];
+
+    // Convected ghost velocities of convective outflow sides
+    std::vector<float> m_OutflowX[4];
+    std::vector<float> m_OutflowY[4];
+    bool m_OutflowPrimed = false;
+};
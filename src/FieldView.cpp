@@ -0,0 +1,35 @@
+#include "FieldView.h"
+#include <algorithm>
+
+FieldView FieldSlice::GetView() const
+{
+    FieldView view;
+    view.Width = Width;
+    view.Height = Height;
+    view.VelocityX = VelocityX.data();
+    view.VelocityY = VelocityY.data();
+    view.Pressure = Pressure.data();
+    view.DyeDensity = DyeDensity.data();
+    view.SolidMask = SolidMask.data();
+    view.Version = Version;
+    return view;
+}
+
+void FieldSlice::Assign(const FieldView& view)
+{
+    size_t cellCount = (size_t)view.Width * view.Height;
+    Width = view.Width;
+    Height = view.Height;
+
+    auto copy = [&](std::vector<float>& dest, const float* source) {
+        if (source) dest.assign(source, source + cellCount);
+        else dest.assign(cellCount, 0.0f);
+    };
+
+    copy(VelocityX, view.VelocityX);
+    copy(VelocityY, view.VelocityY);
+    copy(Pressure, view.Pressure);
+    copy(DyeDensity, view.DyeDensity);
+    copy(SolidMask, view.SolidMask);
+    Version++;
+}
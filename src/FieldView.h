@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Non-owning view of one 2D set of simulation fields (row-major, width * height).
+// Lets the renderer draw anything that can present the solver's layout, not just FluidSolver itself.
+struct FieldView {
+    int Width = 0;
+    int Height = 0;
+
+    const float* VelocityX = nullptr;
+    const float* VelocityY = nullptr;
+    const float* Pressure = nullptr;
+    const float* DyeDensity = nullptr;
+    const float* SolidMask = nullptr;
+
+    // Changes whenever the fields do (e.g. the solver step count), so consumers can cache results derived from them.
+    // 0 means unknown and is never treated as up to date.
+    uint64_t Version = 0;
+};
+
+// Owning 2D set of fields in the same layout, e.g. a slice of the volume or a published copy of the 2D solver
+struct FieldSlice {
+    int Width = 0;
+    int Height = 0;
+    std::vector<float> VelocityX;
+    std::vector<float> VelocityY;
+    std::vector<float> Pressure;
+    std::vector<float> DyeDensity;
+    std::vector<float> SolidMask;
+    uint64_t Version = 0; // Bumped by every ExtractSlice / Assign
+
+    FieldView GetView() const;
+
+    // Copies every field of 'view' (missing fields become zero)
+    void Assign(const FieldView& view);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "DomainBoundaries.h"
+#include "FieldView.h"
+#include "ScalarTransport.h"
+#include "Span.h"
+
+// What the simulation thread and UI need from a 2D engine, so Stable Fluids (FluidSolver) and lattice Boltzmann
+// (LatticeBoltzmannSolver) can be swapped. Fields are width * height, row-major with a one-cell ghost layer, and
+// in FluidSolver's units: velocity in domain widths (x) and heights (y) per second, viscosity in domain units.
+class FlowSolver {
+public:
+    virtual ~FlowSolver() = default;
+
+    virtual void Step(float deltaTime) = 0;
+
+    // Flow and scalars back to rest; parameters and obstacle are kept
+    virtual void Reset() = 0;
+
+    virtual int GetWidth() const = 0;
+    virtual int GetHeight() const = 0;
+    virtual const std::vector<float>& GetVelocityX() const = 0;
+    virtual const std::vector<float>& GetVelocityY() const = 0;
+    virtual const std::vector<float>& GetPressure() const = 0;
+    virtual const std::vector<float>& GetSolidMask() const = 0;
+    virtual const std::vector<float>& GetDyeDensity() const = 0;
+    virtual const std::vector<float>& GetScalar(int species) const = 0;
+    virtual FieldView GetFieldView() const = 0;
+
+    // Bumped by every Step and obstacle change
+    virtual uint64_t GetVersion() const = 0;
+
+    virtual void SetViscosity(float viscosity) = 0;
+    virtual void SetInflowVelocity(float velocity) = 0;
+    virtual void SetBoundarySettings(const BoundarySettings& settings) = 0;
+    virtual const BoundarySettings& GetBoundarySettings() const = 0;
+    virtual void SetSpecies(const std::vector<ScalarSpecies>& species) = 0;
+    virtual const std::vector<ScalarSpecies>& GetSpecies() const = 0;
+    virtual void SetObstacleMask(Span<const float> mask) = 0; // width * height, 1 = solid
+};
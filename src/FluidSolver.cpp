@@ -1,9 +1,133 @@
 #include "FluidSolver.h"
+#include "KernelFlags.h"
+#include "KernelProfiler.h"
+#include "SignedDistance.h"
+#include "ThreadPool.h"
 #include <algorithm>
 #include <cmath>
 
+namespace {
+
+// Closest a no-slip wall may get to a fluid cell centre, as a fraction of the spacing, before the
+// ghost-fluid coefficient 1 / theta is clamped
+constexpr float MinWallFraction = 0.1f;
+
+// Grid rows per task in the parallel kernels
+constexpr int RowGrain = 8;
+
+// Below this largest off-diagonal weight (times the coefficient) one explicit diffusion step stands in for the
+// implicit solve; the two differ by about its square
+constexpr float ExplicitDiffusionLimit = 0.05f;
+constexpr int MaxDiffusionIterations = 200;
+
+// A conjugate-gradient iteration streams about this many times the arrays of a relaxation sweep, and the direct
+// solver (two fast solves in doubles, each transforming forward and back) about this many sweeps, for the profiler's
+// traffic estimate
+constexpr double ConjugateGradientPasses = 3.0;
+constexpr double SpectralPasses = 8.0;
+
+// Bilinear resampling of a field's interior onto another grid over the same domain; ghost cells are left to the
+// caller. Cell centres sit at (i - 0.5) / (width - 2) of the domain on either grid.
+void ResampleInterior(const std::vector<float>& source, int sourceWidth, int sourceHeight, std::vector<float>& dest, int width, int height)
+{
+    float scaleX = (float)(sourceWidth - 2) / (width - 2);
+    float scaleY = (float)(sourceHeight - 2) / (height - 2);
+
+    ThreadPool::Get().ParallelFor(1, height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            float y = std::max(0.0f, std::min(0.5f + (j - 0.5f) * scaleY, sourceHeight - 1.0f));
+            int bottom = std::min((int)y, sourceHeight - 2);
+            float weightTop = y - bottom;
+
+            for (int i = 1; i < width - 1; i++) {
+                float x = std::max(0.0f, std::min(0.5f + (i - 0.5f) * scaleX, sourceWidth - 1.0f));
+                int left = std::min((int)x, sourceWidth - 2);
+                float weightRight = x - left;
+
+                const float* row = source.data() + left + bottom * sourceWidth;
+                dest[i + j * width] =
+                    (1.0f - weightRight) * ((1.0f - weightTop) * row[0] + weightTop * row[sourceWidth]) +
+                    weightRight * ((1.0f - weightTop) * row[1] + weightTop * row[sourceWidth + 1]);
+            }
+        }
+    });
+}
+
+// Area-weighted remap of an amount per cell area onto another grid over the same domain, skipping solid cells on
+// both sides: each fluid source cell's amount is shared among the fluid destination cells it overlaps, in
+// proportion to the overlap, so it is kept unless every cell it overlaps is solid. Ghost cells are left to the
+// caller.
+void RemapConservative(const std::vector<float>& source, const std::vector<float>& sourceMask, int sourceWidth, int sourceHeight,
+                       std::vector<float>& dest, const std::vector<float>& destMask, int width, int height)
+{
+    // In source cell lengths: source cell i spans [i - 1, i], destination cell i spans [(i - 1) ratio, i ratio].
+    // The index ranges below may take in a neighbour with no overlap, which counts for nothing.
+    double ratioX = (double)(sourceWidth - 2) / (width - 2);
+    double ratioY = (double)(sourceHeight - 2) / (height - 2);
+    auto overlap = [](double low, double high, double otherLow, double otherHigh) {
+        return std::max(0.0, std::min(high, otherHigh) - std::max(low, otherLow));
+    };
+
+    // Fluid destination area each source cell overlaps, zero where it has nothing to share
+    std::vector<double> fluidOverlap(source.size(), 0.0);
+    ThreadPool::Get().ParallelFor(1, sourceHeight - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            int firstY = std::max(1, (int)std::floor((j - 1) / ratioY));
+            int lastY = std::min(height - 2, (int)std::ceil(j / ratioY));
+            for (int i = 1; i < sourceWidth - 1; i++) {
+                int index = i + j * sourceWidth;
+                if (sourceMask[index] > 0.0f || source[index] == 0.0f) continue;
+
+                int firstX = std::max(1, (int)std::floor((i - 1) / ratioX));
+                int lastX = std::min(width - 2, (int)std::ceil(i / ratioX));
+                double area = 0.0;
+                for (int y = firstY; y <= lastY; y++) {
+                    double overlapY = overlap(j - 1, j, (y - 1) * ratioY, y * ratioY);
+                    for (int x = firstX; x <= lastX; x++) {
+                        if (destMask[x + y * width] > 0.0f) continue;
+                        area += overlapY * overlap(i - 1, i, (x - 1) * ratioX, x * ratioX);
+                    }
+                }
+                fluidOverlap[index] = area;
+            }
+        }
+    });
+
+    // Each fluid destination cell gathers its share of the source cells it overlaps
+    ThreadPool::Get().ParallelFor(1, height - 1, RowGrain, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            int firstJ = std::max(1, (int)std::floor((y - 1) * ratioY));
+            int lastJ = std::min(sourceHeight - 2, (int)std::ceil(y * ratioY));
+            for (int x = 1; x < width - 1; x++) {
+                int index = x + y * width;
+                if (destMask[index] > 0.0f) {
+                    dest[index] = 0.0f;
+                    continue;
+                }
+
+                int firstI = std::max(1, (int)std::floor((x - 1) * ratioX));
+                int lastI = std::min(sourceWidth - 2, (int)std::ceil(x * ratioX));
+                double amount = 0.0;
+                for (int j = firstJ; j <= lastJ; j++) {
+                    double overlapY = overlap(j - 1, j, (y - 1) * ratioY, y * ratioY);
+                    if (overlapY <= 0.0) continue;
+                    for (int i = firstI; i <= lastI; i++) {
+                        int sourceIndex = i + j * sourceWidth;
+                        if (fluidOverlap[sourceIndex] <= 0.0) continue;
+                        double shared = overlapY * overlap(i - 1, i, (x - 1) * ratioX, x * ratioX);
+                        amount += source[sourceIndex] * shared / fluidOverlap[sourceIndex];
+                    }
+                }
+                dest[index] = (float)(amount / (ratioX * ratioY));
+            }
+        }
+    });
+}
+
+}
+
 FluidSolver::FluidSolver(int width, int height)
-    : m_Width(width), m_Height(height), m_Size(width * height)
+    : m_Width(width), m_Height(height), m_Size(width * height), m_DomainWidth(width), m_ColumnEnd(width - 1)
 {
     m_VelocityX.resize(m_Size, 0.0f);
     m_VelocityXPrev.resize(m_Size, 0.0f);
@@ -11,10 +135,17 @@ FluidSolver::FluidSolver(int width, int height)
     m_VelocityYPrev.resize(m_Size, 0.0f);
     m_Pressure.resize(m_Size, 0.0f);
     m_Divergence.resize(m_Size, 0.0f);
-    m_DyeDensity.resize(m_Size, 0.0f);
-    m_DyeDensityPrev.resize(m_Size, 0.0f);
+    m_ScalarPrev.resize(m_Size, 0.0f);
     m_SolidMask.resize(m_Size, 0.0f); // 0.0 = fluid
+    m_SolidDistance.resize(m_Size, 0.0f);
+    m_FaceOpenX.resize(m_Size, 1.0f);
+    m_FaceOpenY.resize(m_Size, 1.0f);
+    m_EddyViscosity.resize(m_Size, 0.0f);
+    for (SolveWorkspace* workspace : { &m_WorkspaceX, &m_WorkspaceY, &m_ScalarWorkspace }) workspace->Resize(m_Size);
+    m_Boundaries.Configure(BoundarySettings(), width, height);
+    m_Scalars.Configure(ScalarTransport::GetDefaultSpecies(), width, height);
     InitObstacle();
+    BuildStepGraph();
 }
 
 FluidSolver::~FluidSolver()
@@ -22,6 +153,13 @@ FluidSolver::~FluidSolver()
 
 }
 
+void FluidSolver::SolveWorkspace::Resize(int size)
+{
+    for (std::vector<float>* buffer : { &CellDiffusion, &StencilDiagonal, &CouplingX, &CouplingY, &StencilActive, &Scratch }) {
+        buffer->resize(size, 0.0f);
+    }
+}
+
 int FluidSolver::GetIndex(int x, int y) const
 {
     x = std::max(0, std::min(x, m_Width - 1));
@@ -29,214 +167,767 @@ int FluidSolver::GetIndex(int x, int y) const
     return x + y * m_Width;
 }
 
+FieldView FluidSolver::GetFieldView() const
+{
+    FieldView view;
+    view.Width = m_Width;
+    view.Height = m_Height;
+    view.VelocityX = m_VelocityX.data();
+    view.VelocityY = m_VelocityY.data();
+    view.Pressure = m_Pressure.data();
+    view.DyeDensity = m_Scalars.GetValues(std::max(0, std::min(m_DisplayedSpecies, m_Scalars.GetSpeciesCount() - 1))).data();
+    view.SolidMask = m_SolidMask.data();
+    view.Version = m_Version;
+    return view;
+}
+
 void FluidSolver::Step(float dt)
 {
-    std::swap(m_VelocityX, m_VelocityXPrev);
-    std::swap(m_VelocityY, m_VelocityYPrev);
+    m_StepDeltaTime = dt;
+    for (SolveWorkspace* workspace : { &m_WorkspaceX, &m_WorkspaceY, &m_ScalarWorkspace }) workspace->DiffusionIterations = 0;
 
-    // Diffuse velocity (Viscosity)
-    Diffuse(1, m_VelocityX, m_VelocityXPrev, m_Viscosity, dt);
-    Diffuse(2, m_VelocityY, m_VelocityYPrev, m_Viscosity, dt);
+    if (m_SlabLink) m_StepGraph.RunInOrder();
+    else m_StepGraph.Run();
 
-    // Compute Pressure and remove divergence
-    Project(m_VelocityX, m_VelocityY, m_Pressure, m_Divergence);
+    m_LastDiffusionIterations = m_WorkspaceX.DiffusionIterations + m_WorkspaceY.DiffusionIterations + m_ScalarWorkspace.DiffusionIterations;
+    m_Version++;
+}
+
+void FluidSolver::BuildStepGraph()
+{
+    // In the order of a serial step. The scalars only meet the velocity again at their advection, so their
+    // diffusion overlaps the whole velocity update, and the two components diffuse and advect side by side.
+    TaskGraph& graph = m_StepGraph;
+    graph.Add("Advance Boundaries", { &m_VelocityX, &m_VelocityY }, { &m_Boundaries }, [this] {
+        m_Boundaries.Advance(m_VelocityX.data(), m_VelocityY.data(), m_InflowVelocity, m_StepDeltaTime);
+    });
+
+    auto swapVelocity = [this] {
+        std::swap(m_VelocityX, m_VelocityXPrev);
+        std::swap(m_VelocityY, m_VelocityYPrev);
+    };
+    graph.Add("Swap Velocity", {}, { &m_VelocityX, &m_VelocityY, &m_VelocityXPrev, &m_VelocityYPrev }, swapVelocity);
 
-    std::swap(m_VelocityX, m_VelocityXPrev);
-    std::swap(m_VelocityY, m_VelocityYPrev);
+    // Diffuse velocity (Viscosity)
+    graph.Add("Eddy Viscosity", { &m_VelocityXPrev, &m_VelocityYPrev, &m_Boundaries }, { &m_EddyViscosity }, [this] {
+        if (m_TurbulenceModel != TurbulenceModel::None) ComputeEddyViscosity(m_VelocityXPrev, m_VelocityYPrev);
+    });
+    graph.Add("Diffuse X", { &m_VelocityXPrev, &m_EddyViscosity, &m_Boundaries }, { &m_VelocityX, &m_WorkspaceX }, [this] {
+        Diffuse(m_WorkspaceX, BoundaryField::VelocityX, m_VelocityX, m_VelocityXPrev, m_Viscosity, m_StepDeltaTime);
+    });
+    graph.Add("Diffuse Y", { &m_VelocityYPrev, &m_EddyViscosity, &m_Boundaries }, { &m_VelocityY, &m_WorkspaceY }, [this] {
+        Diffuse(m_WorkspaceY, BoundaryField::VelocityY, m_VelocityY, m_VelocityYPrev, m_Viscosity, m_StepDeltaTime);
+    });
+
+    // Compute Pressure and remove divergence, then again after advection to keep it mass-conserving
+    auto project = [this] { Project(m_VelocityX, m_VelocityY, m_Pressure, m_Divergence); };
+    std::initializer_list<TaskGraph::Resource> projectWrites = { &m_VelocityX, &m_VelocityY, &m_Pressure, &m_Divergence, &m_WorkspaceX, &m_SpectralSolver };
+    graph.Add("Project", { &m_Boundaries }, projectWrites, project);
+    graph.Add("Swap Velocity", {}, { &m_VelocityX, &m_VelocityY, &m_VelocityXPrev, &m_VelocityYPrev }, swapVelocity);
 
     // Advect velocity
-    Advect(1, m_VelocityX, m_VelocityXPrev, m_VelocityXPrev, m_VelocityYPrev, dt);
-    Advect(2, m_VelocityY, m_VelocityYPrev, m_VelocityXPrev, m_VelocityYPrev, dt);
+    graph.Add("Advect X", { &m_VelocityXPrev, &m_VelocityYPrev, &m_Boundaries }, { &m_VelocityX }, [this] {
+        Advect(BoundaryField::VelocityX, m_VelocityX, m_VelocityXPrev, m_VelocityXPrev, m_VelocityYPrev, m_StepDeltaTime);
+    });
+    graph.Add("Advect Y", { &m_VelocityXPrev, &m_VelocityYPrev, &m_Boundaries }, { &m_VelocityY }, [this] {
+        Advect(BoundaryField::VelocityY, m_VelocityY, m_VelocityYPrev, m_VelocityXPrev, m_VelocityYPrev, m_StepDeltaTime);
+    });
+    graph.Add("Project", { &m_Boundaries }, projectWrites, project);
 
-    // Project again to keep it mass-conserving
-    Project(m_VelocityX, m_VelocityY, m_Pressure, m_Divergence);
+    // Diffuse each scalar species at its own rate over the whole grid, then advect all of them in one pass over the
+    // tiles they occupy
+    graph.Add("Diffuse Scalars", { &m_Boundaries }, { &m_Scalars, &m_ScalarPrev, &m_ScalarWorkspace }, [this] {
+        bool diffused = false;
+        for (int species = 0; species < m_Scalars.GetSpeciesCount(); species++) {
+            float rate = m_Scalars.GetSpecies()[species].Diffusion;
+            if (rate <= 0.0f) continue;
 
-    // Advect and Diffuse Dye
-    std::swap(m_DyeDensity, m_DyeDensityPrev);
-    Diffuse(0, m_DyeDensity, m_DyeDensityPrev, m_Diffusion, dt);
+            std::vector<float>& values = m_Scalars.GetValues(species);
+            std::swap(values, m_ScalarPrev);
+            Diffuse(m_ScalarWorkspace, BoundaryField::Scalar, values, m_ScalarPrev, rate, m_StepDeltaTime);
+            diffused = true;
+        }
+        if (diffused) m_Scalars.RefreshActiveTiles();
+    });
+    graph.Add("Transport Scalars", { &m_VelocityX, &m_VelocityY, &m_Boundaries }, { &m_Scalars }, [this] {
+        // One pass per species over the occupied share of the grid
+        ProfileScope scope(ProfilePhase::ScalarTransport, m_Size);
+        m_Scalars.Advect(m_VelocityX.data(), m_VelocityY.data(), m_HasObstacle ? m_SolidMask.data() : nullptr, m_Boundaries, m_StepDeltaTime);
+        m_Scalars.Decay(m_StepDeltaTime);
+        scope.SetPasses((double)m_Scalars.GetSpeciesCount() * m_Scalars.GetActiveTileCount() / m_Scalars.GetTileCount());
+    });
 
-    std::swap(m_DyeDensity, m_DyeDensityPrev);
-    Advect(0, m_DyeDensity, m_DyeDensityPrev, m_VelocityX, m_VelocityY, dt);
+    // Apply forces, inflow and scalar emitters
+    graph.Add("Apply Inflow", { &m_Boundaries }, { &m_VelocityX, &m_VelocityY, &m_Scalars }, [this] { ApplyInflow(); });
+}
 
-    // Apply forces and inflow
-    ApplyInflow();
+void FluidSolver::Reset()
+{
+    for (std::vector<float>* field : { &m_VelocityX, &m_VelocityXPrev, &m_VelocityY, &m_VelocityYPrev, &m_Pressure,
+                                       &m_Divergence, &m_EddyViscosity, &m_ScalarPrev,
+                                       &m_WorkspaceX.Scratch, &m_WorkspaceY.Scratch, &m_ScalarWorkspace.Scratch }) {
+        std::fill(field->begin(), field->end(), 0.0f);
+    }
+    m_Scalars.Clear();
+    m_Boundaries.Reset();
+    m_Version++;
 }
 
-void FluidSolver::Advect(int boundaryType, std::vector<float>& destField, const std::vector<float>& sourceField,
-                        const std::vector<float>& velocityX, const std::vector<float>& velocityY, float deltaTime)
+void FluidSolver::Resize(int width, int height)
 {
-    float dt0_x = deltaTime * (m_Width - 2);
-    float dt0_y = deltaTime * (m_Height - 2);
+    Resize(width, height, [](FluidSolver&) {});
+}
 
-    for (int j = 1; j < m_Height - 1; j++) {
-        for (int i = 1; i < m_Width - 1; i++) {
+void FluidSolver::Resize(int width, int height, FunctionRef<void(FluidSolver&)> rebuildObstacle)
+{
+    if (width == m_Width && height == m_Height) return;
+    if (width < 4 || height < 4 || m_SlabLink) return;
 
-            if (m_SolidMask[GetIndex(i, j)] > 0.0f) {
-                destField[GetIndex(i, j)] = 0.0f;
-                continue;
-            }
+    int oldWidth = m_Width;
+    int oldHeight = m_Height;
+    std::vector<float> oldVelocityX = std::move(m_VelocityX);
+    std::vector<float> oldVelocityY = std::move(m_VelocityY);
+    std::vector<float> oldPressure = std::move(m_Pressure);
+    std::vector<float> oldMask = std::move(m_SolidMask);
+    std::vector<float> oldDistance = std::move(m_SolidDistance);
+    std::vector<std::vector<float>> oldScalars;
+    for (int species = 0; species < m_Scalars.GetSpeciesCount(); species++) oldScalars.push_back(std::move(m_Scalars.GetValues(species)));
 
-            // Backtrace
-            float x = i - dt0_x * velocityX[GetIndex(i, j)];
-            float y = j - dt0_y * velocityY[GetIndex(i, j)];
-
-            // Clamp to grid
-            if (x < 0.5f) x = 0.5f;
-            if (x > m_Width - 1.5f) x = m_Width - 1.5f;
-            if (y < 0.5f) y = 0.5f;
-            if (y > m_Height - 1.5f) y = m_Height - 1.5f;
-
-            // Bilinear interpolation indices
-            int cellLeft = (int)x;
-            int cellRight = cellLeft + 1;
-            int cellBottom = (int)y;
-            int cellTop = cellBottom + 1;
-
-            // Interpolation weights
-            float lerpWeightRight = x - cellLeft;
-            float lerpWeightLeft = 1.0f - lerpWeightRight;
-            float lerpWeightTop = y - cellBottom;
-            float lerpWeightBottom = 1.0f - lerpWeightTop;
-
-            // Sample source field
-            destField[GetIndex(i, j)] =
-                lerpWeightLeft * (lerpWeightBottom * sourceField[GetIndex(cellLeft, cellBottom)] + lerpWeightTop * sourceField[GetIndex(cellLeft, cellTop)]) +
-                lerpWeightRight * (lerpWeightBottom * sourceField[GetIndex(cellRight, cellBottom)] + lerpWeightTop * sourceField[GetIndex(cellRight, cellTop)]);
-        }
+    m_Width = width;
+    m_Height = height;
+    m_Size = width * height;
+    m_DomainWidth = width;
+    m_ColumnEnd = width - 1;
+    for (std::vector<float>* field : { &m_VelocityX, &m_VelocityXPrev, &m_VelocityY, &m_VelocityYPrev, &m_Pressure, &m_Divergence,
+                                       &m_ScalarPrev, &m_SolidMask, &m_SolidDistance, &m_EddyViscosity }) {
+        field->assign(m_Size, 0.0f);
+    }
+    m_FaceOpenX.assign(m_Size, 1.0f);
+    m_FaceOpenY.assign(m_Size, 1.0f);
+    for (SolveWorkspace* workspace : { &m_WorkspaceX, &m_WorkspaceY, &m_ScalarWorkspace }) workspace->Resize(m_Size);
+    m_Boundaries.Configure(m_Boundaries.GetSettings(), width, height);
+    m_Scalars.Configure(std::vector<ScalarSpecies>(m_Scalars.GetSpecies()), width, height);
+
+    // Obstacle first, so the flow can be cleared inside it; distances are in cells, which change size
+    ResampleInterior(oldDistance, oldWidth, oldHeight, m_SolidDistance, width, height);
+    float cellRatio = (float)(width - 2) / (oldWidth - 2);
+    for (int index = 0; index < m_Size; index++) m_SolidDistance[index] *= cellRatio;
+    SetBoundaries(BoundaryField::Scalar, m_SolidDistance);
+    for (int index = 0; index < m_Size; index++) m_SolidMask[index] = m_SolidDistance[index] < 0.0f ? 1.0f : 0.0f;
+    UpdateFaceFractions();
+
+    ResampleInterior(oldVelocityX, oldWidth, oldHeight, m_VelocityX, width, height);
+    ResampleInterior(oldVelocityY, oldWidth, oldHeight, m_VelocityY, width, height);
+    ResampleInterior(oldPressure, oldWidth, oldHeight, m_Pressure, width, height);
+    for (int index = 0; index < m_Size; index++) {
+        if (m_SolidMask[index] <= 0.0f) continue;
+        m_VelocityX[index] = 0.0f;
+        m_VelocityY[index] = 0.0f;
+    }
+
+    // A sharper obstacle from its source replaces the resampled one before anything depends on it
+    rebuildObstacle(*this);
+    SetBoundaries(BoundaryField::VelocityX, m_VelocityX);
+    SetBoundaries(BoundaryField::VelocityY, m_VelocityY);
+    SetBoundaries(BoundaryField::Pressure, m_Pressure);
+
+    for (int species = 0; species < (int)oldScalars.size(); species++) {
+        std::vector<float>& values = m_Scalars.GetValues(species);
+        RemapConservative(oldScalars[species], oldMask, oldWidth, oldHeight, values, m_SolidMask, width, height);
+        SetBoundaries(BoundaryField::Scalar, values);
     }
-    SetBoundaries(boundaryType, destField);
+    m_Scalars.RefreshActiveTiles();
+
+    // Interpolation leaves some divergence behind. The projection's pressure goes to a buffer the next step
+    // overwrites before reading, so the resampled pressure is what shows until then.
+    Project(m_VelocityX, m_VelocityY, m_VelocityXPrev, m_Divergence);
+
+    m_Version++;
 }
 
-void FluidSolver::Diffuse(int boundaryType, std::vector<float>& destField, const std::vector<float>& sourceField, float diffRate, float deltaTime)
+void FluidSolver::SetSlab(int domainWidth, int columnOffset, int columnBegin, int columnEnd, SlabLink& link)
 {
-    // Diffusion coefficient used by the Gauss-Seidel/Jacobi relaxation
-    float diffusionCoefficient = deltaTime * diffRate * (m_Width - 2) * (m_Height - 2);
+    m_DomainWidth = domainWidth;
+    m_ColumnOffset = columnOffset;
+    m_ColumnBegin = columnBegin;
+    m_ColumnEnd = columnEnd;
+    m_SlabLink = &link;
+    m_Boundaries.Configure(m_Boundaries.GetSettings(), m_Width, m_Height, domainWidth, columnOffset);
+}
 
-    for (int k = 0; k < m_Iterations; k++) {
-        for (int j = 1; j < m_Height - 1; j++) {
-            for (int i = 1; i < m_Width - 1; i++) {
+void FluidSolver::Advect(BoundaryField field, std::vector<float>& destField, const std::vector<float>& sourceField,
+                        const std::vector<float>& velocityX, const std::vector<float>& velocityY, float deltaTime)
+{
+    ProfileScope scope(ProfilePhase::Advect, m_Size);
+    SpecialiseFlags([&](auto obstacles, auto periodicX, auto periodicY) {
+        AdvectKernel<obstacles, periodicX, periodicY>(destField.data(), sourceField.data(), velocityX.data(), velocityY.data(), deltaTime);
+    }, m_HasObstacle, m_Boundaries.IsPeriodicX(), m_Boundaries.IsPeriodicY());
+    SetBoundaries(field, destField);
+}
 
-                if (m_SolidMask[GetIndex(i, j)] > 0.0f) continue;
+template <bool Obstacles, bool PeriodicX, bool PeriodicY>
+void FluidSolver::AdvectKernel(float* destField, const float* sourceField, const float* velocityX, const float* velocityY, float deltaTime)
+{
+    float dt0_x = deltaTime * (m_DomainWidth - 2);
+    float dt0_y = deltaTime * (m_Height - 2);
+    const float* solid = m_SolidMask.data();
+    int w = m_Width;
+    int offset = m_ColumnOffset;
+
+    // A slab clamps to the domain, then to the columns it holds, which only backtraces longer than its halo reach
+    float minX = std::max(0.5f, (float)offset);
+    float maxX = std::min(m_DomainWidth - 1.5f, offset + w - 1.5f);
+
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = m_ColumnBegin; i < m_ColumnEnd; i++) {
+                int index = i + j * w;
+                if constexpr (Obstacles) {
+                    if (solid[index] > 0.0f) {
+                        destField[index] = 0.0f;
+                        continue;
+                    }
+                }
 
-                float valLeft   = destField[GetIndex(i - 1, j)];
-                float valRight  = destField[GetIndex(i + 1, j)];
-                float valBottom = destField[GetIndex(i, j - 1)];
-                float valTop    = destField[GetIndex(i, j + 1)];
+                // Backtrace, in domain columns
+                float x = (i + offset) - dt0_x * velocityX[index];
+                float y = j - dt0_y * velocityY[index];
 
-                // Handle obstacle boundaries for diffusion
-                if (boundaryType == 0) {
-                    // Scalar diffusion simply extends value at boundary (no flux into solid)
-                    if (m_SolidMask[GetIndex(i - 1, j)] > 0.0f) valLeft   = destField[GetIndex(i, j)];
-                    if (m_SolidMask[GetIndex(i + 1, j)] > 0.0f) valRight  = destField[GetIndex(i, j)];
-                    if (m_SolidMask[GetIndex(i, j - 1)] > 0.0f) valBottom = destField[GetIndex(i, j)];
-                    if (m_SolidMask[GetIndex(i, j + 1)] > 0.0f) valTop    = destField[GetIndex(i, j)];
+                // Clamp to grid; periodic directions wrap over the interior, the far ghost layer mirroring the first interior cells
+                if constexpr (PeriodicX) {
+                    x = 1.0f + std::fmod(x - 1.0f, (float)(m_DomainWidth - 2));
+                    if (x < 1.0f) x += m_DomainWidth - 2;
+                } else {
+                    if (x < minX) x = minX;
+                    if (x > maxX) x = maxX;
+                }
+                if constexpr (PeriodicY) {
+                    y = 1.0f + std::fmod(y - 1.0f, (float)(m_Height - 2));
+                    if (y < 1.0f) y += m_Height - 2;
                 } else {
-                    // Velocity diffusion assumes no-slip (zero velocity inside solid)
-                    if (m_SolidMask[GetIndex(i - 1, j)] > 0.0f) valLeft   = 0.0f;
-                    if (m_SolidMask[GetIndex(i + 1, j)] > 0.0f) valRight  = 0.0f;
-                    if (m_SolidMask[GetIndex(i, j - 1)] > 0.0f) valBottom = 0.0f;
-                    if (m_SolidMask[GetIndex(i, j + 1)] > 0.0f) valTop    = 0.0f;
+                    if (y < 0.5f) y = 0.5f;
+                    if (y > m_Height - 1.5f) y = m_Height - 1.5f;
                 }
 
-                // Jacobi iteration step
-                destField[GetIndex(i, j)] = (sourceField[GetIndex(i, j)] + diffusionCoefficient * (valLeft + valRight + valBottom + valTop)) / (1 + 4 * diffusionCoefficient);
+                // Bilinear interpolation indices; a wrapped coordinate can round up onto the far ghost layer, where
+                // the corner beyond it has no weight
+                int column = (int)x;
+                int cellLeft = column - offset;
+                int cellRight = PeriodicX ? std::min(cellLeft + 1, w - 1) : cellLeft + 1;
+                int cellBottom = (int)y;
+                int cellTop = PeriodicY ? std::min(cellBottom + 1, m_Height - 1) : cellBottom + 1;
+
+                // Interpolation weights
+                float lerpWeightRight = x - column;
+                float lerpWeightLeft = 1.0f - lerpWeightRight;
+                float lerpWeightTop = y - cellBottom;
+                float lerpWeightBottom = 1.0f - lerpWeightTop;
+
+                // Sample source field
+                destField[index] =
+                    lerpWeightLeft * (lerpWeightBottom * sourceField[cellLeft + cellBottom * w] + lerpWeightTop * sourceField[cellLeft + cellTop * w]) +
+                    lerpWeightRight * (lerpWeightBottom * sourceField[cellRight + cellBottom * w] + lerpWeightTop * sourceField[cellRight + cellTop * w]);
             }
         }
-        SetBoundaries(boundaryType, destField);
-    }
+    });
 }
 
-void FluidSolver::Project(std::vector<float>& velocX, std::vector<float>& velocY, std::vector<float>& pressure, std::vector<float>& divergence)
+void FluidSolver::Diffuse(SolveWorkspace& workspace, BoundaryField field, std::vector<float>& destField, const std::vector<float>& sourceField, float diffRate, float deltaTime)
 {
-    float h = 1.0f / m_Width;
+    ProfileScope scope(ProfilePhase::Diffuse, m_Size);
 
-    // Divergence
-    for (int j = 1; j < m_Height - 1; j++) {
-        for (int i = 1; i < m_Width - 1; i++) {
+    // Implicit step (I + a L) x = x0, with 'a' per cell: the rate plus, for velocity, any eddy viscosity
+    float stiffness = GlobalMax(BuildDiffusionStencil(workspace, field, diffRate, deltaTime));
+    std::copy(sourceField.begin(), sourceField.end(), destField.begin());
+    SetBoundaries(field, destField);
+    if (stiffness <= 0.0f) return;
+
+    GridStencil stencil = GetStencil(workspace);
+    std::vector<float>& scratch = workspace.Scratch;
+    if (stiffness < ExplicitDiffusionLimit) {
+        // Forward Euler, x = x0 - (A - I) x0, agrees with the implicit step to O(stiffness^2)
+        workspace.Solver.Apply(stencil, destField.data(), scratch.data());
+        SpecialiseFlags([&](auto obstacles) { ExplicitDiffusionKernel<obstacles>(workspace, destField.data()); }, m_HasObstacle);
+        SetBoundaries(field, destField);
+        scope.SetPasses(2.0);
+        return;
+    }
+
+    if (m_Relaxation == Relaxation::Jacobi) {
+        // Sweeps that read only the previous iterate, like the pressure relaxation, so the result does not depend
+        // on how the domain is decomposed
+        SpecialiseFlags([&](auto obstacles) {
+            for (int k = 0; k < m_Iterations; k++) {
+                JacobiDiffusionKernel<obstacles>(workspace, scratch.data(), destField.data(), sourceField.data());
+                SetBoundaries(field, scratch);
+                std::swap(destField, scratch);
+            }
+        }, m_HasObstacle);
+        workspace.DiffusionIterations += m_Iterations;
+        scope.SetPasses(1.0 + m_Iterations);
+        return;
+    }
+
+    int iterations = workspace.Solver.SolveConjugateGradient(
+        stencil, sourceField.data(), destField.data(),
+        [&](float* values) { m_Boundaries.Apply(field, values); },
+        [&](float* values) { m_Boundaries.Apply(field, values, true); },
+        m_DiffusionTolerance, MaxDiffusionIterations);
+    workspace.DiffusionIterations += iterations;
+    scope.SetPasses(1.0 + ConjugateGradientPasses * iterations);
+}
+
+template <bool Obstacles>
+void FluidSolver::ExplicitDiffusionKernel(const SolveWorkspace& workspace, float* values)
+{
+    // Scratch holds A x0; ghost cells are left to the caller
+    const float* applied = workspace.Scratch.data();
+    const float* active = workspace.StencilActive.data();
+    int w = m_Width;
 
-            if (m_SolidMask[GetIndex(i, j)] > 0.0f) {
-                divergence[GetIndex(i, j)] = 0.0f;
-                pressure[GetIndex(i, j)] = 0.0f;
-                continue;
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int index = m_ColumnBegin + j * w; index < m_ColumnEnd + j * w; index++) {
+                if constexpr (Obstacles) {
+                    if (active[index] <= 0.0f) continue;
+                }
+                values[index] = 2.0f * values[index] - applied[index];
             }
+        }
+    });
+}
 
-            divergence[GetIndex(i, j)] = -0.5f * h * (velocX[GetIndex(i + 1, j)] - velocX[GetIndex(i - 1, j)] +
-                                                velocY[GetIndex(i, j + 1)] - velocY[GetIndex(i, j - 1)]);
-            pressure[GetIndex(i, j)] = 0;
+template <bool Obstacles>
+void FluidSolver::JacobiDiffusionKernel(const SolveWorkspace& workspace, float* target, const float* values, const float* source)
+{
+    const float* diagonal = workspace.StencilDiagonal.data();
+    const float* couplingX = workspace.CouplingX.data();
+    const float* couplingY = workspace.CouplingY.data();
+    const float* active = workspace.StencilActive.data();
+    int w = m_Width;
+
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int index = m_ColumnBegin + j * w; index < m_ColumnEnd + j * w; index++) {
+                if constexpr (Obstacles) {
+                    if (active[index] <= 0.0f) {
+                        target[index] = values[index];
+                        continue;
+                    }
+                }
+                target[index] = (source[index] +
+                                 couplingX[index] * values[index - 1] + couplingX[index + 1] * values[index + 1] +
+                                 couplingY[index] * values[index - w] + couplingY[index + w] * values[index + w]) /
+                                diagonal[index];
+            }
         }
+    });
+}
+
+float FluidSolver::BuildDiffusionStencil(SolveWorkspace& workspace, BoundaryField field, float diffRate, float deltaTime)
+{
+    bool velocityField = field != BoundaryField::Scalar;
+    bool eddyViscosity = velocityField && m_TurbulenceModel != TurbulenceModel::None;
+    float stiffness = 0.0f;
+    SpecialiseFlags([&](auto velocity, auto eddy, auto subCell, auto obstacles) {
+        stiffness = BuildDiffusionStencilKernel<velocity, eddy, subCell, obstacles>(workspace, diffRate, deltaTime);
+    }, velocityField, eddyViscosity, m_SubCellBoundaries, m_HasObstacle);
+    return stiffness;
+}
+
+template <bool Velocity, bool Eddy, bool SubCell, bool Obstacles>
+float FluidSolver::BuildDiffusionStencilKernel(SolveWorkspace& workspace, float diffRate, float deltaTime)
+{
+    // Same scaling as the advection and pressure steps
+    float scale = deltaTime * (m_DomainWidth - 2) * (m_Height - 2);
+
+    std::vector<float>& cellDiffusion = workspace.CellDiffusion;
+    ThreadPool& pool = ThreadPool::Get();
+    if constexpr (Eddy) {
+        pool.ParallelFor(0, m_Size, RowGrain * m_Width, [&](int begin, int end) {
+            for (int index = begin; index < end; index++) cellDiffusion[index] = scale * (diffRate + m_EddyViscosity[index]);
+        });
+    } else {
+        std::fill(cellDiffusion.begin(), cellDiffusion.end(), scale * diffRate);
     }
 
-    SetBoundaries(0, divergence);
-    SetBoundaries(3, pressure); // 3 = Pressure specific boundary
+    const float* coefficient = cellDiffusion.data();
+    float* diagonals = workspace.StencilDiagonal.data();
+    float* couplingX = workspace.CouplingX.data();
+    float* couplingY = workspace.CouplingY.data();
+    float* activeFlags = workspace.StencilActive.data();
+    const float* solid = m_SolidMask.data();
+    int w = m_Width;
+    int rowChunks = (m_Height - 2 + RowGrain - 1) / RowGrain;
+    std::vector<float>& chunkStiffness = workspace.ChunkStiffness;
+    chunkStiffness.assign(rowChunks, 0.0f);
 
-    // Solve Pressure (Poisson equation)
-    for (int k = 0; k < m_Iterations; k++) {
-        for (int j = 1; j < m_Height - 1; j++) {
-            for (int i = 1; i < m_Width - 1; i++) {
+    pool.ParallelFor(0, rowChunks, 1, [&](int chunkBegin, int chunkEnd) {
+        for (int chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+            int jEnd = std::min(1 + (chunk + 1) * RowGrain, m_Height - 1);
+            for (int j = 1 + chunk * RowGrain; j < jEnd; j++) {
+                for (int i = m_ColumnBegin; i < m_ColumnEnd; i++) {
+                    int index = i + j * w;
+                    float a = coefficient[index];
+                    bool active = !Obstacles || solid[index] <= 0.0f;
+                    float diagonal = 1.0f;
 
-                if (m_SolidMask[GetIndex(i, j)] > 0.0f) continue;
+                    // Coupling through one face; solid neighbours close it (scalars) or act as a no-slip wall
+                    // (velocity, at the zero crossing of the distance in sub-cell mode)
+                    auto face = [&](int neighbour, float open) {
+                        if constexpr (Obstacles) {
+                            if (!active) return 0.0f;
+                            if (solid[neighbour] > 0.0f) {
+                                if constexpr (Velocity) {
+                                    float theta = 1.0f;
+                                    if constexpr (SubCell) {
+                                        float distance = m_SolidDistance[index];
+                                        theta = std::max(distance / (distance - m_SolidDistance[neighbour]), MinWallFraction);
+                                    }
+                                    diagonal += a / theta;
+                                }
+                                return 0.0f;
+                            }
+                        }
+                        float coupling = (SubCell && !Velocity ? open : 1.0f) * 0.5f * (a + coefficient[neighbour]);
+                        diagonal += coupling;
+                        return coupling;
+                    };
 
-                // Neumann boundary condition at obstacles
-                float pLeft   = (m_SolidMask[GetIndex(i - 1, j)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i - 1, j)];
-                float pRight  = (m_SolidMask[GetIndex(i + 1, j)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i + 1, j)];
-                float pBottom = (m_SolidMask[GetIndex(i, j - 1)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i, j - 1)];
-                float pTop    = (m_SolidMask[GetIndex(i, j + 1)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i, j + 1)];
+                    couplingX[index] = face(index - 1, m_FaceOpenX[index]);
+                    couplingY[index] = face(index - w, m_FaceOpenY[index]);
+                    float right = face(index + 1, m_FaceOpenX[index + 1]);
+                    float top = face(index + w, m_FaceOpenY[index + w]);
+                    if (i == m_ColumnEnd - 1) couplingX[index + 1] = right;
+                    if (j == m_Height - 2) couplingY[index + w] = top;
 
-                pressure[GetIndex(i, j)] = (divergence[GetIndex(i, j)] + pLeft + pRight + pBottom + pTop) / 4.0f;
+                    diagonals[index] = diagonal;
+                    activeFlags[index] = active ? 1.0f : 0.0f;
+                    if (active) chunkStiffness[chunk] = std::max(chunkStiffness[chunk], diagonal - 1.0f);
+                }
             }
         }
-        SetBoundaries(3, pressure);
-    }
+    });
+    return *std::max_element(chunkStiffness.begin(), chunkStiffness.end());
+}
 
-    // Subtract Gradient from Velocity
-    for (int j = 1; j < m_Height - 1; j++) {
-        for (int i = 1; i < m_Width - 1; i++) {
+void FluidSolver::BuildPressureStencil(SolveWorkspace& workspace)
+{
+    const float* solid = m_SolidMask.data();
+    float* couplingX = workspace.CouplingX.data();
+    float* couplingY = workspace.CouplingY.data();
+    int w = m_Width;
+    bool subCell = m_SubCellBoundaries;
+
+    // The relaxation's operator: faces weighted by their open fraction in sub-cell mode, otherwise closed at solids
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = m_ColumnBegin; i < m_ColumnEnd; i++) {
+                int index = i + j * w;
+                bool fluid = solid[index] <= 0.0f;
+                auto face = [&](int neighbour, float open) {
+                    if (!fluid) return 0.0f;
+                    return subCell ? open : (solid[neighbour] > 0.0f ? 0.0f : 1.0f);
+                };
+
+                couplingX[index] = face(index - 1, m_FaceOpenX[index]);
+                couplingY[index] = face(index - w, m_FaceOpenY[index]);
+                float right = face(index + 1, m_FaceOpenX[index + 1]);
+                float top = face(index + w, m_FaceOpenY[index + w]);
+                if (i == m_ColumnEnd - 1) couplingX[index + 1] = right;
+                if (j == m_Height - 2) couplingY[index + w] = top;
 
-            if (m_SolidMask[GetIndex(i, j)] > 0.0f) {
-                velocX[GetIndex(i, j)] = 0.0f;
-                velocY[GetIndex(i, j)] = 0.0f;
-                continue;
+                float diagonal = couplingX[index] + couplingY[index] + right + top;
+                workspace.StencilDiagonal[index] = diagonal;
+                workspace.StencilActive[index] = fluid && diagonal > 0.0f ? 1.0f : 0.0f;
             }
+        }
+    });
+}
 
-            float pLeft   = (m_SolidMask[GetIndex(i - 1, j)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i - 1, j)];
-            float pRight  = (m_SolidMask[GetIndex(i + 1, j)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i + 1, j)];
-            float pBottom = (m_SolidMask[GetIndex(i, j - 1)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i, j - 1)];
-            float pTop    = (m_SolidMask[GetIndex(i, j + 1)] > 0.0f) ? pressure[GetIndex(i, j)] : pressure[GetIndex(i, j + 1)];
+GridStencil FluidSolver::GetStencil(const SolveWorkspace& workspace) const
+{
+    GridStencil stencil;
+    stencil.Width = m_Width;
+    stencil.Height = m_Height;
+    stencil.Diagonal = workspace.StencilDiagonal.data();
+    stencil.CouplingX = workspace.CouplingX.data();
+    stencil.CouplingY = workspace.CouplingY.data();
+    stencil.Active = workspace.StencilActive.data();
+    return stencil;
+}
+
+bool FluidSolver::PrepareSpectralSolver()
+{
+    // The transform needs unit couplings and mirrored pressure along y
+    if (m_SubCellBoundaries || m_Boundaries.IsPeriodicX() || m_Boundaries.IsPeriodicY()) return false;
+    if (m_Boundaries.HasFixedPressure(BoundarySide::Bottom) || m_Boundaries.HasFixedPressure(BoundarySide::Top)) return false;
+
+    return m_SpectralSolver.Prepare(m_Width, m_Height, m_Boundaries.HasFixedPressure(BoundarySide::Left),
+                                    m_Boundaries.HasFixedPressure(BoundarySide::Right), m_SolidMask.data(), m_ObstacleVersion);
+}
+
+void FluidSolver::ComputeEddyViscosity(const std::vector<float>& velocityX, const std::vector<float>& velocityY)
+{
+    ProfileScope scope(ProfilePhase::EddyViscosity, m_Size);
+    SpecialiseFlags([&](auto wale, auto obstacles) {
+        EddyViscosityKernel<wale, obstacles>(velocityX.data(), velocityY.data());
+    }, m_TurbulenceModel == TurbulenceModel::WALE, m_HasObstacle);
+
+    // Ghost cells take their neighbour's value, so face averages at the domain edge stay symmetric
+    SetBoundaries(BoundaryField::Scalar, m_EddyViscosity);
+}
+
+template <bool Wale, bool Obstacles>
+void FluidSolver::EddyViscosityKernel(const float* u, const float* v)
+{
+    // Velocity is in domain lengths per unit time, so gradients scale with the cell count and the filter width
+    // delta is the geometric mean cell size
+    float scaleX = 0.5f * (m_DomainWidth - 2);
+    float scaleY = 0.5f * (m_Height - 2);
+    float deltaSquared = 1.0f / ((float)(m_DomainWidth - 2) * (m_Height - 2));
+    float constant = Wale ? m_WaleConstant : m_SmagorinskyConstant;
+    float lengthSquared = constant * constant * deltaSquared;
+
+    const float* solid = m_SolidMask.data();
+    float* nu = m_EddyViscosity.data();
+    int w = m_Width;
 
-            velocX[GetIndex(i, j)] -= 0.5f * (pRight - pLeft) / h;
-            velocY[GetIndex(i, j)] -= 0.5f * (pTop - pBottom) / h;
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = m_ColumnBegin; i < m_ColumnEnd; i++) {
+                int index = i + j * w;
+                float dudx = scaleX * (u[index + 1] - u[index - 1]);
+                float dudy = scaleY * (u[index + w] - u[index - w]);
+                float dvdx = scaleX * (v[index + 1] - v[index - 1]);
+                float dvdy = scaleY * (v[index + w] - v[index - w]);
+
+                float shear = 0.5f * (dudy + dvdx);
+                float strainSquared = dudx * dudx + dvdy * dvdy + 2.0f * shear * shear; // S_ij S_ij
+
+                float viscosity;
+                if constexpr (Wale) {
+                    // Traceless symmetric part of g^2 (g_ij = du_i / dx_j), with the out-of-plane components zero
+                    float g11 = dudx * dudx + dudy * dvdx;
+                    float g22 = dvdx * dudy + dvdy * dvdy;
+                    float g12 = 0.5f * (dudx * dudy + dudy * dvdy + dvdx * dudx + dvdy * dvdx);
+                    float third = (g11 + g22) / 3.0f;
+                    float sd = (g11 - third) * (g11 - third) + (g22 - third) * (g22 - third) + third * third + 2.0f * g12 * g12;
+
+                    float denominator = std::pow(strainSquared, 2.5f) + std::pow(sd, 1.25f);
+                    viscosity = denominator > 0.0f ? lengthSquared * std::pow(sd, 1.5f) / denominator : 0.0f;
+                } else {
+                    viscosity = lengthSquared * std::sqrt(2.0f * strainSquared);
+                }
+                nu[index] = Obstacles && solid[index] > 0.0f ? 0.0f : viscosity;
+            }
         }
+    });
+}
+
+void FluidSolver::Project(std::vector<float>& velocX, std::vector<float>& velocY, std::vector<float>& pressure, std::vector<float>& divergence)
+{
+    {
+        ProfileScope scope(ProfilePhase::Divergence, m_Size);
+        SpecialiseFlags([&](auto subCell, auto obstacles) {
+            DivergenceKernel<subCell, obstacles>(velocX.data(), velocY.data(), pressure.data(), divergence.data());
+        }, m_SubCellBoundaries, m_HasObstacle);
+
+        SetBoundaries(BoundaryField::Scalar, divergence);
+        SetBoundaries(BoundaryField::Pressure, pressure);
+    }
+
+    // Solve Pressure (Poisson equation)
+    {
+        ProfileScope scope(ProfilePhase::PressureSolve, m_Size);
+        bool direct = m_Relaxation == Relaxation::Spectral && PrepareSpectralSolver();
+        if (direct) {
+            m_SpectralSolver.Solve(divergence.data(), pressure.data());
+            SetBoundaries(BoundaryField::Pressure, pressure);
+            m_LastPressureIterations = 1;
+            scope.SetPasses(SpectralPasses);
+        } else if (m_Relaxation == Relaxation::ConjugateGradient) {
+            BuildPressureStencil(m_WorkspaceX);
+            m_LastPressureIterations = m_WorkspaceX.Solver.SolveConjugateGradient(
+                GetStencil(m_WorkspaceX), divergence.data(), pressure.data(),
+                [&](float* values) { m_Boundaries.Apply(BoundaryField::Pressure, values); },
+                [&](float* values) { m_Boundaries.Apply(BoundaryField::Pressure, values, true); },
+                m_PressureTolerance, m_Iterations);
+            scope.SetPasses(1.0 + ConjugateGradientPasses * m_LastPressureIterations);
+        }
+
+        bool jacobi = m_Relaxation == Relaxation::Jacobi;
+        int sweeps = (direct || m_Relaxation == Relaxation::ConjugateGradient) ? 0 : m_Iterations;
+        if (sweeps > 0) m_LastPressureIterations = sweeps;
+
+        SpecialiseFlags([&](auto subCell, auto obstacles) {
+            for (int k = 0; k < sweeps; k++) {
+                std::vector<float>& target = jacobi ? m_WorkspaceX.Scratch : pressure;
+                float maxChange = PressureSweepKernel<subCell, obstacles>(target.data(), pressure.data(), divergence.data());
+                SetBoundaries(BoundaryField::Pressure, target);
+                if (jacobi) std::swap(pressure, m_WorkspaceX.Scratch);
+
+                if (m_PressureTolerance > 0.0f && GlobalMax(maxChange) < m_PressureTolerance) {
+                    m_LastPressureIterations = k + 1;
+                    break;
+                }
+            }
+        }, m_SubCellBoundaries, m_HasObstacle);
+        if (sweeps > 0) scope.SetPasses(m_LastPressureIterations);
     }
 
-    SetBoundaries(1, velocX);
-    SetBoundaries(2, velocY);
+    ProfileScope scope(ProfilePhase::Gradient, m_Size);
+    SpecialiseFlags([&](auto subCell, auto obstacles) {
+        SubtractGradientKernel<subCell, obstacles>(velocX.data(), velocY.data(), pressure.data());
+    }, m_SubCellBoundaries, m_HasObstacle);
+
+    SetBoundaries(BoundaryField::VelocityX, velocX);
+    SetBoundaries(BoundaryField::VelocityY, velocY);
 }
 
-void FluidSolver::SetBoundaries(int boundaryType, std::vector<float>& field)
+template <bool SubCell, bool Obstacles>
+void FluidSolver::DivergenceKernel(const float* velocX, const float* velocY, float* pressure, float* divergence)
 {
-    for (int i = 1; i < m_Width - 1; i++) {
-        // Top and Bottom walls
-        field[GetIndex(i, 0)]             = (boundaryType == 2) ? -field[GetIndex(i, 1)] : field[GetIndex(i, 1)];
-        field[GetIndex(i, m_Height - 1)]  = (boundaryType == 2) ? -field[GetIndex(i, m_Height - 2)] : field[GetIndex(i, m_Height - 2)];
-    }
+    float h = 1.0f / m_DomainWidth;
+    const float* solid = m_SolidMask.data();
+    const float* openX = m_FaceOpenX.data();
+    const float* openY = m_FaceOpenY.data();
+    int w = m_Width;
+
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int index = m_ColumnBegin + j * w; index < m_ColumnEnd + j * w; index++) {
+                if constexpr (Obstacles) {
+                    if (solid[index] > 0.0f) {
+                        divergence[index] = 0.0f;
+                        pressure[index] = 0.0f;
+                        continue;
+                    }
+                }
+
+                if constexpr (SubCell) {
+                    // Net flux through the open part of each face, with the face velocity averaged from both cells
+                    float center = velocX[index];
+                    float centerY = velocY[index];
+                    divergence[index] = -0.5f * h * (openX[index + 1] * (center + velocX[index + 1]) -
+                                                     openX[index] * (center + velocX[index - 1]) +
+                                                     openY[index + w] * (centerY + velocY[index + w]) -
+                                                     openY[index] * (centerY + velocY[index - w]));
+                } else {
+                    divergence[index] = -0.5f * h * (velocX[index + 1] - velocX[index - 1] +
+                                                     velocY[index + w] - velocY[index - w]);
+                }
+                pressure[index] = 0;
+            }
+        }
+    });
+}
+
+template <bool SubCell, bool Obstacles>
+float FluidSolver::PressureSweepKernel(float* target, const float* pressure, const float* divergence)
+{
+    // Serial, so Gauss-Seidel (target == pressure) keeps its sweep order
+    const float* solid = m_SolidMask.data();
+    const float* openX = m_FaceOpenX.data();
+    const float* openY = m_FaceOpenY.data();
+    int w = m_Width;
+    float maxChange = 0.0f;
 
     for (int j = 1; j < m_Height - 1; j++) {
-        // Left and Right walls
-        if (boundaryType == 3) {
-             // Special case for Pressure: Fixed pressure at outflow (Right wall)
-            field[GetIndex(0, j)] = field[GetIndex(1, j)];
-            field[GetIndex(m_Width - 1, j)] = 0.0f;
-        } else {
-            field[GetIndex(0, j)] = field[GetIndex(1, j)];
-            field[GetIndex(m_Width - 1, j)] = field[GetIndex(m_Width - 2, j)];
+        for (int index = m_ColumnBegin + j * w; index < m_ColumnEnd + j * w; index++) {
+            if constexpr (Obstacles) {
+                if (solid[index] > 0.0f) {
+                    target[index] = pressure[index];
+                    continue;
+                }
+            }
+
+            float updated;
+            if constexpr (SubCell) {
+                // Variational weights: each neighbour couples through the open fraction of the shared face
+                float weightLeft   = openX[index];
+                float weightRight  = openX[index + 1];
+                float weightBottom = openY[index];
+                float weightTop    = openY[index + w];
+                float weightSum = weightLeft + weightRight + weightBottom + weightTop;
+                if (weightSum <= 0.0f) {
+                    target[index] = pressure[index];
+                    continue;
+                }
+
+                updated = (divergence[index] +
+                           weightLeft * pressure[index - 1] + weightRight * pressure[index + 1] +
+                           weightBottom * pressure[index - w] + weightTop * pressure[index + w]) / weightSum;
+            } else if constexpr (Obstacles) {
+                // Neumann boundary condition at obstacles
+                float pLeft   = (solid[index - 1] > 0.0f) ? pressure[index] : pressure[index - 1];
+                float pRight  = (solid[index + 1] > 0.0f) ? pressure[index] : pressure[index + 1];
+                float pBottom = (solid[index - w] > 0.0f) ? pressure[index] : pressure[index - w];
+                float pTop    = (solid[index + w] > 0.0f) ? pressure[index] : pressure[index + w];
+
+                updated = (divergence[index] + pLeft + pRight + pBottom + pTop) / 4.0f;
+            } else {
+                updated = (divergence[index] + pressure[index - 1] + pressure[index + 1] + pressure[index - w] + pressure[index + w]) / 4.0f;
+            }
+            maxChange = std::max(maxChange, std::abs(updated - pressure[index]));
+            target[index] = updated;
         }
     }
+    return maxChange;
+}
 
-    // Corners (average of neighbors)
-    field[GetIndex(0, 0)]                      = 0.5f * (field[GetIndex(1, 0)] + field[GetIndex(0, 1)]);
-    field[GetIndex(0, m_Height - 1)]           = 0.5f * (field[GetIndex(1, m_Height - 1)] + field[GetIndex(0, m_Height - 2)]);
-    field[GetIndex(m_Width - 1, 0)]            = 0.5f * (field[GetIndex(m_Width - 2, 0)] + field[GetIndex(m_Width - 1, 1)]);
-    field[GetIndex(m_Width - 1, m_Height - 1)] = 0.5f * (field[GetIndex(m_Width - 2, m_Height - 1)] + field[GetIndex(m_Width - 1, m_Height - 2)]);
+template <bool SubCell, bool Obstacles>
+void FluidSolver::SubtractGradientKernel(float* velocX, float* velocY, const float* pressure)
+{
+    float h = 1.0f / m_DomainWidth;
+    const float* solid = m_SolidMask.data();
+    const float* openX = m_FaceOpenX.data();
+    const float* openY = m_FaceOpenY.data();
+    int w = m_Width;
+
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int index = m_ColumnBegin + j * w; index < m_ColumnEnd + j * w; index++) {
+                if constexpr (Obstacles) {
+                    if (solid[index] > 0.0f) {
+                        velocX[index] = 0.0f;
+                        velocY[index] = 0.0f;
+                        continue;
+                    }
+                }
+
+                // Closed faces carry no gradient (Neumann); in sub-cell mode that is decided by the face fraction
+                float center = pressure[index];
+                float pLeft = pressure[index - 1], pRight = pressure[index + 1];
+                float pBottom = pressure[index - w], pTop = pressure[index + w];
+                if constexpr (SubCell) {
+                    if (openX[index] <= 0.0f)     pLeft = center;
+                    if (openX[index + 1] <= 0.0f) pRight = center;
+                    if (openY[index] <= 0.0f)     pBottom = center;
+                    if (openY[index + w] <= 0.0f) pTop = center;
+                } else if constexpr (Obstacles) {
+                    if (solid[index - 1] > 0.0f) pLeft = center;
+                    if (solid[index + 1] > 0.0f) pRight = center;
+                    if (solid[index - w] > 0.0f) pBottom = center;
+                    if (solid[index + w] > 0.0f) pTop = center;
+                }
+
+                velocX[index] -= 0.5f * (pRight - pLeft) / h;
+                velocY[index] -= 0.5f * (pTop - pBottom) / h;
+            }
+        }
+    });
+}
+
+void FluidSolver::SetBoundaries(BoundaryField field, std::vector<float>& values)
+{
+    m_Boundaries.Apply(field, values.data());
+    ExchangeHalos(values);
+}
+
+void FluidSolver::ExchangeHalos(std::vector<float>& values)
+{
+    if (m_SlabLink) m_SlabLink->ExchangeHalos(values.data());
 }
 
 void FluidSolver::ApplyInflow()
@@ -265,66 +956,108 @@ void FluidSolver::ApplyInflow()
                             float speed = 2.0f;
                             m_VelocityX[GetIndex(i, j)] = normalX * speed;
                             m_VelocityY[GetIndex(i, j)] = normalY * speed;
-                            m_DyeDensity[GetIndex(i, j)] = 1.0f;
+                            m_Scalars.GetValues(0)[GetIndex(i, j)] = 1.0f;
+                            m_Scalars.MarkActive(GetIndex(i, j));
                         }
                     }
                 }
             }
         }
-        return;
+        m_Scalars.Emit(m_SolidMask.data(), m_Boundaries, false);
+    } else {
+        m_Boundaries.ApplyInflow(m_VelocityX.data(), m_VelocityY.data(), m_InflowVelocity);
+        m_Scalars.Emit(m_SolidMask.data(), m_Boundaries, true);
     }
 
-    // Override left boundary for wind tunnel effect
-    for (int j = 1; j < m_Height - 1; j++) {
-        m_VelocityX[GetIndex(0, j)] = m_InflowVelocity;
-        m_VelocityX[GetIndex(1, j)] = m_InflowVelocity;
-        m_VelocityY[GetIndex(0, j)] = 0.0f;
-        m_VelocityY[GetIndex(1, j)] = 0.0f;
-
-        // Emitter
-        if (j > m_Height * 0.45f && j < m_Height * 0.55f) {
-             m_DyeDensity[GetIndex(0, j)] = 1.0f;
-             m_DyeDensity[GetIndex(1, j)] = 1.0f;
-        } else {
-             m_DyeDensity[GetIndex(0, j)] = 0.0f;
+    // The inflow, the emitters and the scalar transport before them write without SetBoundaries, so a slab takes
+    // its halo columns from the neighbours once here, tracking the scalar tiles they fill
+    if (!m_SlabLink) return;
+    ExchangeHalos(m_VelocityX);
+    ExchangeHalos(m_VelocityY);
+    for (int species = 0; species < m_Scalars.GetSpeciesCount(); species++) ExchangeHalos(m_Scalars.GetValues(species));
+    m_Scalars.RefreshActiveTiles(0, m_ColumnBegin);
+    m_Scalars.RefreshActiveTiles(m_ColumnEnd, m_Width);
+}
+
+void FluidSolver::SetSpecies(const std::vector<ScalarSpecies>& species)
+{
+    m_Scalars.Configure(species.empty() ? ScalarTransport::GetDefaultSpecies() : species, m_Width, m_Height);
+}
+
+void FluidSolver::SetDiffusion(float diffusion)
+{
+    std::vector<ScalarSpecies> species = m_Scalars.GetSpecies();
+    species[0].Diffusion = diffusion;
+    m_Scalars.Configure(species, m_Width, m_Height);
+}
+
+void FluidSolver::InitObstacle()
+{
+    SetAirfoil(ObstacleLibrary::GetDefaultAirfoil(m_Width, m_Height));
+}
+
+bool FluidSolver::SetAirfoil(const ObstacleLibrary::Airfoil& airfoil)
+{
+    std::shared_ptr<const ObstacleLibrary::Shape> shape = ObstacleLibrary::Get().GetAirfoil(airfoil, m_Width, m_Height);
+    if (!shape) return false;
+
+    m_SolidMask = shape->Mask;
+    m_SolidDistance = shape->Distance;
+    m_Version++;
+
+    // Clear velocity inside obstacle
+    for (int i = 0; i < m_Size; i++) {
+        if (m_SolidMask[i] > 0.0f) {
+            m_VelocityX[i] = 0.0f;
+            m_VelocityY[i] = 0.0f;
         }
     }
+    UpdateFaceFractions();
+    return true;
 }
 
-void FluidSolver::InitObstacle()
+void FluidSolver::SetObstacleMask(Span<const float> mask)
 {
-    std::fill(m_SolidMask.begin(), m_SolidMask.end(), 0.0f);
+    if (mask.size() != (size_t)m_Size) return;
+    std::copy(mask.begin(), mask.end(), m_SolidMask.begin());
+    m_Version++;
 
-    int centerX = m_Width / 3;
-    int centerY = m_Height / 2;
-    int chordLength = m_Width / 4;
-    float thickness = 0.15f;
+    SignedDistance::FromMask(m_SolidMask.data(), m_Width, m_Height, m_SolidDistance);
+    UpdateFaceFractions();
 
-    for (int j = 0; j < m_Height; j++) {
-        for (int i = 0; i < m_Width; i++) {
-            float localX = (float)(i - centerX) / chordLength;
-            float localY = (float)(j - centerY) / chordLength;
-
-            // Simple NACA 4-digit symmetrical airfoil approximation (NACA 00xx)
-            // yt = 5 * t * (0.2969*sqrt(x) - 0.1260*x - 0.3516*x^2 + 0.2843*x^3 - 0.1015*x^4)
-            if (localX >= 0.0f && localX <= 1.0f) {
-                float yt = 5.0f * thickness * (0.2969f * std::sqrt(localX) - 0.1260f * localX - 0.3516f * localX * localX + 0.2843f * localX * localX * localX - 0.1015f * localX * localX * localX * localX);
-                if (std::abs(localY) <= yt) {
-                    m_SolidMask[GetIndex(i, j)] = 1.0f;
-
-                    // Clear velocity inside obstacle
-                    m_VelocityX[GetIndex(i, j)] = 0.0f;
-                    m_VelocityY[GetIndex(i, j)] = 0.0f;
-                }
-            }
+    // Clear velocity inside obstacle
+    for (int i = 0; i < m_Size; i++) {
+        if (m_SolidMask[i] > 0.0f) {
+            m_VelocityX[i] = 0.0f;
+            m_VelocityY[i] = 0.0f;
+        }
+    }
+}
+
+void FluidSolver::SetObstacleDistance(Span<const float> distance)
+{
+    if (distance.size() != (size_t)m_Size) return;
+    std::copy(distance.begin(), distance.end(), m_SolidDistance.begin());
+    m_Version++;
+
+    for (int i = 0; i < m_Size; i++) {
+        m_SolidMask[i] = m_SolidDistance[i] < 0.0f ? 1.0f : 0.0f;
+
+        // Clear velocity inside obstacle
+        if (m_SolidMask[i] > 0.0f) {
+            m_VelocityX[i] = 0.0f;
+            m_VelocityY[i] = 0.0f;
         }
     }
+    UpdateFaceFractions();
 }
 
-void FluidSolver::SetObstacleMask(const std::vector<float>& mask)
+void FluidSolver::SetObstacle(Span<const float> mask, Span<const float> distance)
 {
-    if (mask.size() != m_Size) return;
-    m_SolidMask = mask;
+    if (mask.size() != (size_t)m_Size || distance.size() != (size_t)m_Size) return;
+    std::copy(mask.begin(), mask.end(), m_SolidMask.begin());
+    std::copy(distance.begin(), distance.end(), m_SolidDistance.begin());
+    m_Version++;
 
     // Clear velocity inside obstacle
     for (int i = 0; i < m_Size; i++) {
@@ -333,4 +1066,32 @@ void FluidSolver::SetObstacleMask(const std::vector<float>& mask)
             m_VelocityY[i] = 0.0f;
         }
     }
+    UpdateFaceFractions();
+}
+
+void FluidSolver::UpdateFaceFractions()
+{
+    m_ObstacleVersion++; // The spectral solver rebuilds its capacitance system on the next projection
+    m_HasObstacle = std::any_of(m_SolidMask.begin(), m_SolidMask.end(), [](float solid) { return solid > 0.0f; });
+
+    // Signed distance at the grid node shared by cells (i - 1, j - 1) .. (i, j)
+    auto nodeDistance = [&](int i, int j) {
+        return 0.25f * (m_SolidDistance[GetIndex(i - 1, j - 1)] + m_SolidDistance[GetIndex(i, j - 1)] +
+                        m_SolidDistance[GetIndex(i - 1, j)] + m_SolidDistance[GetIndex(i, j)]);
+    };
+
+    // Faces next to a solid cell stay closed, so the pressure unknowns are still exactly the fluid cells; the
+    // fractions then narrow faces that a surface crosses between two fluid centres (thin or sharp features)
+    for (int j = 0; j < m_Height; j++) {
+        for (int i = 0; i < m_Width; i++) {
+            int index = GetIndex(i, j);
+            bool solid = m_SolidMask[index] > 0.0f;
+
+            bool solidLeft = m_SolidMask[GetIndex(i - 1, j)] > 0.0f;
+            m_FaceOpenX[index] = (solid || solidLeft) ? 0.0f : SignedDistance::OpenFraction(nodeDistance(i, j), nodeDistance(i, j + 1));
+
+            bool solidBelow = m_SolidMask[GetIndex(i, j - 1)] > 0.0f;
+            m_FaceOpenY[index] = (solid || solidBelow) ? 0.0f : SignedDistance::OpenFraction(nodeDistance(i, j), nodeDistance(i + 1, j));
+        }
+    }
 }
@@ -1,64 +1,255 @@
 #pragma once
 
 #include <vector>
+#include "DomainBoundaries.h"
+#include "FieldView.h"
+#include "FlowSolver.h"
+#include "LinearSolver.h"
+#include "ObstacleLibrary.h"
+#include "ScalarTransport.h"
+#include "SpectralPoisson.h"
+#include "TaskGraph.h"
+
+// Connects a FluidSolver holding one slab of a domain's columns to the slabs beside it (see FluidSolver::SetSlab)
+class SlabLink {
+public:
+    virtual ~SlabLink() = default;
+
+    // Refreshes the columns of a local field that the neighbouring slabs update. Every slab calls it together.
+    virtual void ExchangeHalos(float* values) = 0;
+
+    // Maximum of 'value' over all slabs, returned on every slab
+    virtual float AllReduceMax(float value) = 0;
+};
 
-class FluidSolver {
+class FluidSolver : public FlowSolver {
 public:
     FluidSolver(int width, int height);
     ~FluidSolver();
 
-    void Step(float deltaTime);
+    // The step graph's phases refer to this solver
+    FluidSolver(const FluidSolver&) = delete;
+    FluidSolver& operator=(const FluidSolver&) = delete;
+
+    void Step(float deltaTime) override;
+
+    // Flow and scalars back to rest, as after construction; parameters and obstacle are kept
+    void Reset() override;
+
+    // Moves the run onto a width x height grid covering the same domain. Velocity and pressure are resampled
+    // bilinearly, scalars by area-weighted averaging over the cells' overlaps, which keeps each fluid cell's
+    // amount; only what lies where the new grid has nothing but solid is lost. The obstacle's signed distance is
+    // resampled too, or rebuilt at the new resolution by 'rebuildObstacle' (e.g. with SetAirfoil or
+    // SetObstacleMask) before the scalars are remapped and the velocity is projected again, so the flow is
+    // divergence-free against the obstacle the next step uses. Parameters are kept; boundary state such as
+    // outflow history restarts.
+    void Resize(int width, int height);
+    void Resize(int width, int height, FunctionRef<void(FluidSolver&)> rebuildObstacle);
+
+    // Makes this solver one slab of a domain split into columns across processes (see DistributedFluidSolver): its
+    // grid is domain columns columnOffset .. columnOffset + width - 1 of 'domainWidth', and it updates local columns
+    // [columnBegin, columnEnd). 'link' fills in the other columns after every boundary update and makes convergence
+    // tests global, and steps run their phases in order so every slab meets it at the same points. Fields, obstacle
+    // and the domain sides the slab reaches are local; solves must use Relaxation::Jacobi, sides may not be periodic
+    // left and right or convective outflow at the bottom and top, and the grid cannot be resized.
+    void SetSlab(int domainWidth, int columnOffset, int columnBegin, int columnEnd, SlabLink& link);
 
     // Getters for Renderer
-    int GetWidth() const { return m_Width; }
-    int GetHeight() const { return m_Height; }
-    const std::vector<float>& GetVelocityX() const { return m_VelocityX; }
-    const std::vector<float>& GetVelocityY() const { return m_VelocityY; }
-    const std::vector<float>& GetPressure() const { return m_Pressure; }
-    const std::vector<float>& GetSolidMask() const { return m_SolidMask; }
-    const std::vector<float>& GetDyeDensity() const { return m_DyeDensity; }
+    int GetWidth() const override { return m_Width; }
+    int GetHeight() const override { return m_Height; }
+    const std::vector<float>& GetVelocityX() const override { return m_VelocityX; }
+    const std::vector<float>& GetVelocityY() const override { return m_VelocityY; }
+    const std::vector<float>& GetPressure() const override { return m_Pressure; }
+    const std::vector<float>& GetSolidMask() const override { return m_SolidMask; }
+    const std::vector<float>& GetSolidDistance() const { return m_SolidDistance; }
+    const std::vector<float>& GetDyeDensity() const override { return m_Scalars.GetValues(0); }
+    const std::vector<float>& GetScalar(int species) const override { return m_Scalars.GetValues(species); }
+    const std::vector<float>& GetEddyViscosity() const { return m_EddyViscosity; }
+    FieldView GetFieldView() const override; // DyeDensity is m_DisplayedSpecies
+
+    // Bumped by every Step and obstacle change
+    uint64_t GetVersion() const override { return m_Version; }
+
+    // Bumped by every obstacle change only
+    uint64_t GetObstacleVersion() const { return m_ObstacleVersion; }
 
     // Configuration
-    void SetViscosity(float viscosity) { m_Viscosity = viscosity; }
-    void SetDiffusion(float diffusion) { m_Diffusion = diffusion; }
-    void SetInflowVelocity(float velocity) { m_InflowVelocity = velocity; }
+    void SetViscosity(float viscosity) override { m_Viscosity = viscosity; }
+    void SetDiffusion(float diffusion); // Of the dye, species 0
+    void SetInflowVelocity(float velocity) override { m_InflowVelocity = velocity; }
+
+    // Condition on each side of the domain; the default is the wind tunnel (uniform inflow left, outflow right,
+    // free-slip top and bottom)
+    void SetBoundarySettings(const BoundarySettings& settings) override
+    {
+        m_Boundaries.Configure(settings, m_Width, m_Height, m_DomainWidth, m_ColumnOffset);
+    }
+    const BoundarySettings& GetBoundarySettings() const override { return m_Boundaries.GetSettings(); }
+
+    // Passive scalars transported by the flow, each with its own emitters, diffusion and decay; species 0 is the
+    // dye. There is always at least one species.
+    void SetSpecies(const std::vector<ScalarSpecies>& species) override;
+    const std::vector<ScalarSpecies>& GetSpecies() const override { return m_Scalars.GetSpecies(); }
     void InitObstacle();
-    void SetObstacleMask(const std::vector<float>& mask);
+
+    // Replaces the obstacle with a generated (and cached) NACA profile; false if the designation is invalid
+    bool SetAirfoil(const ObstacleLibrary::Airfoil& airfoil);
+    void SetObstacleMask(Span<const float> mask) override;
+
+    // Obstacle given as a signed distance in cells (negative inside); the mask follows from the sign
+    void SetObstacleDistance(Span<const float> distance);
+
+    // Restores a mask and distance taken from GetSolidMask / GetSolidDistance exactly
+    void SetObstacle(Span<const float> mask, Span<const float> distance);
 
     // Simulation Parameters public for UI
     float m_Viscosity = 0.000133f;
-    float m_Diffusion = 0.0f;
     float m_InflowVelocity = 1.6f;
-    float m_DyeDecay = 0.01f;
+    int m_DisplayedSpecies = 0;
 
     bool m_FrontalSource = false;
 
+    // Use the obstacle's signed distance instead of the staircase mask at walls: pressure couples through the open
+    // fraction of each cell face and velocity diffusion puts the no-slip wall at the zero crossing
+    bool m_SubCellBoundaries = false;
+
+    // Sub-grid model for large-eddy simulation: a per-cell eddy viscosity from the resolved velocity gradient is
+    // added to m_Viscosity when diffusing velocity
+    enum class TurbulenceModel {
+        None = 0,
+        Smagorinsky = 1, // nu_t = (Cs * delta)^2 * |S|
+        WALE = 2         // Wall-adapting local eddy viscosity: vanishes in pure shear, so walls need no damping
+    };
+    TurbulenceModel m_TurbulenceModel = TurbulenceModel::None;
+    float m_SmagorinskyConstant = 0.17f;
+    float m_WaleConstant = 0.5f;
+
     int m_Iterations = 40;
 
+    // Pressure solver. GaussSeidel relaxes in place (faster convergence); Jacobi reads only the previous sweep,
+    // so its result does not depend on traversal order or on how the domain is decomposed, and diffusion then
+    // uses m_Iterations Jacobi sweeps as well. ConjugateGradient solves the same system with the shared Krylov
+    // solver, which diffusion uses in the other two modes. Spectral solves the staircase system directly (see
+    // SpectralPoisson); with sub-cell boundaries or sides it does not support it falls back to GaussSeidel.
+    enum class Relaxation {
+        GaussSeidel = 0,
+        Jacobi = 1,
+        ConjugateGradient = 2,
+        Spectral = 3
+    };
+    Relaxation m_Relaxation = Relaxation::GaussSeidel;
+
+    // Pressure sweeps stop early once the largest per-sweep change drops below this (0 = always m_Iterations);
+    // for ConjugateGradient it is the residual relative to the divergence
+    float m_PressureTolerance = 0.0f;
+    int GetLastPressureIterations() const { return m_LastPressureIterations; }
+
+    // Diffusion solves stop at this residual relative to the right-hand side
+    float m_DiffusionTolerance = 1e-5f;
+    int GetLastDiffusionIterations() const { return m_LastDiffusionIterations; } // Summed over the last step
 
 private:
-    void Advect(int boundaryType, std::vector<float>& dest, const std::vector<float>& source, const std::vector<float>& velocityX, const std::vector<float>& velocityY, float deltaTime);
-    void Diffuse(int boundaryType, std::vector<float>& x, const std::vector<float>& xPrev, float diffusionRate, float deltaTime);
+    // Buffers of one linear solve, so solves that do not depend on each other can run at the same time
+    struct SolveWorkspace {
+        std::vector<float> CellDiffusion; // Per-cell diffusion coefficient
+
+        // Operator of the current solve (see GridStencil)
+        std::vector<float> StencilDiagonal, CouplingX, CouplingY, StencilActive;
+        std::vector<float> Scratch;        // Jacobi target buffer
+        std::vector<float> ChunkStiffness; // Per row chunk of BuildDiffusionStencil
+        LinearSolver Solver;
+        int DiffusionIterations = 0;       // In the current step
+
+        void Resize(int size);
+    };
+
+    // Declares the phases of Step with the fields each reads and writes (see TaskGraph)
+    void BuildStepGraph();
+
+    void Advect(BoundaryField field, std::vector<float>& dest, const std::vector<float>& source, const std::vector<float>& velocityX, const std::vector<float>& velocityY, float deltaTime);
+    void Diffuse(SolveWorkspace& workspace, BoundaryField field, std::vector<float>& x, const std::vector<float>& xPrev, float diffusionRate, float deltaTime);
+    void ComputeEddyViscosity(const std::vector<float>& velocityX, const std::vector<float>& velocityY);
     void Project(std::vector<float>& velocityX, std::vector<float>& velocityY, std::vector<float>& pressure, std::vector<float>& divergence);
 
-    // boundaryType: 0 = scalars, 1 = velocityX (horizontal), 2 = velocityY (vertical)
-    void SetBoundaries(int boundaryType, std::vector<float>& x);
+    void SetBoundaries(BoundaryField field, std::vector<float>& x);
+
+    // For a slab (see SetSlab): refreshes the columns other slabs update, and takes a maximum over all slabs
+    void ExchangeHalos(std::vector<float>& x);
+    float GlobalMax(float value) { return m_SlabLink ? m_SlabLink->AllReduceMax(value) : value; }
 
     // Helper for linear array access
     int GetIndex(int x, int y) const;
 
     void ApplyInflow();
 
+    // Face fractions from m_SolidDistance; called whenever the obstacle changes
+    void UpdateFaceFractions();
+
+    // Fill the stencil arrays with the obstacle-aware operator of a diffusion step (returning its largest
+    // off-diagonal weight, 0 when there is nothing to diffuse) or of the pressure Poisson equation
+    float BuildDiffusionStencil(SolveWorkspace& workspace, BoundaryField field, float diffusionRate, float deltaTime);
+    void BuildPressureStencil(SolveWorkspace& workspace);
+    GridStencil GetStencil(const SolveWorkspace& workspace) const;
+
+    // Per-cell kernels behind the methods above, specialised on what would otherwise be tested in every cell
+    // (see SpecialiseFlags): 'Obstacles' is m_HasObstacle, and without it no kernel loads the solid mask
+    template <bool Obstacles, bool PeriodicX, bool PeriodicY>
+    void AdvectKernel(float* dest, const float* source, const float* velocityX, const float* velocityY, float deltaTime);
+    template <bool Velocity, bool Eddy, bool SubCell, bool Obstacles>
+    float BuildDiffusionStencilKernel(SolveWorkspace& workspace, float diffusionRate, float deltaTime);
+    template <bool Obstacles>
+    void ExplicitDiffusionKernel(const SolveWorkspace& workspace, float* values);
+    template <bool Obstacles>
+    void JacobiDiffusionKernel(const SolveWorkspace& workspace, float* target, const float* values, const float* source);
+    template <bool Wale, bool Obstacles>
+    void EddyViscosityKernel(const float* velocityX, const float* velocityY);
+    template <bool SubCell, bool Obstacles>
+    void DivergenceKernel(const float* velocityX, const float* velocityY, float* pressure, float* divergence);
+    template <bool SubCell, bool Obstacles>
+    float PressureSweepKernel(float* target, const float* pressure, const float* divergence); // Returns the largest change
+    template <bool SubCell, bool Obstacles>
+    void SubtractGradientKernel(float* velocityX, float* velocityY, const float* pressure);
+
+    // Brings the spectral solver up to date with the grid, sides and obstacle; false if it cannot be used
+    bool PrepareSpectralSolver();
+
 
 private:
     int m_Width;
     int m_Height;
     int m_Size; // m_Width * m_Height
 
+    // Columns of the domain this grid holds and updates (see SetSlab); all of them unless it is a slab
+    int m_DomainWidth;
+    int m_ColumnOffset = 0;
+    int m_ColumnBegin = 1;
+    int m_ColumnEnd;
+    SlabLink* m_SlabLink = nullptr;
+
     // Fluid Fields (Current and Previous)
     std::vector<float> m_VelocityX, m_VelocityXPrev;
     std::vector<float> m_VelocityY, m_VelocityYPrev;
     std::vector<float> m_Pressure, m_Divergence;
-    std::vector<float> m_DyeDensity, m_DyeDensityPrev;
+    std::vector<float> m_ScalarPrev; // Source of each species' diffusion
     std::vector<float> m_SolidMask;
+    std::vector<float> m_SolidDistance; // Cells to the obstacle surface, negative inside
+    std::vector<float> m_FaceOpenX;     // Open fraction of the face between (i - 1, j) and (i, j)
+    std::vector<float> m_FaceOpenY;     // Open fraction of the face between (i, j - 1) and (i, j)
+    bool m_HasObstacle = false;         // Any cell of m_SolidMask is solid
+    std::vector<float> m_EddyViscosity;
+
+    // One per solve that can overlap another: the two velocity diffusions (the pressure solves, which follow both,
+    // reuse the first) and the scalar diffusion running alongside them
+    SolveWorkspace m_WorkspaceX, m_WorkspaceY, m_ScalarWorkspace;
+    SpectralPoisson m_SpectralSolver;
+    DomainBoundaries m_Boundaries;
+    ScalarTransport m_Scalars;
+
+    int m_LastPressureIterations = 0;
+    int m_LastDiffusionIterations = 0;
+
+    TaskGraph m_StepGraph;
+    float m_StepDeltaTime = 0.0f; // Of the Step running the graph
+    uint64_t m_Version = 0;
+    uint64_t m_ObstacleVersion = 0;
 };
@@ -0,0 +1,434 @@
+#include "FluidSolver3D.h"
+#include "ObstacleLibrary.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+FluidSolver3D::FluidSolver3D(int width, int height, int depth)
+    : m_Width(width), m_Height(height), m_Depth(depth)
+{
+    m_BricksX = (width + BrickSize - 1) / BrickSize;
+    m_BricksY = (height + BrickSize - 1) / BrickSize;
+    m_BricksZ = (depth + BrickSize - 1) / BrickSize;
+    m_Size = m_BricksX * m_BricksY * m_BricksZ * BrickCells;
+    m_BrickStrideY = m_BricksX * BrickCells;
+    m_BrickStrideZ = m_BricksX * m_BricksY * BrickCells;
+
+    m_VelocityX.resize(m_Size, 0.0f);
+    m_VelocityXPrev.resize(m_Size, 0.0f);
+    m_VelocityY.resize(m_Size, 0.0f);
+    m_VelocityYPrev.resize(m_Size, 0.0f);
+    m_VelocityZ.resize(m_Size, 0.0f);
+    m_VelocityZPrev.resize(m_Size, 0.0f);
+    m_Pressure.resize(m_Size, 0.0f);
+    m_Divergence.resize(m_Size, 0.0f);
+    m_DyeDensity.resize(m_Size, 0.0f);
+    m_DyeDensityPrev.resize(m_Size, 0.0f);
+    m_SolidMask.resize(m_Size, 0.0f); // 0.0 = fluid
+    InitObstacle();
+}
+
+FluidSolver3D::~FluidSolver3D()
+{
+
+}
+
+int FluidSolver3D::GetIndex(int x, int y, int z) const
+{
+    x = std::max(0, std::min(x, m_Width - 1));
+    y = std::max(0, std::min(y, m_Height - 1));
+    z = std::max(0, std::min(z, m_Depth - 1));
+
+    int brick = ((z >> BrickShift) * m_BricksY + (y >> BrickShift)) * m_BricksX + (x >> BrickShift);
+    return brick * BrickCells + LocalIndex(x, y, z);
+}
+
+void FluidSolver3D::GetNeighbours(int index, int x, int y, int z, int (&neighbours)[6]) const
+{
+    const int last = BrickSize - 1;
+    int lx = x & last;
+    int ly = y & last;
+    int lz = z & last;
+
+    // Inside a brick neighbours are 1, 8 and 64 cells apart; across a brick face they sit in the adjacent brick
+    neighbours[0] = lx > 0    ? index - 1 : index - BrickCells + last;
+    neighbours[1] = lx < last ? index + 1 : index + BrickCells - last;
+    neighbours[2] = ly > 0    ? index - BrickSize : index - m_BrickStrideY + last * BrickSize;
+    neighbours[3] = ly < last ? index + BrickSize : index + m_BrickStrideY - last * BrickSize;
+    neighbours[4] = lz > 0    ? index - BrickSize * BrickSize : index - m_BrickStrideZ + last * BrickSize * BrickSize;
+    neighbours[5] = lz < last ? index + BrickSize * BrickSize : index + m_BrickStrideZ - last * BrickSize * BrickSize;
+}
+
+template <typename Func>
+void FluidSolver3D::ForEachBrick(const Func& func) const
+{
+    int brickCount = m_BricksX * m_BricksY * m_BricksZ;
+    ThreadPool::Get().ParallelFor(0, brickCount, 1, [&](int begin, int end) {
+        for (int brick = begin; brick < end; brick++) {
+            int bx = brick % m_BricksX;
+            int by = (brick / m_BricksX) % m_BricksY;
+            int bz = brick / (m_BricksX * m_BricksY);
+            func(bx, by, bz, brick * BrickCells);
+        }
+    });
+}
+
+// Iterates the interior cells (1 .. n-2 on every axis) of one brick, with 'index' the cell's blocked index
+#define FOR_EACH_INTERIOR_CELL(bx, by, bz, brickBase)                                                               \
+    for (int k = std::max(1, (bz) * BrickSize); k < std::min(m_Depth - 1, ((bz) + 1) * BrickSize); k++)             \
+        for (int j = std::max(1, (by) * BrickSize); j < std::min(m_Height - 1, ((by) + 1) * BrickSize); j++)        \
+            for (int i = std::max(1, (bx) * BrickSize), index = (brickBase) + LocalIndex(i, j, k);                  \
+                 i < std::min(m_Width - 1, ((bx) + 1) * BrickSize); i++, index++)
+
+// Same as above but only visits cells with (i + j + k) % 2 == parity, for red-black relaxation
+#define FOR_EACH_INTERIOR_CELL_OF_PARITY(bx, by, bz, brickBase, parity)                                             \
+    for (int k = std::max(1, (bz) * BrickSize); k < std::min(m_Depth - 1, ((bz) + 1) * BrickSize); k++)             \
+        for (int j = std::max(1, (by) * BrickSize); j < std::min(m_Height - 1, ((by) + 1) * BrickSize); j++)        \
+            for (int i = std::max(1, (bx) * BrickSize) + ((std::max(1, (bx) * BrickSize) + j + k + (parity)) & 1),  \
+                     index = (brickBase) + LocalIndex(i, j, k);                                                     \
+                 i < std::min(m_Width - 1, ((bx) + 1) * BrickSize); i += 2, index += 2)
+
+void FluidSolver3D::Step(float dt)
+{
+    std::swap(m_VelocityX, m_VelocityXPrev);
+    std::swap(m_VelocityY, m_VelocityYPrev);
+    std::swap(m_VelocityZ, m_VelocityZPrev);
+
+    // Diffuse velocity (Viscosity)
+    Diffuse(1, m_VelocityX, m_VelocityXPrev, m_Viscosity, dt);
+    Diffuse(2, m_VelocityY, m_VelocityYPrev, m_Viscosity, dt);
+    Diffuse(3, m_VelocityZ, m_VelocityZPrev, m_Viscosity, dt);
+
+    // Compute Pressure and remove divergence
+    Project();
+
+    std::swap(m_VelocityX, m_VelocityXPrev);
+    std::swap(m_VelocityY, m_VelocityYPrev);
+    std::swap(m_VelocityZ, m_VelocityZPrev);
+
+    // Advect velocity
+    Advect(1, m_VelocityX, m_VelocityXPrev, m_VelocityXPrev, m_VelocityYPrev, m_VelocityZPrev, dt);
+    Advect(2, m_VelocityY, m_VelocityYPrev, m_VelocityXPrev, m_VelocityYPrev, m_VelocityZPrev, dt);
+    Advect(3, m_VelocityZ, m_VelocityZPrev, m_VelocityXPrev, m_VelocityYPrev, m_VelocityZPrev, dt);
+
+    // Project again to keep it mass-conserving
+    Project();
+
+    // Advect and Diffuse Dye
+    std::swap(m_DyeDensity, m_DyeDensityPrev);
+    Diffuse(0, m_DyeDensity, m_DyeDensityPrev, m_Diffusion, dt);
+
+    std::swap(m_DyeDensity, m_DyeDensityPrev);
+    Advect(0, m_DyeDensity, m_DyeDensityPrev, m_VelocityX, m_VelocityY, m_VelocityZ, dt);
+
+    // Apply forces and inflow
+    ApplyInflow();
+}
+
+void FluidSolver3D::Advect(int boundaryType, std::vector<float>& destField, const std::vector<float>& sourceField,
+                          const std::vector<float>& velocityX, const std::vector<float>& velocityY, const std::vector<float>& velocityZ, float deltaTime)
+{
+    float dt0_x = deltaTime * (m_Width - 2);
+    float dt0_y = deltaTime * (m_Height - 2);
+    float dt0_z = deltaTime * (m_Depth - 2);
+
+    ForEachBrick([&](int bx, int by, int bz, int brickBase) {
+        FOR_EACH_INTERIOR_CELL(bx, by, bz, brickBase) {
+            if (m_SolidMask[index] > 0.0f) {
+                destField[index] = 0.0f;
+                continue;
+            }
+
+            // Backtrace and clamp to grid
+            float x = std::min(std::max(i - dt0_x * velocityX[index], 0.5f), m_Width - 1.5f);
+            float y = std::min(std::max(j - dt0_y * velocityY[index], 0.5f), m_Height - 1.5f);
+            float z = std::min(std::max(k - dt0_z * velocityZ[index], 0.5f), m_Depth - 1.5f);
+
+            int x0 = (int)x;
+            int y0 = (int)y;
+            int z0 = (int)z;
+
+            // Trilinear interpolation weights
+            float wx1 = x - x0, wx0 = 1.0f - wx1;
+            float wy1 = y - y0, wy0 = 1.0f - wy1;
+            float wz1 = z - z0, wz0 = 1.0f - wz1;
+
+            float front =
+                wx0 * (wy0 * sourceField[GetIndex(x0, y0, z0)] + wy1 * sourceField[GetIndex(x0, y0 + 1, z0)]) +
+                wx1 * (wy0 * sourceField[GetIndex(x0 + 1, y0, z0)] + wy1 * sourceField[GetIndex(x0 + 1, y0 + 1, z0)]);
+            float back =
+                wx0 * (wy0 * sourceField[GetIndex(x0, y0, z0 + 1)] + wy1 * sourceField[GetIndex(x0, y0 + 1, z0 + 1)]) +
+                wx1 * (wy0 * sourceField[GetIndex(x0 + 1, y0, z0 + 1)] + wy1 * sourceField[GetIndex(x0 + 1, y0 + 1, z0 + 1)]);
+
+            destField[index] = wz0 * front + wz1 * back;
+        }
+    });
+    SetBoundaries(boundaryType, destField);
+}
+
+void FluidSolver3D::Diffuse(int boundaryType, std::vector<float>& destField, const std::vector<float>& sourceField, float diffRate, float deltaTime)
+{
+    float diffusionCoefficient = deltaTime * diffRate * (m_Width - 2) * (m_Height - 2);
+    float denominator = 1.0f + 6.0f * diffusionCoefficient;
+
+    for (int iteration = 0; iteration < m_Iterations; iteration++) {
+        // Red-black ordering keeps the in-place relaxation race free across bricks
+        for (int parity = 0; parity < 2; parity++) {
+            ForEachBrick([&](int bx, int by, int bz, int brickBase) {
+                FOR_EACH_INTERIOR_CELL_OF_PARITY(bx, by, bz, brickBase, parity) {
+                    if (m_SolidMask[index] > 0.0f) continue;
+
+                    int neighbours[6];
+                    GetNeighbours(index, i, j, k, neighbours);
+
+                    float sum = 0.0f;
+                    for (int n : neighbours) {
+                        if (m_SolidMask[n] > 0.0f) {
+                            // Scalars see no flux into the solid, velocity sees no-slip
+                            sum += (boundaryType == 0) ? destField[index] : 0.0f;
+                        } else {
+                            sum += destField[n];
+                        }
+                    }
+
+                    destField[index] = (sourceField[index] + diffusionCoefficient * sum) / denominator;
+                }
+            });
+        }
+        SetBoundaries(boundaryType, destField);
+    }
+}
+
+void FluidSolver3D::Project()
+{
+    float h = 1.0f / m_Width;
+
+    // Divergence
+    ForEachBrick([&](int bx, int by, int bz, int brickBase) {
+        FOR_EACH_INTERIOR_CELL(bx, by, bz, brickBase) {
+            m_Pressure[index] = 0.0f;
+
+            if (m_SolidMask[index] > 0.0f) {
+                m_Divergence[index] = 0.0f;
+                continue;
+            }
+
+            int n[6];
+            GetNeighbours(index, i, j, k, n);
+
+            m_Divergence[index] = -0.5f * h * (m_VelocityX[n[1]] - m_VelocityX[n[0]] +
+                                               m_VelocityY[n[3]] - m_VelocityY[n[2]] +
+                                               m_VelocityZ[n[5]] - m_VelocityZ[n[4]]);
+        }
+    });
+
+    SetBoundaries(0, m_Divergence);
+    SetBoundaries(4, m_Pressure);
+
+    // Solve Pressure (Poisson equation), Neumann condition at obstacles
+    for (int iteration = 0; iteration < m_Iterations; iteration++) {
+        for (int parity = 0; parity < 2; parity++) {
+            ForEachBrick([&](int bx, int by, int bz, int brickBase) {
+                FOR_EACH_INTERIOR_CELL_OF_PARITY(bx, by, bz, brickBase, parity) {
+                    if (m_SolidMask[index] > 0.0f) continue;
+
+                    int neighbours[6];
+                    GetNeighbours(index, i, j, k, neighbours);
+
+                    float sum = 0.0f;
+                    for (int n : neighbours) {
+                        sum += (m_SolidMask[n] > 0.0f) ? m_Pressure[index] : m_Pressure[n];
+                    }
+
+                    m_Pressure[index] = (m_Divergence[index] + sum) / 6.0f;
+                }
+            });
+        }
+        SetBoundaries(4, m_Pressure);
+    }
+
+    // Subtract Gradient from Velocity
+    ForEachBrick([&](int bx, int by, int bz, int brickBase) {
+        FOR_EACH_INTERIOR_CELL(bx, by, bz, brickBase) {
+            if (m_SolidMask[index] > 0.0f) {
+                m_VelocityX[index] = 0.0f;
+                m_VelocityY[index] = 0.0f;
+                m_VelocityZ[index] = 0.0f;
+                continue;
+            }
+
+            int n[6];
+            GetNeighbours(index, i, j, k, n);
+            auto sample = [&](int neighbour) { return (m_SolidMask[neighbour] > 0.0f) ? m_Pressure[index] : m_Pressure[neighbour]; };
+
+            m_VelocityX[index] -= 0.5f * (sample(n[1]) - sample(n[0])) / h;
+            m_VelocityY[index] -= 0.5f * (sample(n[3]) - sample(n[2])) / h;
+            m_VelocityZ[index] -= 0.5f * (sample(n[5]) - sample(n[4])) / h;
+        }
+    });
+
+    SetBoundaries(1, m_VelocityX);
+    SetBoundaries(2, m_VelocityY);
+    SetBoundaries(3, m_VelocityZ);
+}
+
+void FluidSolver3D::SetBoundaries(int boundaryType, std::vector<float>& field)
+{
+    // Faces are applied x, then y, then z, each over the full extent of the previous ones,
+    // so edges and corners end up copying from already-valid neighbours.
+    ThreadPool::Get().ParallelFor(1, m_Depth - 1, 8, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            for (int j = 1; j < m_Height - 1; j++) {
+                // Inflow (left) and outflow (right); pressure is fixed to zero at the outflow
+                field[GetIndex(0, j, k)] = field[GetIndex(1, j, k)];
+                field[GetIndex(m_Width - 1, j, k)] = (boundaryType == 4) ? 0.0f : field[GetIndex(m_Width - 2, j, k)];
+            }
+        }
+    });
+
+    float signY = (boundaryType == 2) ? -1.0f : 1.0f;
+    ThreadPool::Get().ParallelFor(1, m_Depth - 1, 8, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            for (int i = 0; i < m_Width; i++) {
+                field[GetIndex(i, 0, k)] = signY * field[GetIndex(i, 1, k)];
+                field[GetIndex(i, m_Height - 1, k)] = signY * field[GetIndex(i, m_Height - 2, k)];
+            }
+        }
+    });
+
+    float signZ = (boundaryType == 3) ? -1.0f : 1.0f;
+    ThreadPool::Get().ParallelFor(0, m_Height, 8, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = 0; i < m_Width; i++) {
+                field[GetIndex(i, j, 0)] = signZ * field[GetIndex(i, j, 1)];
+                field[GetIndex(i, j, m_Depth - 1)] = signZ * field[GetIndex(i, j, m_Depth - 2)];
+            }
+        }
+    });
+}
+
+void FluidSolver3D::ApplyInflow()
+{
+    // Override left boundary for wind tunnel effect, with a horizontal dye sheet across the span
+    for (int k = 1; k < m_Depth - 1; k++) {
+        for (int j = 1; j < m_Height - 1; j++) {
+            bool emitter = j > m_Height * 0.45f && j < m_Height * 0.55f;
+
+            for (int i = 0; i < 2; i++) {
+                int index = GetIndex(i, j, k);
+                m_VelocityX[index] = m_InflowVelocity;
+                m_VelocityY[index] = 0.0f;
+                m_VelocityZ[index] = 0.0f;
+            }
+
+            if (emitter) {
+                m_DyeDensity[GetIndex(0, j, k)] = 1.0f;
+                m_DyeDensity[GetIndex(1, j, k)] = 1.0f;
+            } else {
+                m_DyeDensity[GetIndex(0, j, k)] = 0.0f;
+            }
+        }
+    }
+}
+
+void FluidSolver3D::InitObstacle()
+{
+    std::fill(m_SolidMask.begin(), m_SolidMask.end(), 0.0f);
+
+    // FluidSolver's default profile, extruded over the middle half of the depth
+    auto shape = ObstacleLibrary::Get().GetAirfoil(ObstacleLibrary::GetDefaultAirfoil(m_Width, m_Height), m_Width, m_Height);
+    if (!shape) return;
+
+    for (int k = m_Depth / 4; k < m_Depth - m_Depth / 4; k++) {
+        for (int j = 0; j < m_Height; j++) {
+            for (int i = 0; i < m_Width; i++) {
+                if (shape->Mask[i + j * m_Width] > 0.0f) {
+                    int index = GetIndex(i, j, k);
+                    m_SolidMask[index] = 1.0f;
+                    m_VelocityX[index] = 0.0f;
+                    m_VelocityY[index] = 0.0f;
+                    m_VelocityZ[index] = 0.0f;
+                }
+            }
+        }
+    }
+}
+
+void FluidSolver3D::SetObstacleMask(Span<const float> mask)
+{
+    if (mask.size() != (size_t)m_Width * m_Height * m_Depth) return;
+
+    for (int k = 0; k < m_Depth; k++) {
+        for (int j = 0; j < m_Height; j++) {
+            for (int i = 0; i < m_Width; i++) {
+                int index = GetIndex(i, j, k);
+                m_SolidMask[index] = mask[i + (size_t)m_Width * (j + (size_t)m_Height * k)];
+
+                // Clear velocity inside obstacle
+                if (m_SolidMask[index] > 0.0f) {
+                    m_VelocityX[index] = 0.0f;
+                    m_VelocityY[index] = 0.0f;
+                    m_VelocityZ[index] = 0.0f;
+                }
+            }
+        }
+    }
+}
+
+void FluidSolver3D::ExtractSlice(SliceSummary summary, int depthIndex, FieldSlice& slice) const
+{
+    int cellCount = m_Width * m_Height;
+    slice.Width = m_Width;
+    slice.Height = m_Height;
+    slice.VelocityX.resize(cellCount);
+    slice.VelocityY.resize(cellCount);
+    slice.Pressure.resize(cellCount);
+    slice.DyeDensity.resize(cellCount);
+    slice.SolidMask.resize(cellCount);
+    slice.Version++;
+
+    depthIndex = std::max(0, std::min(depthIndex, m_Depth - 1));
+
+    ThreadPool::Get().ParallelFor(0, m_Height, 8, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = 0; i < m_Width; i++) {
+                int out = i + j * m_Width;
+
+                if (summary == SliceSummary::Plane) {
+                    int index = GetIndex(i, j, depthIndex);
+                    slice.VelocityX[out] = m_VelocityX[index];
+                    slice.VelocityY[out] = m_VelocityY[index];
+                    slice.Pressure[out] = m_Pressure[index];
+                    slice.DyeDensity[out] = m_DyeDensity[index];
+                    slice.SolidMask[out] = m_SolidMask[index];
+                    continue;
+                }
+
+                float u = 0.0f, v = 0.0f, p = 0.0f, dye = 0.0f, solid = 0.0f;
+                int fluidCells = 0;
+                for (int k = 1; k < m_Depth - 1; k++) {
+                    int index = GetIndex(i, j, k);
+                    if (m_SolidMask[index] > 0.0f) {
+                        solid = 1.0f;
+                        continue;
+                    }
+                    u += m_VelocityX[index];
+                    v += m_VelocityY[index];
+                    p += m_Pressure[index];
+                    dye += m_DyeDensity[index];
+                    fluidCells++;
+                }
+
+                float scale = fluidCells > 0 ? 1.0f / fluidCells : 0.0f;
+                slice.VelocityX[out] = u * scale;
+                slice.VelocityY[out] = v * scale;
+                slice.Pressure[out] = p * scale;
+                slice.DyeDensity[out] = dye * scale;
+                slice.SolidMask[out] = solid;
+            }
+        }
+    });
+}
+
+#undef FOR_EACH_INTERIOR_CELL
+#undef FOR_EACH_INTERIOR_CELL_OF_PARITY
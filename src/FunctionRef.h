@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Non-owning reference to a callable, for callbacks that are only called while the call taking them runs. Unlike
+// std::function it never allocates, whatever the lambda captures: it keeps the callable's address and a thunk.
+template <typename Signature>
+class FunctionRef;
+
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)> {
+public:
+    template <typename Callable, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Callable>, FunctionRef>>>
+    FunctionRef(Callable&& callable)
+        : m_Object((void*)std::addressof(callable)),
+          m_Call([](void* object, Args... args) -> Result {
+              return (*(std::remove_reference_t<Callable>*)object)(std::forward<Args>(args)...);
+          })
+    {
+    }
+
+    Result operator()(Args... args) const { return m_Call(m_Object, std::forward<Args>(args)...); }
+
+private:
+    void* m_Object;
+    Result (*m_Call)(void*, Args...);
+};
@@ -1,48 +1,242 @@
 #include "Mesh.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Largest spread of vertex indices a 16-bit meshlet can address from its base
+constexpr unsigned int MaxShortSpan = 0xFFFF;
+
+// A level needing more 16-bit meshlets than this (indices with little locality) is drawn with 32-bit indices in one call
+constexpr size_t MaxMeshletsPerLod = 256;
+
+// Signed normalised 10:10:10:2, the layout of GL_INT_2_10_10_10_REV
+uint32_t PackNormal(const glm::vec3& normal)
+{
+    auto component = [](float value) {
+        return (uint32_t)(int)std::round(std::max(-1.0f, std::min(value, 1.0f)) * 511.0f) & 0x3FF;
+    };
+    return component(normal.x) | component(normal.y) << 10 | component(normal.z) << 20;
+}
+
+void AlignElements(std::vector<uint8_t>& elements, size_t alignment)
+{
+    elements.resize((elements.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+MeshGeometry BorrowVectors(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    MeshGeometry geometry;
+    geometry.Vertices = vertices.data();
+    geometry.VertexCount = vertices.size();
+    geometry.Indices = indices.data();
+    geometry.IndexCount = indices.size();
+    return geometry;
+}
+
+}
 
 Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+    : Mesh(BorrowVectors(vertices, indices))
+{
+}
+
+Mesh::Mesh(const MeshGeometry& geometry)
 {
-    m_IndexCount = static_cast<unsigned int>(indices.size());
-    SetupMesh(vertices, indices);
+    m_VertexCount = geometry.VertexCount;
+
+    // Levels that do not fit the index array are dropped rather than drawn out of bounds
+    for (size_t i = 0; i < geometry.LodCount; i++) {
+        const MeshLod& lod = geometry.Lods[i];
+        if (lod.IndexOffset + lod.IndexCount <= geometry.IndexCount) m_Lods.push_back(lod);
+    }
+    if (m_Lods.empty()) {
+        MeshLod full;
+        full.IndexCount = geometry.IndexCount;
+        m_Lods.push_back(full);
+    }
+
+    if (geometry.Storage && geometry.Positions) {
+        // Borrow the caller's arrays (e.g. a mapped cache file) instead of duplicating them
+        m_Storage = geometry.Storage;
+        m_PositionData = geometry.Positions;
+        m_IndexData = geometry.Indices;
+    } else {
+        m_Positions.resize(geometry.VertexCount);
+        for (size_t i = 0; i < geometry.VertexCount; i++) {
+            m_Positions[i] = geometry.Vertices[i].Position;
+        }
+        m_Indices.assign(geometry.Indices, geometry.Indices + geometry.IndexCount);
+
+        m_PositionData = m_Positions.data();
+        m_IndexData = m_Indices.data();
+    }
+
+    if (m_VertexCount > 0) {
+        m_BoundsMin = m_BoundsMax = m_PositionData[0];
+        for (size_t i = 1; i < m_VertexCount; i++) {
+            m_BoundsMin = glm::min(m_BoundsMin, m_PositionData[i]);
+            m_BoundsMax = glm::max(m_BoundsMax, m_PositionData[i]);
+        }
+    }
+
+    SetupMesh(geometry);
 }
 
 Mesh::~Mesh()
 {
     glDeleteVertexArrays(1, &m_VAO);
-    glDeleteBuffers(1, &m_VBO);
+    glDeleteBuffers(1, &m_PositionVBO);
+    if (m_NormalVBO) glDeleteBuffers(1, &m_NormalVBO);
+    if (m_TexCoordVBO) glDeleteBuffers(1, &m_TexCoordVBO);
     glDeleteBuffers(1, &m_EBO);
 }
 
-void Mesh::SetupMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+void Mesh::SetupMesh(const MeshGeometry& geometry)
 {
-    glGenVertexArrays(1, &m_VAO);
-    glGenBuffers(1, &m_VBO);
-    glGenBuffers(1, &m_EBO);
+    size_t vertexCount = geometry.VertexCount;
 
-    glBindVertexArray(m_VAO);
+    // Positions as 16-bit fractions of the bounding box, padded to four components for alignment
+    glm::vec3 extent = m_BoundsMax - m_BoundsMin;
+    std::vector<uint16_t> positions(vertexCount * 4, 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            float fraction = extent[axis] > 0.0f ? (m_PositionData[i][axis] - m_BoundsMin[axis]) / extent[axis] : 0.0f;
+            positions[i * 4 + axis] = (uint16_t)std::round(std::max(0.0f, std::min(fraction, 1.0f)) * 65535.0f);
+        }
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // Normals and texture coordinates only when the geometry carries any
+    bool normals = false;
+    bool texCoords = false;
+    for (size_t i = 0; i < vertexCount && geometry.Vertices && !(normals && texCoords); i++) {
+        normals |= geometry.Vertices[i].Normal != glm::vec3(0.0f);
+        texCoords |= geometry.Vertices[i].TexCoords != glm::vec2(0.0f);
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // Every level goes into the one element buffer as a few meshlets
+    std::vector<uint8_t> elements;
+    m_LodMeshlets.clear();
+    for (const MeshLod& lod : m_Lods) {
+        m_LodMeshlets.push_back(m_Meshlets.size());
+        BuildMeshlets(lod, geometry.Indices, elements);
+    }
+    m_LodMeshlets.push_back(m_Meshlets.size());
+
+    glGenVertexArrays(1, &m_VAO);
+    glBindVertexArray(m_VAO);
 
-    // Vertex positions
+    glGenBuffers(1, &m_PositionVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_PositionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(uint16_t), positions.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(uint16_t), (void*)0);
+    m_GpuBytes = positions.size() * sizeof(uint16_t);
+
+    if (normals) {
+        std::vector<uint32_t> packed(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) packed[i] = PackNormal(geometry.Vertices[i].Normal);
+
+        glGenBuffers(1, &m_NormalVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_NormalVBO);
+        glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(uint32_t), packed.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(uint32_t), (void*)0);
+        m_GpuBytes += packed.size() * sizeof(uint32_t);
+    }
+
+    if (texCoords) {
+        std::vector<glm::vec2> coords(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) coords[i] = geometry.Vertices[i].TexCoords;
 
-    // Vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glGenBuffers(1, &m_TexCoordVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_TexCoordVBO);
+        glBufferData(GL_ARRAY_BUFFER, coords.size() * sizeof(glm::vec2), coords.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        m_GpuBytes += coords.size() * sizeof(glm::vec2);
+    }
 
-    // Vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    glGenBuffers(1, &m_EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size(), elements.data(), GL_STATIC_DRAW);
+    m_GpuBytes += elements.size();
 
     glBindVertexArray(0);
 }
 
-void Mesh::Draw()
+void Mesh::BuildMeshlets(const MeshLod& lod, const unsigned int* indices, std::vector<uint8_t>& elements)
+{
+    const unsigned int* levelIndices = indices + lod.IndexOffset;
+    size_t triangleCount = (size_t)lod.IndexCount / 3;
+
+    // Greedily cut the level where the vertices referenced so far would span more than 16 bits can reach
+    std::vector<Meshlet> meshlets;
+    bool narrow = true;
+    unsigned int low = 0, high = 0;
+    for (size_t t = 0; t < triangleCount && narrow; t++) {
+        const unsigned int* triangle = levelIndices + t * 3;
+        unsigned int triangleLow = std::min(triangle[0], std::min(triangle[1], triangle[2]));
+        unsigned int triangleHigh = std::max(triangle[0], std::max(triangle[1], triangle[2]));
+        if (triangleHigh - triangleLow > MaxShortSpan) {
+            narrow = false;
+            break;
+        }
+
+        if (meshlets.empty() || std::max(high, triangleHigh) - std::min(low, triangleLow) > MaxShortSpan) {
+            Meshlet meshlet;
+            meshlet.ByteOffset = t * 3; // Index offset within the level until placed below
+            meshlet.BaseVertex = (int)triangleLow;
+            meshlets.push_back(meshlet);
+            low = triangleLow;
+            high = triangleHigh;
+            narrow = meshlets.size() <= MaxMeshletsPerLod;
+        }
+        low = std::min(low, triangleLow);
+        high = std::max(high, triangleHigh);
+        meshlets.back().BaseVertex = (int)low;
+        meshlets.back().IndexCount += 3;
+    }
+
+    if (!narrow) {
+        AlignElements(elements, sizeof(unsigned int));
+        Meshlet wide;
+        wide.ByteOffset = elements.size();
+        wide.IndexCount = triangleCount * 3;
+        wide.Wide = true;
+        elements.resize(elements.size() + wide.IndexCount * sizeof(unsigned int));
+        std::copy(levelIndices, levelIndices + wide.IndexCount, (unsigned int*)(elements.data() + wide.ByteOffset));
+        m_Meshlets.push_back(wide);
+        return;
+    }
+
+    for (Meshlet& meshlet : meshlets) {
+        const unsigned int* source = levelIndices + meshlet.ByteOffset;
+        AlignElements(elements, sizeof(uint16_t));
+        meshlet.ByteOffset = elements.size();
+        elements.resize(elements.size() + meshlet.IndexCount * sizeof(uint16_t));
+
+        uint16_t* target = (uint16_t*)(elements.data() + meshlet.ByteOffset);
+        for (size_t i = 0; i < meshlet.IndexCount; i++) target[i] = (uint16_t)(source[i] - (unsigned int)meshlet.BaseVertex);
+        m_Meshlets.push_back(meshlet);
+    }
+}
+
+int Mesh::SelectLod(const glm::mat4& transform, float maxError) const
+{
+    // Errors are lengths, so the largest axis scale of the transform bounds how much they grow
+    float scale = std::max(glm::length(glm::vec3(transform[0])),
+                           std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+    int selected = 0;
+    for (int lod = 1; lod < (int)m_Lods.size(); lod++) {
+        if (m_Lods[lod].Error * scale >= maxError) break;
+        selected = lod;
+    }
+    return selected;
+}
+
+void Mesh::Draw(int lod)
 {
     if (m_TextureID > 0) {
         glActiveTexture(GL_TEXTURE0);
@@ -50,10 +244,21 @@ void Mesh::Draw()
     }
 
     glBindVertexArray(m_VAO);
-    glDrawElements(GL_TRIANGLES, m_IndexCount, GL_UNSIGNED_INT, 0);
+
+    // Streams the mesh lacks read the current attribute value, which is context state shared by every VAO, so it
+    // is set for each draw rather than once
+    if (!HasNormals()) glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    if (!HasTexCoords()) glVertexAttrib2f(2, 0.0f, 0.0f);
+
+    lod = std::min(std::max(lod, 0), (int)m_Lods.size() - 1);
+    for (size_t i = m_LodMeshlets[lod]; i < m_LodMeshlets[lod + 1]; i++) {
+        const Meshlet& meshlet = m_Meshlets[i];
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)meshlet.IndexCount, meshlet.Wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
+                                 (void*)meshlet.ByteOffset, meshlet.BaseVertex);
+    }
     glBindVertexArray(0);
 
     if (m_TextureID > 0) {
         glBindTexture(GL_TEXTURE_2D, 0);
     }
-}
\ No newline at end of file
+}
@@ -1,30 +1,115 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
+// Import and cache record; on the GPU a Mesh keeps the attributes in separate, smaller streams
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 TexCoords;
 };
 
+// One level of detail: a range of the mesh's index array. All levels index the same vertices.
+struct MeshLod {
+    uint64_t IndexOffset = 0;
+    uint64_t IndexCount = 0;
+    float Error = 0.0f; // Largest deviation from the full-detail surface, in model units
+    float Reserved = 0.0f;
+};
+
+// Flat geometry arrays a Mesh is built from. Storage keeps them alive (e.g. a mapped cache file); when it is set
+// the mesh keeps a reference to Positions / Indices for CPU passes instead of copying them.
+struct MeshGeometry {
+    const Vertex* Vertices = nullptr;
+    size_t VertexCount = 0;
+    const unsigned int* Indices = nullptr;
+    size_t IndexCount = 0;
+
+    const glm::vec3* Positions = nullptr; // Optional flat copy of Vertices[i].Position
+
+    // Optional coarser levels, finest first; Indices then holds all of them back to back.
+    // Without any, the whole index array is a single full-detail level.
+    const MeshLod* Lods = nullptr;
+    size_t LodCount = 0;
+    std::shared_ptr<const void> Storage;
+};
+
 class Mesh {
 public:
     Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+    explicit Mesh(const MeshGeometry& geometry);
     ~Mesh();
 
-    void Draw();
+    // Shaders take the position stream as 16-bit fractions of the bounding box and decode it as
+    // positionOffset + aPos * positionScale (see GetPositionOffset / GetPositionScale)
+    void Draw(int lod = 0);
 
     void SetTexture(unsigned int textureID) { m_TextureID = textureID; }
     unsigned int GetTexture() const { return m_TextureID; }
 
+    // CPU-side geometry for voxelisation and other CPU passes
+    const glm::vec3* GetPositions() const { return m_PositionData; }
+    const unsigned int* GetIndices(int lod = 0) const { return m_IndexData + m_Lods[lod].IndexOffset; }
+    size_t GetVertexCount() const { return m_VertexCount; }
+    size_t GetIndexCount(int lod = 0) const { return (size_t)m_Lods[lod].IndexCount; }
+
+    int GetLodCount() const { return (int)m_Lods.size(); }
+    float GetLodError(int lod) const { return m_Lods[lod].Error; }
+
+    // Coarsest level whose error, measured after 'transform' (e.g. into grid cells or pixels), is below maxError
+    int SelectLod(const glm::mat4& transform, float maxError) const;
+
+    const glm::vec3& GetBoundsMin() const { return m_BoundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_BoundsMax; }
+
+    // Decoding of the quantised position stream: the box's minimum corner and extent
+    const glm::vec3& GetPositionOffset() const { return m_BoundsMin; }
+    glm::vec3 GetPositionScale() const { return m_BoundsMax - m_BoundsMin; }
+
+    // Normals and texture coordinates are only uploaded when the geometry has any; without them the preview
+    // shader sees a constant normal facing the light and (0, 0)
+    bool HasNormals() const { return m_NormalVBO != 0; }
+    bool HasTexCoords() const { return m_TexCoordVBO != 0; }
+
+    // Vertex and element buffer sizes on the GPU
+    size_t GetGpuBytes() const { return m_GpuBytes; }
+
+private:
+    // One draw of a level: indices relative to BaseVertex, 16-bit unless the level spans too many vertices
+    struct Meshlet {
+        size_t ByteOffset = 0; // In the element buffer
+        size_t IndexCount = 0;
+        int BaseVertex = 0;
+        bool Wide = false;     // 32-bit indices
+    };
+
+    // Splits a level into meshlets and appends their indices to 'elements'
+    void BuildMeshlets(const MeshLod& lod, const unsigned int* indices, std::vector<uint8_t>& elements);
+
+    void SetupMesh(const MeshGeometry& geometry);
+
 private:
     unsigned int m_TextureID = 0;
     unsigned int m_VAO = 0;
-    unsigned int m_VBO = 0;
+    unsigned int m_PositionVBO = 0;
+    unsigned int m_NormalVBO = 0;
+    unsigned int m_TexCoordVBO = 0;
     unsigned int m_EBO = 0;
-    unsigned int m_IndexCount = 0;
+    size_t m_VertexCount = 0;
+    size_t m_GpuBytes = 0;
+    std::vector<MeshLod> m_Lods;
+    std::vector<Meshlet> m_Meshlets;
+    std::vector<size_t> m_LodMeshlets; // First meshlet of each level, then the total
+    glm::vec3 m_BoundsMin = glm::vec3(0.0f);
+    glm::vec3 m_BoundsMax = glm::vec3(0.0f);
 
-    void SetupMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
-};
\ No newline at end of file
+    // Either points into the owned copies below or into the geometry's Storage
+    const glm::vec3* m_PositionData = nullptr;
+    const unsigned int* m_IndexData = nullptr;
+    std::vector<glm::vec3> m_Positions;
+    std::vector<unsigned int> m_Indices;
+    std::shared_ptr<const void> m_Storage;
+};
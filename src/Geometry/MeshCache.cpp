@@ -0,0 +1,227 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char CacheDirectory[] = "cache/meshes";
+const char CacheMagic[8] = { 'C', 'F', 'D', 'M', 'E', 'S', 'H', '\0' };
+constexpr uint32_t CacheFormatVersion = 2;
+constexpr uint64_t SectionAlignment = 64;
+
+struct CacheHeader {
+    char Magic[8];
+    uint32_t FormatVersion;
+    uint32_t HeaderSize;
+    uint64_t SourceSize;
+    int64_t SourceTime;
+
+    uint64_t VertexCount;
+    uint64_t IndexCount;
+    uint64_t VertexOffset;
+    uint64_t PositionOffset;
+    uint64_t IndexOffset;
+    uint64_t LodCount;
+    uint64_t LodOffset;
+
+    uint64_t TextureOffset; // 0 = no texture
+    uint32_t TextureWidth;
+    uint32_t TextureHeight;
+    uint32_t TextureComponents;
+    uint32_t Reserved;
+};
+
+struct SourceStamp {
+    std::string Path;
+    uint64_t Size = 0;
+    int64_t Time = 0;
+};
+
+bool GetSourceStamp(const std::string& sourcePath, SourceStamp& stamp)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(sourcePath, error);
+    stamp.Path = error ? sourcePath : canonical.string();
+
+    stamp.Size = std::filesystem::file_size(sourcePath, error);
+    if (error) return false;
+
+    auto time = std::filesystem::last_write_time(sourcePath, error);
+    if (error) return false;
+    stamp.Time = (int64_t)time.time_since_epoch().count();
+    return true;
+}
+
+uint64_t HashStamp(const SourceStamp& stamp)
+{
+    // FNV-1a over the path followed by size and time
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(stamp.Path.data(), stamp.Path.size());
+    mix(&stamp.Size, sizeof(stamp.Size));
+    mix(&stamp.Time, sizeof(stamp.Time));
+    return hash;
+}
+
+uint64_t AlignUp(uint64_t offset)
+{
+    return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+}
+
+}
+
+std::string MeshCache::GetCachePath(const std::string& sourcePath)
+{
+    SourceStamp stamp;
+    if (!GetSourceStamp(sourcePath, stamp)) return std::string();
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)HashStamp(stamp));
+    return (std::filesystem::path(CacheDirectory) / name).string();
+}
+
+bool MeshCache::Load(const std::string& sourcePath, MeshGeometry& geometry, MeshTexture& texture)
+{
+    SourceStamp stamp;
+    if (!GetSourceStamp(sourcePath, stamp)) return false;
+
+    std::string cachePath = GetCachePath(sourcePath);
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(cachePath)) return false;
+
+    const unsigned char* data = file->GetData();
+    size_t size = file->GetSize();
+    if (size < sizeof(CacheHeader)) return false;
+
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    // A hash collision or a rewritten source with the same name must not be mistaken for a hit
+    bool valid = std::memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+                 header.FormatVersion == CacheFormatVersion &&
+                 header.HeaderSize == sizeof(CacheHeader) &&
+                 header.SourceSize == stamp.Size &&
+                 header.SourceTime == stamp.Time;
+
+    uint64_t textureBytes = (uint64_t)header.TextureWidth * header.TextureHeight * header.TextureComponents;
+    valid = valid &&
+            header.VertexOffset + header.VertexCount * sizeof(Vertex) <= size &&
+            header.PositionOffset + header.VertexCount * sizeof(glm::vec3) <= size &&
+            header.IndexOffset + header.IndexCount * sizeof(unsigned int) <= size &&
+            header.LodOffset + header.LodCount * sizeof(MeshLod) <= size &&
+            (header.TextureOffset == 0 || header.TextureOffset + textureBytes <= size);
+    if (!valid) return false;
+
+    geometry.Vertices = (const Vertex*)(data + header.VertexOffset);
+    geometry.VertexCount = (size_t)header.VertexCount;
+    geometry.Positions = (const glm::vec3*)(data + header.PositionOffset);
+    geometry.Indices = (const unsigned int*)(data + header.IndexOffset);
+    geometry.IndexCount = (size_t)header.IndexCount;
+    geometry.Lods = header.LodCount ? (const MeshLod*)(data + header.LodOffset) : nullptr;
+    geometry.LodCount = (size_t)header.LodCount;
+    geometry.Storage = file;
+
+    texture = MeshTexture();
+    if (header.TextureOffset != 0) {
+        texture.Width = (int)header.TextureWidth;
+        texture.Height = (int)header.TextureHeight;
+        texture.Components = (int)header.TextureComponents;
+        texture.Pixels = data + header.TextureOffset;
+    }
+    return true;
+}
+
+bool MeshCache::Store(const std::string& sourcePath, const MeshGeometry& geometry, const MeshTexture& texture)
+{
+    SourceStamp stamp;
+    if (!GetSourceStamp(sourcePath, stamp)) return false;
+
+    std::error_code error;
+    std::filesystem::create_directories(CacheDirectory, error);
+
+    CacheHeader header = {};
+    std::memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+    header.FormatVersion = CacheFormatVersion;
+    header.HeaderSize = sizeof(CacheHeader);
+    header.SourceSize = stamp.Size;
+    header.SourceTime = stamp.Time;
+    header.VertexCount = geometry.VertexCount;
+    header.IndexCount = geometry.IndexCount;
+
+    header.VertexOffset = AlignUp(sizeof(CacheHeader));
+    header.PositionOffset = AlignUp(header.VertexOffset + geometry.VertexCount * sizeof(Vertex));
+    header.IndexOffset = AlignUp(header.PositionOffset + geometry.VertexCount * sizeof(glm::vec3));
+    header.LodCount = geometry.LodCount;
+    header.LodOffset = AlignUp(header.IndexOffset + geometry.IndexCount * sizeof(unsigned int));
+    uint64_t end = header.LodOffset + geometry.LodCount * sizeof(MeshLod);
+
+    uint64_t textureBytes = 0;
+    if (texture.Pixels) {
+        header.TextureOffset = AlignUp(end);
+        header.TextureWidth = (uint32_t)texture.Width;
+        header.TextureHeight = (uint32_t)texture.Height;
+        header.TextureComponents = (uint32_t)texture.Components;
+        textureBytes = (uint64_t)texture.Width * texture.Height * texture.Components;
+    }
+
+    // Write under a temporary name and rename, so a concurrent or interrupted run never maps a partial file
+    std::string cachePath = GetCachePath(sourcePath);
+    std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR::MESH_CACHE:: Cannot write " << temporaryPath << std::endl;
+            return false;
+        }
+
+        auto writeAt = [&](uint64_t offset, const void* data, size_t bytes) {
+            static const char padding[SectionAlignment] = {};
+            uint64_t position = (uint64_t)file.tellp();
+            file.write(padding, (std::streamsize)(offset - position));
+            file.write((const char*)data, (std::streamsize)bytes);
+        };
+
+        file.write((const char*)&header, sizeof(header));
+        writeAt(header.VertexOffset, geometry.Vertices, geometry.VertexCount * sizeof(Vertex));
+
+        if (geometry.Positions) {
+            writeAt(header.PositionOffset, geometry.Positions, geometry.VertexCount * sizeof(glm::vec3));
+        } else {
+            std::vector<glm::vec3> positions(geometry.VertexCount);
+            for (size_t i = 0; i < geometry.VertexCount; i++) {
+                positions[i] = geometry.Vertices[i].Position;
+            }
+            writeAt(header.PositionOffset, positions.data(), positions.size() * sizeof(glm::vec3));
+        }
+
+        writeAt(header.IndexOffset, geometry.Indices, geometry.IndexCount * sizeof(unsigned int));
+        writeAt(header.LodOffset, geometry.Lods, geometry.LodCount * sizeof(MeshLod));
+        if (texture.Pixels) writeAt(header.TextureOffset, texture.Pixels, (size_t)textureBytes);
+
+        if (!file) {
+            std::cerr << "ERROR::MESH_CACHE:: Failed while writing " << temporaryPath << std::endl;
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, cachePath, error);
+    if (error) {
+        std::cerr << "ERROR::MESH_CACHE:: Cannot rename " << temporaryPath << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include "Mesh.h"
+
+// Decoded pixels of the mesh's base colour texture (Pixels == nullptr when there is none)
+struct MeshTexture {
+    int Width = 0;
+    int Height = 0;
+    int Components = 0;
+    const unsigned char* Pixels = nullptr;
+};
+
+// Preprocessed copy of an imported model: interleaved vertices (the GL buffer layout), flat positions,
+// 32-bit indices of every level of detail, the level table and the decoded texture, each 64-byte aligned in one file. A hit maps that file and hands
+// out pointers into it, so nothing is parsed or copied before the GL upload.
+// Entries are named by a hash of the source path, size and modification time and re-validated on load.
+class MeshCache {
+public:
+    // On a hit, fills geometry / texture with arrays borrowed from the mapping (geometry.Storage keeps it alive)
+    static bool Load(const std::string& sourcePath, MeshGeometry& geometry, MeshTexture& texture);
+    static bool Store(const std::string& sourcePath, const MeshGeometry& geometry, const MeshTexture& texture);
+
+    static std::string GetCachePath(const std::string& sourcePath);
+};
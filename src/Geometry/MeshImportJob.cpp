@@ -0,0 +1,29 @@
+#include "MeshImportJob.h"
+
+MeshImportJob::MeshImportJob(const std::string& filepath)
+    : m_Path(filepath)
+{
+    m_Thread = std::thread([this]() {
+        m_Succeeded = SceneImporter::ImportGLTF(m_Path, m_Data, &m_Progress);
+        m_Finished.store(true, std::memory_order_release);
+    });
+}
+
+MeshImportJob::~MeshImportJob()
+{
+    Cancel();
+    if (m_Thread.joinable()) m_Thread.join();
+}
+
+std::unique_ptr<Mesh> MeshImportJob::TakeMesh()
+{
+    if (!IsFinished()) return nullptr;
+    if (m_Thread.joinable()) m_Thread.join();
+
+    if (!m_Succeeded || IsCancelled()) return nullptr;
+
+    auto mesh = SceneImporter::CreateMesh(m_Data);
+    m_Data = MeshData(); // The mesh holds its own reference to the storage
+    m_Succeeded = false;
+    return mesh;
+}
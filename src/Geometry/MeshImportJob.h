@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "SceneImporter.h"
+
+// Runs SceneImporter::ImportGLTF on a background thread so the UI and the solver keep going while a
+// large model is parsed and flattened. Only the GL upload in TakeMesh happens on the render thread.
+class MeshImportJob {
+public:
+    explicit MeshImportJob(const std::string& filepath);
+    ~MeshImportJob(); // Cancels and waits for the worker
+
+    MeshImportJob(const MeshImportJob&) = delete;
+    MeshImportJob& operator=(const MeshImportJob&) = delete;
+
+    const std::string& GetPath() const { return m_Path; }
+    float GetProgress() const { return m_Progress.Fraction.load(std::memory_order_relaxed); }
+    bool IsFinished() const { return m_Finished.load(std::memory_order_acquire); }
+
+    // Stops at the next checkpoint; TakeMesh then returns nullptr
+    void Cancel() { m_Progress.Cancelled = true; }
+    bool IsCancelled() const { return m_Progress.Cancelled.load(std::memory_order_relaxed); }
+
+    // Uploads the result once IsFinished(); must be called on the GL thread. nullptr on failure or cancel.
+    std::unique_ptr<Mesh> TakeMesh();
+
+private:
+    std::string m_Path;
+    ImportProgress m_Progress;
+    MeshData m_Data;
+    bool m_Succeeded = false;
+    std::atomic<bool> m_Finished{ false };
+    std::thread m_Thread;
+};
@@ -0,0 +1,522 @@
+#include "MeshSimplifier.h"
+#include "../ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+// Vertices per task when scoring collapses
+constexpr int VertexGrain = 4096;
+
+// Welded vertices with more distinct neighbours than this are left alone
+constexpr int MaxValence = 32;
+
+// Weight of the planes that hold open borders in place, relative to the face planes
+constexpr double BorderWeight = 10.0;
+
+// A collapse may not turn a triangle's normal by more than about 75 degrees (cosine)
+constexpr float MaxNormalTurn = 0.25f;
+
+// Symmetric 4x4 quadric (plane equations accumulated as n n^T etc.) plus the total weight it was built from
+struct Quadric {
+    double A00 = 0, A01 = 0, A02 = 0, A11 = 0, A12 = 0, A22 = 0;
+    double B0 = 0, B1 = 0, B2 = 0;
+    double C = 0;
+    double Weight = 0;
+
+    void AddPlane(const glm::dvec3& n, double d, double weight)
+    {
+        A00 += weight * n.x * n.x; A01 += weight * n.x * n.y; A02 += weight * n.x * n.z;
+        A11 += weight * n.y * n.y; A12 += weight * n.y * n.z; A22 += weight * n.z * n.z;
+        B0 += weight * n.x * d; B1 += weight * n.y * d; B2 += weight * n.z * d;
+        C += weight * d * d;
+        Weight += weight;
+    }
+
+    void Add(const Quadric& q)
+    {
+        A00 += q.A00; A01 += q.A01; A02 += q.A02; A11 += q.A11; A12 += q.A12; A22 += q.A22;
+        B0 += q.B0; B1 += q.B1; B2 += q.B2;
+        C += q.C;
+        Weight += q.Weight;
+    }
+
+    // Weighted sum of squared distances to the accumulated planes
+    double Evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return A00 * x * x + 2.0 * A01 * x * y + 2.0 * A02 * x * z + 2.0 * B0 * x +
+               A11 * y * y + 2.0 * A12 * y * z + 2.0 * B1 * y +
+               A22 * z * z + 2.0 * B2 * z + C;
+    }
+};
+
+// Mean squared distance of 'p' to the planes of both quadrics
+double CollapseCost(const Quadric& a, const Quadric& b, const glm::vec3& p)
+{
+    double weight = a.Weight + b.Weight;
+    if (weight <= 0.0) return 0.0;
+    return std::max(0.0, (a.Evaluate(p) + b.Evaluate(p)) / weight);
+}
+
+struct PositionKey {
+    uint32_t Bits[3];
+    bool operator==(const PositionKey& other) const { return std::memcmp(Bits, other.Bits, sizeof(Bits)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const
+    {
+        uint64_t h = key.Bits[0] * 0x9E3779B97F4A7C15ull;
+        h ^= key.Bits[1] + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+        h ^= key.Bits[2] + 0x94D049BB133111EBull + (h << 6) + (h >> 2);
+        return (size_t)h;
+    }
+};
+
+// Distinct neighbours of one welded vertex and how many of its triangles share each edge
+struct Neighbourhood {
+    uint32_t Vertex[MaxValence];
+    int TriangleCount[MaxValence];
+    int Count = 0;
+    bool Overflow = false;
+
+    void Add(uint32_t vertex)
+    {
+        for (int k = 0; k < Count; k++) {
+            if (Vertex[k] == vertex) {
+                TriangleCount[k]++;
+                return;
+            }
+        }
+        if (Count == MaxValence) {
+            Overflow = true;
+            return;
+        }
+        Vertex[Count] = vertex;
+        TriangleCount[Count] = 1;
+        Count++;
+    }
+};
+
+// Working state: triangles refer to original vertices, topology uses the welded ids
+struct SimplifyState {
+    const glm::vec3* Positions = nullptr;
+    std::vector<uint32_t> Weld;           // Original vertex -> welded vertex
+    std::vector<uint32_t> Representative; // Welded vertex -> an original vertex with its position
+    std::vector<Quadric> Quadrics;        // Per welded vertex
+    std::vector<unsigned int> Triangles;  // Current level, original vertex indices
+    std::vector<uint32_t> Survivor;       // Welded vertex -> welded vertex it has been merged into (itself if alive)
+
+    // Per pass
+    std::vector<uint32_t> TriangleOffsets; // CSR welded vertex -> triangles
+    std::vector<uint32_t> TriangleList;
+    std::vector<uint32_t> Target;
+    std::vector<float> Cost;
+    std::vector<uint32_t> Remap;
+    std::vector<unsigned char> Locked;
+
+    const glm::vec3& GetPosition(uint32_t welded) const { return Positions[Representative[welded]]; }
+    uint32_t GetCorner(size_t triangle, int corner) const { return Weld[Triangles[triangle * 3 + corner]]; }
+
+    void GetNeighbourhood(uint32_t vertex, Neighbourhood& neighbourhood) const
+    {
+        for (uint32_t k = TriangleOffsets[vertex]; k < TriangleOffsets[vertex + 1]; k++) {
+            uint32_t t = TriangleList[k];
+            for (int c = 0; c < 3; c++) {
+                uint32_t other = GetCorner(t, c);
+                if (other != vertex) neighbourhood.Add(other);
+            }
+        }
+    }
+};
+
+void Weld(SimplifyState& state, size_t vertexCount)
+{
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> lookup;
+    lookup.reserve(vertexCount);
+
+    state.Weld.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        PositionKey key;
+        std::memcpy(key.Bits, &state.Positions[i], sizeof(key.Bits));
+
+        auto inserted = lookup.emplace(key, (uint32_t)state.Representative.size());
+        if (inserted.second) state.Representative.push_back((uint32_t)i);
+        state.Weld[i] = inserted.first->second;
+    }
+}
+
+void BuildAdjacency(SimplifyState& state)
+{
+    size_t weldedCount = state.Representative.size();
+    size_t triangleCount = state.Triangles.size() / 3;
+
+    state.TriangleOffsets.assign(weldedCount + 1, 0);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int c = 0; c < 3; c++) state.TriangleOffsets[state.GetCorner(t, c) + 1]++;
+    }
+    for (size_t v = 0; v < weldedCount; v++) {
+        state.TriangleOffsets[v + 1] += state.TriangleOffsets[v];
+    }
+
+    state.TriangleList.resize(state.TriangleOffsets[weldedCount]);
+    std::vector<uint32_t> fill(state.TriangleOffsets.begin(), state.TriangleOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int c = 0; c < 3; c++) state.TriangleList[fill[state.GetCorner(t, c)]++] = (uint32_t)t;
+    }
+}
+
+void InitQuadrics(SimplifyState& state)
+{
+    state.Quadrics.assign(state.Representative.size(), Quadric());
+
+    size_t triangleCount = state.Triangles.size() / 3;
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t v[3] = { state.GetCorner(t, 0), state.GetCorner(t, 1), state.GetCorner(t, 2) };
+        glm::dvec3 p0(state.GetPosition(v[0]));
+        glm::dvec3 p1(state.GetPosition(v[1]));
+        glm::dvec3 p2(state.GetPosition(v[2]));
+
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+        if (length <= 0.0) continue;
+        normal /= length;
+
+        // Area weighted, so large faces dominate the error of their vertices
+        double area = 0.5 * length;
+        double d = -glm::dot(normal, p0);
+        for (int c = 0; c < 3; c++) state.Quadrics[v[c]].AddPlane(normal, d, area);
+    }
+
+    // Open borders: a plane through each border edge, perpendicular to its face, keeps the outline from shrinking
+    BuildAdjacency(state);
+    for (uint32_t a = 0; a < (uint32_t)state.Representative.size(); a++) {
+        for (uint32_t k = state.TriangleOffsets[a]; k < state.TriangleOffsets[a + 1]; k++) {
+            uint32_t t = state.TriangleList[k];
+            for (int c = 0; c < 3; c++) {
+                if (state.GetCorner(t, c) != a) continue;
+
+                // Edge a -> b in winding order; it is a border when no other triangle of 'a' uses it
+                uint32_t b = state.GetCorner(t, (c + 1) % 3);
+                bool shared = false;
+                for (uint32_t m = state.TriangleOffsets[a]; m < state.TriangleOffsets[a + 1] && !shared; m++) {
+                    uint32_t other = state.TriangleList[m];
+                    if (other == t) continue;
+                    for (int oc = 0; oc < 3; oc++) shared |= state.GetCorner(other, oc) == b;
+                }
+                if (shared) continue;
+
+                glm::dvec3 pa(state.GetPosition(a));
+                glm::dvec3 pb(state.GetPosition(b));
+                glm::dvec3 pc(state.GetPosition(state.GetCorner(t, (c + 2) % 3)));
+                glm::dvec3 edge = pb - pa;
+                glm::dvec3 faceNormal = glm::cross(edge, pc - pa);
+                glm::dvec3 normal = glm::cross(edge, faceNormal);
+                double length = glm::length(normal);
+                if (length <= 0.0) continue;
+                normal /= length;
+
+                double weight = glm::dot(edge, edge) * BorderWeight;
+                double d = -glm::dot(normal, pa);
+                state.Quadrics[a].AddPlane(normal, d, weight);
+                state.Quadrics[b].AddPlane(normal, d, weight);
+            }
+        }
+    }
+}
+
+// Best half-edge collapse for every welded vertex (Target = itself when there is none)
+void ScoreCollapses(SimplifyState& state)
+{
+    int weldedCount = (int)state.Representative.size();
+    state.Target.resize(weldedCount);
+    state.Cost.resize(weldedCount);
+
+    ThreadPool::Get().ParallelFor(0, weldedCount, VertexGrain, [&](int begin, int end) {
+        for (int a = begin; a < end; a++) {
+            state.Target[a] = (uint32_t)a;
+            state.Cost[a] = std::numeric_limits<float>::infinity();
+            if (state.TriangleOffsets[a] == state.TriangleOffsets[a + 1]) continue;
+
+            Neighbourhood neighbourhood;
+            state.GetNeighbourhood((uint32_t)a, neighbourhood);
+            if (neighbourhood.Overflow) continue;
+
+            // An edge used by one triangle is a border, by more than two it is non-manifold
+            bool border = false;
+            bool manifold = true;
+            for (int k = 0; k < neighbourhood.Count; k++) {
+                border |= neighbourhood.TriangleCount[k] == 1;
+                manifold &= neighbourhood.TriangleCount[k] <= 2;
+            }
+            if (!manifold) continue;
+
+            for (int k = 0; k < neighbourhood.Count; k++) {
+                // Border vertices may only slide along the border
+                if (border && neighbourhood.TriangleCount[k] != 1) continue;
+
+                uint32_t b = neighbourhood.Vertex[k];
+                float cost = (float)CollapseCost(state.Quadrics[a], state.Quadrics[b], state.GetPosition(b));
+                if (cost < state.Cost[a]) {
+                    state.Cost[a] = cost;
+                    state.Target[a] = b;
+                }
+            }
+        }
+    });
+}
+
+// Moving 'a' onto 'b' must not turn any surviving triangle of 'a' over (or nearly so; turns add up over passes)
+bool PreservesOrientation(const SimplifyState& state, uint32_t a, uint32_t b)
+{
+    const glm::vec3& target = state.GetPosition(b);
+
+    for (uint32_t k = state.TriangleOffsets[a]; k < state.TriangleOffsets[a + 1]; k++) {
+        uint32_t t = state.TriangleList[k];
+        uint32_t v[3] = { state.GetCorner(t, 0), state.GetCorner(t, 1), state.GetCorner(t, 2) };
+        if (v[0] == b || v[1] == b || v[2] == b) continue; // Collapses away
+
+        glm::vec3 p[3];
+        glm::vec3 moved[3];
+        for (int c = 0; c < 3; c++) {
+            p[c] = state.GetPosition(v[c]);
+            moved[c] = v[c] == a ? target : p[c];
+        }
+
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if (glm::dot(before, after) <= MaxNormalTurn * glm::length(before) * glm::length(after)) return false;
+    }
+    return true;
+}
+
+float PointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    // Closest point by Voronoi region of the triangle (vertices, edges, face)
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return glm::length(ap);
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return glm::length(bp);
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        float v = d1 / (d1 - d3);
+        return glm::length(ap - v * ab);
+    }
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return glm::length(cp);
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        float w = d2 / (d2 - d6);
+        return glm::length(ap - w * ac);
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return glm::length(bp - w * (c - b));
+    }
+
+    float denominator = 1.0f / (va + vb + vc);
+    float v = vb * denominator;
+    float w = vc * denominator;
+    return glm::length(ap - ab * v - ac * w);
+}
+
+// Upper bound on how far the removed vertices lie from the current surface: the distance from each one to the
+// nearest triangle within two rings of the vertex it was merged into. Distances up to 'known' cannot raise the result
+// and are not refined.
+float MeasureError(SimplifyState& state, float known)
+{
+    BuildAdjacency(state);
+
+    int weldedCount = (int)state.Representative.size();
+    std::vector<float> distance(weldedCount, 0.0f);
+
+    ThreadPool::Get().ParallelFor(0, weldedCount, VertexGrain, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            uint32_t survivor = state.Survivor[v];
+            if (survivor == (uint32_t)v) continue;
+
+            const glm::vec3& p = state.GetPosition((uint32_t)v);
+            float nearest = glm::length(p - state.GetPosition(survivor));
+
+            auto visit = [&](uint32_t center) {
+                for (uint32_t k = state.TriangleOffsets[center]; k < state.TriangleOffsets[center + 1]; k++) {
+                    uint32_t t = state.TriangleList[k];
+                    nearest = std::min(nearest, PointTriangleDistance(p, state.GetPosition(state.GetCorner(t, 0)),
+                                                                         state.GetPosition(state.GetCorner(t, 1)),
+                                                                         state.GetPosition(state.GetCorner(t, 2))));
+                }
+            };
+
+            // Thin triangles around the survivor often leave the nearest surface one ring further out
+            visit(survivor);
+            if (nearest <= known) continue;
+
+            Neighbourhood neighbourhood;
+            state.GetNeighbourhood(survivor, neighbourhood);
+            for (int k = 0; k < neighbourhood.Count; k++) visit(neighbourhood.Vertex[k]);
+
+            distance[v] = nearest;
+        }
+    });
+
+    return distance.empty() ? 0.0f : *std::max_element(distance.begin(), distance.end());
+}
+
+// One round of independent collapses, cheapest first, until 'targetTriangles' is reached.
+// Returns the number of collapses made.
+size_t CollapsePass(SimplifyState& state, size_t targetTriangles)
+{
+    BuildAdjacency(state);
+    ScoreCollapses(state);
+
+    size_t weldedCount = state.Representative.size();
+    std::vector<uint32_t> order;
+    order.reserve(weldedCount);
+    for (uint32_t v = 0; v < weldedCount; v++) {
+        if (state.Target[v] != v) order.push_back(v);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) { return state.Cost[x] < state.Cost[y]; });
+
+    state.Remap.resize(weldedCount);
+    for (uint32_t v = 0; v < weldedCount; v++) state.Remap[v] = v;
+    state.Locked.assign(weldedCount, 0);
+
+    size_t triangleCount = state.Triangles.size() / 3;
+    size_t collapses = 0;
+
+    // Each collapse locks its whole neighbourhood, so the geometry every later check in this pass sees is current
+    for (uint32_t a : order) {
+        if (triangleCount <= targetTriangles) break;
+
+        uint32_t b = state.Target[a];
+        if (state.Locked[a] || state.Locked[b]) continue;
+        if (!PreservesOrientation(state, a, b)) continue;
+
+        size_t removed = 0;
+        for (uint32_t k = state.TriangleOffsets[a]; k < state.TriangleOffsets[a + 1]; k++) {
+            uint32_t t = state.TriangleList[k];
+            bool hasB = false;
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = state.GetCorner(t, c);
+                state.Locked[v] = 1;
+                hasB |= v == b;
+            }
+            removed += hasB ? 1 : 0;
+        }
+
+        state.Remap[a] = b;
+        state.Quadrics[b].Add(state.Quadrics[a]);
+        triangleCount -= std::min(removed, triangleCount);
+        collapses++;
+    }
+
+    if (collapses == 0) return 0;
+
+    for (uint32_t& survivor : state.Survivor) survivor = state.Remap[survivor];
+
+    // Point corners of collapsed vertices at the survivor and drop the triangles that degenerated
+    size_t write = 0;
+    for (size_t t = 0; t < state.Triangles.size() / 3; t++) {
+        unsigned int corner[3];
+        uint32_t welded[3];
+        for (int c = 0; c < 3; c++) {
+            corner[c] = state.Triangles[t * 3 + c];
+            welded[c] = state.Weld[corner[c]];
+            if (state.Remap[welded[c]] != welded[c]) {
+                welded[c] = state.Remap[welded[c]];
+                corner[c] = state.Representative[welded[c]];
+            }
+        }
+        if (welded[0] == welded[1] || welded[1] == welded[2] || welded[0] == welded[2]) continue;
+
+        for (int c = 0; c < 3; c++) state.Triangles[write * 3 + c] = corner[c];
+        write++;
+    }
+    state.Triangles.resize(write * 3);
+    return collapses;
+}
+
+}
+
+void MeshSimplifier::BuildLods(const glm::vec3* positions, size_t vertexCount, std::vector<unsigned int>& indices,
+                               std::vector<MeshLod>& lods, const Settings& settings,
+                               const std::function<bool(float)>& progress)
+{
+    lods.clear();
+
+    MeshLod full;
+    full.IndexOffset = 0;
+    full.IndexCount = indices.size();
+    full.Error = 0.0f;
+    lods.push_back(full);
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount <= settings.MinTriangles || settings.MaxLevels <= 1) return;
+
+    SimplifyState state;
+    state.Positions = positions;
+    state.Triangles.assign(indices.begin(), indices.begin() + triangleCount * 3);
+    Weld(state, vertexCount);
+    InitQuadrics(state);
+
+    state.Survivor.resize(state.Representative.size());
+    for (uint32_t v = 0; v < (uint32_t)state.Survivor.size(); v++) state.Survivor[v] = v;
+
+    // Progress is measured in triangles removed towards the coarsest level that will be attempted
+    size_t finalTarget = triangleCount;
+    for (int level = 1; level < settings.MaxLevels && finalTarget > settings.MinTriangles; level++) {
+        finalTarget = std::max(settings.MinTriangles, (size_t)(finalTarget * settings.Reduction));
+    }
+    size_t totalWork = std::max<size_t>(1, triangleCount - finalTarget);
+
+    float error = 0.0f;
+    size_t levelTriangles = triangleCount;
+    for (int level = 1; level < settings.MaxLevels && levelTriangles > settings.MinTriangles; level++) {
+        size_t target = std::max(settings.MinTriangles, (size_t)(levelTriangles * settings.Reduction));
+
+        bool stalled = false;
+        while (state.Triangles.size() / 3 > target) {
+            if (progress && !progress((float)(triangleCount - state.Triangles.size() / 3) / totalWork)) return;
+
+            if (CollapsePass(state, target) == 0) {
+                stalled = true;
+                break;
+            }
+        }
+
+        // A level that barely differs from the previous one is not worth its index memory
+        size_t reached = state.Triangles.size() / 3;
+        if (reached > levelTriangles * (1.0f + settings.Reduction) * 0.5f) break;
+
+        error = std::max(error, MeasureError(state, error));
+
+        MeshLod lod;
+        lod.IndexOffset = indices.size();
+        lod.IndexCount = state.Triangles.size();
+        lod.Error = error;
+        indices.insert(indices.end(), state.Triangles.begin(), state.Triangles.end());
+        lods.push_back(lod);
+
+        levelTriangles = reached;
+        if (stalled) break;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// Quadric error metric simplification by half-edge collapse: a vertex is always merged into one of its
+// neighbours, so every level is just another index list over the original vertex array and all levels can
+// share one vertex buffer. Vertices with equal positions are welded for the topology, so UV / normal seams
+// neither tear open nor block collapses.
+class MeshSimplifier {
+public:
+    struct Settings {
+        float Reduction = 0.5f;   // Triangle count of each level relative to the previous one
+        size_t MinTriangles = 64; // No level is made below this
+        int MaxLevels = 10;       // Including the full-detail level
+    };
+
+    // 'indices' holds the full-detail triangles on input; coarser levels are appended to it and described in 'lods'
+    // (lods[0] is the input, Error 0). Errors are in model units. 'progress' is called between passes with the
+    // fraction done and may return false to stop early; levels finished so far are kept.
+    static void BuildLods(const glm::vec3* positions, size_t vertexCount, std::vector<unsigned int>& indices,
+                          std::vector<MeshLod>& lods, const Settings& settings,
+                          const std::function<bool(float)>& progress = nullptr);
+};
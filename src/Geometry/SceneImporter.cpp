@@ -4,9 +4,89 @@
 
 #include <tiny_gltf.h>
 #include "SceneImporter.h"
+#include "MeshSimplifier.h"
+#include "../ThreadPool.h"
+#include <algorithm>
 #include <iostream>
 
+namespace {
+
+// Items per task when flattening; chunks may span several primitives
+constexpr int FlattenGrain = 1 << 16;
+
+// Shares of the progress bar for parsing (tinygltf cannot report progress itself), flattening and simplification
+constexpr float ParseProgress = 0.4f;
+constexpr float FlattenProgress = 0.3f;
+constexpr float SimplifyProgress = 0.3f;
+
+// Owning storage behind an imported MeshGeometry
+struct ImportedArrays {
+    std::vector<Vertex> Vertices;
+    std::vector<glm::vec3> Positions;
+    std::vector<unsigned int> Indices; // Every level of detail, finest first
+    std::vector<MeshLod> Lods;
+    std::vector<unsigned char> Pixels;
+};
+
+// Where one primitive's attributes live in the glTF buffers and where it lands in the flattened arrays
+struct PrimitiveRange {
+    const unsigned char* PosData = nullptr;
+    const unsigned char* NormData = nullptr;
+    const unsigned char* UvData = nullptr;
+    const unsigned char* IdxData = nullptr;
+    int PosStride = 0;
+    int NormStride = 0;
+    int UvStride = 0;
+    int IdxStride = 0;
+    int IdxComponentType = 0;
+
+    size_t VertexStart = 0;
+    size_t VertexCount = 0;
+    size_t IndexStart = 0;
+    size_t IndexCount = 0;
+};
+
+const unsigned char* GetAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name, int defaultStride, int& stride)
+{
+    auto attribute = primitive.attributes.find(name);
+    if (attribute == primitive.attributes.end()) return nullptr;
+
+    const tinygltf::Accessor& accessor = model.accessors[attribute->second];
+    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+    const tinygltf::Buffer& buffer = model.buffers[view.buffer];
+
+    stride = accessor.ByteStride(view) ? accessor.ByteStride(view) : defaultStride;
+    return &buffer.data[view.byteOffset + accessor.byteOffset];
+}
+
+bool IsCancelled(ImportProgress* progress)
+{
+    return progress && progress->Cancelled.load(std::memory_order_relaxed);
+}
+
+void AddProgress(ImportProgress* progress, float amount)
+{
+    if (!progress) return;
+    float current = progress->Fraction.load(std::memory_order_relaxed);
+    while (!progress->Fraction.compare_exchange_weak(current, std::min(1.0f, current + amount), std::memory_order_relaxed)) {
+    }
+}
+
+}
+
 std::unique_ptr<Mesh> SceneImporter::LoadGLTF(const std::string& filepath) {
+    MeshData data;
+    if (!ImportGLTF(filepath, data)) return nullptr;
+    return CreateMesh(data);
+}
+
+bool SceneImporter::ImportGLTF(const std::string& filepath, MeshData& data, ImportProgress* progress) {
+    // A current cache entry is mapped and uploaded directly, without touching tinygltf
+    if (MeshCache::Load(filepath, data.Geometry, data.Texture)) {
+        if (progress) progress->Fraction = 1.0f;
+        return true;
+    }
+
     tinygltf::Model model;
     tinygltf::TinyGLTF loader;
     std::string err;
@@ -29,135 +109,186 @@ std::unique_ptr<Mesh> SceneImporter::LoadGLTF(const std::string& filepath) {
 
     if (!ret) {
         std::cerr << "Failed to parse glTF: " << filepath << std::endl;
-        return nullptr;
+        return false;
     }
 
-    std::vector<Vertex> globalVertices;
-    std::vector<unsigned int> globalIndices;
+    if (IsCancelled(progress)) return false;
+    AddProgress(progress, ParseProgress);
 
-    // Iterate over all meshes and primitives to flatten the geometry
+    // Lay every primitive out in the flattened arrays; the sizes are known from the accessor counts
+    std::vector<PrimitiveRange> ranges;
+    size_t vertexTotal = 0;
+    size_t indexTotal = 0;
     for (const auto& mesh : model.meshes) {
         for (const auto& primitive : mesh.primitives) {
-            if (primitive.attributes.find("POSITION") == primitive.attributes.end())
+            PrimitiveRange range;
+            range.PosData = GetAttribute(model, primitive, "POSITION", sizeof(float) * 3, range.PosStride);
+            if (!range.PosData)
                 continue;
 
-            // Position Accessor
-            const tinygltf::Accessor& posAccessor = model.accessors[primitive.attributes.at("POSITION")];
-            const tinygltf::BufferView& posView = model.bufferViews[posAccessor.bufferView];
-            const tinygltf::Buffer& posBuffer = model.buffers[posView.buffer];
+            range.NormData = GetAttribute(model, primitive, "NORMAL", sizeof(float) * 3, range.NormStride);
+            range.UvData = GetAttribute(model, primitive, "TEXCOORD_0", sizeof(float) * 2, range.UvStride);
 
-            const unsigned char* posData = &posBuffer.data[posView.byteOffset + posAccessor.byteOffset];
-            int posStride = posAccessor.ByteStride(posView) ? posAccessor.ByteStride(posView) : sizeof(float) * 3;
+            range.VertexStart = vertexTotal;
+            range.VertexCount = model.accessors[primitive.attributes.at("POSITION")].count;
 
-            // Normal Accessor
-            const unsigned char* normData = nullptr;
-            int normStride = 0;
-            if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-                const tinygltf::Accessor& normAccessor = model.accessors[primitive.attributes.at("NORMAL")];
-                const tinygltf::BufferView& normView = model.bufferViews[normAccessor.bufferView];
-                const tinygltf::Buffer& normBuffer = model.buffers[normView.buffer];
+            range.IndexStart = indexTotal;
+            range.IndexCount = range.VertexCount;
+            if (primitive.indices >= 0) {
+                const tinygltf::Accessor& idxAccessor = model.accessors[primitive.indices];
+                const tinygltf::BufferView& idxView = model.bufferViews[idxAccessor.bufferView];
+                const tinygltf::Buffer& idxBuffer = model.buffers[idxView.buffer];
 
-                normData = &normBuffer.data[normView.byteOffset + normAccessor.byteOffset];
-                normStride = normAccessor.ByteStride(normView) ? normAccessor.ByteStride(normView) : sizeof(float) * 3;
+                range.IdxData = &idxBuffer.data[idxView.byteOffset + idxAccessor.byteOffset];
+                range.IdxComponentType = idxAccessor.componentType;
+                range.IdxStride = idxAccessor.ByteStride(idxView) ? idxAccessor.ByteStride(idxView) :
+                    (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? 2 :
+                    (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT ? 4 : 1));
+                range.IndexCount = idxAccessor.count;
             }
 
-            // TexCoord Accessor
-            const unsigned char* uvData = nullptr;
-            int uvStride = 0;
-            if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes.at("TEXCOORD_0")];
-                const tinygltf::BufferView& uvView = model.bufferViews[uvAccessor.bufferView];
-                const tinygltf::Buffer& uvBuffer = model.buffers[uvView.buffer];
+            vertexTotal += range.VertexCount;
+            indexTotal += range.IndexCount;
+            ranges.push_back(range);
+        }
+    }
 
-                uvData = &uvBuffer.data[uvView.byteOffset + uvAccessor.byteOffset];
-                uvStride = uvAccessor.ByteStride(uvView) ? uvAccessor.ByteStride(uvView) : sizeof(float) * 2;
-            }
+    auto arrays = std::make_shared<ImportedArrays>();
+    arrays->Vertices.resize(vertexTotal);
+    arrays->Positions.resize(vertexTotal);
+    arrays->Indices.resize(indexTotal);
 
-            size_t vertexStart = globalVertices.size();
+    // Flatten in parallel: each chunk of the output finds the primitive it starts in and walks forward
+    float progressPerItem = FlattenProgress / (float)std::max<size_t>(1, vertexTotal + indexTotal);
 
-            // Read Vertices
-            for (size_t i = 0; i < posAccessor.count; ++i) {
-                Vertex vertex;
+    ThreadPool::Get().ParallelFor(0, (int)vertexTotal, FlattenGrain, [&](int begin, int end) {
+        if (IsCancelled(progress)) return;
 
-                const float* p = reinterpret_cast<const float*>(posData + i * posStride);
-                vertex.Position = glm::vec3(p[0], p[1], p[2]);
+        auto range = std::upper_bound(ranges.begin(), ranges.end(), (size_t)begin,
+            [](size_t vertex, const PrimitiveRange& r) { return vertex < r.VertexStart; }) - 1;
 
-                if (normData) {
-                    const float* n = reinterpret_cast<const float*>(normData + i * normStride);
-                    vertex.Normal = glm::vec3(n[0], n[1], n[2]);
-                } else {
-                    vertex.Normal = glm::vec3(0.0f);
-                }
+        for (size_t v = begin; v < (size_t)end; v++) {
+            while (v >= range->VertexStart + range->VertexCount) ++range;
+            size_t i = v - range->VertexStart;
 
-                if (uvData) {
-                    const float* uv = reinterpret_cast<const float*>(uvData + i * uvStride);
-                    vertex.TexCoords = glm::vec2(uv[0], uv[1]);
-                } else {
-                    vertex.TexCoords = glm::vec2(0.0f);
-                }
+            Vertex& vertex = arrays->Vertices[v];
+
+            const float* p = reinterpret_cast<const float*>(range->PosData + i * range->PosStride);
+            vertex.Position = glm::vec3(p[0], p[1], p[2]);
 
-                globalVertices.push_back(vertex);
+            if (range->NormData) {
+                const float* n = reinterpret_cast<const float*>(range->NormData + i * range->NormStride);
+                vertex.Normal = glm::vec3(n[0], n[1], n[2]);
+            } else {
+                vertex.Normal = glm::vec3(0.0f);
             }
 
-            // Read Indices
-            if (primitive.indices >= 0) {
-                const tinygltf::Accessor& idxAccessor = model.accessors[primitive.indices];
-                const tinygltf::BufferView& idxView = model.bufferViews[idxAccessor.bufferView];
-                const tinygltf::Buffer& idxBuffer = model.buffers[idxView.buffer];
+            if (range->UvData) {
+                const float* uv = reinterpret_cast<const float*>(range->UvData + i * range->UvStride);
+                vertex.TexCoords = glm::vec2(uv[0], uv[1]);
+            } else {
+                vertex.TexCoords = glm::vec2(0.0f);
+            }
 
-                const unsigned char* idxData = &idxBuffer.data[idxView.byteOffset + idxAccessor.byteOffset];
-                int idxByteStride = idxAccessor.ByteStride(idxView);
-
-                for (size_t i = 0; i < idxAccessor.count; ++i) {
-                    unsigned int index = 0;
-                    const unsigned char* ptr = idxData + i * (idxByteStride ? idxByteStride :
-                        (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? 2 :
-                        (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT ? 4 : 1)));
-
-                    if (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                        index = (unsigned int)(*reinterpret_cast<const unsigned short*>(ptr));
-                    } else if (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                        index = *reinterpret_cast<const unsigned int*>(ptr);
-                    } else if (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-                        index = (unsigned int)(*reinterpret_cast<const unsigned char*>(ptr));
-                    }
-                    globalIndices.push_back(index + (unsigned int)vertexStart);
+            arrays->Positions[v] = vertex.Position;
+        }
+        AddProgress(progress, (end - begin) * progressPerItem);
+    });
+
+    ThreadPool::Get().ParallelFor(0, (int)indexTotal, FlattenGrain, [&](int begin, int end) {
+        if (IsCancelled(progress)) return;
+
+        auto range = std::upper_bound(ranges.begin(), ranges.end(), (size_t)begin,
+            [](size_t index, const PrimitiveRange& r) { return index < r.IndexStart; }) - 1;
+
+        for (size_t x = begin; x < (size_t)end; x++) {
+            while (x >= range->IndexStart + range->IndexCount) ++range;
+            size_t i = x - range->IndexStart;
+
+            unsigned int index = (unsigned int)i; // Non-indexed geometry
+            if (range->IdxData) {
+                const unsigned char* ptr = range->IdxData + i * range->IdxStride;
+                if (range->IdxComponentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                    index = (unsigned int)(*reinterpret_cast<const unsigned short*>(ptr));
+                } else if (range->IdxComponentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+                    index = *reinterpret_cast<const unsigned int*>(ptr);
+                } else if (range->IdxComponentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+                    index = (unsigned int)(*reinterpret_cast<const unsigned char*>(ptr));
+                } else {
+                    index = 0;
                 }
-            } else {
-                // Non-indexed geometry
-                 for (size_t i = 0; i < posAccessor.count; ++i) {
-                     globalIndices.push_back((unsigned int)(vertexStart + i));
-                 }
             }
+            arrays->Indices[x] = index + (unsigned int)range->VertexStart;
         }
-    }
+        AddProgress(progress, (end - begin) * progressPerItem);
+    });
+
+    if (IsCancelled(progress)) return false;
 
-    auto mesh = std::make_unique<Mesh>(globalVertices, globalIndices);
+    // Coarser levels for slicing and preview, so their cost follows the grid and screen resolution rather than the model
+    float simplifyStart = ParseProgress + FlattenProgress;
+    MeshSimplifier::BuildLods(arrays->Positions.data(), vertexTotal, arrays->Indices, arrays->Lods, MeshSimplifier::Settings(),
+        [&](float fraction) {
+            if (progress) progress->Fraction = simplifyStart + fraction * SimplifyProgress;
+            return !IsCancelled(progress);
+        });
+
+    if (IsCancelled(progress)) return false;
 
     // Load first texture if exists
     if (!model.textures.empty()) {
         const tinygltf::Texture& tex = model.textures[0];
         if (tex.source > -1 && tex.source < (int)model.images.size()) {
-            const tinygltf::Image& image = model.images[tex.source];
+            tinygltf::Image& image = model.images[tex.source];
+            if (!image.image.empty() && image.bits == 8) {
+                arrays->Pixels.swap(image.image);
+                data.Texture.Width = image.width;
+                data.Texture.Height = image.height;
+                data.Texture.Components = image.component;
+                data.Texture.Pixels = arrays->Pixels.data();
+            }
+        }
+    }
 
-            unsigned int textureID;
-            glGenTextures(1, &textureID);
-            glBindTexture(GL_TEXTURE_2D, textureID);
+    data.Geometry.Vertices = arrays->Vertices.data();
+    data.Geometry.VertexCount = vertexTotal;
+    data.Geometry.Positions = arrays->Positions.data();
+    data.Geometry.Indices = arrays->Indices.data();
+    data.Geometry.IndexCount = arrays->Indices.size();
+    data.Geometry.Lods = arrays->Lods.data();
+    data.Geometry.LodCount = arrays->Lods.size();
+    data.Geometry.Storage = arrays;
+
+    MeshCache::Store(filepath, data.Geometry, data.Texture);
+    if (progress) progress->Fraction = 1.0f;
+    return true;
+}
 
-            GLenum format = GL_RGBA;
-            if (image.component == 3) format = GL_RGB;
-            else if (image.component == 1) format = GL_RED;
+std::unique_ptr<Mesh> SceneImporter::CreateMesh(const MeshData& data) {
+    auto mesh = std::make_unique<Mesh>(data.Geometry);
 
-            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, &image.image[0]);
-            glGenerateMipmap(GL_TEXTURE_2D);
+    const MeshTexture& texture = data.Texture;
+    if (texture.Pixels) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLenum format = GL_RGBA;
+        if (texture.Components == 3) format = GL_RGB;
+        else if (texture.Components == 1) format = GL_RED;
 
-            mesh->SetTexture(textureID);
-        }
+        // Rows of RGB / single channel images are not 4-byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, texture.Width, texture.Height, 0, format, GL_UNSIGNED_BYTE, texture.Pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        mesh->SetTexture(textureID);
     }
 
     return mesh;
@@ -1,10 +1,32 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <memory>
 #include "Mesh.h"
+#include "MeshCache.h"
+
+// Shared between an import running on a worker thread and the thread watching it
+struct ImportProgress {
+    std::atomic<float> Fraction{ 0.0f };   // 0..1
+    std::atomic<bool> Cancelled{ false };  // Set to abandon the import at the next checkpoint
+};
+
+// CPU result of an import: everything a Mesh needs except the GL objects
+struct MeshData {
+    MeshGeometry Geometry;
+    MeshTexture Texture; // Pixels live in Geometry.Storage
+};
 
 class SceneImporter {
 public:
+    // Synchronous import and upload (ImportGLTF followed by CreateMesh)
     static std::unique_ptr<Mesh> LoadGLTF(const std::string& filepath);
+
+    // CPU stage, safe to run off the render thread: cache lookup, parse and parallel flattening.
+    // Returns false on failure or cancellation.
+    static bool ImportGLTF(const std::string& filepath, MeshData& data, ImportProgress* progress = nullptr);
+
+    // GL stage; must run on the thread that owns the context
+    static std::unique_ptr<Mesh> CreateMesh(const MeshData& data);
 };
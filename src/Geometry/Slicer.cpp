@@ -1,10 +1,23 @@
 #include "Slicer.h"
+#include "../KernelProfiler.h"
+#include "../SignedDistance.h"
+#include "../ThreadPool.h"
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
+namespace {
+
+// Triangles per binning chunk, and vertices per transform chunk
+constexpr int TriangleGrain = 4096;
+constexpr int VertexGrain = 8192;
+
+}
+
 Slicer::Slicer(int width, int height)
     : m_Width(width), m_Height(height)
 {
@@ -16,23 +29,30 @@ Slicer::~Slicer()
 {
     glDeleteFramebuffers(1, &m_FBO);
     glDeleteTextures(1, &m_Texture);
+    if (m_FineFBO) glDeleteFramebuffers(1, &m_FineFBO);
+    if (m_FineTexture) glDeleteTextures(1, &m_FineTexture);
     glDeleteProgram(m_Shader.ID);
 }
 
 void Slicer::InitResources()
+{
+    CreateTarget(m_Width, m_Height, m_FBO, m_Texture);
+}
+
+void Slicer::CreateTarget(int width, int height, unsigned int& fbo, unsigned int& texture)
 {
     // Create Framebuffer
-    glGenFramebuffers(1, &m_FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
     // Create Texture Attachment
-    glGenTextures(1, &m_Texture);
-    glBindTexture(GL_TEXTURE_2D, m_Texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_Width, m_Height, 0, GL_RED, GL_FLOAT, NULL);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cerr << "ERROR::SLICER::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
@@ -40,14 +60,195 @@ void Slicer::InitResources()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-std::vector<float> Slicer::Capture(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness)
+void Slicer::Capture(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, std::vector<float>& mask)
+{
+    Render(mesh, modelMatrix, sliceZ, thickness, m_FBO, m_Width, m_Height, mask);
+}
+
+void Slicer::CaptureDistance(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, std::vector<float>& distance, int supersample)
 {
+    supersample = std::max(1, supersample);
+    if (m_FineFactor != supersample) {
+        if (m_FineFBO) glDeleteFramebuffers(1, &m_FineFBO);
+        if (m_FineTexture) glDeleteTextures(1, &m_FineTexture);
+        CreateTarget(m_Width * supersample, m_Height * supersample, m_FineFBO, m_FineTexture);
+        m_FineFactor = supersample;
+    }
+
+    // Scaling x / y makes the finer raster cover the same grid (and picks a correspondingly finer level of detail)
+    Render(mesh, glm::scale(glm::mat4(1.0f), glm::vec3((float)supersample, (float)supersample, 1.0f)) * modelMatrix,
+           sliceZ, thickness, m_FineFBO, m_Width * supersample, m_Height * supersample, m_FinePixels);
+
+    SignedDistance::FromSupersampledMask(m_FinePixels.data(), m_Width, m_Height, supersample, distance);
+}
+
+void Slicer::CaptureStack(const Mesh& mesh, const glm::mat4& modelMatrix, Span<const SliceBand> bands, std::vector<float>& masks,
+                          std::vector<SliceStatistics>& statistics) const
+{
+    size_t cellCount = (size_t)m_Width * m_Height;
+    masks.assign(cellCount * bands.size(), 0.0f);
+    statistics.assign(bands.size(), SliceStatistics());
+    if (bands.empty() || mesh.GetVertexCount() == 0) return;
+
+    // Same level of detail as the GL capture
+    int lod = mesh.SelectLod(modelMatrix, 0.5f);
+    const glm::vec3* positions = mesh.GetPositions();
+    const unsigned int* indices = mesh.GetIndices(lod);
+
+    // Pixel x / y and world depth, as the slicer shader sees them
+    ThreadPool& pool = ThreadPool::Get();
+    std::vector<glm::vec3> gridPositions(mesh.GetVertexCount());
+    pool.ParallelFor(0, (int)gridPositions.size(), VertexGrain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) gridPositions[i] = glm::vec3(modelMatrix * glm::vec4(positions[i], 1.0f));
+    });
+
+    // Bands by centre depth: those a triangle can meet have their centre within the thickest half-thickness of
+    // its depth range, which two binary searches find; the exact test then drops the rest
+    int bandCount = (int)bands.size();
+    std::vector<int> bandOrder(bandCount);
+    std::vector<float> sortedCentres(bandCount);
+    float maxHalfThickness = 0.0f;
+    for (int band = 0; band < bandCount; band++) {
+        bandOrder[band] = band;
+        maxHalfThickness = std::max(maxHalfThickness, bands[band].Thickness * 0.5f);
+    }
+    std::sort(bandOrder.begin(), bandOrder.end(), [&](int a, int b) { return bands[a].SliceZ < bands[b].SliceZ; });
+    for (int k = 0; k < bandCount; k++) sortedCentres[k] = bands[bandOrder[k]].SliceZ;
+
+    auto forEachBand = [&](int t, auto&& visit) {
+        float a = gridPositions[indices[t * 3 + 0]].z;
+        float b = gridPositions[indices[t * 3 + 1]].z;
+        float c = gridPositions[indices[t * 3 + 2]].z;
+        float minZ = std::min(a, std::min(b, c));
+        float maxZ = std::max(a, std::max(b, c));
+
+        auto first = std::lower_bound(sortedCentres.begin(), sortedCentres.end(), minZ - maxHalfThickness);
+        auto last = std::upper_bound(first, sortedCentres.end(), maxZ + maxHalfThickness);
+        for (auto it = first; it != last; ++it) {
+            int band = bandOrder[it - sortedCentres.begin()];
+            float halfThickness = bands[band].Thickness * 0.5f;
+            if (maxZ < bands[band].SliceZ - halfThickness || minZ > bands[band].SliceZ + halfThickness) continue;
+            visit(band);
+        }
+    };
+
+    // Bins in one flat array, band after band, each in triangle order: chunks count their entries per band, a prefix
+    // sum places every chunk's share, and a second pass writes them
+    int triangleCount = (int)(mesh.GetIndexCount(lod) / 3);
+    int chunkCount = (triangleCount + TriangleGrain - 1) / TriangleGrain;
+    std::vector<int> chunkCursor((size_t)chunkCount * bandCount, 0);
+    pool.ParallelFor(0, triangleCount, TriangleGrain, [&](int begin, int end) {
+        int* counts = chunkCursor.data() + (size_t)(begin / TriangleGrain) * bandCount;
+        for (int t = begin; t < end; t++) forEachBand(t, [&](int band) { counts[band]++; });
+    });
+
+    std::vector<int> bandStart(bandCount + 1, 0);
+    int offset = 0;
+    for (int band = 0; band < bandCount; band++) {
+        bandStart[band] = offset;
+        for (int chunk = 0; chunk < chunkCount; chunk++) {
+            int& cursor = chunkCursor[(size_t)chunk * bandCount + band];
+            int count = cursor;
+            cursor = offset;
+            offset += count;
+        }
+    }
+    bandStart[bandCount] = offset;
+
+    std::vector<unsigned int> binTriangles(offset);
+    pool.ParallelFor(0, triangleCount, TriangleGrain, [&](int begin, int end) {
+        int* cursors = chunkCursor.data() + (size_t)(begin / TriangleGrain) * bandCount;
+        for (int t = begin; t < end; t++) forEachBand(t, [&](int band) { binTriangles[cursors[band]++] = (unsigned int)t; });
+    });
+
+    int w = m_Width;
+    int h = m_Height;
+    pool.ParallelFor(0, bandCount, 1, [&](int bandBegin, int bandEnd) {
+        for (int band = bandBegin; band < bandEnd; band++) {
+            float* mask = masks.data() + cellCount * band;
+            float sliceZ = bands[band].SliceZ;
+            float halfThickness = bands[band].Thickness * 0.5f;
+
+            for (int bin = bandStart[band]; bin < bandStart[band + 1]; bin++) {
+                unsigned int t = binTriangles[bin];
+                const glm::vec3& a = gridPositions[indices[t * 3 + 0]];
+                const glm::vec3& b = gridPositions[indices[t * 3 + 1]];
+                const glm::vec3& c = gridPositions[indices[t * 3 + 2]];
+
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                if (std::abs(area) < 1e-12f) continue;
+
+                int colStart = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+                int colEnd = std::min(w - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+                int rowStart = std::max(0, (int)std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f));
+                int rowEnd = std::min(h - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f));
+
+                for (int j = rowStart; j <= rowEnd; j++) {
+                    float y = j + 0.5f;
+                    for (int i = colStart; i <= colEnd; i++) {
+                        float x = i + 0.5f;
+
+                        // Barycentric weights of the pixel centre; depth is linear in them under the orthographic view
+                        float w0 = ((b.x - x) * (c.y - y) - (b.y - y) * (c.x - x)) / area;
+                        float w1 = ((c.x - x) * (a.y - y) - (c.y - y) * (a.x - x)) / area;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+                        float z = w0 * a.z + w1 * b.z + w2 * c.z;
+                        if (std::abs(z - sliceZ) <= halfThickness) mask[i + j * w] = 1.0f;
+                    }
+                }
+            }
+
+            SliceStatistics& stats = statistics[band];
+            for (int j = 0; j < h; j++) {
+                int rowCells = 0;
+                for (int i = 0; i < w; i++) {
+                    if (mask[i + j * w] <= 0.0f) continue;
+                    if (stats.SolidCells + rowCells == 0) {
+                        stats.MinX = stats.MaxX = i;
+                        stats.MinY = j;
+                    }
+                    stats.MinX = std::min(stats.MinX, i);
+                    stats.MaxX = std::max(stats.MaxX, i);
+                    rowCells++;
+                }
+                if (rowCells == 0) continue;
+                stats.SolidCells += rowCells;
+                stats.BlockedRows++;
+                stats.MaxY = j;
+            }
+        }
+    });
+}
+
+int Slicer::FindLargestBlockage(const std::vector<SliceStatistics>& statistics)
+{
+    int best = -1;
+    for (int band = 0; band < (int)statistics.size(); band++) {
+        const SliceStatistics& stats = statistics[band];
+        if (stats.SolidCells == 0) continue;
+        if (best >= 0) {
+            const SliceStatistics& leader = statistics[best];
+            if (stats.BlockedRows < leader.BlockedRows) continue;
+            if (stats.BlockedRows == leader.BlockedRows && stats.SolidCells <= leader.SolidCells) continue;
+        }
+        best = band;
+    }
+    return best;
+}
+
+void Slicer::Render(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, unsigned int fbo, int width, int height, std::vector<float>& pixels)
+{
+    // Covers the draw and the blocking read-back
+    ProfileScope scope(ProfilePhase::SliceCapture, width * height);
+
     // Save current state
     GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
     GLint last_fbo; glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_fbo);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
-    glViewport(0, 0, m_Width, m_Height);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
 
     // Clear to black (empty fluid)
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -55,29 +256,30 @@ std::vector<float> Slicer::Capture(Mesh& mesh, const glm::mat4& modelMatrix, flo
 
     m_Shader.use();
 
-    // Projection matching grid coordinates exactly (0,0) to (width, height)
-    glm::mat4 projection = glm::ortho(0.0f, (float)m_Width, 0.0f, (float)m_Height, -1000.0f, 1000.0f);
+    // Projection matching pixel coordinates exactly (0,0) to (width, height)
+    glm::mat4 projection = glm::ortho(0.0f, (float)width, 0.0f, (float)height, -1000.0f, 1000.0f);
 
     m_Shader.setMat4("projection", projection);
     m_Shader.setMat4("model", modelMatrix);
+    m_Shader.setVec3("positionOffset", mesh.GetPositionOffset());
+    m_Shader.setVec3("positionScale", mesh.GetPositionScale());
     m_Shader.setFloat("sliceZ", sliceZ);
     m_Shader.setFloat("thickness", thickness);
 
     // Disable culling to ensure backfaces are rendered (solid object might be cut open)
     glDisable(GL_CULL_FACE);
 
-    mesh.Draw();
+    // One world unit is one pixel here; detail below half a pixel cannot change the rasterised mask
+    mesh.Draw(mesh.SelectLod(modelMatrix, 0.5f));
 
     glEnable(GL_CULL_FACE);
 
-    std::vector<float> pixels(m_Width * m_Height);
-    glReadPixels(0, 0, m_Width, m_Height, GL_RED, GL_FLOAT, pixels.data());
+    pixels.resize((size_t)width * height);
+    glReadPixels(0, 0, width, height, GL_RED, GL_FLOAT, pixels.data());
 
     // Restore state
     glBindFramebuffer(GL_FRAMEBUFFER, last_fbo);
     glViewport(last_viewport[0], last_viewport[1], last_viewport[2], last_viewport[3]);
-
-    return pixels;
 }
 
 void Slicer::CreateShader()
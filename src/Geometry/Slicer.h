@@ -4,24 +4,67 @@
 #include <glm/glm.hpp>
 #include "Mesh.h"
 #include "../Shader.h"
+#include "../Span.h"
+
+// One band of a stack capture: what Capture would take as sliceZ and thickness
+struct SliceBand {
+    float SliceZ = 0.0f;
+    float Thickness = 1.0f;
+};
+
+// Cells of one captured mask, for choosing a slice without running the solver
+struct SliceStatistics {
+    int SolidCells = 0;
+    int BlockedRows = 0; // Rows with any solid cell: the obstacle's frontal extent across the flow
+
+    // Bounding box of the solid cells, inclusive; empty (MaxX < MinX) without any
+    int MinX = 0;
+    int MinY = 0;
+    int MaxX = -1;
+    int MaxY = -1;
+};
 
 class Slicer {
 public:
     Slicer(int width, int height);
     ~Slicer();
 
-    // Renders the mesh cross-section and returns a flat array (width * height), 1.0f = solid, 0.0f = empty.
-    std::vector<float> Capture(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness);
+    // Renders the mesh cross-section into 'mask' (width * height), 1.0f = solid, 0.0f = empty. A buffer the caller
+    // keeps is only resized once, so repeated captures do not allocate.
+    void Capture(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, std::vector<float>& mask);
+
+    // Signed distance to the cross-section in cells (negative inside), from a capture 'supersample' times finer
+    void CaptureDistance(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, std::vector<float>& distance, int supersample = 4);
+
+    // The masks Capture would give for each band, one after another in 'masks', rasterised on the CPU without
+    // touching GL: the triangles are binned in parallel into the bands their depth range meets, found by a search
+    // over the bands sorted by depth, then the bands are filled in parallel. A pixel is solid when a triangle
+    // covers its centre at a depth inside the band.
+    void CaptureStack(const Mesh& mesh, const glm::mat4& modelMatrix, Span<const SliceBand> bands, std::vector<float>& masks,
+                      std::vector<SliceStatistics>& statistics) const;
+
+    // Band with the most blocked rows (ties: the most solid cells), -1 if every band is empty
+    static int FindLargestBlockage(const std::vector<SliceStatistics>& statistics);
 
 private:
     void InitResources();
     void CreateShader();
 
+    // Renders into 'fbo' (width x height pixels spanning the grid) and reads the red channel back
+    void Render(Mesh& mesh, const glm::mat4& modelMatrix, float sliceZ, float thickness, unsigned int fbo, int width, int height, std::vector<float>& pixels);
+    void CreateTarget(int width, int height, unsigned int& fbo, unsigned int& texture);
+
 private:
     int m_Width;
     int m_Height;
 
     unsigned int m_FBO = 0;
     unsigned int m_Texture = 0;
+
+    // Supersampled target for CaptureDistance, created on first use
+    unsigned int m_FineFBO = 0;
+    unsigned int m_FineTexture = 0;
+    int m_FineFactor = 0;
+    std::vector<float> m_FinePixels;
     Shader m_Shader;
 };
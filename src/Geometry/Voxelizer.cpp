@@ -0,0 +1,91 @@
+#include "Voxelizer.h"
+#include "../ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+void Voxelizer::Voxelize(const Mesh& mesh, const glm::mat4& gridFromModel, int width, int height, int depth, std::vector<float>& mask)
+{
+    mask.assign((size_t)width * height * depth, 0.0f);
+
+    // Coarsest level that stays within half a cell of the full surface
+    int lod = mesh.SelectLod(gridFromModel, 0.5f);
+
+    const glm::vec3* positions = mesh.GetPositions();
+    const unsigned int* indices = mesh.GetIndices(lod);
+
+    std::vector<glm::vec3> gridPositions(mesh.GetVertexCount());
+    for (size_t i = 0; i < gridPositions.size(); i++) {
+        gridPositions[i] = glm::vec3(gridFromModel * glm::vec4(positions[i], 1.0f));
+    }
+
+    // Bin triangles by the rows of columns they cover so rows can be processed independently
+    std::vector<std::vector<unsigned int>> rowBins(height);
+    size_t triangleCount = mesh.GetIndexCount(lod) / 3;
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec3& a = gridPositions[indices[t * 3 + 0]];
+        const glm::vec3& b = gridPositions[indices[t * 3 + 1]];
+        const glm::vec3& c = gridPositions[indices[t * 3 + 2]];
+
+        float minY = std::min(a.y, std::min(b.y, c.y));
+        float maxY = std::max(a.y, std::max(b.y, c.y));
+        int rowStart = std::max(0, (int)std::ceil(minY - 0.5f));
+        int rowEnd = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+
+        for (int j = rowStart; j <= rowEnd; j++) {
+            rowBins[j].push_back((unsigned int)t);
+        }
+    }
+
+    ThreadPool::Get().ParallelFor(0, height, 1, [&](int rowBegin, int rowEnd) {
+        std::vector<std::vector<float>> columnHits(width);
+
+        for (int j = rowBegin; j < rowEnd; j++) {
+            for (auto& hits : columnHits) hits.clear();
+
+            // Ray origins are nudged off the cell centre so rays do not run exactly through shared edges
+            float rayY = j + 0.5f + 1.31e-4f;
+
+            for (unsigned int t : rowBins[j]) {
+                const glm::vec3& a = gridPositions[indices[t * 3 + 0]];
+                const glm::vec3& b = gridPositions[indices[t * 3 + 1]];
+                const glm::vec3& c = gridPositions[indices[t * 3 + 2]];
+
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                if (std::abs(area) < 1e-12f) continue;
+
+                float minX = std::min(a.x, std::min(b.x, c.x));
+                float maxX = std::max(a.x, std::max(b.x, c.x));
+                int colStart = std::max(0, (int)std::ceil(minX - 0.5f));
+                int colEnd = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+
+                for (int i = colStart; i <= colEnd; i++) {
+                    float rayX = i + 0.5f + 1.07e-4f;
+
+                    // Barycentric weights of the ray in the triangle's xy projection
+                    float w0 = ((b.x - rayX) * (c.y - rayY) - (b.y - rayY) * (c.x - rayX)) / area;
+                    float w1 = ((c.x - rayX) * (a.y - rayY) - (c.y - rayY) * (a.x - rayX)) / area;
+                    float w2 = 1.0f - w0 - w1;
+
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+                    columnHits[i].push_back(w0 * a.z + w1 * b.z + w2 * c.z);
+                }
+            }
+
+            for (int i = 0; i < width; i++) {
+                std::vector<float>& hits = columnHits[i];
+                if (hits.size() < 2) continue;
+                std::sort(hits.begin(), hits.end());
+
+                // Inside between each entry/exit pair; an unmatched final crossing (open mesh) is ignored
+                for (size_t h = 0; h + 1 < hits.size(); h += 2) {
+                    int zStart = std::max(0, (int)std::ceil(hits[h] - 0.5f));
+                    int zEnd = std::min(depth - 1, (int)std::floor(hits[h + 1] - 0.5f));
+                    for (int k = zStart; k <= zEnd; k++) {
+                        mask[i + (size_t)width * (j + (size_t)height * k)] = 1.0f;
+                    }
+                }
+            }
+        }
+    });
+}
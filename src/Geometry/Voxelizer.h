@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+class Voxelizer {
+public:
+    // Fills a solid mask (x + y * width + z * width * height, 1.0f = solid) by casting one ray per (x, y) column
+    // along +z and filling between pairs of surface crossings. 'gridFromModel' maps mesh space to cell units.
+    static void Voxelize(const Mesh& mesh, const glm::mat4& gridFromModel, int width, int height, int depth, std::vector<float>& mask);
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <type_traits>
+
+// Turns runtime switches into compile-time ones, so a grid kernel is instantiated once per combination and its
+// inner loop carries no test of them. kernel is called once with one std::bool_constant per flag, in order:
+//     SpecialiseFlags([&](auto obstacles, auto periodic) { Kernel<obstacles, periodic>(...); }, hasObstacle, periodic);
+template <typename Kernel>
+void SpecialiseFlags(Kernel&& kernel)
+{
+    kernel();
+}
+
+template <typename Kernel, typename... Flags>
+void SpecialiseFlags(Kernel&& kernel, bool flag, Flags... flags)
+{
+    if (flag) SpecialiseFlags([&](auto... rest) { kernel(std::true_type(), rest...); }, flags...);
+    else SpecialiseFlags([&](auto... rest) { kernel(std::false_type(), rest...); }, flags...);
+}
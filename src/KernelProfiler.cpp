@@ -0,0 +1,229 @@
+#include "KernelProfiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+
+struct PhaseInfo {
+    const char* Name;
+    double BytesPerPass; // Nominal, per grid cell
+    bool Pool;           // Runs on the ThreadPool, so the workers are counted too
+};
+
+// Bytes are the float arrays a pass reads or writes once each; neighbours and repeated reads are assumed cached
+constexpr PhaseInfo Phases[(int)ProfilePhase::Count] = {
+    { "Advect",           20.0, true  }, // u, v, source, destination, solid mask
+    { "Diffuse",          28.0, true  }, // Iterate, target, right-hand side, diagonal, two couplings, active flag
+    { "Eddy Viscosity",   16.0, true  }, // u, v, solid mask, viscosity
+    { "Divergence",       28.0, true  }, // u, v, two face fractions, solid mask, divergence, pressure reset
+    { "Pressure Solve",   16.0, true  }, // Pressure, target, divergence, solid mask
+    { "Gradient",         24.0, true  }, // u and v read and written, pressure, solid mask
+    { "Scalar Transport", 12.0, true  }, // Source and destination of one species, amortised velocity
+    { "Slice Capture",     4.0, false }  // The read-back red channel
+};
+
+// At least this fraction of the peak bandwidth counts as bandwidth-bound
+constexpr double MemoryBoundFraction = 0.5;
+
+// Below that, a phase retiring fewer instructions per cycle than this is stalled rather than busy
+constexpr double BusyIpc = 1.0;
+
+constexpr double CacheLineBytes = 64.0;
+
+// STREAM triad: three arrays of this many floats (32 MB each), best of a few runs
+constexpr int TriadElements = 1 << 23;
+constexpr int TriadRuns = 5;
+constexpr int TriadGrain = 1 << 16;
+
+// The calling thread's own counters, opened on its first counted scope
+struct ThreadCounters {
+    PerfCounters Counters;
+    bool Tried = false;
+};
+
+thread_local ThreadCounters LocalCounters;
+
+void Accumulate(PerfSample& total, const PerfSample& sample)
+{
+    for (int e = 0; e < (int)PerfEvent::Count; e++) total.Values[e] += sample.Values[e];
+}
+
+}
+
+KernelProfiler& KernelProfiler::Get()
+{
+    static KernelProfiler profiler;
+    return profiler;
+}
+
+void KernelProfiler::SetEnabled(bool enabled)
+{
+    if (enabled == IsEnabled()) return;
+
+    if (enabled) MeasurePeakBandwidth();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WorkerCounters.clear();
+    m_WorkerStatus.clear();
+    if (enabled) {
+        for (int threadId : ThreadPool::Get().GetWorkerThreadIds()) {
+            auto counters = std::make_unique<PerfCounters>();
+            std::string error;
+            counters->Open(threadId, error);
+            if (m_WorkerStatus.empty()) m_WorkerStatus = error;
+            m_WorkerCounters.push_back(std::move(counters));
+        }
+    }
+    m_Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+std::string KernelProfiler::GetStatus() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_ThreadStatus.empty() ? m_WorkerStatus : m_ThreadStatus;
+}
+
+std::vector<PhaseReport> KernelProfiler::GetReport() const
+{
+    double peak = GetPeakBandwidth();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<PhaseReport> report;
+    for (int p = 0; p < (int)ProfilePhase::Count; p++) {
+        const Totals& totals = m_Totals[p];
+        PhaseReport phase;
+        phase.Name = Phases[p].Name;
+        phase.Calls = totals.Calls;
+        if (totals.Calls == 0 || totals.Cells <= 0.0 || totals.Seconds <= 0.0) {
+            report.push_back(phase);
+            continue;
+        }
+
+        phase.Milliseconds = 1000.0 * totals.Seconds / totals.Calls;
+        phase.BytesPerCell = totals.Bytes / totals.Cells;
+
+        // Counts cover only the calls that had counters, so they are normalised by those
+        double traffic = totals.Bytes / totals.Seconds;
+        phase.Counted = totals.CountedCalls > 0 && totals.CountedCells > 0.0 && totals.CountedSeconds > 0.0;
+        if (phase.Counted) {
+            const uint64_t* counts = totals.Counts.Values;
+            double missBytes = counts[(int)PerfEvent::CacheMisses] * CacheLineBytes;
+            phase.MissBytesPerCell = missBytes / totals.CountedCells;
+            phase.BranchMissesPerCell = counts[(int)PerfEvent::BranchMisses] / totals.CountedCells;
+            phase.VectorOpsPerCell = counts[(int)PerfEvent::VectorOps] / totals.CountedCells;
+            phase.HasVectorOps = totals.VectorOps;
+            uint64_t cycles = counts[(int)PerfEvent::Cycles];
+            phase.Ipc = cycles > 0 ? (double)counts[(int)PerfEvent::Instructions] / cycles : 0.0;
+            traffic = std::max(traffic, missBytes / totals.CountedSeconds);
+        }
+        phase.Bandwidth = traffic;
+        phase.PeakFraction = peak > 0.0 ? traffic / peak : 0.0;
+
+        if (phase.PeakFraction >= MemoryBoundFraction) phase.Bound = PhaseBound::Memory;
+        else if (phase.Ipc > 0.0) phase.Bound = phase.Ipc >= BusyIpc ? PhaseBound::Compute : PhaseBound::Latency;
+        else phase.Bound = PhaseBound::NotMemory;
+        report.push_back(phase);
+    }
+    return report;
+}
+
+void KernelProfiler::ResetTotals()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (Totals& totals : m_Totals) totals = Totals();
+}
+
+const char* KernelProfiler::GetBoundName(PhaseBound bound)
+{
+    switch (bound) {
+    case PhaseBound::Memory:  return "memory";
+    case PhaseBound::Compute: return "compute";
+    case PhaseBound::Latency: return "latency";
+    default:                  return "not memory";
+    }
+}
+
+bool KernelProfiler::ReadCounters(ProfilePhase phase, PerfSample& sample)
+{
+    if (!LocalCounters.Tried) {
+        LocalCounters.Tried = true;
+        std::string error;
+        LocalCounters.Counters.Open(0, error);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!error.empty()) m_ThreadStatus = error;
+    }
+
+    sample = LocalCounters.Counters.Read();
+    bool counted = LocalCounters.Counters.IsOpen();
+    if (!Phases[(int)phase].Pool) return counted;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (const auto& counters : m_WorkerCounters) {
+        if (!counters->IsOpen()) continue;
+        Accumulate(sample, counters->Read());
+        counted = true;
+    }
+    return counted;
+}
+
+void KernelProfiler::Record(ProfilePhase phase, double cells, double passes, double seconds, const PerfSample* counts)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Totals& totals = m_Totals[(int)phase];
+    totals.Calls++;
+    totals.Seconds += seconds;
+    totals.Cells += cells;
+    totals.Bytes += cells * passes * Phases[(int)phase].BytesPerPass;
+    if (counts) {
+        totals.CountedCalls++;
+        totals.CountedSeconds += seconds;
+        totals.CountedCells += cells;
+        Accumulate(totals.Counts, *counts);
+        totals.VectorOps |= LocalCounters.Counters.HasEvent(PerfEvent::VectorOps);
+    }
+}
+
+void KernelProfiler::MeasurePeakBandwidth()
+{
+    if (GetPeakBandwidth() > 0.0) return;
+
+    std::vector<float> a(TriadElements, 0.0f), b(TriadElements, 1.0f), c(TriadElements, 2.0f);
+    const float scalar = 3.0f;
+
+    double best = 0.0;
+    for (int run = 0; run < TriadRuns; run++) {
+        auto start = std::chrono::steady_clock::now();
+        ThreadPool::Get().ParallelFor(0, TriadElements, TriadGrain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) a[i] = b[i] + scalar * c[i];
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds > 0.0) best = std::max(best, 3.0 * sizeof(float) * TriadElements / seconds);
+    }
+    m_PeakBandwidth.store(best, std::memory_order_relaxed);
+}
+
+ProfileScope::ProfileScope(ProfilePhase phase, int cells)
+    : m_Phase(phase), m_Cells(cells), m_Active(KernelProfiler::Get().IsEnabled())
+{
+    if (!m_Active) return;
+    m_Counted = KernelProfiler::Get().ReadCounters(phase, m_Start);
+    m_StartTime = std::chrono::steady_clock::now();
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (!m_Active) return;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StartTime).count();
+
+    KernelProfiler& profiler = KernelProfiler::Get();
+    if (!profiler.IsEnabled()) return; // Disabled meanwhile: the worker counters may be gone
+
+    PerfSample end;
+    bool counted = m_Counted && profiler.ReadCounters(m_Phase, end);
+    PerfSample counts;
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        // Counters reopened in between restart from zero
+        counts.Values[e] = end.Values[e] >= m_Start.Values[e] ? end.Values[e] - m_Start.Values[e] : 0;
+    }
+    profiler.Record(m_Phase, m_Cells, m_Passes, seconds, counted ? &counts : nullptr);
+}
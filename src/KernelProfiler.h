@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PerfCounters.h"
+
+// Instrumented phases of a step, plus the obstacle capture
+enum class ProfilePhase {
+    Advect = 0,
+    Diffuse,
+    EddyViscosity,
+    Divergence,
+    PressureSolve,
+    Gradient,
+    ScalarTransport,
+    SliceCapture,
+    Count
+};
+
+// Whether a phase is limited by memory bandwidth, by execution, or by neither (stalls and synchronisation)
+enum class PhaseBound {
+    Memory,
+    Compute,
+    Latency,
+    NotMemory // Below the bandwidth threshold, with no counts to tell the other two apart
+};
+
+struct PhaseReport {
+    const char* Name = "";
+    uint64_t Calls = 0;
+    double Milliseconds = 0.0;       // Per call
+    double BytesPerCell = 0.0;       // Nominal traffic per call: the arrays the kernel streams times its passes
+    double MissBytesPerCell = 0.0;   // Last-level cache misses times the line size
+    double Bandwidth = 0.0;          // Bytes per second, from the larger of the two traffic figures
+    double PeakFraction = 0.0;       // Of GetPeakBandwidth()
+    double Ipc = 0.0;                // Instructions per cycle, summed over the threads taking part
+    double BranchMissesPerCell = 0.0;
+    double VectorOpsPerCell = 0.0;
+    bool Counted = false;            // The counter figures are measured; otherwise only time and bandwidth are
+    bool HasVectorOps = false;
+    PhaseBound Bound = PhaseBound::NotMemory;
+};
+
+// Optional per-phase hardware counters for deciding whether the solver is compute- or bandwidth-bound on a box.
+// ProfileScope marks a phase; while disabled it costs one atomic load. Pool phases count the calling thread and
+// every ThreadPool worker, others the calling thread only, so two threads running pool phases at the same time see
+// each other's worker counts. FluidSolver's step graph overlaps phases that way; their times are each phase's own
+// wall time, so the totals can exceed the step time.
+//
+// Without counters (other platforms, a restrictive perf_event_paranoid, virtual machines without a PMU) the report
+// keeps the wall time, the nominal traffic and its fraction of the peak.
+class KernelProfiler {
+public:
+    static KernelProfiler& Get();
+
+    // Enabling opens the worker counters, and measures the peak bandwidth if that has not been done yet
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+    // Runs a STREAM triad (a = b + s c) over the pool on arrays well beyond the caches, best of several runs, and
+    // keeps the result. Takes a moment and needs the pool and memory bus to itself to be meaningful, so call it
+    // before other threads start working; later calls keep the first result.
+    void MeasurePeakBandwidth();
+
+    // In bytes per second; 0 until measured
+    double GetPeakBandwidth() const { return m_PeakBandwidth.load(std::memory_order_relaxed); }
+
+    // Why some or all counts are missing, empty when every event is counted everywhere
+    std::string GetStatus() const;
+
+    std::vector<PhaseReport> GetReport() const;
+    void ResetTotals();
+
+    static const char* GetBoundName(PhaseBound bound);
+
+private:
+    friend class ProfileScope;
+
+    struct Totals {
+        uint64_t Calls = 0;
+        uint64_t CountedCalls = 0;
+        double Seconds = 0.0;
+        double CountedSeconds = 0.0;
+        double Cells = 0.0;        // Summed over calls
+        double CountedCells = 0.0;
+        double Bytes = 0.0;        // Nominal
+        PerfSample Counts;
+        bool VectorOps = false;    // The vector event was among the counts
+    };
+
+    KernelProfiler() = default;
+
+    // Counter totals of the threads taking part in 'phase'; false when none of them count
+    bool ReadCounters(ProfilePhase phase, PerfSample& sample);
+    void Record(ProfilePhase phase, double cells, double passes, double seconds, const PerfSample* counts);
+
+private:
+    std::atomic<bool> m_Enabled{ false };
+    std::atomic<double> m_PeakBandwidth{ 0.0 };
+
+    mutable std::mutex m_Mutex;
+    std::vector<std::unique_ptr<PerfCounters>> m_WorkerCounters; // One per ThreadPool worker
+    std::string m_WorkerStatus;
+    std::string m_ThreadStatus; // From the first thread that opened its own counters
+    Totals m_Totals[(int)ProfilePhase::Count];
+};
+
+// Times and counts one phase from construction to destruction when the profiler is enabled. 'cells' is the grid
+// size a pass covers; phases that sweep more than once set their pass count before the scope ends.
+class ProfileScope {
+public:
+    ProfileScope(ProfilePhase phase, int cells);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    void SetPasses(double passes) { m_Passes = passes; }
+
+private:
+    ProfilePhase m_Phase;
+    int m_Cells;
+    double m_Passes = 1.0;
+    bool m_Active;
+    bool m_Counted = false;
+    PerfSample m_Start;
+    std::chrono::steady_clock::time_point m_StartTime;
+};
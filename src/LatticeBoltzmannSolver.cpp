@@ -0,0 +1,421 @@
+#include "LatticeBoltzmannSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// D2Q9: rest, the four axes, then the four diagonals
+constexpr int Directions = 9;
+constexpr int VelocityX[Directions] = { 0, 1, 0, -1, 0, 1, -1, -1, 1 };
+constexpr int VelocityY[Directions] = { 0, 0, 1, 0, -1, 1, 1, -1, -1 };
+constexpr int Opposite[Directions] = { 0, 3, 4, 1, 2, 7, 8, 5, 6 };
+constexpr float Weights[Directions] = { 4.0f / 9.0f,
+                                        1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f,
+                                        1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f };
+
+// Closest the shear relaxation time may get to the stability limit of 1/2; MRT damps the other moments at fixed
+// rates and gets much closer than BGK
+constexpr float MinRelaxationTimeBGK = 0.53f;
+constexpr float MinRelaxationTimeMRT = 0.51f;
+
+// Relaxation rates of the MRT energy, energy-square and heat-flux moments (Lallemand & Luo 2000)
+constexpr float EnergyRate = 1.64f;
+constexpr float EnergySquareRate = 1.54f;
+constexpr float HeatFluxRate = 1.9f;
+
+// Inflow speed (domain units per second) that sets the lattice time step when the inflow is slower or off
+constexpr float MinReferenceVelocity = 0.1f;
+
+// Inflow changes are spread over one period of the tunnel's lowest acoustic mode, a quarter wave between inflow
+// and outflow (4 L / c_s lattice steps), which leaves that mode and its odd harmonics unexcited
+constexpr float RampSoundSpeed = 0.57735027f;
+
+// Grid rows per task
+constexpr int RowGrain = 8;
+
+int FindDirection(int x, int y)
+{
+    for (int q = 0; q < Directions; q++) {
+        if (VelocityX[q] == x && VelocityY[q] == y) return q;
+    }
+    return 0;
+}
+
+// Relaxes the populations of one cell in place and returns its density and velocity
+void CollideCell(float* f, float omega, bool mrt, float& density, float& velocityX, float& velocityY)
+{
+    float rho = 0.0f, jx = 0.0f, jy = 0.0f;
+    for (int q = 0; q < Directions; q++) {
+        rho += f[q];
+        jx += VelocityX[q] * f[q];
+        jy += VelocityY[q] * f[q];
+    }
+    float ux = jx / rho;
+    float uy = jy / rho;
+    density = rho;
+    velocityX = ux;
+    velocityY = uy;
+
+    if (!mrt) {
+        float usq = 1.5f * (ux * ux + uy * uy);
+        for (int q = 0; q < Directions; q++) {
+            float cu = 3.0f * (VelocityX[q] * ux + VelocityY[q] * uy);
+            float equilibrium = Weights[q] * rho * (1.0f + cu + 0.5f * cu * cu - usq);
+            f[q] -= omega * (f[q] - equilibrium);
+        }
+        return;
+    }
+
+    // Non-conserved moments and their departure from equilibrium, scaled by their rates
+    float momentum = (jx * jx + jy * jy) / rho;
+    float energy = -4.0f * f[0] - (f[1] + f[2] + f[3] + f[4]) + 2.0f * (f[5] + f[6] + f[7] + f[8]);
+    float energySquare = 4.0f * f[0] - 2.0f * (f[1] + f[2] + f[3] + f[4]) + (f[5] + f[6] + f[7] + f[8]);
+    float heatFluxX = -2.0f * (f[1] - f[3]) + (f[5] - f[6] - f[7] + f[8]);
+    float heatFluxY = -2.0f * (f[2] - f[4]) + (f[5] + f[6] - f[7] - f[8]);
+    float stressXX = f[1] - f[2] + f[3] - f[4];
+    float stressXY = f[5] - f[6] + f[7] - f[8];
+
+    float de = EnergyRate * (energy - (-2.0f * rho + 3.0f * momentum));
+    float dEps = EnergySquareRate * (energySquare - (rho - 3.0f * momentum));
+    float dqx = HeatFluxRate * (heatFluxX + jx);
+    float dqy = HeatFluxRate * (heatFluxY + jy);
+    float dxx = omega * (stressXX - (jx * jx - jy * jy) / rho);
+    float dxy = omega * (stressXY - jx * jy / rho);
+
+    // Back to populations through the inverse moment matrix (its rows are orthogonal: M^-1 = M^T / |row|^2)
+    float e = de / 36.0f, eps = dEps / 36.0f, qx = dqx / 12.0f, qy = dqy / 12.0f, xx = dxx / 4.0f, xy = dxy / 4.0f;
+    f[0] -= -4.0f * e + 4.0f * eps;
+    f[1] -= -e - 2.0f * eps - 2.0f * qx + xx;
+    f[2] -= -e - 2.0f * eps - 2.0f * qy - xx;
+    f[3] -= -e - 2.0f * eps + 2.0f * qx + xx;
+    f[4] -= -e - 2.0f * eps + 2.0f * qy - xx;
+    f[5] -= 2.0f * e + eps + qx + qy + xy;
+    f[6] -= 2.0f * e + eps - qx + qy - xy;
+    f[7] -= 2.0f * e + eps - qx - qy + xy;
+    f[8] -= 2.0f * e + eps + qx - qy - xy;
+}
+
+}
+
+LatticeBoltzmannSolver::LatticeBoltzmannSolver(int width, int height)
+    : m_Width(width), m_Height(height), m_Size(width * height)
+{
+    m_Distributions.resize((size_t)Directions * m_Size, 0.0f);
+    m_Density.resize(m_Size, 1.0f);
+    m_LatticeVelocityX.resize(m_Size, 0.0f);
+    m_LatticeVelocityY.resize(m_Size, 0.0f);
+    m_VelocityX.resize(m_Size, 0.0f);
+    m_VelocityY.resize(m_Size, 0.0f);
+    m_Pressure.resize(m_Size, 0.0f);
+    m_SolidMask.resize(m_Size, 0.0f);
+    m_InflowX.resize(m_Size, 0.0f);
+    m_InflowY.resize(m_Size, 0.0f);
+    m_Boundaries.Configure(BoundarySettings(), width, height);
+    m_Scalars.Configure(ScalarTransport::GetDefaultSpecies(), width, height);
+    InitDistributions();
+    BuildLinks();
+}
+
+FieldView LatticeBoltzmannSolver::GetFieldView() const
+{
+    FieldView view;
+    view.Width = m_Width;
+    view.Height = m_Height;
+    view.VelocityX = m_VelocityX.data();
+    view.VelocityY = m_VelocityY.data();
+    view.Pressure = m_Pressure.data();
+    view.DyeDensity = m_Scalars.GetValues(std::max(0, std::min(m_DisplayedSpecies, m_Scalars.GetSpeciesCount() - 1))).data();
+    view.SolidMask = m_SolidMask.data();
+    view.Version = m_Version;
+    return view;
+}
+
+void LatticeBoltzmannSolver::SetBoundarySettings(const BoundarySettings& settings)
+{
+    m_Boundaries.Configure(settings, m_Width, m_Height);
+    BuildLinks();
+}
+
+void LatticeBoltzmannSolver::SetSpecies(const std::vector<ScalarSpecies>& species)
+{
+    m_Scalars.Configure(species.empty() ? ScalarTransport::GetDefaultSpecies() : species, m_Width, m_Height);
+}
+
+void LatticeBoltzmannSolver::SetObstacleMask(Span<const float> mask)
+{
+    if (mask.size() != (size_t)m_Size) return;
+
+    // Cells that change sides restart at rest
+    for (int cell = 0; cell < m_Size; cell++) {
+        if ((mask[cell] > 0.0f) == (m_SolidMask[cell] > 0.0f)) continue;
+        for (int q = 0; q < Directions; q++) m_Distributions[(size_t)q * m_Size + cell] = Weights[q];
+        m_Density[cell] = 1.0f;
+        m_LatticeVelocityX[cell] = m_LatticeVelocityY[cell] = 0.0f;
+        m_VelocityX[cell] = m_VelocityY[cell] = 0.0f;
+    }
+    std::copy(mask.begin(), mask.end(), m_SolidMask.begin());
+    BuildLinks();
+    m_Version++;
+}
+
+void LatticeBoltzmannSolver::Reset()
+{
+    InitDistributions();
+    for (std::vector<float>* field : { &m_LatticeVelocityX, &m_LatticeVelocityY, &m_VelocityX, &m_VelocityY, &m_Pressure }) {
+        std::fill(field->begin(), field->end(), 0.0f);
+    }
+    std::fill(m_Density.begin(), m_Density.end(), 1.0f);
+    m_Scalars.Clear();
+    m_Boundaries.Reset();
+    m_PendingTime = 0.0f;
+    m_RampedInflow = 0.0f;
+    m_Version++;
+}
+
+void LatticeBoltzmannSolver::InitDistributions()
+{
+    for (int q = 0; q < Directions; q++) {
+        std::fill(m_Distributions.begin() + (size_t)q * m_Size, m_Distributions.begin() + (size_t)(q + 1) * m_Size, Weights[q]);
+    }
+    m_OddStep = false;
+}
+
+void LatticeBoltzmannSolver::RescaleTime(float ratio)
+{
+    // Either way a cell's populations are in its own slots: as they arrived after an odd step, as they left after
+    // an even one (in the opposite slots)
+    float* f = m_Distributions.data();
+    size_t size = m_Size;
+
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int cell = 1 + j * m_Width; cell < (j + 1) * m_Width - 1; cell++) {
+            if (m_SolidMask[cell] > 0.0f) continue;
+
+            float rho = m_Density[cell];
+            float ux = m_LatticeVelocityX[cell];
+            float uy = m_LatticeVelocityY[cell];
+            float scaledRho = 1.0f + (rho - 1.0f) * ratio * ratio;
+            for (int q = 0; q < Directions; q++) {
+                float& population = m_OddStep ? f[Opposite[q] * size + cell] : f[q * size + cell];
+                float cu = 3.0f * (VelocityX[q] * ux + VelocityY[q] * uy);
+                float usq = 1.5f * (ux * ux + uy * uy);
+                float equilibrium = Weights[q] * rho * (1.0f + cu + 0.5f * cu * cu - usq);
+                float scaledEquilibrium = Weights[q] * scaledRho * (1.0f + ratio * cu + 0.5f * ratio * ratio * cu * cu - ratio * ratio * usq);
+                population = scaledEquilibrium + ratio * (population - equilibrium);
+            }
+            m_Density[cell] = scaledRho;
+            m_LatticeVelocityX[cell] = ux * ratio;
+            m_LatticeVelocityY[cell] = uy * ratio;
+        }
+    }
+}
+
+void LatticeBoltzmannSolver::BuildLinks()
+{
+    m_Links.clear();
+    const BoundarySettings& settings = m_Boundaries.GetSettings();
+    bool periodicX = m_Boundaries.IsPeriodicX();
+    bool periodicY = m_Boundaries.IsPeriodicY();
+    int w = m_Width;
+    int cellsX = m_Width - 2;
+    int cellsY = m_Height - 2;
+
+    auto outsideX = [&](int i) { return i < 1 || i > m_Width - 2; };
+    auto outsideY = [&](int j) { return j < 1 || j > m_Height - 2; };
+    auto wrapX = [&](int i) { return periodicX && outsideX(i) ? 1 + (i - 1 + cellsX) % cellsX : i; };
+    auto wrapY = [&](int j) { return periodicY && outsideY(j) ? 1 + (j - 1 + cellsY) % cellsY : j; };
+    auto fluid = [&](int i, int j) { return !outsideX(i) && !outsideY(j) && m_SolidMask[i + j * w] <= 0.0f; };
+
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int i = 1; i < m_Width - 1; i++) {
+            int cell = i + j * w;
+            if (m_SolidMask[cell] > 0.0f) continue;
+
+            for (int q = 1; q < Directions; q++) {
+                int rawI = i - VelocityX[q];
+                int rawJ = j - VelocityY[q];
+                int sourceI = wrapX(rawI);
+                int sourceJ = wrapY(rawJ);
+
+                Link link = { cell, cell, rawI + rawJ * w, (uint8_t)q, 0, LinkRule::BounceBack };
+                if (!outsideX(sourceI) && !outsideY(sourceJ)) {
+                    if (m_SolidMask[sourceI + sourceJ * w] <= 0.0f) {
+                        if (sourceI == rawI && sourceJ == rawJ) continue; // Plain streaming between fluid cells
+                        link.Rule = LinkRule::Periodic;
+                        link.Source = sourceI + sourceJ * w;
+                    }
+                } else if (outsideX(sourceI) != outsideY(sourceJ) && m_SolidMask[link.Ghost] <= 0.0f) {
+                    bool horizontal = outsideX(sourceI);
+                    BoundarySide side = horizontal ? (sourceI < 1 ? BoundarySide::Left : BoundarySide::Right)
+                                                   : (sourceJ < 1 ? BoundarySide::Bottom : BoundarySide::Top);
+                    switch (settings.Types[(int)side]) {
+                    case BoundaryType::Inflow:
+                        link.Rule = LinkRule::MovingWall;
+                        break;
+                    case BoundaryType::Outflow:
+                    case BoundaryType::ConvectiveOutflow:
+                        link.Rule = LinkRule::AntiBounceBack;
+                        break;
+                    case BoundaryType::FreeSlip: {
+                        // Mirrored population from the neighbour along the wall; at corners and next to
+                        // obstacles that neighbour is missing and the wall bounces back instead
+                        int mirrorI = horizontal ? i : wrapX(i - VelocityX[q]);
+                        int mirrorJ = horizontal ? wrapY(j - VelocityY[q]) : j;
+                        if (fluid(mirrorI, mirrorJ)) {
+                            link.Rule = LinkRule::Specular;
+                            link.Source = mirrorI + mirrorJ * w;
+                            link.Mirrored = (uint8_t)(horizontal ? FindDirection(-VelocityX[q], VelocityY[q])
+                                                                 : FindDirection(VelocityX[q], -VelocityY[q]));
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                    }
+                }
+                m_Links.push_back(link);
+            }
+        }
+    }
+}
+
+void LatticeBoltzmannSolver::FillLinks(bool odd, float velocityScaleX, float velocityScaleY)
+{
+    float* f = m_Distributions.data();
+    size_t size = m_Size;
+    int offsets[Directions];
+    for (int q = 0; q < Directions; q++) offsets[q] = VelocityX[q] + VelocityY[q] * m_Width;
+
+    // Where population q that left 'cell' in the previous step is stored, and where 'cell' reads its incoming q
+    auto outgoing = [&](int cell, int q) -> float {
+        return odd ? f[Opposite[q] * size + cell] : f[q * size + cell + offsets[q]];
+    };
+    auto incoming = [&](int cell, int q) -> float& {
+        return odd ? f[Opposite[q] * size + cell - offsets[q]] : f[q * size + cell];
+    };
+
+    for (const Link& link : m_Links) {
+        int q = link.Direction;
+        float value;
+        switch (link.Rule) {
+        case LinkRule::MovingWall: {
+            float wallX = m_InflowX[link.Ghost] * velocityScaleX;
+            float wallY = m_InflowY[link.Ghost] * velocityScaleY;
+            value = outgoing(link.Cell, Opposite[q]) + 6.0f * Weights[q] * (VelocityX[q] * wallX + VelocityY[q] * wallY);
+            break;
+        }
+        case LinkRule::AntiBounceBack: {
+            float ux = m_LatticeVelocityX[link.Cell];
+            float uy = m_LatticeVelocityY[link.Cell];
+            float cu = VelocityX[q] * ux + VelocityY[q] * uy;
+            value = -outgoing(link.Cell, Opposite[q]) + 2.0f * Weights[q] * (1.0f + 4.5f * cu * cu - 1.5f * (ux * ux + uy * uy));
+            break;
+        }
+        case LinkRule::Specular:
+            value = outgoing(link.Source, link.Mirrored);
+            break;
+        case LinkRule::Periodic:
+            value = outgoing(link.Source, q);
+            break;
+        default:
+            value = outgoing(link.Cell, Opposite[q]);
+            break;
+        }
+        incoming(link.Cell, q) = value;
+    }
+}
+
+void LatticeBoltzmannSolver::Collide(bool odd, float omega)
+{
+    float* distributions = m_Distributions.data();
+    size_t size = m_Size;
+    int w = m_Width;
+    bool mrt = m_Collision == Collision::MRT;
+    int offsets[Directions];
+    for (int q = 0; q < Directions; q++) offsets[q] = VelocityX[q] + VelocityY[q] * w;
+
+    ThreadPool::Get().ParallelFor(1, m_Height - 1, RowGrain, [&](int begin, int end) {
+        float f[Directions];
+        for (int j = begin; j < end; j++) {
+            for (int cell = 1 + j * w; cell < (j + 1) * w - 1; cell++) {
+                if (m_SolidMask[cell] > 0.0f) continue;
+
+                // Even: own slots in, opposite slots out. Odd: from the upstream neighbours, to the downstream ones.
+                if (odd) {
+                    for (int q = 0; q < Directions; q++) f[q] = distributions[Opposite[q] * size + cell - offsets[q]];
+                } else {
+                    for (int q = 0; q < Directions; q++) f[q] = distributions[q * size + cell];
+                }
+
+                CollideCell(f, omega, mrt, m_Density[cell], m_LatticeVelocityX[cell], m_LatticeVelocityY[cell]);
+
+                if (odd) {
+                    for (int q = 0; q < Directions; q++) distributions[q * size + cell + offsets[q]] = f[q];
+                } else {
+                    for (int q = 0; q < Directions; q++) distributions[Opposite[q] * size + cell] = f[q];
+                }
+            }
+        }
+    });
+}
+
+void LatticeBoltzmannSolver::Step(float deltaTime)
+{
+    m_Boundaries.Advance(m_VelocityX.data(), m_VelocityY.data(), m_InflowVelocity, deltaTime);
+
+    // Lattice time step from the inflow speed in cells per second
+    float cellsX = (float)(m_Width - 2);
+    float cellsY = (float)(m_Height - 2);
+    float reference = std::max(std::abs(m_InflowVelocity), MinReferenceVelocity) * std::max(cellsX, cellsY);
+    float latticeTime = m_LatticeVelocity / reference;
+    if (m_LatticeTime > 0.0f && latticeTime != m_LatticeTime) RescaleTime(latticeTime / m_LatticeTime);
+    m_LatticeTime = latticeTime;
+
+    m_PendingTime += deltaTime;
+    int substeps = (int)(m_PendingTime / latticeTime);
+    m_PendingTime -= substeps * latticeTime;
+
+    // Solver velocities to cells per lattice step, and the viscosity in lattice units
+    float scaleX = cellsX * latticeTime;
+    float scaleY = cellsY * latticeTime;
+    float viscosity = m_Viscosity * cellsX * cellsY * latticeTime;
+    float minRelaxationTime = m_Collision == Collision::MRT ? MinRelaxationTimeMRT : MinRelaxationTimeBGK;
+    float relaxationTime = std::max(minRelaxationTime, 3.0f * viscosity + 0.5f);
+
+    float rampStep = std::max(std::abs(m_InflowVelocity), MinReferenceVelocity) * RampSoundSpeed / (4.0f * std::max(cellsX, cellsY));
+    for (int s = 0; s < substeps; s++) {
+        if (s == 0 || m_RampedInflow != m_InflowVelocity) {
+            m_RampedInflow += std::max(-rampStep, std::min(rampStep, m_InflowVelocity - m_RampedInflow));
+            m_Boundaries.ApplyInflow(m_InflowX.data(), m_InflowY.data(), m_RampedInflow);
+        }
+        FillLinks(m_OddStep, scaleX, scaleY);
+        Collide(m_OddStep, 1.0f / relaxationTime);
+        m_OddStep = !m_OddStep;
+    }
+    m_LastSubsteps = substeps;
+    m_LastRelaxationTime = relaxationTime;
+
+    // Back to the solver's units; pressure as FluidSolver's projection potential, dt * p / rho
+    float pressureScale = deltaTime / (3.0f * cellsX * cellsY * latticeTime * latticeTime);
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int cell = 1 + j * m_Width; cell < (j + 1) * m_Width - 1; cell++) {
+            if (m_SolidMask[cell] > 0.0f) {
+                m_VelocityX[cell] = m_VelocityY[cell] = m_Pressure[cell] = 0.0f;
+                continue;
+            }
+            m_VelocityX[cell] = m_LatticeVelocityX[cell] / scaleX;
+            m_VelocityY[cell] = m_LatticeVelocityY[cell] / scaleY;
+            m_Pressure[cell] = (m_Density[cell] - 1.0f) * pressureScale;
+        }
+    }
+    m_Boundaries.Apply(BoundaryField::VelocityX, m_VelocityX.data());
+    m_Boundaries.Apply(BoundaryField::VelocityY, m_VelocityY.data());
+    m_Boundaries.Apply(BoundaryField::Pressure, m_Pressure.data());
+
+    m_Scalars.Advect(m_VelocityX.data(), m_VelocityY.data(), m_SolidMask.data(), m_Boundaries, deltaTime);
+    m_Scalars.Decay(deltaTime);
+    m_Scalars.Emit(m_SolidMask.data(), m_Boundaries, true);
+
+    m_Version++;
+}
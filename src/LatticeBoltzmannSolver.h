@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "DomainBoundaries.h"
+#include "FlowSolver.h"
+#include "ScalarTransport.h"
+
+// D2Q9 lattice Boltzmann engine on FluidSolver's grid, units and side conditions. Every update reads only a cell
+// and its neighbours, so unlike the projection it has no global solve.
+//
+// The lattice time step moves the inflow m_LatticeVelocity cells per step (low lattice Mach number); Step(dt) runs
+// as many of them as fit, carrying the remainder to the next call. The lattice viscosity follows from m_Viscosity,
+// with the relaxation time kept above a floor per collision model where it stays stable, so viscosities below
+// that are not resolved.
+//
+// Streaming uses the AA pattern on one distribution array: even steps collide in place and store each population
+// in its opposite slot, odd steps gather from and scatter to the neighbours. Each memory location is read and
+// written by one cell only, so both run in parallel without a second array. Populations entering a fluid cell from
+// a solid cell or across a side come from precomputed links, filled before every step from what left the cell:
+// bounce-back at obstacles and no-slip walls, moving-wall bounce-back at inflows (the profile of
+// DomainBoundaries::ApplyInflow), anti-bounce-back at p = 0 for outflows, specular reflection for free slip and
+// wrapping for periodic sides.
+//
+// A sudden inflow change would ring the tunnel between the velocity inlet and the pressure outlet for a long time,
+// so the applied inflow follows m_InflowVelocity over one period of its lowest acoustic mode.
+//
+// Scalars are advected, decayed and emitted as in FluidSolver; species diffusion and the frontal source are not
+// modelled.
+class LatticeBoltzmannSolver : public FlowSolver {
+public:
+    LatticeBoltzmannSolver(int width, int height);
+
+    void Step(float deltaTime) override;
+    void Reset() override;
+
+    int GetWidth() const override { return m_Width; }
+    int GetHeight() const override { return m_Height; }
+    const std::vector<float>& GetVelocityX() const override { return m_VelocityX; }
+    const std::vector<float>& GetVelocityY() const override { return m_VelocityY; }
+    const std::vector<float>& GetPressure() const override { return m_Pressure; }
+    const std::vector<float>& GetSolidMask() const override { return m_SolidMask; }
+    const std::vector<float>& GetDyeDensity() const override { return m_Scalars.GetValues(0); }
+    const std::vector<float>& GetScalar(int species) const override { return m_Scalars.GetValues(species); }
+    FieldView GetFieldView() const override; // DyeDensity is m_DisplayedSpecies
+    uint64_t GetVersion() const override { return m_Version; }
+
+    void SetViscosity(float viscosity) override { m_Viscosity = viscosity; }
+    void SetInflowVelocity(float velocity) override { m_InflowVelocity = velocity; }
+    void SetBoundarySettings(const BoundarySettings& settings) override;
+    const BoundarySettings& GetBoundarySettings() const override { return m_Boundaries.GetSettings(); }
+    void SetSpecies(const std::vector<ScalarSpecies>& species) override;
+    const std::vector<ScalarSpecies>& GetSpecies() const override { return m_Scalars.GetSpecies(); }
+    void SetObstacleMask(Span<const float> mask) override;
+
+    // Lattice steps taken by the last Step and their relaxation time
+    int GetLastSubsteps() const { return m_LastSubsteps; }
+    float GetLastRelaxationTime() const { return m_LastRelaxationTime; }
+
+    enum class Collision {
+        BGK = 0, // Single relaxation time
+        MRT = 1  // Multiple relaxation times (Lallemand & Luo): non-hydrodynamic moments relax at fixed rates
+    };
+
+    // Simulation Parameters public for UI
+    float m_Viscosity = 0.000133f;
+    float m_InflowVelocity = 1.6f;
+    Collision m_Collision = Collision::MRT;
+    float m_LatticeVelocity = 0.1f; // Fastest speed per lattice step, in cells
+    int m_DisplayedSpecies = 0;
+
+private:
+    // A population entering a fluid cell from outside the fluid
+    enum class LinkRule : uint8_t {
+        BounceBack,     // Solid cell, no-slip wall, or a corner
+        MovingWall,     // Inflow side, at the ghost cell's inflow velocity
+        AntiBounceBack, // Outflow side at zero pressure
+        Specular,       // Free-slip wall: the mirrored population that left 'Source'
+        Periodic        // The same population leaving 'Source' across the opposite side
+    };
+    struct Link {
+        int Cell;
+        int Source;
+        int Ghost; // Cell the population comes from, for inflow velocities
+        uint8_t Direction;
+        uint8_t Mirrored;
+        LinkRule Rule;
+    };
+
+    // Rebuilds the links after the obstacle or the side conditions changed
+    void BuildLinks();
+
+    // Writes every link's population where the next step reads it; 'odd' is the parity of that step
+    void FillLinks(bool odd, float velocityScaleX, float velocityScaleY);
+
+    // One collide-and-stream step of every fluid cell
+    void Collide(bool odd, float omega);
+
+    // Back to rest: equilibrium at unit density everywhere
+    void InitDistributions();
+
+    // Keeps the flow when the lattice time step changes by 'ratio': lattice velocities scale with it, density
+    // departures with its square, and the non-equilibrium part is scaled like the velocity gradients
+    void RescaleTime(float ratio);
+
+private:
+    int m_Width;
+    int m_Height;
+    int m_Size; // m_Width * m_Height
+
+    std::vector<float> m_Distributions; // Direction-major: m_Distributions[q * m_Size + cell]
+    std::vector<float> m_Density;       // Lattice units, from the last collision
+    std::vector<float> m_LatticeVelocityX;
+    std::vector<float> m_LatticeVelocityY;
+    bool m_OddStep = false;
+
+    std::vector<float> m_VelocityX, m_VelocityY, m_Pressure;
+    std::vector<float> m_SolidMask;
+    std::vector<float> m_InflowX, m_InflowY; // Inflow profile written by DomainBoundaries::ApplyInflow
+    std::vector<Link> m_Links;
+
+    DomainBoundaries m_Boundaries;
+    ScalarTransport m_Scalars;
+
+    int m_LastSubsteps = 0;
+    float m_LastRelaxationTime = 0.0f;
+    float m_LatticeTime = 0.0f;  // Seconds per lattice step, 0 before the first Step
+    float m_PendingTime = 0.0f;  // Not yet simulated, less than one lattice step
+    float m_RampedInflow = 0.0f; // Inflow velocity applied, following m_InflowVelocity at a bounded rate
+    uint64_t m_Version = 0;
+};
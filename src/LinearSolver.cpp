@@ -0,0 +1,123 @@
+#include "LinearSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Grid rows per task; also the reduction chunk, so it must not depend on the thread count
+constexpr int RowGrain = 8;
+
+}
+
+void LinearSolver::Apply(const GridStencil& stencil, const float* x, float* result)
+{
+    int w = stencil.Width;
+    const float* diagonal = stencil.Diagonal;
+    const float* couplingX = stencil.CouplingX;
+    const float* couplingY = stencil.CouplingY;
+    const float* active = stencil.Active;
+
+    ThreadPool::Get().ParallelFor(1, stencil.Height - 1, RowGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = 1, index = 1 + j * w; i < w - 1; i++, index++) {
+                float value = diagonal[index] * x[index] -
+                              couplingX[index] * x[index - 1] - couplingX[index + 1] * x[index + 1] -
+                              couplingY[index] * x[index - w] - couplingY[index + w] * x[index + w];
+                result[index] = active[index] > 0.0f ? value : 0.0f;
+            }
+        }
+    });
+}
+
+double LinearSolver::Dot(const GridStencil& stencil, const float* a, const float* b)
+{
+    int w = stencil.Width;
+    int rows = stencil.Height - 2;
+    m_Partials.assign((rows + RowGrain - 1) / RowGrain, 0.0);
+
+    ThreadPool::Get().ParallelFor(0, (int)m_Partials.size(), 1, [&](int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            double sum = 0.0;
+            int jEnd = std::min(1 + (chunk + 1) * RowGrain, stencil.Height - 1);
+            for (int j = 1 + chunk * RowGrain; j < jEnd; j++) {
+                for (int index = 1 + j * w; index < (j + 1) * w - 1; index++) {
+                    if (stencil.Active[index] > 0.0f) sum += (double)a[index] * b[index];
+                }
+            }
+            m_Partials[chunk] = sum;
+        }
+    });
+
+    double total = 0.0;
+    for (double partial : m_Partials) total += partial;
+    return total;
+}
+
+int LinearSolver::SolveConjugateGradient(const GridStencil& stencil, const float* b, float* x, const GhostFill& fillGhosts,
+                                         const GhostFill& fillHomogeneousGhosts, float tolerance, int maxIterations)
+{
+    size_t size = (size_t)stencil.Width * stencil.Height;
+    m_Residual.assign(size, 0.0f);
+    m_Preconditioned.assign(size, 0.0f);
+    m_Direction.assign(size, 0.0f);
+    m_Product.resize(size);
+
+    int w = stencil.Width;
+    int h = stencil.Height;
+    ThreadPool& pool = ThreadPool::Get();
+
+    // Runs func(index) over the active interior cells
+    auto forEachActive = [&](const auto& func) {
+        pool.ParallelFor(1, h - 1, RowGrain, [&](int begin, int end) {
+            for (int j = begin; j < end; j++) {
+                for (int index = 1 + j * w; index < (j + 1) * w - 1; index++) {
+                    if (stencil.Active[index] > 0.0f) func(index);
+                }
+            }
+        });
+    };
+
+    // r = b - A x with the real boundary values; z = M^-1 r
+    fillGhosts(x);
+    Apply(stencil, x, m_Product.data());
+    forEachActive([&](int index) {
+        m_Residual[index] = b[index] - m_Product[index];
+        m_Preconditioned[index] = m_Residual[index] / stencil.Diagonal[index];
+        m_Direction[index] = m_Preconditioned[index];
+    });
+
+    double bNorm = std::sqrt(Dot(stencil, b, b));
+    double threshold = tolerance * (bNorm > 0.0 ? bNorm : 1.0);
+    double rz = Dot(stencil, m_Residual.data(), m_Preconditioned.data());
+    double rNorm = std::sqrt(Dot(stencil, m_Residual.data(), m_Residual.data()));
+
+    int iteration = 0;
+    while (iteration < maxIterations && rNorm > threshold) {
+        // Search directions only carry the homogeneous part of the boundary conditions
+        fillHomogeneousGhosts(m_Direction.data());
+        Apply(stencil, m_Direction.data(), m_Product.data());
+        double pAp = Dot(stencil, m_Direction.data(), m_Product.data());
+        if (pAp <= 0.0) break; // Converged to round-off, or a singular (all-Neumann) mode
+
+        float alpha = (float)(rz / pAp);
+        forEachActive([&](int index) {
+            x[index] += alpha * m_Direction[index];
+            m_Residual[index] -= alpha * m_Product[index];
+            m_Preconditioned[index] = m_Residual[index] / stencil.Diagonal[index];
+        });
+        iteration++;
+
+        double rzNext = Dot(stencil, m_Residual.data(), m_Preconditioned.data());
+        rNorm = std::sqrt(Dot(stencil, m_Residual.data(), m_Residual.data()));
+        float beta = (float)(rzNext / rz);
+        rz = rzNext;
+        forEachActive([&](int index) {
+            m_Direction[index] = m_Preconditioned[index] + beta * m_Direction[index];
+        });
+    }
+
+    m_LastResidual = (float)(rNorm / (bNorm > 0.0 ? bNorm : 1.0));
+    fillGhosts(x);
+    return iteration;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "FunctionRef.h"
+
+// Symmetric 5-point system on a width x height grid with a one-cell ghost layer:
+//     Diagonal[i] * x[i] - sum over the four faces of Coupling * x[neighbour] = b[i]
+// for every interior cell with Active > 0. Inactive cells (solids) keep their value and, having zero coupling,
+// do not enter the system. Domain boundary conditions live in the ghost layer, refreshed through a callback, so
+// Neumann, Dirichlet and periodic sides all keep the operator symmetric.
+struct GridStencil {
+    int Width = 0;
+    int Height = 0;
+    const float* Diagonal = nullptr;
+    const float* CouplingX = nullptr; // Face between (i - 1, j) and (i, j)
+    const float* CouplingY = nullptr; // Face between (i, j - 1) and (i, j)
+    const float* Active = nullptr;
+};
+
+// Jacobi-preconditioned conjugate gradient shared by the pressure and diffusion solves. Reductions are summed
+// per fixed chunk in order, so results do not depend on the thread count.
+class LinearSolver {
+public:
+    // Fills the ghost layer of a field in place
+    using GhostFill = FunctionRef<void(float*)>;
+
+    // result = A x over the active cells (0 elsewhere); x's ghost layer must be current
+    void Apply(const GridStencil& stencil, const float* x, float* result);
+
+    // Improves x (the initial guess) until ||b - A x|| <= tolerance * ||b|| or maxIterations is reached.
+    // 'fillGhosts' applies the real boundary conditions, 'fillHomogeneousGhosts' the same ones with any
+    // prescribed values replaced by zero (used on search directions). Returns the iterations taken.
+    int SolveConjugateGradient(const GridStencil& stencil, const float* b, float* x, const GhostFill& fillGhosts,
+                               const GhostFill& fillHomogeneousGhosts, float tolerance, int maxIterations);
+
+    // Relative residual reached by the last solve
+    float GetLastResidual() const { return m_LastResidual; }
+
+private:
+    // Sum of a[i] * b[i] over the active cells
+    double Dot(const GridStencil& stencil, const float* a, const float* b);
+
+private:
+    std::vector<float> m_Residual;
+    std::vector<float> m_Preconditioned;
+    std::vector<float> m_Direction;
+    std::vector<float> m_Product;
+    std::vector<double> m_Partials;
+    float m_LastResidual = 0.0f;
+};
@@ -0,0 +1,379 @@
+#include "ObstacleLibrary.h"
+#include "SignedDistance.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <tuple>
+
+namespace {
+
+const char MaskMagic[8] = { 'C', 'F', 'D', 'M', 'A', 'S', 'K', '\0' };
+constexpr uint32_t MaskFormatVersion = 1;
+
+struct MaskHeader {
+    char Magic[8];
+    uint32_t FormatVersion;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t RunBytes;
+};
+
+constexpr float Pi = 3.14159265f;
+
+// Mean camber line of a NACA 4-digit or 5-digit profile, in chord units
+struct CamberLine {
+    enum class Kind { Symmetric, FourDigit, FiveDigit, FiveDigitReflex };
+    Kind Type = Kind::Symmetric;
+    float MaxCamber = 0.0f; // 4-digit: m
+    float Position = 0.0f;  // 4-digit: p; 5-digit: r (end of the cubic part)
+    float K1 = 0.0f;        // 5-digit
+    float K21 = 0.0f;       // 5-digit reflex: k2 / k1
+    float Scale = 1.0f;     // 5-digit: design lift coefficient relative to the tabulated 0.3
+
+    void Evaluate(float x, float& y, float& slope) const
+    {
+        float m = MaxCamber, p = Position, r = Position;
+        switch (Type) {
+        case Kind::Symmetric:
+            y = slope = 0.0f;
+            break;
+        case Kind::FourDigit:
+            if (x < p) {
+                y = m / (p * p) * (2.0f * p * x - x * x);
+                slope = 2.0f * m / (p * p) * (p - x);
+            } else {
+                y = m / ((1.0f - p) * (1.0f - p)) * (1.0f - 2.0f * p + 2.0f * p * x - x * x);
+                slope = 2.0f * m / ((1.0f - p) * (1.0f - p)) * (p - x);
+            }
+            break;
+        case Kind::FiveDigit:
+            if (x < r) {
+                y = K1 / 6.0f * (x * x * x - 3.0f * r * x * x + r * r * (3.0f - r) * x);
+                slope = K1 / 6.0f * (3.0f * x * x - 6.0f * r * x + r * r * (3.0f - r));
+            } else {
+                y = K1 * r * r * r / 6.0f * (1.0f - x);
+                slope = -K1 * r * r * r / 6.0f;
+            }
+            y *= Scale;
+            slope *= Scale;
+            break;
+        case Kind::FiveDigitReflex: {
+            float tail = K21 * (1.0f - r) * (1.0f - r) * (1.0f - r);
+            float d = x - r;
+            if (x < r) {
+                y = K1 / 6.0f * (d * d * d - tail * x - r * r * r * x + r * r * r);
+                slope = K1 / 6.0f * (3.0f * d * d - tail - r * r * r);
+            } else {
+                y = K1 / 6.0f * (K21 * d * d * d - tail * x - r * r * r * x + r * r * r);
+                slope = K1 / 6.0f * (3.0f * K21 * d * d - tail - r * r * r);
+            }
+            y *= Scale;
+            slope *= Scale;
+            break;
+        }
+        }
+    }
+};
+
+// Tabulated 5-digit camber constants for P = 1..5 (design lift coefficient 0.3)
+const float FiveDigitR[5] = { 0.0580f, 0.1260f, 0.2025f, 0.2900f, 0.3910f };
+const float FiveDigitK1[5] = { 361.400f, 51.640f, 15.957f, 6.643f, 3.230f };
+const float ReflexR[5] = { 0.0f, 0.1300f, 0.2170f, 0.3180f, 0.4410f };
+const float ReflexK1[5] = { 0.0f, 51.990f, 15.793f, 6.520f, 3.191f };
+const float ReflexK21[5] = { 0.0f, 0.000764f, 0.00677f, 0.0303f, 0.1355f };
+
+bool ParseNaca(const std::string& naca, CamberLine& camber, float& thickness)
+{
+    if (naca.size() != 4 && naca.size() != 5) return false;
+    int digits[5] = {};
+    for (size_t n = 0; n < naca.size(); n++) {
+        if (naca[n] < '0' || naca[n] > '9') return false;
+        digits[n] = naca[n] - '0';
+    }
+
+    camber = CamberLine();
+    if (naca.size() == 4) {
+        thickness = (digits[2] * 10 + digits[3]) / 100.0f;
+        if (digits[0] > 0) {
+            if (digits[1] == 0) return false; // Camber needs a position
+            camber.Type = CamberLine::Kind::FourDigit;
+            camber.MaxCamber = digits[0] / 100.0f;
+            camber.Position = digits[1] / 10.0f;
+        }
+    } else {
+        thickness = (digits[3] * 10 + digits[4]) / 100.0f;
+        int position = digits[1];
+        bool reflex = digits[2] == 1;
+        if (digits[2] > 1 || position < 1 || position > 5 || (reflex && position < 2)) return false;
+
+        camber.Type = reflex ? CamberLine::Kind::FiveDigitReflex : CamberLine::Kind::FiveDigit;
+        camber.Position = reflex ? ReflexR[position - 1] : FiveDigitR[position - 1];
+        camber.K1 = reflex ? ReflexK1[position - 1] : FiveDigitK1[position - 1];
+        camber.K21 = reflex ? ReflexK21[position - 1] : 0.0f;
+        camber.Scale = digits[0] * 0.15f / 0.3f;
+    }
+    return thickness > 0.0f;
+}
+
+void WriteVarint(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    while (value >= 0x80) {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+bool ReadVarint(const std::vector<uint8_t>& bytes, size_t& position, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && position < bytes.size(); shift += 7) {
+        uint8_t byte = bytes[position++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+}
+
+bool ObstacleLibrary::AirfoilKey::operator<(const AirfoilKey& other) const
+{
+    return std::tie(Naca, Chord, AngleOfAttack, LeadingEdgeX, LeadingEdgeY, PointsPerSide, Width, Height) <
+           std::tie(other.Naca, other.Chord, other.AngleOfAttack, other.LeadingEdgeX, other.LeadingEdgeY, other.PointsPerSide, other.Width, other.Height);
+}
+
+ObstacleLibrary& ObstacleLibrary::Get()
+{
+    static ObstacleLibrary library;
+    return library;
+}
+
+ObstacleLibrary::Airfoil ObstacleLibrary::GetDefaultAirfoil(int width, int height)
+{
+    Airfoil airfoil;
+    airfoil.Naca = "0015";
+    airfoil.Chord = (float)(width / 4);
+    airfoil.LeadingEdgeX = (float)(width / 3);
+    airfoil.LeadingEdgeY = (float)(height / 2);
+    return airfoil;
+}
+
+bool ObstacleLibrary::IsValidNaca(const std::string& naca)
+{
+    CamberLine camber;
+    float thickness = 0.0f;
+    return ParseNaca(naca, camber, thickness);
+}
+
+std::shared_ptr<const ObstacleLibrary::Shape> ObstacleLibrary::GetAirfoil(const Airfoil& airfoil, int width, int height)
+{
+    AirfoilKey key{ airfoil.Naca, airfoil.Chord, airfoil.AngleOfAttack, airfoil.LeadingEdgeX, airfoil.LeadingEdgeY,
+                    airfoil.PointsPerSide, width, height };
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_Airfoils.find(key);
+        if (it != m_Airfoils.end()) {
+            m_Uses.splice(m_Uses.begin(), m_Uses, it->second.Use);
+            return it->second.Value;
+        }
+    }
+
+    // Generated outside the lock; a concurrent miss on the same key just builds it twice
+    auto shape = std::make_shared<Shape>();
+    if (!BuildAirfoilPolygon(airfoil, shape->Polygon)) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: Invalid NACA designation " << airfoil.Naca << std::endl;
+        return nullptr;
+    }
+    shape->Width = width;
+    shape->Height = height;
+    RasterizePolygon(shape->Polygon, width, height, shape->Mask);
+    SignedDistance::FromPolygon(shape->Mask.data(), shape->Polygon, width, height, shape->Distance);
+
+    Insert(key, shape);
+    return shape;
+}
+
+void ObstacleLibrary::Insert(const AirfoilKey& key, std::shared_ptr<const Shape> shape)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Airfoils.count(key)) return;
+
+    m_Uses.push_front(key);
+    m_Airfoils[key] = Entry{ std::move(shape), m_Uses.begin() };
+    while (m_Airfoils.size() > m_Capacity) {
+        m_Airfoils.erase(m_Uses.back());
+        m_Uses.pop_back();
+    }
+}
+
+void ObstacleLibrary::SetCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Capacity = std::max<size_t>(1, capacity);
+    while (m_Airfoils.size() > m_Capacity) {
+        m_Airfoils.erase(m_Uses.back());
+        m_Uses.pop_back();
+    }
+}
+
+void ObstacleLibrary::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Airfoils.clear();
+    m_Uses.clear();
+}
+
+bool ObstacleLibrary::BuildAirfoilPolygon(const Airfoil& airfoil, std::vector<float>& polygon)
+{
+    CamberLine camber;
+    float thickness = 0.0f;
+    if (!ParseNaca(airfoil.Naca, camber, thickness) || airfoil.PointsPerSide < 2) return false;
+
+    // Nose up pitches the leading edge towards +y about the quarter chord
+    float angle = airfoil.AngleOfAttack * Pi / 180.0f;
+    float cosAngle = std::cos(angle);
+    float sinAngle = std::sin(angle);
+    float pivotX = airfoil.LeadingEdgeX + 0.25f * airfoil.Chord;
+    float pivotY = airfoil.LeadingEdgeY;
+
+    int pointsPerSide = airfoil.PointsPerSide;
+    auto surface = [&](int n, float side) {
+        // Cosine spacing clusters points at the leading and trailing edges
+        float x = 0.5f * (1.0f - std::cos(Pi * n / (pointsPerSide - 1)));
+        float yt = 5.0f * thickness * (0.2969f * std::sqrt(x) - 0.1260f * x - 0.3516f * x * x + 0.2843f * x * x * x - 0.1015f * x * x * x * x);
+        float yc = 0.0f, slope = 0.0f;
+        camber.Evaluate(x, yc, slope);
+
+        // Thickness is laid off normal to the camber line
+        float normalScale = 1.0f / std::sqrt(1.0f + slope * slope);
+        float localX = (x - side * yt * slope * normalScale - 0.25f) * airfoil.Chord;
+        float localY = (yc + side * yt * normalScale) * airfoil.Chord;
+
+        polygon.push_back(pivotX + localX * cosAngle + localY * sinAngle);
+        polygon.push_back(pivotY - localX * sinAngle + localY * cosAngle);
+    };
+
+    polygon.clear();
+    polygon.reserve(pointsPerSide * 4);
+    for (int n = 0; n < pointsPerSide; n++) surface(n, 1.0f);
+    for (int n = pointsPerSide - 1; n > 0; n--) surface(n, -1.0f);
+    return true;
+}
+
+void ObstacleLibrary::RasterizePolygon(const std::vector<float>& polygon, int width, int height, std::vector<float>& mask)
+{
+    mask.assign((size_t)width * height, 0.0f);
+    int pointCount = (int)polygon.size() / 2;
+    if (pointCount < 3) return;
+
+    float minY = polygon[1], maxY = polygon[1];
+    for (int p = 1; p < pointCount; p++) {
+        minY = std::min(minY, polygon[p * 2 + 1]);
+        maxY = std::max(maxY, polygon[p * 2 + 1]);
+    }
+    int jMin = std::max(0, (int)std::ceil(minY));
+    int jMax = std::min(height - 1, (int)std::floor(maxY));
+
+    // Even-odd scanline fill through the cell centres of each row
+    std::vector<float> crossings;
+    for (int j = jMin; j <= jMax; j++) {
+        float y = (float)j;
+        crossings.clear();
+        for (int p = 0; p < pointCount; p++) {
+            float ax = polygon[p * 2 + 0], ay = polygon[p * 2 + 1];
+            float bx = polygon[((p + 1) % pointCount) * 2 + 0], by = polygon[((p + 1) % pointCount) * 2 + 1];
+            if ((ay <= y) == (by <= y)) continue;
+            crossings.push_back(ax + (y - ay) / (by - ay) * (bx - ax));
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        float* row = mask.data() + (size_t)j * width;
+        for (size_t c = 0; c + 1 < crossings.size(); c += 2) {
+            int iBegin = std::max(0, (int)std::ceil(crossings[c]));
+            int iEnd = std::min(width - 1, (int)std::floor(crossings[c + 1]));
+            for (int i = iBegin; i <= iEnd; i++) row[i] = 1.0f;
+        }
+    }
+}
+
+bool ObstacleLibrary::SaveMask(const std::string& filepath, const std::vector<float>& mask, int width, int height)
+{
+    if (width <= 0 || height <= 0 || mask.size() != (size_t)width * height) return false;
+
+    // Runs alternate fluid, solid, fluid, ... starting with a (possibly empty) fluid run
+    std::vector<uint8_t> runs;
+    bool solid = false;
+    uint32_t length = 0;
+    for (float value : mask) {
+        if ((value > 0.0f) != solid) {
+            WriteVarint(runs, length);
+            solid = !solid;
+            length = 0;
+        }
+        length++;
+    }
+    WriteVarint(runs, length);
+
+    MaskHeader header = {};
+    std::copy(MaskMagic, MaskMagic + 8, header.Magic);
+    header.FormatVersion = MaskFormatVersion;
+    header.Width = (uint32_t)width;
+    header.Height = (uint32_t)height;
+    header.RunBytes = (uint32_t)runs.size();
+
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: Cannot open " << filepath << " for writing" << std::endl;
+        return false;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)runs.data(), (std::streamsize)runs.size());
+    if (!file.good()) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: Failed while writing " << filepath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ObstacleLibrary::LoadMask(const std::string& filepath, std::vector<float>& mask, int& width, int& height)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: Cannot open " << filepath << std::endl;
+        return false;
+    }
+
+    MaskHeader header = {};
+    file.read((char*)&header, sizeof(header));
+    if (!file.good() || !std::equal(MaskMagic, MaskMagic + 8, header.Magic) || header.FormatVersion != MaskFormatVersion ||
+        header.Width == 0 || header.Height == 0) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: " << filepath << " is not an obstacle mask" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> runs(header.RunBytes);
+    file.read((char*)runs.data(), (std::streamsize)runs.size());
+
+    size_t cellCount = (size_t)header.Width * header.Height;
+    std::vector<float> cells;
+    cells.reserve(cellCount);
+    size_t position = 0;
+    bool solid = false;
+    while (file.good() && position < runs.size()) {
+        uint32_t length = 0;
+        if (!ReadVarint(runs, position, length) || cells.size() + length > cellCount) break;
+        cells.insert(cells.end(), length, solid ? 1.0f : 0.0f);
+        solid = !solid;
+    }
+    if (cells.size() != cellCount || position != runs.size()) {
+        std::cerr << "ERROR::OBSTACLE_LIBRARY:: Corrupt run data in " << filepath << std::endl;
+        return false;
+    }
+
+    mask = std::move(cells);
+    width = (int)header.Width;
+    height = (int)header.Height;
+    return true;
+}
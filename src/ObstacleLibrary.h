@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Parametric obstacles for the 2D solver. Generated shapes are cached by their parameters and grid size, so
+// sweeps that revisit a configuration (or reset to it) pay for the rasterisation and distance field only once.
+class ObstacleLibrary {
+public:
+    struct Airfoil {
+        std::string Naca = "0015";  // 4-digit (MPXX) or 5-digit (LPQXX) designation
+        float Chord = 64.0f;        // Cells
+        float AngleOfAttack = 0.0f; // Degrees, positive nose up; the profile pitches about its quarter chord
+        float LeadingEdgeX = 85.0f; // Leading edge position at zero incidence, in cells
+        float LeadingEdgeY = 64.0f;
+        int PointsPerSide = 64;
+    };
+
+    // Mask, signed distance (cells, negative inside) and outline of one obstacle on a width x height grid
+    struct Shape {
+        int Width = 0;
+        int Height = 0;
+        std::vector<float> Mask; // 1 = solid
+        std::vector<float> Distance;
+        std::vector<float> Polygon; // x0, y0, x1, y1, ... in cell coordinates
+    };
+
+    static ObstacleLibrary& Get();
+
+    // The solver's default obstacle: NACA 0015, a quarter of the grid long, a third of the way in
+    static Airfoil GetDefaultAirfoil(int width, int height);
+
+    static bool IsValidNaca(const std::string& naca);
+
+    // nullptr if the designation is not a valid NACA 4/5-digit code
+    std::shared_ptr<const Shape> GetAirfoil(const Airfoil& airfoil, int width, int height);
+
+    // Least recently used shapes are dropped beyond this many entries
+    void SetCapacity(size_t capacity);
+    void Clear();
+
+    // Closed outline of the profile, upper surface from leading to trailing edge and back along the lower one
+    static bool BuildAirfoilPolygon(const Airfoil& airfoil, std::vector<float>& polygon);
+
+    // Marks cells whose centre lies inside the polygon; only rows and columns of its bounding box are visited
+    static void RasterizePolygon(const std::vector<float>& polygon, int width, int height, std::vector<float>& mask);
+
+    // Masks on disk as alternating fluid / solid run lengths (varint coded), typically a few hundred bytes
+    static bool SaveMask(const std::string& filepath, const std::vector<float>& mask, int width, int height);
+    static bool LoadMask(const std::string& filepath, std::vector<float>& mask, int& width, int& height);
+
+private:
+    struct AirfoilKey {
+        std::string Naca;
+        float Chord, AngleOfAttack, LeadingEdgeX, LeadingEdgeY;
+        int PointsPerSide, Width, Height;
+        bool operator<(const AirfoilKey& other) const;
+    };
+
+    struct Entry {
+        std::shared_ptr<const Shape> Value;
+        std::list<AirfoilKey>::iterator Use;
+    };
+
+    void Insert(const AirfoilKey& key, std::shared_ptr<const Shape> shape);
+
+private:
+    std::mutex m_Mutex;
+    std::map<AirfoilKey, Entry> m_Airfoils;
+    std::list<AirfoilKey> m_Uses; // Most recently used first
+    size_t m_Capacity = 64;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "FieldView.h"
+
+// Lagrangian tracers advected through the solver's velocity field with RK2 (midpoint) integration.
+// Positions are kept as separate x / y / age arrays (grid index space, like FluidSolver::Advect's backtrace)
+// so the update loops are straight passes over contiguous floats that the compiler can vectorise.
+class ParticleTracer {
+public:
+    explicit ParticleTracer(int count);
+
+    // Re-seeds every particle along the inflow column (on the next Advance) with staggered ages
+    void Resize(int count);
+    void Advance(const FieldView& fields, float deltaTime);
+
+    int GetCount() const { return (int)m_PositionX.size(); }
+    const float* GetPositionX() const { return m_PositionX.data(); }
+    const float* GetPositionY() const { return m_PositionY.data(); }
+    const float* GetAge() const { return m_Age.data(); }
+
+    // Particles are recycled at the inflow once they reach this age (simulation time), which bounds trail length
+    float m_MaxAge = 3.0f;
+
+private:
+    void Seed(int index, int gridHeight, float age);
+
+    // Cheap per-particle random number in [0, 1) that needs no shared state across threads
+    float Random(uint32_t index, uint32_t stream) const;
+
+private:
+    std::vector<float> m_PositionX;
+    std::vector<float> m_PositionY;
+    std::vector<float> m_Age;
+
+    uint32_t m_Frame = 0;
+};
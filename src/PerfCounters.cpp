@@ -0,0 +1,158 @@
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+
+namespace {
+
+const char* EventNames[(int)PerfEvent::Count] = { "cycles", "instructions", "LLC misses", "branch misses", "vector ops" };
+
+// Raw encodings (umask << 8 | event) of retired packed floating-point work, which has no generic perf event:
+// FP_ARITH_INST_RETIRED with every packed width on Intel (Skylake and later), FpRetSseAvxOps on AMD Zen
+constexpr uint64_t IntelPackedArithmetic = 0xFCC7;
+constexpr uint64_t AmdSseAvxOps = 0xFF03;
+
+// 0 when the CPU is neither, so the vector event is not tried
+uint64_t VectorEventConfig()
+{
+    static const uint64_t config = [] {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 9, "vendor_id") != 0) continue;
+            if (line.find("GenuineIntel") != std::string::npos) return IntelPackedArithmetic;
+            if (line.find("AuthenticAMD") != std::string::npos) return AmdSseAvxOps;
+            break;
+        }
+        return (uint64_t)0;
+    }();
+    return config;
+}
+
+bool DescribeEvent(PerfEvent event, perf_event_attr& attr)
+{
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+    case PerfEvent::Cycles:       attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PerfEvent::Instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PerfEvent::CacheMisses:  attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+    case PerfEvent::BranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    case PerfEvent::VectorOps:
+        attr.type = PERF_TYPE_RAW;
+        attr.config = VectorEventConfig();
+        if (attr.config == 0) return false;
+        break;
+    default: return false;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return true;
+}
+
+}
+
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+bool PerfCounters::Open(int threadId, std::string& error)
+{
+    Close();
+    error.clear();
+
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        perf_event_attr attr;
+        if (!DescribeEvent((PerfEvent)e, attr)) {
+            error += std::string(error.empty() ? "" : "; ") + EventNames[e] + ": no event on this CPU";
+            continue;
+        }
+
+        // Counting starts with the leader; members follow it
+        int descriptor = (int)syscall(SYS_perf_event_open, &attr, threadId, -1, m_Leader, 0);
+        if (descriptor < 0) {
+            error += std::string(error.empty() ? "" : "; ") + EventNames[e] + ": " + std::strerror(errno);
+            if (errno == EACCES || errno == EPERM) error += " (see /proc/sys/kernel/perf_event_paranoid)";
+            continue;
+        }
+
+        if (m_Leader < 0) m_Leader = descriptor;
+        m_Descriptors[e] = descriptor;
+        m_Slots[e] = m_OpenCount++;
+    }
+
+    // One line when nothing counts, typically all events failing for the same reason
+    if (!IsOpen()) error = "unavailable (" + error.substr(0, error.find(';')) + ")";
+    return IsOpen();
+}
+
+void PerfCounters::Close()
+{
+    // Members first, the leader last
+    for (int e = (int)PerfEvent::Count - 1; e >= 0; e--) {
+        if (m_Descriptors[e] >= 0 && m_Descriptors[e] != m_Leader) close(m_Descriptors[e]);
+    }
+    if (m_Leader >= 0) close(m_Leader);
+
+    m_Leader = -1;
+    m_OpenCount = 0;
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        m_Descriptors[e] = -1;
+        m_Slots[e] = -1;
+    }
+}
+
+PerfSample PerfCounters::Read() const
+{
+    PerfSample sample;
+    if (m_Leader < 0) return sample;
+
+    // Group layout: event count, time enabled, time running, then one value per event in opening order
+    uint64_t buffer[3 + (int)PerfEvent::Count] = {};
+    if (read(m_Leader, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) return sample;
+
+    uint64_t enabled = buffer[1];
+    uint64_t running = buffer[2];
+    double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        if (m_Slots[e] < 0 || m_Slots[e] >= (int)buffer[0]) continue;
+        sample.Values[e] = (uint64_t)(buffer[3 + m_Slots[e]] * scale);
+    }
+    return sample;
+}
+
+#else
+
+PerfCounters::~PerfCounters()
+{
+
+}
+
+bool PerfCounters::Open(int, std::string& error)
+{
+    error = "hardware counters need Linux perf_event_open";
+    return false;
+}
+
+void PerfCounters::Close()
+{
+
+}
+
+PerfSample PerfCounters::Read() const
+{
+    return PerfSample();
+}
+
+#endif
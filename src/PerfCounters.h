@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Hardware events counted per thread
+enum class PerfEvent {
+    Cycles = 0,
+    Instructions = 1,
+    CacheMisses = 2,  // Last-level cache
+    BranchMisses = 3,
+    VectorOps = 4,    // Retired packed floating-point instructions, where the CPU has such an event
+    Count = 5
+};
+
+struct PerfSample {
+    uint64_t Values[(int)PerfEvent::Count] = {};
+};
+
+// One thread's hardware counters, opened through Linux perf_event_open as a single group so every event covers the
+// same interval. User-space only, which the default perf_event_paranoid level allows. Events the CPU, the kernel or
+// a virtual machine does not offer are left out; on other platforms nothing opens.
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // 'threadId' is an OS thread id of this process, 0 for the calling thread. Returns false, with the reason in
+    // 'error', when not even the leading event opened; 'error' also names events that are missing.
+    bool Open(int threadId, std::string& error);
+    void Close();
+
+    bool IsOpen() const { return m_Leader >= 0; }
+    bool HasEvent(PerfEvent event) const { return m_Slots[(int)event] >= 0; }
+
+    // Counts since Open, scaled up when the kernel had to multiplex the group with other users of the PMU.
+    // Missing events read 0.
+    PerfSample Read() const;
+
+private:
+    int m_Leader = -1;
+    int m_Descriptors[(int)PerfEvent::Count] = { -1, -1, -1, -1, -1 };
+    int m_Slots[(int)PerfEvent::Count] = { -1, -1, -1, -1, -1 }; // Position in the group read, -1 when missing
+    int m_OpenCount = 0;
+};
@@ -1,14 +1,41 @@
 #include "Renderer.h"
 #include "FluidSolver.h"
 #include "Geometry/Mesh.h"
+#include "ParticleTracer.h"
+#include "DerivedFields.h"
+#include <algorithm>
+#include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+namespace {
+
+// Largest on-screen deviation allowed when picking a preview level of detail
+constexpr float PreviewPixelError = 1.0f;
+
+// Level of detail for drawing 'mesh' into a viewport of the given size, judged at the mesh centre
+int SelectPreviewLod(const Mesh& mesh, const glm::mat4& model, const glm::mat4& viewProjection, int viewportWidth, int viewportHeight)
+{
+    glm::vec3 center = 0.5f * (mesh.GetBoundsMin() + mesh.GetBoundsMax());
+    glm::vec4 clip = viewProjection * model * glm::vec4(center, 1.0f);
+    float w = std::max(clip.w, 1e-4f);
+
+    // Rows of the view-projection give clip units per world unit along the screen axes
+    float scaleX = glm::length(glm::vec3(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0])) * 0.5f * viewportWidth / w;
+    float scaleY = glm::length(glm::vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1])) * 0.5f * viewportHeight / w;
+
+    glm::mat4 pixelsFromModel = glm::scale(glm::mat4(1.0f), glm::vec3(std::max(scaleX, scaleY))) * model;
+    return mesh.SelectLod(pixelsFromModel, PreviewPixelError);
+}
+
+}
+
 Renderer::Renderer()
 {
     InitRenderData();
     CreateShader();
     CreateMeshShader();
+    m_ParticleShader.Load("src/Shaders/particles.vert", "src/Shaders/particles.frag");
 }
 
 Renderer::~Renderer()
@@ -17,6 +44,13 @@ Renderer::~Renderer()
     glDeleteBuffers(1, &m_QuadVBO);
     glDeleteProgram(m_ShaderProgram.ID);
     glDeleteProgram(m_MeshShader.ID);
+    glDeleteProgram(m_ParticleShader.ID);
+
+    for (GLsync& fence : m_ParticleFences) {
+        if (fence) glDeleteSync(fence);
+    }
+    if (m_ParticleVAO) glDeleteVertexArrays(1, &m_ParticleVAO);
+    if (m_ParticleVBO) glDeleteBuffers(1, &m_ParticleVBO);
 
     if (m_FrontViewFBO) glDeleteFramebuffers(1, &m_FrontViewFBO);
     if (m_FrontViewTexture) glDeleteTextures(1, &m_FrontViewTexture);
@@ -29,11 +63,16 @@ void Renderer::DrawMeshPreview(const Mesh& mesh, const glm::mat4& model, const g
     m_MeshShader.use();
 
     m_MeshShader.setMat4("model", model);
+    m_MeshShader.setVec3("positionOffset", mesh.GetPositionOffset());
+    m_MeshShader.setVec3("positionScale", mesh.GetPositionScale());
     m_MeshShader.setMat4("projection", projection);
     m_MeshShader.setFloat("sliceZ", sliceZ);
     m_MeshShader.setFloat("thickness", thickness);
     m_MeshShader.setInt("meshTexture", 0);
 
+    GLint viewport[4]; glGetIntegerv(GL_VIEWPORT, viewport);
+    int lod = SelectPreviewLod(mesh, model, projection, viewport[2], viewport[3]);
+
     // Enable blending for ghost effect
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -41,23 +80,110 @@ void Renderer::DrawMeshPreview(const Mesh& mesh, const glm::mat4& model, const g
     if (wireframe) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glDisable(GL_CULL_FACE);
-        ((Mesh&)mesh).Draw();
+        ((Mesh&)mesh).Draw(lod);
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     } else {
         // Draw back faces first for better transparency
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
-        ((Mesh&)mesh).Draw();
+        ((Mesh&)mesh).Draw(lod);
 
         // Draw front faces
         glCullFace(GL_BACK);
-        ((Mesh&)mesh).Draw();
+        ((Mesh&)mesh).Draw(lod);
     }
 
     glDisable(GL_BLEND);
     glDisable(GL_CULL_FACE);
 }
 
+void Renderer::InitParticleBuffer(int capacity)
+{
+    for (GLsync& fence : m_ParticleFences) {
+        if (fence) glDeleteSync(fence);
+        fence = 0;
+    }
+
+    if (!m_ParticleVAO) glGenVertexArrays(1, &m_ParticleVAO);
+    if (!m_ParticleVBO) glGenBuffers(1, &m_ParticleVBO);
+
+    m_ParticleCapacity = capacity;
+    m_ParticleRegion = 0;
+
+    // Every region holds three float streams (x, y, age) of 'capacity' entries each
+    glBindBuffer(GL_ARRAY_BUFFER, m_ParticleVBO);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)ParticleRegions * 3 * capacity * sizeof(float), NULL, GL_STREAM_DRAW);
+
+    glBindVertexArray(m_ParticleVAO);
+    for (GLuint attribute = 0; attribute < 3; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Renderer::DrawParticles(const ParticleTracer& tracer, const glm::mat4& viewProjection, float pointSize)
+{
+    int count = tracer.GetCount();
+    if (count == 0) return;
+
+    if (count > m_ParticleCapacity) {
+        InitParticleBuffer(count);
+    }
+
+    m_ParticleRegion = (m_ParticleRegion + 1) % ParticleRegions;
+
+    // Only blocks if the GPU is still reading this region from ParticleRegions frames ago
+    GLsync& fence = m_ParticleFences[m_ParticleRegion];
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    GLsizeiptr streamBytes = (GLsizeiptr)m_ParticleCapacity * sizeof(float);
+    GLintptr regionOffset = (GLintptr)m_ParticleRegion * 3 * streamBytes;
+    GLsizeiptr copyBytes = (GLsizeiptr)count * sizeof(float);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_ParticleVBO);
+    char* mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, regionOffset, 3 * streamBytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    std::memcpy(mapped, tracer.GetPositionX(), copyBytes);
+    std::memcpy(mapped + streamBytes, tracer.GetPositionY(), copyBytes);
+    std::memcpy(mapped + 2 * streamBytes, tracer.GetAge(), copyBytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    glBindVertexArray(m_ParticleVAO);
+    for (GLuint attribute = 0; attribute < 3; attribute++) {
+        glVertexAttribPointer(attribute, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(regionOffset + attribute * streamBytes));
+    }
+
+    m_ParticleShader.use();
+    m_ParticleShader.setMat4("viewProjection", viewProjection);
+    m_ParticleShader.setFloat("maxAge", tracer.m_MaxAge);
+    m_ParticleShader.setFloat("pointSize", pointSize);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    // A single point per instance; the per-particle streams advance once per instance
+    glDrawArraysInstanced(GL_POINTS, 0, 1, count);
+
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    glDisable(GL_BLEND);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
 void Renderer::InitPreviewFBOs(int width, int height)
 {
     if (m_PreviewWidth == width && m_PreviewHeight == height) return;
@@ -85,7 +211,7 @@ void Renderer::InitPreviewFBOs(int width, int height)
     setup(m_SideViewFBO, m_SideViewTexture);
 }
 
-void Renderer::DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sliceZ, float thickness)
+void Renderer::DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sliceZ, float thickness, int gridWidth, int gridHeight)
 {
     if (m_PreviewWidth == 0) InitPreviewFBOs(256, 256);
 
@@ -101,6 +227,8 @@ void Renderer::DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sli
 
         m_MeshShader.use();
         m_MeshShader.setMat4("model", model);
+        m_MeshShader.setVec3("positionOffset", mesh.GetPositionOffset());
+        m_MeshShader.setVec3("positionScale", mesh.GetPositionScale());
         m_MeshShader.setMat4("projection", viewProj);
         m_MeshShader.setFloat("sliceZ", sliceZ);
         m_MeshShader.setFloat("thickness", thickness);
@@ -108,22 +236,26 @@ void Renderer::DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sli
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+        int lod = SelectPreviewLod(mesh, model, viewProj, m_PreviewWidth, m_PreviewHeight);
+
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
-        ((Mesh&)mesh).Draw();
+        ((Mesh&)mesh).Draw(lod);
         glCullFace(GL_BACK);
-        ((Mesh&)mesh).Draw();
+        ((Mesh&)mesh).Draw(lod);
 
         glDisable(GL_BLEND);
         glDisable(GL_CULL_FACE);
     };
 
-    // Front View (XZ Plane): Look from -Y
-    glm::mat4 projFront = glm::ortho(0.0f, 256.0f, -128.0f, 128.0f, -1000.0f, 1000.0f) *
+    // Front View (XZ Plane): Look from -Y, framing the tunnel's length
+    float width = (float)gridWidth;
+    float height = (float)gridHeight;
+    glm::mat4 projFront = glm::ortho(0.0f, width, -height, height, -1000.0f, 1000.0f) *
                           glm::lookAt(glm::vec3(0, -500, 0), glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
 
     // Side View (YZ Plane): Look from +X
-    glm::mat4 projSide = glm::ortho(0.0f, 128.0f, -64.0f, 64.0f, -1000.0f, 1000.0f) *
+    glm::mat4 projSide = glm::ortho(0.0f, height, -0.5f * height, 0.5f * height, -1000.0f, 1000.0f) *
                          glm::lookAt(glm::vec3(500, 0, 0), glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
 
     drawView(m_FrontViewFBO, projFront);
@@ -133,20 +265,45 @@ void Renderer::DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sli
     glViewport(last_viewport[0], last_viewport[1], last_viewport[2], last_viewport[3]);
 }
 
-void Renderer::Draw(const FluidSolver& solver, int displayWidth, int displayHeight, const glm::mat4& viewProjection)
+void Renderer::Draw(const FluidSolver& solver, const glm::mat4& viewProjection)
 {
-    int width = solver.GetWidth();
-    int height = solver.GetHeight();
+    Draw(solver.GetFieldView(), viewProjection);
+}
+
+void Renderer::Draw(const FieldView& fields, const glm::mat4& viewProjection)
+{
+    int width = fields.Width;
+    int height = fields.Height;
 
     if (m_GridWidth != width || m_GridHeight != height) {
         InitTextures(width, height);
     }
 
-    UpdateTexture(m_TextureVelocityX, width, height, solver.GetVelocityX());
-    UpdateTexture(m_TextureVelocityY, width, height, solver.GetVelocityY());
-    UpdateTexture(m_TexturePressure, width, height, solver.GetPressure());
-    UpdateTexture(m_TextureDyeDensity, width, height, solver.GetDyeDensity());
-    UpdateTexture(m_TextureObstacleMask, width, height, solver.GetSolidMask());
+    UpdateTexture(m_TextureVelocityX, width, height, fields.VelocityX);
+    UpdateTexture(m_TextureVelocityY, width, height, fields.VelocityY);
+    UpdateTexture(m_TexturePressure, width, height, fields.Pressure);
+    UpdateTexture(m_TextureDyeDensity, width, height, fields.DyeDensity);
+    UpdateTexture(m_TextureObstacleMask, width, height, fields.SolidMask);
+
+    // Derived modes colour by value relative to the field's current range, with a gain so peaks saturate
+    float derivedScale = 0.0f;
+    if (m_DerivedFields && m_CurrentMode >= DisplayMode::Vorticity) {
+        DerivedField field = DerivedField::Vorticity;
+        float gain = 4.0f;
+        if (m_CurrentMode == DisplayMode::QCriterion) {
+            field = DerivedField::QCriterion;
+            gain = 20.0f;
+        } else if (m_CurrentMode == DisplayMode::StreamFunction) {
+            field = DerivedField::StreamFunction;
+            gain = 1.0f;
+        }
+
+        const std::vector<float>& derived = m_DerivedFields->Get(field, fields);
+        UpdateTexture(m_TextureDerived, width, height, derived.data());
+
+        float range = m_DerivedFields->GetRange(field);
+        derivedScale = range > 0.0f ? gain / range : 0.0f;
+    }
 
     m_ShaderProgram.use();
 
@@ -170,6 +327,12 @@ void Renderer::Draw(const FluidSolver& solver, int displayWidth, int displayHeig
     glBindTexture(GL_TEXTURE_2D, m_TextureObstacleMask);
     m_ShaderProgram.setInt("solidMaskTexture", 4);
 
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, m_TextureDerived);
+    m_ShaderProgram.setInt("derivedTexture", 5);
+    m_ShaderProgram.setFloat("derivedScale", derivedScale);
+    glActiveTexture(GL_TEXTURE0);
+
     m_ShaderProgram.setInt("displayMode", (int)m_CurrentMode);
     m_ShaderProgram.setMat4("viewProjection", viewProjection);
     m_ShaderProgram.setVec2("gridSize", (float)width, (float)height);
@@ -234,12 +397,13 @@ void Renderer::InitTextures(int width, int height)
     setupTexture(m_TexturePressure);
     setupTexture(m_TextureDyeDensity);
     setupTexture(m_TextureObstacleMask);
+    setupTexture(m_TextureDerived);
 }
 
-void Renderer::UpdateTexture(GLuint textureID, int width, int height, const std::vector<float>& data)
+void Renderer::UpdateTexture(GLuint textureID, int width, int height, const float* data)
 {
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, data.data());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, data);
 }
 
 void Renderer::CreateShader()
@@ -4,43 +4,66 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include "Shader.h"
+#include "FieldView.h"
 
 class FluidSolver;
 class Mesh;
+class ParticleTracer;
+class DerivedFields;
 
 class Renderer {
 public:
     Renderer();
     ~Renderer();
 
-    void Draw(const FluidSolver& solver, int displayWidth, int displayHeight, const glm::mat4& viewProjection);
+    void Draw(const FluidSolver& solver, const glm::mat4& viewProjection);
+    void Draw(const FieldView& fields, const glm::mat4& viewProjection);
+    void DrawParticles(const ParticleTracer& tracer, const glm::mat4& viewProjection, float pointSize);
     void DrawMeshPreview(const Mesh& mesh, const glm::mat4& model, const glm::mat4& projection, float sliceZ, float thickness, bool wireframe);
 
     void InitPreviewFBOs(int width, int height);
-    void DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sliceZ, float thickness);
+    // Front and side previews framed on a gridWidth x gridHeight tunnel
+    void DrawMeshViews(const Mesh& mesh, const glm::mat4& model, float sliceZ, float thickness, int gridWidth, int gridHeight);
     unsigned int GetFrontViewTexture() const { return m_FrontViewTexture; }
     unsigned int GetSideViewTexture() const { return m_SideViewTexture; }
 
     enum class DisplayMode {
         Dye = 0,
         Velocity = 1,
-        Pressure = 2
+        Pressure = 2,
+        Vorticity = 3,
+        QCriterion = 4,
+        StreamFunction = 5
     };
 
     DisplayMode m_CurrentMode = DisplayMode::Velocity;
 
+    // Source of the derived display modes; they are only computed while one of them is shown
+    void SetDerivedFields(DerivedFields* derived) { m_DerivedFields = derived; }
+
 private:
     void InitRenderData();
     void InitTextures(int width, int height);
-    void UpdateTexture(GLuint textureID, int width, int height, const std::vector<float>& data);
+    void UpdateTexture(GLuint textureID, int width, int height, const float* data);
     void CreateShader();
     void CreateMeshShader();
+    void InitParticleBuffer(int capacity);
 
 private:
     unsigned int m_QuadVAO = 0;
     unsigned int m_QuadVBO = 0;
     Shader m_ShaderProgram;
     Shader m_MeshShader;
+    Shader m_ParticleShader;
+
+    // Particle streaming: a buffer split into ParticleRegions regions that are written in rotation.
+    // Each region is fenced after its draw so the CPU only maps (unsynchronised) memory the GPU has finished reading.
+    static constexpr int ParticleRegions = 3;
+    unsigned int m_ParticleVAO = 0;
+    unsigned int m_ParticleVBO = 0;
+    int m_ParticleCapacity = 0;
+    int m_ParticleRegion = 0;
+    GLsync m_ParticleFences[ParticleRegions] = {};
 
     unsigned int m_FrontViewFBO = 0;
     unsigned int m_FrontViewTexture = 0;
@@ -55,6 +78,9 @@ private:
     unsigned int m_TexturePressure = 0;
     unsigned int m_TextureDyeDensity = 0;
     unsigned int m_TextureObstacleMask = 0;
+    unsigned int m_TextureDerived = 0;
+
+    DerivedFields* m_DerivedFields = nullptr;
 
     int m_GridWidth = 0;
     int m_GridHeight = 0;
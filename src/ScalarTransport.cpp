@@ -0,0 +1,402 @@
+#include "ScalarTransport.h"
+#include "KernelFlags.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Grid rows per task
+constexpr int RowGrain = 8;
+
+}
+
+std::vector<ScalarSpecies> ScalarTransport::GetDefaultSpecies()
+{
+    ScalarSpecies dye;
+    dye.Decay = 0.01f;
+    dye.Emitters.push_back(ScalarEmitter());
+    return { dye };
+}
+
+void ScalarTransport::Configure(const std::vector<ScalarSpecies>& species, int width, int height)
+{
+    if (width != m_Width || height != m_Height) {
+        m_Values.clear();
+        m_Previous.clear();
+        m_Width = width;
+        m_Height = height;
+        m_TilesX = (width + TileSize - 1) / TileSize;
+        m_TilesY = (height + TileSize - 1) / TileSize;
+        m_TileActive.assign(m_TilesX * m_TilesY, 0);
+        m_TileListed.assign(m_TilesX * m_TilesY, 0);
+        m_TileList.reserve(m_TilesX * m_TilesY); // Listing never allocates during a step
+    }
+
+    m_Species = species;
+    size_t size = (size_t)width * height;
+    m_Values.resize(species.size(), std::vector<float>(size, 0.0f));
+    m_Previous.resize(species.size(), std::vector<float>(size, 0.0f));
+}
+
+void ScalarTransport::Clear()
+{
+    for (std::vector<float>& values : m_Values) std::fill(values.begin(), values.end(), 0.0f);
+    for (std::vector<float>& values : m_Previous) std::fill(values.begin(), values.end(), 0.0f);
+    std::fill(m_TileActive.begin(), m_TileActive.end(), 0);
+}
+
+void ScalarTransport::MarkActive(int cell)
+{
+    m_TileActive[(cell % m_Width) / TileSize + (cell / m_Width) / TileSize * m_TilesX] = 1;
+}
+
+void ScalarTransport::MarkRegion(int iBegin, int iEnd, int jBegin, int jEnd)
+{
+    int txBegin = std::max(iBegin, 0) / TileSize;
+    int txEnd = std::min(iEnd, m_Width - 1) / TileSize;
+    int tyBegin = std::max(jBegin, 0) / TileSize;
+    int tyEnd = std::min(jEnd, m_Height - 1) / TileSize;
+    for (int ty = tyBegin; ty <= tyEnd; ty++) {
+        for (int tx = txBegin; tx <= txEnd; tx++) m_TileActive[tx + ty * m_TilesX] = 1;
+    }
+}
+
+void ScalarTransport::RefreshActiveTiles()
+{
+    RefreshActiveTiles(0, m_Width);
+}
+
+void ScalarTransport::RefreshActiveTiles(int columnBegin, int columnEnd)
+{
+    int txBegin = std::max(columnBegin, 0) / TileSize;
+    int txEnd = (std::min(columnEnd, m_Width) + TileSize - 1) / TileSize;
+    int columns = txEnd - txBegin;
+    if (columns <= 0) return;
+
+    ThreadPool::Get().ParallelFor(0, columns * m_TilesY, 1, [&](int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            int tile = txBegin + n % columns + n / columns * m_TilesX;
+            bool held = GetTileMaximum(tile, m_Values) > 0.0f;
+            if (m_TileActive[tile] && !held) {
+                for (std::vector<float>& values : m_Previous) ClearTile(tile, values);
+            }
+            m_TileActive[tile] = held;
+        }
+    });
+}
+
+int ScalarTransport::GetActiveTileCount() const
+{
+    return (int)std::count(m_TileActive.begin(), m_TileActive.end(), 1);
+}
+
+void ScalarTransport::ListActiveTiles(int reachX, int reachY, bool periodicX, bool periodicY)
+{
+    reachX = std::min(reachX, m_TilesX);
+    reachY = std::min(reachY, m_TilesY);
+    std::fill(m_TileListed.begin(), m_TileListed.end(), 0);
+
+    for (int ty = 0; ty < m_TilesY; ty++) {
+        for (int tx = 0; tx < m_TilesX; tx++) {
+            if (!m_TileActive[tx + ty * m_TilesX]) continue;
+
+            for (int dy = -reachY; dy <= reachY; dy++) {
+                int y = ty + dy;
+                if (periodicY) y = (y + m_TilesY) % m_TilesY;
+                else if (y < 0 || y >= m_TilesY) continue;
+
+                for (int dx = -reachX; dx <= reachX; dx++) {
+                    int x = tx + dx;
+                    if (periodicX) x = (x + m_TilesX) % m_TilesX;
+                    else if (x < 0 || x >= m_TilesX) continue;
+                    m_TileListed[x + y * m_TilesX] = 1;
+                }
+            }
+        }
+    }
+
+    m_TileList.clear();
+    for (int tile = 0; tile < m_TilesX * m_TilesY; tile++) {
+        if (!m_TileListed[tile]) continue;
+        if (m_TileActive[tile]) m_TileListed[tile] = 2;
+        m_TileList.push_back(tile);
+    }
+}
+
+void ScalarTransport::MarkGhostTiles()
+{
+    int w = m_Width, h = m_Height;
+    auto markIfHeld = [&](int cell) {
+        for (const std::vector<float>& values : m_Values) {
+            if (values[cell] != 0.0f) {
+                MarkActive(cell);
+                return;
+            }
+        }
+    };
+    for (int i = 0; i < w; i++) {
+        markIfHeld(i);
+        markIfHeld(i + (h - 1) * w);
+    }
+    for (int j = 1; j < h - 1; j++) {
+        markIfHeld(j * w);
+        markIfHeld(w - 1 + j * w);
+    }
+}
+
+float ScalarTransport::GetTileMaximum(int tile, const std::vector<std::vector<float>>& buffers) const
+{
+    int iBegin = (tile % m_TilesX) * TileSize;
+    int jBegin = (tile / m_TilesX) * TileSize;
+    int iEnd = std::min(iBegin + TileSize, m_Width);
+    int jEnd = std::min(jBegin + TileSize, m_Height);
+
+    float maximum = 0.0f;
+    for (const std::vector<float>& values : buffers) {
+        for (int j = jBegin; j < jEnd; j++) {
+            for (int index = iBegin + j * m_Width; index < iEnd + j * m_Width; index++) maximum = std::max(maximum, std::abs(values[index]));
+        }
+    }
+    return maximum;
+}
+
+void ScalarTransport::ClearTile(int tile, std::vector<float>& values) const
+{
+    int iBegin = (tile % m_TilesX) * TileSize;
+    int jBegin = (tile / m_TilesX) * TileSize;
+    int iEnd = std::min(iBegin + TileSize, m_Width);
+    int jEnd = std::min(jBegin + TileSize, m_Height);
+    for (int j = jBegin; j < jEnd; j++) std::fill(values.begin() + iBegin + j * m_Width, values.begin() + iEnd + j * m_Width, 0.0f);
+}
+
+void ScalarTransport::Advect(const float* velocityX, const float* velocityY, const float* solid,
+                             const DomainBoundaries& boundaries, float deltaTime)
+{
+    int count = GetSpeciesCount();
+    if (count == 0) return;
+
+    m_Targets.resize(count);
+    m_Sources.resize(count);
+    for (int s = 0; s < count; s++) {
+        std::swap(m_Values[s], m_Previous[s]);
+        boundaries.Apply(BoundaryField::Scalar, m_Previous[s].data());
+        m_Targets[s] = m_Values[s].data();
+        m_Sources[s] = m_Previous[s].data();
+    }
+
+    // Largest backtrace of the step in cells, plus the bilinear stencil's second cell; a periodic side also shifts
+    // the wrapped cells against the tile grid by up to one tile
+    float dt0_x = deltaTime * (boundaries.GetDomainWidth() - 2);
+    float dt0_y = deltaTime * (m_Height - 2);
+    int w = m_Width;
+    int rowChunks = (m_Height + RowGrain - 1) / RowGrain;
+    std::vector<float>& chunkReachX = m_ChunkReachX;
+    std::vector<float>& chunkReachY = m_ChunkReachY;
+    chunkReachX.assign(rowChunks, 0.0f);
+    chunkReachY.assign(rowChunks, 0.0f);
+    ThreadPool::Get().ParallelFor(0, rowChunks, 1, [&](int chunkBegin, int chunkEnd) {
+        for (int chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+            int end = std::min((chunk + 1) * RowGrain, m_Height) * w;
+            for (int index = chunk * RowGrain * w; index < end; index++) {
+                chunkReachX[chunk] = std::max(chunkReachX[chunk], std::abs(velocityX[index]));
+                chunkReachY[chunk] = std::max(chunkReachY[chunk], std::abs(velocityY[index]));
+            }
+        }
+    });
+    float reachX = dt0_x * *std::max_element(chunkReachX.begin(), chunkReachX.end()) + 1.0f;
+    float reachY = dt0_y * *std::max_element(chunkReachY.begin(), chunkReachY.end()) + 1.0f;
+    bool periodicX = boundaries.IsPeriodicX();
+    bool periodicY = boundaries.IsPeriodicY();
+    ListActiveTiles((int)std::ceil(reachX / TileSize) + (periodicX ? 1 : 0),
+                    (int)std::ceil(reachY / TileSize) + (periodicY ? 1 : 0), periodicX, periodicY);
+
+    SpecialiseFlags([&](auto obstacles, auto periodicX, auto periodicY) {
+        AdvectKernel<obstacles, periodicX, periodicY>(velocityX, velocityY, solid, boundaries, deltaTime);
+    }, solid != nullptr, periodicX, periodicY);
+
+    // The sources of tiles that emptied become the next targets
+    for (int tile : m_TileList) {
+        if (m_TileListed[tile] == 2 && !m_TileActive[tile]) {
+            for (std::vector<float>& values : m_Previous) ClearTile(tile, values);
+        }
+    }
+
+    for (int s = 0; s < count; s++) boundaries.Apply(BoundaryField::Scalar, m_Values[s].data());
+    MarkGhostTiles();
+}
+
+template <bool Obstacles, bool PeriodicX, bool PeriodicY>
+void ScalarTransport::AdvectKernel(const float* velocityX, const float* velocityY, const float* solid,
+                                   const DomainBoundaries& boundaries, float deltaTime)
+{
+    int w = m_Width;
+    int count = GetSpeciesCount();
+    int domainWidth = boundaries.GetDomainWidth();
+    int offset = boundaries.GetColumnOffset();
+    float dt0_x = deltaTime * (domainWidth - 2);
+    float dt0_y = deltaTime * (m_Height - 2);
+    float minX = std::max(0.5f, (float)offset);
+    float maxX = std::min(domainWidth - 1.5f, offset + w - 1.5f);
+    float* const* targets = m_Targets.data();
+    const float* const* sources = m_Sources.data();
+    const int* tiles = m_TileList.data();
+
+    ThreadPool::Get().ParallelFor(0, (int)m_TileList.size(), 1, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            int tile = tiles[t];
+            int iBegin = std::max(1, (tile % m_TilesX) * TileSize);
+            int iEnd = std::min(w - 1, (tile % m_TilesX + 1) * TileSize);
+            int jBegin = std::max(1, (tile / m_TilesX) * TileSize);
+            int jEnd = std::min(m_Height - 1, (tile / m_TilesX + 1) * TileSize);
+            bool held = false;
+
+            for (int j = jBegin; j < jEnd; j++) {
+                for (int i = iBegin; i < iEnd; i++) {
+                    int index = i + j * w;
+                    if constexpr (Obstacles) {
+                        if (solid[index] > 0.0f) {
+                            for (int s = 0; s < count; s++) targets[s][index] = 0.0f;
+                            continue;
+                        }
+                    }
+
+                    // Backtrace in domain columns, clamped or wrapped exactly as for velocity
+                    float x = (i + offset) - dt0_x * velocityX[index];
+                    float y = j - dt0_y * velocityY[index];
+                    if constexpr (PeriodicX) {
+                        x = 1.0f + std::fmod(x - 1.0f, (float)(domainWidth - 2));
+                        if (x < 1.0f) x += domainWidth - 2;
+                    } else {
+                        if (x < minX) x = minX;
+                        if (x > maxX) x = maxX;
+                    }
+                    if constexpr (PeriodicY) {
+                        y = 1.0f + std::fmod(y - 1.0f, (float)(m_Height - 2));
+                        if (y < 1.0f) y += m_Height - 2;
+                    } else {
+                        if (y < 0.5f) y = 0.5f;
+                        if (y > m_Height - 1.5f) y = m_Height - 1.5f;
+                    }
+
+                    // One set of corners and weights for all species; a wrapped coordinate on the far ghost layer
+                    // keeps its weightless corner inside the grid
+                    int column = (int)x;
+                    int cellLeft = column - offset;
+                    int cellBottom = (int)y;
+                    int bottomLeft = cellLeft + cellBottom * w;
+                    int right = PeriodicX && cellLeft == w - 1 ? 0 : 1;
+                    int up = PeriodicY && cellBottom == m_Height - 1 ? 0 : w;
+                    int topLeft = bottomLeft + up;
+
+                    float lerpWeightRight = x - column;
+                    float lerpWeightLeft = 1.0f - lerpWeightRight;
+                    float lerpWeightTop = y - cellBottom;
+                    float lerpWeightBottom = 1.0f - lerpWeightTop;
+
+                    for (int s = 0; s < count; s++) {
+                        const float* source = sources[s];
+                        float value =
+                            lerpWeightLeft * (lerpWeightBottom * source[bottomLeft] + lerpWeightTop * source[topLeft]) +
+                            lerpWeightRight * (lerpWeightBottom * source[bottomLeft + right] + lerpWeightTop * source[topLeft + right]);
+                        if (std::abs(value) < FlushThreshold) value = 0.0f;
+                        held |= value != 0.0f;
+                        targets[s][index] = value;
+                    }
+                }
+            }
+            m_TileActive[tile] = held;
+        }
+    });
+}
+
+void ScalarTransport::Decay(float deltaTime)
+{
+    ListActiveTiles();
+    for (int s = 0; s < GetSpeciesCount(); s++) {
+        if (m_Species[s].Decay <= 0.0f) continue;
+
+        float factor = std::exp(-m_Species[s].Decay * deltaTime);
+        float* values = m_Values[s].data();
+        ThreadPool::Get().ParallelFor(0, (int)m_TileList.size(), 1, [&](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                int tile = m_TileList[t];
+                int iBegin = (tile % m_TilesX) * TileSize;
+                int jBegin = (tile / m_TilesX) * TileSize;
+                int iEnd = std::min(iBegin + TileSize, m_Width);
+                int jEnd = std::min(jBegin + TileSize, m_Height);
+                for (int j = jBegin; j < jEnd; j++) {
+                    for (int index = iBegin + j * m_Width; index < iEnd + j * m_Width; index++) values[index] *= factor;
+                }
+            }
+        });
+    }
+}
+
+void ScalarTransport::Emit(const float* solid, const DomainBoundaries& boundaries, bool inflow)
+{
+    int w = m_Width;
+    for (int s = 0; s < GetSpeciesCount(); s++) {
+        float* values = m_Values[s].data();
+        if (inflow) boundaries.ClearInflow(values);
+
+        for (const ScalarEmitter& emitter : m_Species[s].Emitters) {
+            switch (emitter.Type) {
+            case ScalarEmitter::Shape::InflowBand:
+                if (inflow && boundaries.GetSettings().Types[(int)emitter.Side] == BoundaryType::Inflow && boundaries.HoldsSide(emitter.Side)) {
+                    boundaries.FillSideBand(emitter.Side, emitter.Begin, emitter.End, emitter.Value, values);
+
+                    // The ghost and first interior cells along the band
+                    bool vertical = emitter.Side == BoundarySide::Left || emitter.Side == BoundarySide::Right;
+                    int length = vertical ? m_Height : boundaries.GetDomainWidth();
+                    int first = vertical ? 0 : boundaries.GetColumnOffset();
+                    int bandBegin = (int)std::floor(length * emitter.Begin) - first;
+                    int bandEnd = (int)std::ceil(length * emitter.End) - first;
+                    switch (emitter.Side) {
+                    case BoundarySide::Left:   MarkRegion(0, 1, bandBegin, bandEnd); break;
+                    case BoundarySide::Right:  MarkRegion(m_Width - 2, m_Width - 1, bandBegin, bandEnd); break;
+                    case BoundarySide::Bottom: MarkRegion(bandBegin, bandEnd, 0, 1); break;
+                    default:                   MarkRegion(bandBegin, bandEnd, m_Height - 2, m_Height - 1); break;
+                    }
+                }
+                break;
+
+            case ScalarEmitter::Shape::ObstacleSurface:
+                for (int j = 1; j < m_Height - 1; j++) {
+                    for (int index = 1 + j * w; index < (j + 1) * w - 1; index++) {
+                        if (solid[index] > 0.0f) continue;
+                        if (solid[index - 1] > 0.0f || solid[index + 1] > 0.0f || solid[index - w] > 0.0f || solid[index + w] > 0.0f) {
+                            values[index] = emitter.Value;
+                            MarkActive(index);
+                        }
+                    }
+                }
+                break;
+
+            case ScalarEmitter::Shape::Disc: {
+                // Placed in domain columns
+                int offset = boundaries.GetColumnOffset();
+                float centerX = emitter.X * boundaries.GetDomainWidth();
+                float centerY = emitter.Y * m_Height;
+                float radius = emitter.Radius * boundaries.GetDomainWidth();
+                int iBegin = std::max(1, (int)std::floor(centerX - radius) - offset);
+                int iEnd = std::min(m_Width - 2, (int)std::ceil(centerX + radius) - offset);
+                int jBegin = std::max(1, (int)std::floor(centerY - radius));
+                int jEnd = std::min(m_Height - 2, (int)std::ceil(centerY + radius));
+                for (int j = jBegin; j <= jEnd; j++) {
+                    for (int i = iBegin; i <= iEnd; i++) {
+                        float dx = (i + offset) - centerX;
+                        float dy = j - centerY;
+                        if (dx * dx + dy * dy <= radius * radius && solid[i + j * w] <= 0.0f) values[i + j * w] = emitter.Value;
+                    }
+                }
+                MarkRegion(iBegin, iEnd, jBegin, jEnd);
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+    }
+}
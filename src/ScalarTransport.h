@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "DomainBoundaries.h"
+
+// Where a species is released; emitting cells are held at 'Value' after every step
+struct ScalarEmitter {
+    enum class Shape {
+        InflowBand = 0,      // Part of one side, while that side is an inflow
+        ObstacleSurface = 1, // Fluid cells next to the obstacle
+        Disc = 2,            // Circle of fluid cells inside the domain
+        Count = 3
+    };
+    Shape Type = Shape::InflowBand;
+    float Value = 1.0f;
+
+    // InflowBand: the side and the part of it that emits, as fractions of its length
+    BoundarySide Side = BoundarySide::Left;
+    float Begin = 0.45f;
+    float End = 0.55f;
+
+    // Disc: centre as fractions of the domain, radius as a fraction of its width
+    float X = 0.2f;
+    float Y = 0.5f;
+    float Radius = 0.02f;
+};
+
+struct ScalarSpecies {
+    float Diffusion = 0.0f;
+    float Decay = 0.0f; // First-order loss rate: values fall by exp(-Decay * dt) per step
+    std::vector<ScalarEmitter> Emitters;
+};
+
+// Passive scalars carried by the 2D flow. Each species is a separate field, but all of them are advected in one
+// pass that computes the backtrace and bilinear weights of a cell once and applies them to every species.
+// Diffusion stays with the solver, which owns the linear solver and obstacle stencil.
+//
+// Scalars usually fill a thin plume, so the grid is split into TileSize x TileSize tiles and only those holding a
+// value, grown by the step's largest backtrace, are advected and decayed. Advection drops values below
+// FlushThreshold so the plume's numerically smeared fringe does not keep the whole tunnel active; since that cut
+// is per cell, the result is the same as processing every tile.
+class ScalarTransport {
+public:
+    static constexpr int TileSize = 16;
+    static constexpr float FlushThreshold = 1e-4f;
+
+    // A single dye species released from the middle of the left side
+    static std::vector<ScalarSpecies> GetDefaultSpecies();
+
+    // Species that remain keep their values, new ones start empty
+    void Configure(const std::vector<ScalarSpecies>& species, int width, int height);
+    const std::vector<ScalarSpecies>& GetSpecies() const { return m_Species; }
+    int GetSpeciesCount() const { return (int)m_Species.size(); }
+
+    std::vector<float>& GetValues(int species) { return m_Values[species]; }
+    const std::vector<float>& GetValues(int species) const { return m_Values[species]; }
+
+    // Empties every species
+    void Clear();
+
+    // Values written through GetValues bypass the tile tracking: MarkActive covers single cells, and
+    // RefreshActiveTiles rescans the whole grid (e.g. after diffusion) or the tiles over columns [columnBegin, columnEnd)
+    void MarkActive(int cell);
+    void RefreshActiveTiles();
+    void RefreshActiveTiles(int columnBegin, int columnEnd);
+    int GetActiveTileCount() const;
+    int GetTileCount() const { return m_TilesX * m_TilesY; }
+
+    // Semi-Lagrangian step of every species through the velocity field; solid cells are cleared. 'solid' may be
+    // null when no cell is solid, which selects a kernel without mask loads. When the grid is a slab of a wider
+    // domain (see DomainBoundaries::Configure), backtraces are clamped to the domain and then to the columns held.
+    void Advect(const float* velocityX, const float* velocityY, const float* solid, const DomainBoundaries& boundaries,
+                float deltaTime);
+
+    void Decay(float deltaTime);
+
+    // Clears what enters through inflow sides and refills every emitter. 'inflow' is false while the solver's
+    // frontal source replaces the inflow, which also silences inflow bands.
+    void Emit(const float* solid, const DomainBoundaries& boundaries, bool inflow);
+
+private:
+    // Over the tiles in m_TileList, deactivating those left empty
+    template <bool Obstacles, bool PeriodicX, bool PeriodicY>
+    void AdvectKernel(const float* velocityX, const float* velocityY, const float* solid, const DomainBoundaries& boundaries,
+                      float deltaTime);
+
+    // Activates the tiles covering cells iBegin..iEnd, jBegin..jEnd (inclusive, clamped to the grid)
+    void MarkRegion(int iBegin, int iEnd, int jBegin, int jEnd);
+
+    // Fills m_TileList with the active tiles, grown by 'reachX' and 'reachY' tiles (wrapping where periodic)
+    void ListActiveTiles(int reachX = 0, int reachY = 0, bool periodicX = false, bool periodicY = false);
+
+    // Activates tiles whose ghost cells hold a value, which boundary rules can copy from elsewhere
+    void MarkGhostTiles();
+
+    // Largest value of any species in a tile
+    float GetTileMaximum(int tile, const std::vector<std::vector<float>>& buffers) const;
+    void ClearTile(int tile, std::vector<float>& values) const;
+
+private:
+    std::vector<ScalarSpecies> m_Species;
+    std::vector<std::vector<float>> m_Values;
+    std::vector<std::vector<float>> m_Previous;
+    std::vector<float*> m_Targets;
+    std::vector<const float*> m_Sources;
+    int m_Width = 0;
+    int m_Height = 0;
+
+    int m_TilesX = 0;
+    int m_TilesY = 0;
+    std::vector<uint8_t> m_TileActive; // Per tile: may hold a value; the interior of every other tile is zero in both buffers
+    std::vector<uint8_t> m_TileListed; // Per tile: in m_TileList (1), and active when listed (2)
+    std::vector<int> m_TileList;
+    std::vector<float> m_ChunkReachX, m_ChunkReachY; // Per row chunk of Advect's velocity maximum
+};
@@ -0,0 +1,433 @@
+#include "SessionJournal.h"
+#include "FluidSolver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr const char* JournalMagic = "CFDJOURNAL";
+constexpr int JournalVersion = 1;
+constexpr char ObstacleMagic[8] = { 'C', 'F', 'D', 'O', 'B', 'S', 'T', '\0' };
+constexpr uint32_t ObstacleVersion = 1;
+
+// Steps between checksums
+constexpr uint64_t CheckpointInterval = 50;
+
+// Sanity limit on species and emitter counts read from a journal
+constexpr long long MaxListLength = 4096;
+
+// FNV-1a, 64 bit
+constexpr uint64_t HashSeed = 14695981039346656037ull;
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HashSeed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HashField(const std::vector<float>& field, uint64_t hash = HashSeed)
+{
+    return HashBytes(field.data(), field.size() * sizeof(float), hash);
+}
+
+std::string ToHex(uint64_t value)
+{
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return text;
+}
+
+// Exact text form of a float (%a), read back with strtof
+std::string ToText(float value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%a", (double)value);
+    return text;
+}
+
+std::string SerializeParameters(const FluidSolver& solver)
+{
+    std::ostringstream out;
+    out << "viscosity " << ToText(solver.m_Viscosity)
+        << " inflow " << ToText(solver.m_InflowVelocity)
+        << " iterations " << solver.m_Iterations
+        << " relaxation " << (int)solver.m_Relaxation
+        << " pressure_tolerance " << ToText(solver.m_PressureTolerance)
+        << " diffusion_tolerance " << ToText(solver.m_DiffusionTolerance)
+        << " frontal " << (solver.m_FrontalSource ? 1 : 0)
+        << " subcell " << (solver.m_SubCellBoundaries ? 1 : 0)
+        << " turbulence " << (int)solver.m_TurbulenceModel
+        << " smagorinsky " << ToText(solver.m_SmagorinskyConstant)
+        << " wale " << ToText(solver.m_WaleConstant);
+
+    const BoundarySettings& boundaries = solver.GetBoundarySettings();
+    out << " boundaries";
+    for (int side = 0; side < 4; side++) out << " " << (int)boundaries.Types[side] << " " << (int)boundaries.Profiles[side];
+    out << " " << ToText(boundaries.RoughnessLength) << " " << ToText(boundaries.ReferenceHeight)
+        << " " << ToText(boundaries.TurbulenceIntensity) << " " << ToText(boundaries.EddySize) << " " << boundaries.EddyCount;
+
+    const std::vector<ScalarSpecies>& species = solver.GetSpecies();
+    out << " species " << species.size();
+    for (const ScalarSpecies& entry : species) {
+        out << " " << ToText(entry.Diffusion) << " " << ToText(entry.Decay) << " " << entry.Emitters.size();
+        for (const ScalarEmitter& emitter : entry.Emitters) {
+            out << " " << (int)emitter.Type << " " << ToText(emitter.Value) << " " << (int)emitter.Side
+                << " " << ToText(emitter.Begin) << " " << ToText(emitter.End)
+                << " " << ToText(emitter.X) << " " << ToText(emitter.Y) << " " << ToText(emitter.Radius);
+        }
+    }
+    return out.str();
+}
+
+// Whitespace-separated tokens of one journal line; any missing or malformed token marks the reader failed
+class TokenReader {
+public:
+    explicit TokenReader(const std::string& text) : m_Stream(text) {}
+
+    bool Failed() const { return m_Failed; }
+
+    std::string Next()
+    {
+        std::string token;
+        if (!(m_Stream >> token)) m_Failed = true;
+        return token;
+    }
+
+    void Expect(const char* key)
+    {
+        if (Next() != key) m_Failed = true;
+    }
+
+    float Float()
+    {
+        std::string token = Next();
+        char* end = nullptr;
+        float value = std::strtof(token.c_str(), &end);
+        if (token.empty() || *end != '\0') m_Failed = true;
+        return value;
+    }
+
+    long long Integer()
+    {
+        std::string token = Next();
+        char* end = nullptr;
+        long long value = std::strtoll(token.c_str(), &end, 10);
+        if (token.empty() || *end != '\0') m_Failed = true;
+        return value;
+    }
+
+    uint64_t Hex()
+    {
+        std::string token = Next();
+        char* end = nullptr;
+        uint64_t value = std::strtoull(token.c_str(), &end, 16);
+        if (token.empty() || *end != '\0') m_Failed = true;
+        return value;
+    }
+
+private:
+    std::istringstream m_Stream;
+    bool m_Failed = false;
+};
+
+bool ApplyParameters(TokenReader& in, FluidSolver& solver)
+{
+    in.Expect("viscosity");           solver.m_Viscosity = in.Float();
+    in.Expect("inflow");              solver.m_InflowVelocity = in.Float();
+    in.Expect("iterations");          solver.m_Iterations = (int)in.Integer();
+    in.Expect("relaxation");          solver.m_Relaxation = (FluidSolver::Relaxation)in.Integer();
+    in.Expect("pressure_tolerance");  solver.m_PressureTolerance = in.Float();
+    in.Expect("diffusion_tolerance"); solver.m_DiffusionTolerance = in.Float();
+    in.Expect("frontal");             solver.m_FrontalSource = in.Integer() != 0;
+    in.Expect("subcell");             solver.m_SubCellBoundaries = in.Integer() != 0;
+    in.Expect("turbulence");          solver.m_TurbulenceModel = (FluidSolver::TurbulenceModel)in.Integer();
+    in.Expect("smagorinsky");         solver.m_SmagorinskyConstant = in.Float();
+    in.Expect("wale");                solver.m_WaleConstant = in.Float();
+
+    BoundarySettings boundaries;
+    in.Expect("boundaries");
+    for (int side = 0; side < 4; side++) {
+        boundaries.Types[side] = (BoundaryType)in.Integer();
+        boundaries.Profiles[side] = (InflowProfile)in.Integer();
+    }
+    boundaries.RoughnessLength = in.Float();
+    boundaries.ReferenceHeight = in.Float();
+    boundaries.TurbulenceIntensity = in.Float();
+    boundaries.EddySize = in.Float();
+    boundaries.EddyCount = (int)in.Integer();
+
+    in.Expect("species");
+    long long speciesCount = in.Integer();
+    if (in.Failed() || speciesCount < 0 || speciesCount > MaxListLength) return false;
+    std::vector<ScalarSpecies> species(speciesCount);
+    for (ScalarSpecies& entry : species) {
+        entry.Diffusion = in.Float();
+        entry.Decay = in.Float();
+        long long emitterCount = in.Integer();
+        if (in.Failed() || emitterCount < 0 || emitterCount > MaxListLength) return false;
+        entry.Emitters.resize(emitterCount);
+        for (ScalarEmitter& emitter : entry.Emitters) {
+            emitter.Type = (ScalarEmitter::Shape)in.Integer();
+            emitter.Value = in.Float();
+            emitter.Side = (BoundarySide)in.Integer();
+            emitter.Begin = in.Float();
+            emitter.End = in.Float();
+            emitter.X = in.Float();
+            emitter.Y = in.Float();
+            emitter.Radius = in.Float();
+        }
+        if (in.Failed()) return false;
+    }
+    if (in.Failed()) return false;
+
+    solver.SetBoundarySettings(boundaries);
+    solver.SetSpecies(species);
+    return true;
+}
+
+std::string ObstaclePath(const std::string& directory, uint64_t hash)
+{
+    return directory + "/" + ToHex(hash) + ".obstacle";
+}
+
+bool SaveObstacle(const std::string& path, const FluidSolver& solver)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Cannot open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    int32_t size[2] = { solver.GetWidth(), solver.GetHeight() };
+    file.write(ObstacleMagic, sizeof(ObstacleMagic));
+    file.write(reinterpret_cast<const char*>(&ObstacleVersion), sizeof(ObstacleVersion));
+    file.write(reinterpret_cast<const char*>(size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(solver.GetSolidMask().data()), solver.GetSolidMask().size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(solver.GetSolidDistance().data()), solver.GetSolidDistance().size() * sizeof(float));
+    if (!file) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Failed while writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LoadObstacle(const std::string& path, int width, int height, std::vector<float>& mask, std::vector<float>& distance)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(ObstacleMagic)] = {};
+    uint32_t version = 0;
+    int32_t size[2] = {};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(size), sizeof(size));
+    if (!file || std::memcmp(magic, ObstacleMagic, sizeof(magic)) != 0 || version != ObstacleVersion ||
+        size[0] != width || size[1] != height) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: " << path << " is not a " << width << "x" << height << " obstacle" << std::endl;
+        return false;
+    }
+
+    mask.resize((size_t)width * height);
+    distance.resize((size_t)width * height);
+    file.read(reinterpret_cast<char*>(mask.data()), mask.size() * sizeof(float));
+    file.read(reinterpret_cast<char*>(distance.data()), distance.size() * sizeof(float));
+    if (!file) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Truncated obstacle " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t HashObstacle(const FluidSolver& solver)
+{
+    return HashField(solver.GetSolidDistance(), HashField(solver.GetSolidMask()));
+}
+
+}
+
+bool SessionJournal::Open(const std::string& path, const FluidSolver& solver)
+{
+    m_File.open(path, std::ios::trunc);
+    if (!m_File) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Cannot open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    m_ObstacleDirectory = path + ".obstacles";
+    std::error_code error;
+    std::filesystem::create_directories(m_ObstacleDirectory, error);
+    if (error) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Cannot create " << m_ObstacleDirectory << ": " << error.message() << std::endl;
+        m_File.close();
+        return false;
+    }
+
+    m_File << JournalMagic << " " << JournalVersion << "\n";
+    m_File << "grid " << solver.GetWidth() << " " << solver.GetHeight() << "\n";
+
+    m_StepCount = 0;
+    m_TimeStep = 0.0f;
+    m_Parameters.clear();
+    m_ObstacleHash = 0;
+    RecordChanges(solver);
+    WriteChecksum(solver);
+    return true;
+}
+
+void SessionJournal::RecordChanges(const FluidSolver& solver)
+{
+    if (!m_File.is_open()) return;
+
+    std::string parameters = SerializeParameters(solver);
+    if (parameters != m_Parameters) {
+        m_File << m_StepCount << " parameters " << parameters << "\n";
+        m_Parameters = std::move(parameters);
+    }
+
+    // Content-addressed: a shape seen before is already on disk
+    uint64_t obstacleHash = HashObstacle(solver);
+    if (obstacleHash != m_ObstacleHash) {
+        std::string path = ObstaclePath(m_ObstacleDirectory, obstacleHash);
+        std::error_code error;
+        if (std::filesystem::exists(path, error) || SaveObstacle(path, solver)) {
+            m_File << m_StepCount << " obstacle " << ToHex(obstacleHash) << "\n";
+        }
+        m_ObstacleHash = obstacleHash;
+    }
+}
+
+void SessionJournal::BeginStep(float timeStep)
+{
+    if (!m_File.is_open() || timeStep == m_TimeStep) return;
+    m_File << m_StepCount << " timestep " << ToText(timeStep) << "\n";
+    m_TimeStep = timeStep;
+}
+
+void SessionJournal::EndStep(const FluidSolver& solver)
+{
+    if (!m_File.is_open()) return;
+    m_StepCount++;
+    if (m_StepCount % CheckpointInterval == 0) WriteChecksum(solver);
+}
+
+void SessionJournal::Close(const FluidSolver& solver)
+{
+    if (!m_File.is_open()) return;
+    if (m_LastChecksumStep != m_StepCount) WriteChecksum(solver);
+    m_File.close();
+}
+
+void SessionJournal::WriteChecksum(const FluidSolver& solver)
+{
+    m_File << m_StepCount << " checksum " << ToHex(Checksum(solver)) << "\n";
+    m_File.flush();
+    m_LastChecksumStep = m_StepCount;
+}
+
+uint64_t SessionJournal::Checksum(const FluidSolver& solver)
+{
+    uint64_t hash = HashField(solver.GetVelocityX());
+    hash = HashField(solver.GetVelocityY(), hash);
+    hash = HashField(solver.GetPressure(), hash);
+    for (int species = 0; species < (int)solver.GetSpecies().size(); species++) {
+        hash = HashField(solver.GetScalar(species), hash);
+    }
+    return hash;
+}
+
+int SessionJournal::Replay(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: Cannot open " << path << std::endl;
+        return 1;
+    }
+
+    std::string line;
+    std::getline(file, line);
+    TokenReader header(line);
+    bool valid = header.Next() == JournalMagic && header.Integer() == JournalVersion;
+    std::getline(file, line);
+    TokenReader grid(line);
+    grid.Expect("grid");
+    int width = (int)grid.Integer();
+    int height = (int)grid.Integer();
+    if (!valid || header.Failed() || grid.Failed() || width < 3 || height < 3) {
+        std::cerr << "ERROR::SESSION_JOURNAL:: " << path << " is not a session journal" << std::endl;
+        return 1;
+    }
+
+    FluidSolver solver(width, height);
+    std::string obstacleDirectory = path + ".obstacles";
+    float timeStep = 0.0f;
+    uint64_t step = 0;
+    int checkpoints = 0;
+    int mismatches = 0;
+    double stepMilliseconds = 0.0;
+
+    for (int lineNumber = 3; std::getline(file, line); lineNumber++) {
+        if (line.empty()) continue;
+
+        TokenReader in(line);
+        uint64_t eventStep = (uint64_t)in.Integer();
+        std::string kind = in.Next();
+        if (in.Failed() || eventStep < step) {
+            std::cerr << "ERROR::SESSION_JOURNAL:: Malformed event on line " << lineNumber << std::endl;
+            return 1;
+        }
+
+        // Catch up to the event; only the steps are timed
+        if (eventStep > step) {
+            auto start = std::chrono::steady_clock::now();
+            for (; step < eventStep; step++) solver.Step(timeStep);
+            stepMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        bool ok = true;
+        if (kind == "timestep") {
+            timeStep = in.Float();
+            ok = !in.Failed();
+        } else if (kind == "parameters") {
+            ok = ApplyParameters(in, solver);
+        } else if (kind == "obstacle") {
+            uint64_t hash = in.Hex();
+            std::vector<float> mask, distance;
+            ok = !in.Failed() && LoadObstacle(ObstaclePath(obstacleDirectory, hash), width, height, mask, distance);
+            if (ok) solver.SetObstacle(mask, distance);
+        } else if (kind == "checksum") {
+            uint64_t expected = in.Hex();
+            ok = !in.Failed();
+            checkpoints++;
+            if (ok && Checksum(solver) != expected) {
+                if (mismatches == 0) std::cerr << "Replay: fields first differ at step " << step << std::endl;
+                mismatches++;
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << "ERROR::SESSION_JOURNAL:: Bad '" << kind << "' event on line " << lineNumber << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Replay: " << step << " steps of " << width << "x" << height << " in " << stepMilliseconds / 1000.0
+              << " s (" << (step > 0 ? stepMilliseconds / step : 0.0) << " ms/step), " << checkpoints << " checkpoints - "
+              << (mismatches == 0 ? "bit-identical" : std::to_string(mismatches) + " MISMATCHED") << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
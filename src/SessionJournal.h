@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class FluidSolver;
+
+// Event log of a 2D run that can be re-executed exactly. Each line is one event stamped with the number of
+// steps taken before it:
+//     <step> timestep <dt>
+//     <step> parameters <every solver setting that affects the result>
+//     <step> obstacle <hash>
+//     <step> checksum <hash of the fields after that many steps>
+// Floats are written as hex floats so they read back bit for bit. Obstacles are stored once per content hash
+// next to the journal (<path>.obstacles/<hash>.obstacle), so re-applying an earlier shape costs nothing.
+//
+// Recording starts from a solver at rest (see FluidSolver::Reset). The solver's kernels are deterministic for
+// any thread count, so a replay reproduces every checksum unless the code changed behaviour. The file is flushed
+// at every checksum, so a crashed session replays up to its last one.
+class SessionJournal {
+public:
+    // Starts a journal at 'path' with the solver's current parameters and obstacle as step 0
+    bool Open(const std::string& path, const FluidSolver& solver);
+    bool IsOpen() const { return m_File.is_open(); }
+    uint64_t GetStepCount() const { return m_StepCount; }
+
+    // After edits were applied between steps: records parameters and obstacle if they differ from the last ones
+    void RecordChanges(const FluidSolver& solver);
+
+    // Around each 2D step; the time step is recorded when it changes, a checksum every few steps
+    void BeginStep(float timeStep);
+    void EndStep(const FluidSolver& solver);
+
+    // Ends with a checksum of the final state
+    void Close(const FluidSolver& solver);
+
+    // Hash of velocity, pressure and every scalar species
+    static uint64_t Checksum(const FluidSolver& solver);
+
+    // Re-executes a journal headlessly as fast as possible, comparing every checkpoint; returns 0 when all match
+    static int Replay(const std::string& path);
+
+private:
+    void WriteChecksum(const FluidSolver& solver);
+
+private:
+    std::ofstream m_File;
+    std::string m_ObstacleDirectory;
+    uint64_t m_StepCount = 0;
+    uint64_t m_LastChecksumStep = 0;
+    float m_TimeStep = 0.0f;
+    std::string m_Parameters;
+    uint64_t m_ObstacleHash = 0;
+};
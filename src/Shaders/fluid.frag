@@ -8,8 +8,10 @@ uniform sampler2D velocityYTexture;
 uniform sampler2D pressureTexture;
 uniform sampler2D dyeDensityTexture;
 uniform sampler2D solidMaskTexture;
+uniform sampler2D derivedTexture;   // CPU-computed field for modes 3-5
+uniform float derivedScale;         // Maps derivedTexture values to roughly [-1, 1]
 
-uniform int displayMode; // 0=Dye, 1=Velocity, 2=Pressure
+uniform int displayMode; // 0=Dye, 1=Velocity, 2=Pressure, 3=Vorticity, 4=Q-Criterion, 5=Streamfunction
 
 vec3 heatMap(float v) {
     float value = clamp(v, 0.0, 1.0);
@@ -24,6 +26,12 @@ vec3 heatMap(float v) {
     }
 }
 
+// Diverging map for signed values in [-1, 1]: blue (negative) - black - red (positive)
+vec3 blueRedMap(float v) {
+    float value = clamp(v, -1.0, 1.0);
+    return value < 0.0 ? mix(vec3(0.02), vec3(0.1, 0.4, 1.0), -value) : mix(vec3(0.02), vec3(1.0, 0.25, 0.1), value);
+}
+
 void main()
 {
     float velocityX = texture(velocityXTexture, TexCoords).r;
@@ -52,6 +60,16 @@ void main()
         // Map [-0.5, 0.5] roughly to [0, 1]
         color = heatMap(pressure * 100.0 + 0.5);
     }
+    else if (displayMode == 3 || displayMode == 4) {
+        color = blueRedMap(texture(derivedTexture, TexCoords).r * derivedScale);
+    }
+    else if (displayMode == 5) {
+        // Iso-lines of the streamfunction are streamlines
+        float psi = texture(derivedTexture, TexCoords).r * derivedScale;
+        float lineDistance = abs(fract(psi * 20.0) - 0.5) * 2.0; // 1 on an iso-line, 0 halfway between
+        float line = smoothstep(0.85, 0.95, lineDistance);
+        color = mix(heatMap(psi * 0.5 + 0.5) * 0.6, vec3(1.0), line);
+    }
 
     FragColor = vec4(color, 1.0);
 }
@@ -4,6 +4,8 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 uniform mat4 model;
+uniform vec3 positionOffset; // aPos is a fraction of the mesh bounds
+uniform vec3 positionScale;
 uniform mat4 projection;
 
 out float v_WorldZ;
@@ -12,7 +14,7 @@ out vec2 v_TexCoords;
 
 void main()
 {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec4 worldPos = model * vec4(positionOffset + aPos * positionScale, 1.0);
     v_WorldZ = worldPos.z;
     v_Normal = mat3(transpose(inverse(model))) * aNormal;
     v_TexCoords = aTexCoords;
@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in float v_Fade;
+
+void main()
+{
+    // Round points with a soft edge
+    vec2 offset = gl_PointCoord - vec2(0.5);
+    float edge = 1.0 - smoothstep(0.3, 0.5, length(offset));
+
+    vec3 color = mix(vec3(0.3, 0.5, 1.0), vec3(1.0), v_Fade);
+    FragColor = vec4(color, v_Fade * v_Fade * edge);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+// One instance per particle; the three streams are the tracer's x / y / age arrays copied as-is
+layout (location = 0) in float aPositionX;
+layout (location = 1) in float aPositionY;
+layout (location = 2) in float aAge;
+
+uniform mat4 viewProjection;
+uniform float maxAge;
+uniform float pointSize;
+
+out float v_Fade;
+
+void main()
+{
+    // Particles live in grid index space; cell i covers [i, i + 1] of the fluid quad
+    gl_Position = viewProjection * vec4(aPositionX + 0.5, aPositionY + 0.5, 0.0, 1.0);
+    gl_PointSize = pointSize;
+    v_Fade = 1.0 - clamp(aAge / maxAge, 0.0, 1.0);
+}
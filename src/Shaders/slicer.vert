@@ -2,13 +2,15 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
+uniform vec3 positionOffset; // aPos is a fraction of the mesh bounds
+uniform vec3 positionScale;
 uniform mat4 projection;
 
 out float v_WorldZ;
 
 void main()
 {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec4 worldPos = model * vec4(positionOffset + aPos * positionScale, 1.0);
     v_WorldZ = worldPos.z;
     gl_Position = projection * worldPos;
 }
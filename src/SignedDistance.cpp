@@ -0,0 +1,171 @@
+#include "SignedDistance.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Rows / columns per task for the separable transform
+constexpr int LineGrain = 16;
+
+// Cells either side of the polygon that get exact distances
+constexpr float PolygonBand = 2.0f;
+
+constexpr float Far = 1e20f;
+
+// 1D squared distance transform of a sampled function (Felzenszwalb & Huttenlocher), in place over a strided line
+void Transform1D(float* values, int count, int stride, std::vector<float>& f, std::vector<int>& v, std::vector<float>& z)
+{
+    for (int q = 0; q < count; q++) f[q] = values[q * stride];
+
+    // Lower envelope of the parabolas rooted at each sample
+    int k = 0;
+    v[0] = 0;
+    z[0] = -Far;
+    z[1] = Far;
+    for (int q = 1; q < count; q++) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = Far;
+    }
+
+    k = 0;
+    for (int q = 0; q < count; q++) {
+        while (z[k + 1] < q) k++;
+        float d = (float)(q - v[k]);
+        values[q * stride] = d * d + f[v[k]];
+    }
+}
+
+// Squared distance from every cell centre to the nearest cell where 'seed' is true
+void SquaredDistance(const float* mask, bool seedSolid, int width, int height, std::vector<float>& result)
+{
+    result.resize((size_t)width * height);
+    for (int index = 0; index < width * height; index++) {
+        bool solid = mask[index] > 0.0f;
+        result[index] = solid == seedSolid ? 0.0f : Far;
+    }
+
+    ThreadPool& pool = ThreadPool::Get();
+    pool.ParallelFor(0, height, LineGrain, [&](int begin, int end) {
+        std::vector<float> f(width), z(width + 1);
+        std::vector<int> v(width);
+        for (int j = begin; j < end; j++) Transform1D(result.data() + j * width, width, 1, f, v, z);
+    });
+    pool.ParallelFor(0, width, LineGrain, [&](int begin, int end) {
+        std::vector<float> f(height), z(height + 1);
+        std::vector<int> v(height);
+        for (int i = begin; i < end; i++) Transform1D(result.data() + i, height, width, f, v, z);
+    });
+}
+
+float SegmentDistance(float px, float py, float ax, float ay, float bx, float by)
+{
+    float dx = bx - ax;
+    float dy = by - ay;
+    float lengthSquared = dx * dx + dy * dy;
+    float t = lengthSquared > 0.0f ? ((px - ax) * dx + (py - ay) * dy) / lengthSquared : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    float ex = px - (ax + t * dx);
+    float ey = py - (ay + t * dy);
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+}
+
+void SignedDistance::FromMask(const float* solidMask, int width, int height, std::vector<float>& distance)
+{
+    std::vector<float> toSolid, toFluid;
+    SquaredDistance(solidMask, true, width, height, toSolid);
+    SquaredDistance(solidMask, false, width, height, toFluid);
+
+    distance.resize((size_t)width * height);
+    ThreadPool::Get().ParallelFor(0, height, LineGrain, [&](int begin, int end) {
+        for (int index = begin * width; index < end * width; index++) {
+            // A mask with no solid (or no fluid) at all leaves the other side at 'Far'
+            if (solidMask[index] > 0.0f) {
+                distance[index] = -(std::min(std::sqrt(toFluid[index]), Far) - 0.5f);
+            } else {
+                distance[index] = std::min(std::sqrt(toSolid[index]), Far) - 0.5f;
+            }
+        }
+    });
+}
+
+void SignedDistance::FromPolygon(const float* solidMask, const std::vector<float>& polygon, int width, int height, std::vector<float>& distance)
+{
+    FromMask(solidMask, width, height, distance);
+
+    int pointCount = (int)polygon.size() / 2;
+    if (pointCount < 2) return;
+
+    // Exact distance in a band around each edge; cells further out keep the transform's value
+    std::vector<float> exact((size_t)width * height, std::numeric_limits<float>::max());
+    for (int p = 0; p < pointCount; p++) {
+        float ax = polygon[p * 2 + 0];
+        float ay = polygon[p * 2 + 1];
+        float bx = polygon[((p + 1) % pointCount) * 2 + 0];
+        float by = polygon[((p + 1) % pointCount) * 2 + 1];
+
+        int iMin = std::max(0, (int)std::floor(std::min(ax, bx) - PolygonBand));
+        int iMax = std::min(width - 1, (int)std::ceil(std::max(ax, bx) + PolygonBand));
+        int jMin = std::max(0, (int)std::floor(std::min(ay, by) - PolygonBand));
+        int jMax = std::min(height - 1, (int)std::ceil(std::max(ay, by) + PolygonBand));
+
+        for (int j = jMin; j <= jMax; j++) {
+            for (int i = iMin; i <= iMax; i++) {
+                float& nearest = exact[i + j * width];
+                nearest = std::min(nearest, SegmentDistance((float)i, (float)j, ax, ay, bx, by));
+            }
+        }
+    }
+
+    for (int index = 0; index < width * height; index++) {
+        if (exact[index] > PolygonBand) continue;
+        distance[index] = solidMask[index] > 0.0f ? -exact[index] : exact[index];
+    }
+}
+
+void SignedDistance::FromSupersampledMask(const float* fineMask, int width, int height, int factor, std::vector<float>& distance)
+{
+    factor = std::max(1, factor);
+    int fineWidth = width * factor;
+    int fineHeight = height * factor;
+
+    std::vector<float> fine;
+    FromMask(fineMask, fineWidth, fineHeight, fine);
+
+    // Cell (i, j) covers fine samples [i * factor, (i + 1) * factor); its centre lies between the middle ones
+    distance.resize((size_t)width * height);
+    int low = (factor - 1) / 2;
+    int high = factor / 2;
+    float scale = 0.25f / factor;
+
+    ThreadPool::Get().ParallelFor(0, height, LineGrain, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = 0; i < width; i++) {
+                int x0 = i * factor + low, x1 = i * factor + high;
+                int y0 = j * factor + low, y1 = j * factor + high;
+                distance[i + j * width] = scale * (fine[x0 + y0 * fineWidth] + fine[x1 + y0 * fineWidth] +
+                                                   fine[x0 + y1 * fineWidth] + fine[x1 + y1 * fineWidth]);
+            }
+        }
+    });
+}
+
+float SignedDistance::OpenFraction(float distanceA, float distanceB)
+{
+    if (distanceA >= 0.0f && distanceB >= 0.0f) return 1.0f;
+    if (distanceA < 0.0f && distanceB < 0.0f) return 0.0f;
+
+    // Linear zero crossing along the segment
+    float open = std::max(distanceA, distanceB);
+    return open / (open - std::min(distanceA, distanceB));
+}
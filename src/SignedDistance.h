@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+// Signed distance fields on the solver grid, in cells, negative inside solids. The interface sits where the
+// field crosses zero, so obstacles keep their sub-cell shape even though the solver still tags whole cells.
+class SignedDistance {
+public:
+    // Exact Euclidean transform of a binary mask (1 = solid). Without more information the surface is taken
+    // halfway between solid and fluid cell centres.
+    static void FromMask(const float* solidMask, int width, int height, std::vector<float>& distance);
+
+    // As FromMask, then cells within a couple of cells of the closed polygon (x0, y0, x1, y1, ... in cell
+    // coordinates, centre of cell (i, j) at (i, j)) get their exact distance to it. The sign still comes from the
+    // mask, which should be the polygon sampled at cell centres.
+    static void FromPolygon(const float* solidMask, const std::vector<float>& polygon, int width, int height, std::vector<float>& distance);
+
+    // Distance field of a mask rendered 'factor' times finer than the grid, resampled at the cell centres
+    static void FromSupersampledMask(const float* fineMask, int width, int height, int factor, std::vector<float>& distance);
+
+    // Fraction of the segment between two points with the given distances that lies in the fluid
+    static float OpenFraction(float distanceA, float distanceB);
+};
@@ -0,0 +1,122 @@
+#include "SimulationThread.h"
+#include <chrono>
+
+FlowSolver& SimulationState::GetFlowSolver()
+{
+    if (LatticeMode && Lattice) return *Lattice;
+    return *Solver;
+}
+
+SimulationThread::SimulationThread(std::unique_ptr<FluidSolver> solver)
+{
+    m_State.Solver = std::move(solver);
+
+    // The UI has something to draw before the first step completes
+    Publish();
+    m_Frames.Acquire();
+
+    m_Thread = std::thread(&SimulationThread::Run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+    m_Thread.join();
+}
+
+void SimulationThread::Submit(Command command)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Commands.push_back(std::move(command));
+    }
+    m_Wake.notify_all();
+}
+
+void SimulationThread::SetPaused(bool paused)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Paused.store(paused, std::memory_order_relaxed);
+    }
+    m_Wake.notify_all();
+}
+
+void SimulationThread::Run()
+{
+    std::vector<Command> commands;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this] { return m_Stop || !m_Paused.load(std::memory_order_relaxed) || !m_Commands.empty(); });
+            if (m_Stop) return;
+            commands.swap(m_Commands);
+        }
+
+        // Edits apply between steps, so the solver never sees a parameter change mid-step
+        bool changed = !commands.empty();
+        for (Command& command : commands) {
+            command(m_State);
+        }
+        commands.clear();
+        if (changed && m_State.Journal) m_State.Journal->RecordChanges(*m_State.Solver);
+        if (m_State.Lattice && m_State.Solver->GetObstacleVersion() != m_LatticeObstacleVersion) {
+            m_State.Lattice->SetObstacleMask(m_State.Solver->GetSolidMask());
+            m_LatticeObstacleVersion = m_State.Solver->GetObstacleVersion();
+        }
+
+        if (!m_Paused.load(std::memory_order_relaxed)) {
+            float timeStep = m_TimeStep.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+
+            bool volume = m_State.VolumeMode && m_State.Solver3D;
+            bool journaled = !volume && !(m_State.LatticeMode && m_State.Lattice) && m_State.Journal;
+            if (journaled) m_State.Journal->BeginStep(timeStep);
+
+            if (volume) m_State.Solver3D->Step(timeStep);
+            else m_State.GetFlowSolver().Step(timeStep);
+
+            float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (journaled) m_State.Journal->EndStep(*m_State.Solver);
+            m_StepMilliseconds = m_StepCount == 0 ? milliseconds : m_StepMilliseconds + 0.05f * (milliseconds - m_StepMilliseconds);
+
+            m_Time += timeStep;
+            m_StepCount++;
+            changed = true;
+        }
+
+        if (changed) Publish();
+    }
+}
+
+void SimulationThread::Publish()
+{
+    SimulationFrame& frame = m_Frames.GetBack();
+
+    frame.Volume = m_State.VolumeMode && m_State.Solver3D;
+    if (frame.Volume) {
+        m_State.Solver3D->ExtractSlice(m_State.VolumeSummary, m_State.VolumeDepthIndex, frame.Fields);
+    } else {
+        frame.Fields.Assign(m_State.GetFlowSolver().GetFieldView());
+    }
+
+    // Unique across slots and modes, so caches keyed on the view never mistake one frame for another
+    frame.Fields.Version = ++m_PublishCount;
+    frame.Time = m_Time;
+    frame.StepCount = m_StepCount;
+    frame.PressureIterations = m_State.LatticeMode ? 0 : m_State.Solver->GetLastPressureIterations();
+    frame.DiffusionIterations = m_State.Solver->GetLastDiffusionIterations();
+    frame.Lattice = m_State.LatticeMode && m_State.Lattice;
+    frame.LatticeSteps = frame.Lattice ? m_State.Lattice->GetLastSubsteps() : 0;
+    frame.RelaxationTime = frame.Lattice ? m_State.Lattice->GetLastRelaxationTime() : 0.0f;
+    frame.StepMilliseconds = m_StepMilliseconds;
+    frame.Recording = m_State.Journal != nullptr;
+    frame.RecordedSteps = m_State.Journal ? m_State.Journal->GetStepCount() : 0;
+
+    m_Frames.Publish();
+}
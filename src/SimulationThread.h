@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FluidSolver.h"
+#include "FluidSolver3D.h"
+#include "LatticeBoltzmannSolver.h"
+#include "SessionJournal.h"
+#include "TripleBuffer.h"
+
+// Everything owned by the simulation thread. Other threads only reach it through submitted commands.
+struct SimulationState {
+    std::unique_ptr<FluidSolver> Solver;
+    std::unique_ptr<FluidSolver3D> Solver3D;
+
+    // Alternative 2D engine, stepped and published instead of Solver while LatticeMode is set. Every obstacle edit
+    // goes through Solver, and the lattice takes the result from there.
+    std::unique_ptr<LatticeBoltzmannSolver> Lattice;
+    bool LatticeMode = false;
+
+    // When set (and Solver3D exists) the volume is stepped instead of the 2D solver and published as a slice
+    bool VolumeMode = false;
+    FluidSolver3D::SliceSummary VolumeSummary = FluidSolver3D::SliceSummary::Plane;
+    int VolumeDepthIndex = 0;
+
+    // Records every 2D step and the edits between them while set (Stable Fluids only)
+    std::unique_ptr<SessionJournal> Journal;
+
+    // The 2D engine that is stepped and published
+    FlowSolver& GetFlowSolver();
+};
+
+// One completed state, copied out of the solver so the UI thread can draw it while the next step runs
+struct SimulationFrame {
+    FieldSlice Fields;
+    bool Volume = false;
+    double Time = 0.0; // Simulated time at publication
+    uint64_t StepCount = 0;
+    int PressureIterations = 0;
+    int DiffusionIterations = 0;
+    bool Lattice = false;
+    int LatticeSteps = 0; // Per step, while the lattice Boltzmann engine runs
+    float RelaxationTime = 0.0f;
+    bool Recording = false;
+    uint64_t RecordedSteps = 0; // Steps in the session journal
+    float StepMilliseconds = 0.0f; // Smoothed cost of one step
+};
+
+// Steps the solver on its own thread as fast as it can, independent of the display rate.
+// Each finished step is published through a lock-free triple buffer; UI edits travel the other way
+// as commands that run between steps.
+class SimulationThread {
+public:
+    using Command = std::function<void(SimulationState&)>;
+
+    explicit SimulationThread(std::unique_ptr<FluidSolver> solver);
+    ~SimulationThread();
+
+    void Submit(Command command);
+
+    // Makes the newest published frame current; returns false if nothing new arrived since the last call
+    bool AcquireFrame() { return m_Frames.Acquire(); }
+    const SimulationFrame& GetFrame() const { return m_Frames.GetFront(); }
+
+    void SetPaused(bool paused);
+    void SetTimeStep(float timeStep) { m_TimeStep.store(timeStep, std::memory_order_relaxed); }
+
+private:
+    void Run();
+    void Publish();
+
+private:
+    SimulationState m_State;
+    TripleBuffer<SimulationFrame> m_Frames;
+
+    std::vector<Command> m_Commands;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Stop = false;
+
+    std::atomic<bool> m_Paused{ false };
+    std::atomic<float> m_TimeStep{ 0.01f };
+
+    // Simulation thread only
+    double m_Time = 0.0;
+    uint64_t m_StepCount = 0;
+    uint64_t m_PublishCount = 0;
+    uint64_t m_LatticeObstacleVersion = 0;
+    float m_StepMilliseconds = 0.0f;
+
+    std::thread m_Thread;
+};
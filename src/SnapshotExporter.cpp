@@ -0,0 +1,71 @@
+#include "SnapshotExporter.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Legacy VTK binary data is big-endian
+void WriteBigEndian(std::ofstream& file, const float* values, size_t count, size_t components = 1, const float* const* extra = nullptr)
+{
+    std::vector<uint32_t> buffer(count * components);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t c = 0; c < components; c++) {
+            float value = c == 0 ? values[i] : (extra[c - 1] ? extra[c - 1][i] : 0.0f);
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            buffer[i * components + c] = (bits >> 24) | ((bits >> 8) & 0xFF00u) | ((bits << 8) & 0xFF0000u) | (bits << 24);
+        }
+    }
+    file.write((const char*)buffer.data(), buffer.size() * sizeof(uint32_t));
+    file << "\n";
+}
+
+void WriteScalars(std::ofstream& file, const char* name, const float* values, size_t count)
+{
+    file << "SCALARS " << name << " float 1\nLOOKUP_TABLE default\n";
+    WriteBigEndian(file, values, count);
+}
+
+}
+
+bool SnapshotExporter::WriteVTK(const std::string& filepath, const FieldView& fields, DerivedFields& derived, const std::vector<DerivedField>& derivedFields)
+{
+    if (fields.Width < 3 || fields.Height < 3 || !fields.VelocityX || !fields.VelocityY) return false;
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        std::cerr << "ERROR::SNAPSHOT:: Cannot open " << filepath << " for writing" << std::endl;
+        return false;
+    }
+
+    size_t count = (size_t)fields.Width * fields.Height;
+
+    file << "# vtk DataFile Version 3.0\n";
+    file << "OpenGL-CFD snapshot (version " << fields.Version << ")\n";
+    file << "BINARY\nDATASET STRUCTURED_POINTS\n";
+    file << "DIMENSIONS " << fields.Width << " " << fields.Height << " 1\n";
+    file << "ORIGIN 0 0 0\n";
+    file << "SPACING " << 1.0f / (fields.Width - 2) << " " << 1.0f / (fields.Height - 2) << " 1\n";
+    file << "POINT_DATA " << count << "\n";
+
+    const float* velocityComponents[] = { fields.VelocityY, nullptr };
+    file << "VECTORS Velocity float\n";
+    WriteBigEndian(file, fields.VelocityX, count, 3, velocityComponents);
+
+    if (fields.Pressure) WriteScalars(file, "Pressure", fields.Pressure, count);
+    if (fields.DyeDensity) WriteScalars(file, "DyeDensity", fields.DyeDensity, count);
+    if (fields.SolidMask) WriteScalars(file, "SolidMask", fields.SolidMask, count);
+
+    // Same cache the renderer uses, so a field on screen is not computed twice
+    for (DerivedField field : derivedFields) {
+        WriteScalars(file, DerivedFields::GetName(field), derived.Get(field, fields).data(), count);
+    }
+
+    if (!file) {
+        std::cerr << "ERROR::SNAPSHOT:: Failed while writing " << filepath << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "FieldView.h"
+#include "DerivedFields.h"
+
+class SnapshotExporter {
+public:
+    // Writes the fields (plus the requested derived fields, taken from the shared cache) as a
+    // legacy binary VTK structured-points file that ParaView / VisIt can open.
+    static bool WriteVTK(const std::string& filepath, const FieldView& fields, DerivedFields& derived, const std::vector<DerivedField>& derivedFields);
+};
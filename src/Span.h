@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// View of a caller's contiguous array, for APIs that only read or fill it during the call, so a vector, a member
+// buffer or raw memory can be passed without copying or allocating. A stand-in for C++20 std::span with the same
+// member names.
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(T* data, size_t size) : m_Data(data), m_Size(size) {}
+
+    // Any container with data() and size(), e.g. std::vector<float> for Span<const float>. A temporary container
+    // only lives until the end of the call it is passed to.
+    template <typename Container, typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<Container&>().data()), T*>>>
+    Span(Container&& container) : m_Data(container.data()), m_Size(container.size()) {}
+
+    T* data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+    bool empty() const { return m_Size == 0; }
+
+    T& operator[](size_t index) const { return m_Data[index]; }
+    T* begin() const { return m_Data; }
+    T* end() const { return m_Data + m_Size; }
+
+private:
+    T* m_Data = nullptr;
+    size_t m_Size = 0;
+};
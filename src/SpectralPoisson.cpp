@@ -0,0 +1,375 @@
+#include "SpectralPoisson.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+// Columns or modes per task
+constexpr int LineGrain = 8;
+
+// Boundary cells per task while building the capacitance matrix
+constexpr int CapacitanceGrain = 4;
+
+// Larger obstacles are left to the iterative solvers: factorising C grows with the cube of this
+constexpr int MaxBoundaryCells = 2048;
+
+// Pivots below this mean the obstacle leaves a fluid region without a fixed-pressure side
+constexpr double SingularPivot = 1e-12;
+
+// Radices up to this use a stack buffer in the butterfly
+constexpr int SmallRadix = 16;
+
+}
+
+bool SpectralPoisson::Prepare(int width, int height, bool fixedLeft, bool fixedRight, const float* solidMask, uint64_t obstacleVersion)
+{
+    bool sameGrid = m_Prepared && width == m_Width && height == m_Height && fixedLeft == m_FixedLeft && fixedRight == m_FixedRight;
+    if (sameGrid && obstacleVersion == m_ObstacleVersion) return m_Supported;
+
+    m_Prepared = true;
+    m_ObstacleVersion = obstacleVersion;
+    m_Width = width;
+    m_Height = height;
+    m_FixedLeft = fixedLeft;
+    m_FixedRight = fixedRight;
+    m_CellsX = width - 2;
+    m_CellsY = height - 2;
+
+    // All-Neumann sides leave the pressure defined only up to a constant
+    m_Supported = m_CellsX > 0 && m_CellsY > 0 && (fixedLeft || fixedRight);
+    if (!m_Supported) return false;
+
+    if (!sameGrid) {
+        int nx = m_CellsX;
+        int ny = m_CellsY;
+
+        // Mixed-radix plan: each stage splits off the smallest prime factor
+        m_Factors.clear();
+        int remaining = ny;
+        for (int radix = 2; remaining > 1; radix++) {
+            if (radix * radix > remaining) radix = remaining;
+            while (remaining % radix == 0) {
+                remaining /= radix;
+                m_Factors.push_back(radix);
+                m_Factors.push_back(remaining);
+            }
+        }
+
+        // Column scratch of SolveRectangle, per pool chunk (chunks start at multiples of LineGrain)
+        size_t chunks = (nx + LineGrain - 1) / LineGrain;
+        m_ColumnBuffers.resize(chunks * 2 * ny);
+        m_ColumnValues.resize(chunks * 2 * ny);
+
+        m_Twiddles.resize(ny);
+        m_Shifts.resize(ny);
+        m_Eigenvalues.resize(ny);
+        m_Cosines.resize((size_t)ny * ny);
+        for (int k = 0; k < ny; k++) {
+            m_Twiddles[k] = std::polar(1.0, -2.0 * Pi * k / ny);
+            m_Shifts[k] = std::polar(1.0, -Pi * k / (2.0 * ny));
+            m_Eigenvalues[k] = 2.0 - 2.0 * std::cos(Pi * k / ny);
+            for (int j = 0; j < ny; j++) m_Cosines[(size_t)k * ny + j] = std::cos(Pi * k * (j + 0.5) / ny);
+        }
+
+        // Along x each cell couples to its interior neighbours, and to the ghost only where the pressure is fixed
+        m_InversePivots.resize((size_t)nx * ny);
+        for (int k = 0; k < ny; k++) {
+            double* inversePivots = &m_InversePivots[(size_t)k * nx];
+            double pivot = 0.0;
+            for (int i = 0; i < nx; i++) {
+                double diagonal = m_Eigenvalues[k] + ((i > 0 || fixedLeft) ? 1.0 : 0.0) + ((i < nx - 1 || fixedRight) ? 1.0 : 0.0);
+                pivot = i == 0 ? diagonal : diagonal - 1.0 / pivot;
+                inversePivots[i] = 1.0 / pivot;
+            }
+        }
+    }
+
+    m_Supported = BuildCapacitance(solidMask);
+    return m_Supported;
+}
+
+void SpectralPoisson::Solve(const float* divergence, float* pressure)
+{
+    int nx = m_CellsX;
+    int w = m_Width;
+    size_t count = (size_t)m_CellsX * m_CellsY;
+    m_Values.resize(count);
+
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int i = 1; i < w - 1; i++) m_Values[(i - 1) + (size_t)(j - 1) * nx] = divergence[i + j * w];
+    }
+
+    int rows = (int)m_BoundaryCells.size();
+    if (rows > 0) {
+        // Solid cells carry no divergence (Project zeroes it), so b is the fluid right-hand side as it stands
+        m_Correction = m_Values;
+        SolveRectangle(m_Values);
+
+        // z = C^-1 V^T L^-1 b, then p = L^-1 (b + U z)
+        std::vector<double>& z = m_Capacities;
+        z.resize(rows);
+        for (int r = 0; r < rows; r++) {
+            double sum = 0.0;
+            for (const Term& term : m_Rows[r]) sum += term.Weight * m_Values[term.Cell];
+            z[r] = sum;
+        }
+        for (int r = 0; r < rows; r++) std::swap(z[r], z[m_Permutation[r]]);
+        for (int r = 0; r < rows; r++) {
+            const double* row = &m_Capacitance[(size_t)r * rows];
+            for (int c = 0; c < r; c++) z[r] -= row[c] * z[c];
+        }
+        for (int r = rows - 1; r >= 0; r--) {
+            const double* row = &m_Capacitance[(size_t)r * rows];
+            for (int c = r + 1; c < rows; c++) z[r] -= row[c] * z[c];
+            z[r] /= row[r];
+        }
+
+        std::swap(m_Values, m_Correction);
+        for (int r = 0; r < rows; r++) m_Values[m_BoundaryCells[r]] += z[r];
+    }
+    SolveRectangle(m_Values);
+
+    // Values inside the obstacle solve the extended problem only and mean nothing
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int i = 1; i < w - 1; i++) {
+            size_t cell = (i - 1) + (size_t)(j - 1) * nx;
+            pressure[i + j * w] = m_Solid[cell] ? 0.0f : (float)m_Values[cell];
+        }
+    }
+}
+
+void SpectralPoisson::SolveRectangle(std::vector<double>& values)
+{
+    int nx = m_CellsX;
+    int ny = m_CellsY;
+
+    auto transformColumns = [&](bool inverse) {
+        ThreadPool::Get().ParallelFor(0, nx, LineGrain, [&](int begin, int end) {
+            size_t slot = (size_t)(begin / LineGrain) * 2 * ny;
+            std::complex<double>* buffer = &m_ColumnBuffers[slot];
+            std::complex<double>* work = buffer + ny;
+            double* column = &m_ColumnValues[slot];
+            double* modes = column + ny;
+            for (int i = begin; i < end; i++) {
+                for (int j = 0; j < ny; j++) column[j] = values[i + (size_t)j * nx];
+                if (inverse) {
+                    InverseColumn(column, modes, buffer, work);
+                } else {
+                    ForwardColumn(column, modes, buffer, work);
+                }
+                for (int j = 0; j < ny; j++) values[i + (size_t)j * nx] = modes[j];
+            }
+        });
+    };
+
+    transformColumns(false);
+
+    // One tridiagonal system along x per mode, rows of the transformed field
+    ThreadPool::Get().ParallelFor(0, ny, LineGrain, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            double* row = &values[(size_t)k * nx];
+            const double* inversePivots = &m_InversePivots[(size_t)k * nx];
+            for (int i = 1; i < nx; i++) row[i] += row[i - 1] * inversePivots[i - 1];
+            row[nx - 1] *= inversePivots[nx - 1];
+            for (int i = nx - 2; i >= 0; i--) row[i] = (row[i] + row[i + 1]) * inversePivots[i];
+        }
+    });
+
+    transformColumns(true);
+}
+
+void SpectralPoisson::ForwardColumn(const double* input, double* output, std::complex<double>* buffer, std::complex<double>* work) const
+{
+    // Even samples ascending, odd ones descending: the cosine transform is then the real part of a shifted FFT
+    int n = m_CellsY;
+    for (int t = 0; 2 * t < n; t++) buffer[t] = input[2 * t];
+    for (int t = 0; 2 * t + 1 < n; t++) buffer[n - 1 - t] = input[2 * t + 1];
+
+    Transform(buffer, work, false);
+    for (int k = 0; k < n; k++) output[k] = (m_Shifts[k] * buffer[k]).real();
+}
+
+void SpectralPoisson::InverseColumn(const double* input, double* output, std::complex<double>* buffer, std::complex<double>* work) const
+{
+    // The imaginary part dropped by the forward transform is the mirrored mode
+    int n = m_CellsY;
+    buffer[0] = input[0];
+    for (int k = 1; k < n; k++) buffer[k] = std::conj(m_Shifts[k]) * std::complex<double>(input[k], -input[n - k]);
+
+    Transform(buffer, work, true);
+    for (int t = 0; 2 * t < n; t++) output[2 * t] = buffer[t].real() / n;
+    for (int t = 0; 2 * t + 1 < n; t++) output[2 * t + 1] = buffer[n - 1 - t].real() / n;
+}
+
+void SpectralPoisson::Transform(std::complex<double>* data, std::complex<double>* work, bool inverse) const
+{
+    std::copy(data, data + m_CellsY, work);
+    TransformStage(data, work, 1, 0, inverse);
+}
+
+void SpectralPoisson::TransformStage(std::complex<double>* output, const std::complex<double>* input, int stride, int factorIndex, bool inverse) const
+{
+    int radix = m_Factors[2 * factorIndex];
+    int length = m_Factors[2 * factorIndex + 1];
+
+    // Decimation in time: transform each of the 'radix' interleaved subsequences into consecutive blocks
+    if (length == 1) {
+        for (int q = 0; q < radix; q++) output[q] = input[q * stride];
+    } else {
+        for (int q = 0; q < radix; q++) TransformStage(output + q * length, input + q * stride, stride * radix, factorIndex + 1, inverse);
+    }
+
+    // Generic butterfly combining the blocks, twiddles included
+    int n = m_CellsY;
+    std::complex<double> small[SmallRadix];
+    std::vector<std::complex<double>> large;
+    std::complex<double>* scratch = small;
+    if (radix > SmallRadix) {
+        large.resize(radix);
+        scratch = large.data();
+    }
+
+    for (int u = 0; u < length; u++) {
+        for (int q = 0; q < radix; q++) scratch[q] = output[u + q * length];
+
+        for (int q1 = 0; q1 < radix; q1++) {
+            int k = u + q1 * length;
+            int twiddle = 0;
+            std::complex<double> sum = scratch[0];
+            for (int q = 1; q < radix; q++) {
+                twiddle += stride * k;
+                if (twiddle >= n) twiddle -= n;
+                sum += scratch[q] * (inverse ? std::conj(m_Twiddles[twiddle]) : m_Twiddles[twiddle]);
+            }
+            output[k] = sum;
+        }
+    }
+}
+
+bool SpectralPoisson::BuildCapacitance(const float* solidMask)
+{
+    int w = m_Width;
+    int nx = m_CellsX;
+    int ny = m_CellsY;
+    auto cellOf = [&](int i, int j) { return (i - 1) + (j - 1) * nx; };
+
+    // Rows of V^T: a fluid cell loses the coupling to each solid neighbour and keeps its own value in its place.
+    // Solid ghosts need a term only on fixed sides; on Neumann sides L already mirrors the cell.
+    m_BoundaryCells.clear();
+    m_Rows.clear();
+    m_Solid.assign((size_t)nx * ny, 0);
+    for (int j = 1; j < m_Height - 1; j++) {
+        for (int i = 1; i < w - 1; i++) {
+            if (solidMask[i + j * w] > 0.0f) {
+                m_Solid[cellOf(i, j)] = 1;
+                continue;
+            }
+
+            std::vector<Term> terms;
+            double weight = 0.0;
+            const int neighbours[4][2] = { { i - 1, j }, { i + 1, j }, { i, j - 1 }, { i, j + 1 } };
+            for (const auto& neighbour : neighbours) {
+                int ni = neighbour[0];
+                int nj = neighbour[1];
+                if (solidMask[ni + nj * w] <= 0.0f) continue;
+
+                if (ni > 0 && ni < w - 1 && nj > 0 && nj < m_Height - 1) {
+                    terms.push_back({ cellOf(ni, nj), -1.0 });
+                    weight += 1.0;
+                } else if ((ni == 0 && m_FixedLeft) || (ni == w - 1 && m_FixedRight)) {
+                    weight += 1.0;
+                }
+            }
+            if (weight == 0.0) continue;
+
+            terms.push_back({ cellOf(i, j), weight });
+            m_BoundaryCells.push_back(cellOf(i, j));
+            m_Rows.push_back(std::move(terms));
+        }
+    }
+
+    int rows = (int)m_BoundaryCells.size();
+    if (rows > MaxBoundaryCells) return false;
+    if (rows == 0) return true;
+
+    // Only cells that appear in V^T are ever read from a column of L^-1 U
+    std::vector<int> slots((size_t)nx * ny, -1);
+    std::vector<int> needed;
+    for (const std::vector<Term>& terms : m_Rows) {
+        for (const Term& term : terms) {
+            if (slots[term.Cell] >= 0) continue;
+            slots[term.Cell] = (int)needed.size();
+            needed.push_back(term.Cell);
+        }
+    }
+
+    // Column f of L^-1 U is L^-1 e_f: the transform of a unit vector is one row of cosines, each mode then needs
+    // one tridiagonal solve, and the inverse transform is summed directly at the needed cells
+    m_Capacitance.assign((size_t)rows * rows, 0.0);
+    ThreadPool::Get().ParallelFor(0, rows, CapacitanceGrain, [&](int begin, int end) {
+        std::vector<double> modes((size_t)nx * ny);
+        std::vector<double> values(needed.size());
+
+        for (int f = begin; f < end; f++) {
+            int sourceX = m_BoundaryCells[f] % nx;
+            int sourceY = m_BoundaryCells[f] / nx;
+
+            for (int k = 0; k < ny; k++) {
+                double* row = &modes[(size_t)k * nx];
+                const double* inversePivots = &m_InversePivots[(size_t)k * nx];
+                double scale = (k == 0 ? 1.0 : 2.0) / ny * m_Cosines[(size_t)k * ny + sourceY];
+
+                std::fill(row, row + sourceX, 0.0);
+                row[sourceX] = scale;
+                for (int i = sourceX + 1; i < nx; i++) row[i] = row[i - 1] * inversePivots[i - 1];
+                row[nx - 1] *= inversePivots[nx - 1];
+                for (int i = nx - 2; i >= 0; i--) row[i] = (row[i] + row[i + 1]) * inversePivots[i];
+            }
+
+            for (size_t s = 0; s < needed.size(); s++) {
+                int x = needed[s] % nx;
+                int y = needed[s] / nx;
+                double sum = 0.0;
+                for (int k = 0; k < ny; k++) sum += m_Cosines[(size_t)k * ny + y] * modes[(size_t)k * nx + x];
+                values[s] = sum;
+            }
+
+            for (int g = 0; g < rows; g++) {
+                double product = 0.0;
+                for (const Term& term : m_Rows[g]) product += term.Weight * values[slots[term.Cell]];
+                m_Capacitance[(size_t)g * rows + f] = (g == f ? 1.0 : 0.0) - product;
+            }
+        }
+    });
+
+    // LU with partial pivoting, in place; m_Permutation[r] is the row swapped into r at step r
+    m_Permutation.resize(rows);
+    for (int r = 0; r < rows; r++) {
+        int best = r;
+        for (int candidate = r + 1; candidate < rows; candidate++) {
+            if (std::abs(m_Capacitance[(size_t)candidate * rows + r]) > std::abs(m_Capacitance[(size_t)best * rows + r])) best = candidate;
+        }
+        m_Permutation[r] = best;
+        if (best != r) {
+            std::swap_ranges(&m_Capacitance[(size_t)r * rows], &m_Capacitance[(size_t)r * rows] + rows, &m_Capacitance[(size_t)best * rows]);
+        }
+
+        double pivot = m_Capacitance[(size_t)r * rows + r];
+        if (std::abs(pivot) < SingularPivot) return false;
+
+        double* pivotRow = &m_Capacitance[(size_t)r * rows];
+        ThreadPool::Get().ParallelFor(r + 1, rows, LineGrain, [&](int begin, int end) {
+            for (int below = begin; below < end; below++) {
+                double* row = &m_Capacitance[(size_t)below * rows];
+                double factor = row[r] / pivot;
+                row[r] = factor;
+                for (int c = r + 1; c < rows; c++) row[c] -= factor * pivotRow[c];
+            }
+        });
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+// Direct solver for the staircase pressure equation of the 2D solver:
+//     4 p - sum of the four neighbours = divergence
+// on the fluid cells, with solid neighbours replaced by the cell itself (Neumann at the obstacle). It requires
+// Neumann pressure on the bottom and top sides and Neumann or zero pressure on the left and right, with at least
+// one of them fixed so the system is not singular - the empty tunnel and its variants.
+//
+// The obstacle-free operator L on the whole rectangle is diagonalised by a cosine transform along y (a mixed-radix
+// FFT), leaving one tridiagonal system along x per mode, so L^-1 costs O(N log N). The obstacle only changes the
+// rows of fluid cells next to it: the real operator is L - U V^T with one column of U per such cell. By the
+// Woodbury identity
+//     p = L^-1 (b + U z),    C z = V^T L^-1 b,    C = I - V^T L^-1 U
+// where the dense capacitance matrix C has one row per boundary cell and is built and factorised once per
+// obstacle. A solve is then two fast solves and one small dense solve, exact up to round-off.
+class SpectralPoisson {
+public:
+    // Sets up the transforms and the capacitance system for this grid, pressure sides and obstacle. Cheap when
+    // none of them changed since the last call ('obstacleVersion' identifies the mask). Returns false when the
+    // problem is not supported, e.g. a fluid pocket cut off from every fixed-pressure side.
+    bool Prepare(int width, int height, bool fixedLeft, bool fixedRight, const float* solidMask, uint64_t obstacleVersion);
+
+    // Pressure on every interior fluid cell (0 in solids) for a width * height divergence field; the ghost layer
+    // of 'pressure' is left to the caller
+    void Solve(const float* divergence, float* pressure);
+
+    // Rows of the capacitance system of the current obstacle
+    int GetBoundaryCellCount() const { return (int)m_BoundaryCells.size(); }
+
+private:
+    // One term of a row of V^T: coefficient on an interior cell
+    struct Term {
+        int Cell;
+        double Weight;
+    };
+
+    // values <- L^-1 values over the interior (nx * ny, row-major)
+    void SolveRectangle(std::vector<double>& values);
+
+    // Cosine transform of one column and its exact inverse
+    void ForwardColumn(const double* input, double* output, std::complex<double>* buffer, std::complex<double>* work) const;
+    void InverseColumn(const double* input, double* output, std::complex<double>* buffer, std::complex<double>* work) const;
+
+    // Length-ny FFT; 'inverse' leaves out the 1 / ny
+    void Transform(std::complex<double>* data, std::complex<double>* work, bool inverse) const;
+    void TransformStage(std::complex<double>* output, const std::complex<double>* input, int stride, int factorIndex, bool inverse) const;
+
+    bool BuildCapacitance(const float* solidMask);
+
+private:
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_CellsX = 0; // Interior cells
+    int m_CellsY = 0;
+    bool m_FixedLeft = false;
+    bool m_FixedRight = false;
+    uint64_t m_ObstacleVersion = 0;
+    bool m_Prepared = false;
+    bool m_Supported = false;
+
+    // FFT plan: twiddles and (radix, remaining length) pairs
+    std::vector<std::complex<double>> m_Twiddles;
+    std::vector<int> m_Factors;
+    std::vector<std::complex<double>> m_Shifts; // exp(-i pi k / (2 ny))
+
+    std::vector<double> m_Eigenvalues;   // Per y mode
+    std::vector<double> m_Cosines;       // Mode k at row j: cos(pi k (j + 1/2) / ny), index k * ny + j
+    std::vector<double> m_InversePivots; // Tridiagonal LU per mode, index k * nx + i
+
+    // Capacitance system: boundary cells (columns of U), rows of V^T, and the LU factors of C
+    std::vector<int> m_BoundaryCells;
+    std::vector<std::vector<Term>> m_Rows;
+    std::vector<double> m_Capacitance;
+    std::vector<int> m_Permutation;
+    std::vector<char> m_Solid; // Per interior cell
+
+    std::vector<double> m_Values;
+    std::vector<double> m_Correction;
+    std::vector<double> m_Capacities; // z, one per boundary cell
+
+    // Per-chunk column scratch of SolveRectangle: two complex and two real columns each
+    std::vector<std::complex<double>> m_ColumnBuffers;
+    std::vector<double> m_ColumnValues;
+};
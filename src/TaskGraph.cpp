@@ -0,0 +1,114 @@
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+
+// Graph whose lane the calling thread is running. A lane helping with queued chunks can be handed another lane of
+// the same run, which must not start: it would wait for phases that only the outer lane can finish.
+thread_local const TaskGraph* ActiveGraph = nullptr;
+
+bool Contains(const std::vector<TaskGraph::Resource>& resources, TaskGraph::Resource resource)
+{
+    return std::find(resources.begin(), resources.end(), resource) != resources.end();
+}
+
+}
+
+int TaskGraph::Add(const char* name, std::initializer_list<Resource> reads, std::initializer_list<Resource> writes,
+                   std::function<void()> work)
+{
+    Task task;
+    task.Name = name;
+    task.Work = std::move(work);
+    task.Reads = reads;
+    task.Writes = writes;
+
+    int index = (int)m_Tasks.size();
+    for (int earlier = 0; earlier < index; earlier++) {
+        if (!Conflicts(m_Tasks[earlier], task)) continue;
+        m_Tasks[earlier].Successors.push_back(index);
+        task.Predecessors++;
+    }
+    m_Tasks.push_back(std::move(task));
+
+    m_Waiting.resize(m_Tasks.size(), 0);
+    m_Ready.reserve(m_Tasks.size());
+    return index;
+}
+
+bool TaskGraph::Conflicts(const Task& earlier, const Task& later)
+{
+    for (Resource resource : earlier.Writes) {
+        if (Contains(later.Reads, resource) || Contains(later.Writes, resource)) return true;
+    }
+    for (Resource resource : earlier.Reads) {
+        if (Contains(later.Writes, resource)) return true;
+    }
+    return false;
+}
+
+void TaskGraph::Run()
+{
+    if (m_Tasks.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Ready.clear();
+        m_ReadyNext = 0;
+        m_Unfinished = (int)m_Tasks.size();
+        for (int task = 0; task < (int)m_Tasks.size(); task++) {
+            m_Waiting[task] = m_Tasks[task].Predecessors;
+            if (m_Waiting[task] == 0) m_Ready.push_back(task);
+        }
+    }
+
+    // One lane per thread; without workers the caller's lane runs the phases in declaration order
+    ThreadPool& pool = ThreadPool::Get();
+    int lanes = std::min((int)pool.GetThreadCount(), (int)m_Tasks.size());
+    pool.ParallelFor(0, lanes, 1, [this](int, int) {
+        if (ActiveGraph == this) return;
+        ActiveGraph = this;
+        RunLane();
+        ActiveGraph = nullptr;
+    });
+}
+
+void TaskGraph::RunInOrder()
+{
+    for (Task& task : m_Tasks) task.Work();
+}
+
+void TaskGraph::RunLane()
+{
+    ThreadPool& pool = ThreadPool::Get();
+    while (true) {
+        int task = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Unfinished == 0) return;
+            if (m_ReadyNext < (int)m_Ready.size()) task = m_Ready[m_ReadyNext++];
+        }
+
+        if (task < 0) {
+            // Everything left waits on running phases: take over some of their kernel chunks meanwhile, and sleep
+            // once there are none until a phase finishes
+            pool.HelpUntil([this] {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                return m_Unfinished == 0 || m_ReadyNext < (int)m_Ready.size();
+            });
+            continue;
+        }
+
+        m_Tasks[task].Work();
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (int successor : m_Tasks[task].Successors) {
+                if (--m_Waiting[successor] == 0) m_Ready.push_back(successor);
+            }
+            m_Unfinished--;
+        }
+        pool.WakeHelpers();
+    }
+}
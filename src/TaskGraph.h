@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+// Phases of a computation declared once with the state each reads and writes, then run together any number of
+// times. A phase waits only for earlier phases it conflicts with (one writes what the other reads or writes), so
+// independent phases run at the same time on the ThreadPool, each splitting its own kernels with ParallelFor.
+// Threads with no phase ready help with the chunks of those running. The result is that of running the phases
+// one after another in declaration order, so it does not depend on the thread count.
+class TaskGraph {
+public:
+    // Any address standing for a piece of state, typically the member it names
+    using Resource = const void*;
+
+    // Appends a phase; 'work' is kept and called once per Run. Returns its index.
+    int Add(const char* name, std::initializer_list<Resource> reads, std::initializer_list<Resource> writes,
+            std::function<void()> work);
+
+    // Runs every phase once and returns when all have finished; does not allocate
+    void Run();
+
+    // Runs every phase once on the calling thread, one after another in declaration order, for phases that have to
+    // be entered in the same order on every run (e.g. ones exchanging data with other processes). Their kernels
+    // still split across the pool.
+    void RunInOrder();
+
+    int GetTaskCount() const { return (int)m_Tasks.size(); }
+    const char* GetName(int task) const { return m_Tasks[task].Name; }
+
+private:
+    struct Task {
+        const char* Name = "";
+        std::function<void()> Work;
+        std::vector<Resource> Reads;
+        std::vector<Resource> Writes;
+        std::vector<int> Successors;
+        int Predecessors = 0;
+    };
+
+    static bool Conflicts(const Task& earlier, const Task& later);
+
+    // One thread's share of a Run: takes ready phases until none is left
+    void RunLane();
+
+private:
+    std::vector<Task> m_Tasks;
+
+    // State of the current Run, guarded by m_Mutex; m_Ready only ever holds each phase once, so it keeps the
+    // capacity reserved by Add
+    std::vector<int> m_Waiting; // Unfinished predecessors per phase
+    std::vector<int> m_Ready;
+    int m_ReadyNext = 0;
+    int m_Unfinished = 0;
+    std::mutex m_Mutex;
+};
@@ -0,0 +1,210 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Yields before a waiting thread sleeps. Most waits end within a chunk, sooner than a sleep and wake-up take.
+constexpr int SpinsBeforeSleep = 64;
+
+int CurrentThreadId()
+{
+#if defined(__linux__)
+    return (int)syscall(SYS_gettid);
+#else
+    return 0;
+#endif
+}
+
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The caller counts as one thread
+    m_WorkerThreadIds.resize(threadCount - 1, 0);
+    for (unsigned int i = 1; i < threadCount; i++) {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, (int)i - 1);
+    }
+
+    // Thread ids are only known once each worker runs
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Wake.wait(lock, [this] { return m_StartedWorkers == (int)m_Workers.size(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+    m_Helpers.notify_all();
+
+    for (auto& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain, FunctionRef<void(int, int)> func)
+{
+    if (end <= begin) return;
+    grain = std::max(1, grain);
+
+    int chunkCount = (end - begin + grain - 1) / grain;
+    if (chunkCount == 1 || m_Workers.empty()) {
+        func(begin, end);
+        return;
+    }
+
+    Job job;
+    job.Func = &func;
+    job.End = end;
+    job.Grain = grain;
+    job.Next = begin;
+    job.Pending = chunkCount;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Jobs.push_back(&job);
+    }
+    m_Wake.notify_all();
+    m_Helpers.notify_all();
+
+    RunChunks(job);
+
+    // No new worker may pick the job up once it has left the queue
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = std::find(m_Jobs.begin(), m_Jobs.end(), &job);
+        if (it != m_Jobs.end()) m_Jobs.erase(it);
+    }
+
+    auto finished = [&job] {
+        return job.Pending.load(std::memory_order_acquire) == 0 && job.Users.load(std::memory_order_acquire) == 0;
+    };
+    for (int spin = 0; spin < SpinsBeforeSleep && !finished(); spin++) {
+        std::this_thread::yield();
+    }
+    if (!finished()) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Helpers.wait(lock, finished);
+    }
+}
+
+bool ThreadPool::RunQueuedChunks()
+{
+    Job* job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (Job* queued : m_Jobs) {
+            if (queued->Next.load(std::memory_order_relaxed) >= queued->End) continue;
+            job = queued;
+            job->Users.fetch_add(1, std::memory_order_acquire);
+            break;
+        }
+    }
+    if (!job) return false;
+
+    RunChunks(*job);
+    ReleaseJob(*job);
+    return true;
+}
+
+void ThreadPool::HelpUntil(FunctionRef<bool()> ready)
+{
+    int spins = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (ready()) return;
+            if (spins >= SpinsBeforeSleep) {
+                m_Helpers.wait(lock, [&] { return m_Stop || ready() || HasQueuedChunks(); });
+                if (ready()) return;
+                spins = 0;
+            }
+        }
+
+        if (RunQueuedChunks()) {
+            spins = 0;
+        } else {
+            spins++;
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::WakeHelpers()
+{
+    // Taking the lock orders the change to 'ready' before any helper's next check of it
+    { std::lock_guard<std::mutex> lock(m_Mutex); }
+    m_Helpers.notify_all();
+}
+
+void ThreadPool::ReleaseJob(Job& job)
+{
+    // The caller may return, and the job go away, as soon as the count reaches zero
+    if (job.Users.fetch_sub(1, std::memory_order_release) == 1) WakeHelpers();
+}
+
+bool ThreadPool::HasQueuedChunks() const
+{
+    for (const Job* job : m_Jobs) {
+        if (job->Next.load(std::memory_order_relaxed) < job->End) return true;
+    }
+    return false;
+}
+
+void ThreadPool::RunChunks(Job& job)
+{
+    while (true) {
+        int chunkBegin = job.Next.fetch_add(job.Grain, std::memory_order_relaxed);
+        if (chunkBegin >= job.End) break;
+
+        (*job.Func)(chunkBegin, std::min(chunkBegin + job.Grain, job.End));
+        job.Pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::WorkerLoop(int index)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_WorkerThreadIds[index] = CurrentThreadId();
+        m_StartedWorkers++;
+    }
+    m_Wake.notify_all();
+
+    while (true) {
+        Job* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this] { return m_Stop || !m_Jobs.empty(); });
+            if (m_Stop) return;
+
+            job = m_Jobs.front();
+            job->Users.fetch_add(1, std::memory_order_acquire);
+
+            // Exhausted jobs are dropped so idle workers go back to sleep
+            if (job->Next.load(std::memory_order_relaxed) >= job->End) {
+                m_Jobs.erase(m_Jobs.begin());
+            }
+        }
+
+        RunChunks(*job);
+        ReleaseJob(*job);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FunctionRef.h"
+
+// Minimal fork-join pool used by the solver kernels.
+// The calling thread always takes part in its own ParallelFor, so nested calls cannot deadlock. Queued calls share
+// one list; each hands out its chunks from an atomic cursor, so any idle thread takes over the next chunk of any
+// call. Threads with nothing to run spin briefly, then sleep until there is.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    // Shared pool sized to the hardware concurrency
+    static ThreadPool& Get();
+
+    unsigned int GetThreadCount() const { return (unsigned int)m_Workers.size() + 1; }
+
+    // OS thread ids of the workers (Linux tids, 0 elsewhere), for per-thread instrumentation
+    const std::vector<int>& GetWorkerThreadIds() const { return m_WorkerThreadIds; }
+
+    // Splits [begin, end) into chunks of at least 'grain' items and calls func(chunkBegin, chunkEnd) on each
+    void ParallelFor(int begin, int end, int grain, FunctionRef<void(int, int)> func);
+
+    // Runs the remaining chunks of one queued ParallelFor on the calling thread, as a worker would; false if no
+    // job had chunks left. For threads that would otherwise wait on work other threads are doing.
+    bool RunQueuedChunks();
+
+    // Returns once 'ready' does, running queued chunks meanwhile and sleeping while there are none. 'ready' is
+    // called with the pool's lock held, so it must not use the pool; whoever changes what it reads calls
+    // WakeHelpers() afterwards.
+    void HelpUntil(FunctionRef<bool()> ready);
+    void WakeHelpers();
+
+private:
+    struct Job {
+        const FunctionRef<void(int, int)>* Func = nullptr;
+        int End = 0;
+        int Grain = 1;
+        std::atomic<int> Next{ 0 };
+        std::atomic<int> Pending{ 0 };
+        std::atomic<int> Users{ 0 };
+    };
+
+    void WorkerLoop(int index);
+    static void RunChunks(Job& job);
+
+    // Drops one user of 'job', which must not be touched afterwards; the last one wakes its waiting caller
+    void ReleaseJob(Job& job);
+
+    // Some queued job still has chunks to hand out; needs m_Mutex
+    bool HasQueuedChunks() const;
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::vector<int> m_WorkerThreadIds;
+    int m_StartedWorkers = 0;
+    std::vector<Job*> m_Jobs; // Only ever a few long; erasing keeps the capacity, so steady use does not allocate
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;    // Workers: a job was queued
+    std::condition_variable m_Helpers; // Callers and HelpUntil: a job was queued, finished or WakeHelpers was called
+    bool m_Stop = false;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+// Single-producer / single-consumer handoff of whole values without locks.
+// The producer fills GetBack() and calls Publish(); the consumer calls Acquire() and reads GetFront().
+// Neither side ever waits: the producer overwrites frames the consumer skipped, and the consumer keeps
+// its current frame until a newer one is published.
+template <typename T>
+class TripleBuffer {
+public:
+    T& GetBack() { return m_Slots[m_Back]; }
+
+    void Publish()
+    {
+        m_Back = m_Shared.exchange(m_Back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Swaps in the newest published value; returns false (front unchanged) when nothing new arrived
+    bool Acquire()
+    {
+        if (!(m_Shared.load(std::memory_order_relaxed) & FreshBit)) return false;
+        m_Front = m_Shared.exchange(m_Front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    const T& GetFront() const { return m_Slots[m_Front]; }
+
+private:
+    static constexpr int IndexMask = 3;
+    static constexpr int FreshBit = 4;
+
+    T m_Slots[3];
+    int m_Back = 0;                 // Producer only
+    int m_Front = 2;                // Consumer only
+    std::atomic<int> m_Shared{ 1 }; // Slot in transit, plus FreshBit when it has not been consumed
+};
@@ -1,7 +1,36 @@
+#include "AllocationAudit.h"
 #include "Application.h"
+#include "Distributed/DistributedCheck.h"
+#include "SessionJournal.h"
 
-int main()
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char** argv)
 {
+    // Headless modes:
+    //   --distributed-check [ranks] [steps]   local ranks of the distributed solver over shared memory
+    //   --mpi-check [steps]                   ranks of an mpirun launch
+    //   --replay <journal>                    re-run a recorded session and verify its checksums
+    //   --allocation-audit [steps]            fail if steady-state frames allocate (CFD_ALLOCATION_AUDIT builds)
+    if (argc > 1 && std::string(argv[1]) == "--distributed-check") {
+        int ranks = argc > 2 ? std::atoi(argv[2]) : 4;
+        int steps = argc > 3 ? std::atoi(argv[3]) : 50;
+        return RunSharedMemoryCheck(ranks, steps);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--mpi-check") {
+        int steps = argc > 2 ? std::atoi(argv[2]) : 50;
+        return RunMpiCheck(steps);
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--replay") {
+        return SessionJournal::Replay(argv[2]);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--allocation-audit") {
+        int steps = argc > 2 ? std::atoi(argv[2]) : 100;
+        return RunAllocationAudit(steps);
+    }
+
     Application app("2D Flow Simulation", 1280, 720);
     app.Run();
 